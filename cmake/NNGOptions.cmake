@@ -51,6 +51,10 @@ option(NNG_ENABLE_COMPAT "Enable legacy nanomsg API." ON)
 option(NNG_ENABLE_STATS "Enable statistics." ON)
 mark_as_advanced(NNG_ENABLE_STATS)
 
+# Pooled allocation of message headers and bodies, with per-thread caches.
+option(NNG_ENABLE_MSG_POOL "Enable the pooled message allocator." OFF)
+mark_as_advanced(NNG_ENABLE_MSG_POOL)
+
 # SQLITE API support.
 option (NNG_ENABLE_SQLITE "Enable SQLITE API." OFF)
 if (NNG_ENABLE_SQLITE)
@@ -851,6 +851,24 @@ NNG_DECL nng_listener nng_pipe_listener(nng_pipe);
 // `NNG_TLS_AUTH_MODE_NONE`.
 #define NNG_OPT_TLS_PEER_ALT_NAMES "tls-peer-alt-names"
 
+// NNG_OPT_TLS_SESSION_REUSE is a boolean that can be set on dialers.  When
+// true, the dialer remembers the session of its last connection, and
+// offers it to the server on the next dial, so that the server can skip
+// the expensive part of the handshake if it still knows the session.
+#define NNG_OPT_TLS_SESSION_REUSE "tls-session-reuse"
+
+// NNG_OPT_TLS_SESSION_RESUMED returns a boolean indicating whether the
+// connection resumed an earlier session (true) rather than going through
+// a full handshake (false).  This is read-only, and only available for
+// pipes and streams.
+#define NNG_OPT_TLS_SESSION_RESUMED "tls-session-resumed"
+
+// NNG_OPT_TLS_KTLS returns a boolean indicating whether the kernel has
+// taken over protecting the records of the connection, in at least one
+// direction.  See nng_tls_config_ktls().  This is read-only, and only
+// available for pipes and streams.
+#define NNG_OPT_TLS_KTLS "tls-ktls"
+
 // TCP options.  These may be supported on various transports that use
 // TCP underneath such as TLS, or not.
 
@@ -1024,6 +1042,13 @@ NNG_DECL nng_listener nng_pipe_listener(nng_pipe);
 // the empty string is not suitable.
 NNG_DECL int nng_stats_get(nng_stat **);
 
+// nng_stats_update refreshes a snapshot obtained from nng_stats_get in
+// place.  Values and timestamps are updated, statistics that have come
+// and gone are added and removed, and the rest is left as it was, so
+// that polling the statistics does not reallocate the whole tree each
+// time.  Pointers to statistics that have been removed are invalidated.
+NNG_DECL int nng_stats_update(nng_stat *);
+
 // nng_stats_free frees a previous list of snapshots.  This should only
 // be called on the parent statistic that obtained via nng_stats_get.
 NNG_DECL void nng_stats_free(nng_stat *);
@@ -143,11 +143,35 @@ NNG_DECL int  nmq_subinfo_decode(nng_msg *msg, void *l, uint8_t ver);
 NNG_DECL int  nmq_unsubinfo_decode(nng_msg *msg, void *l, uint8_t ver);
 NNG_DECL bool topic_filter(const char *origin, const char *input);
 NNG_DECL bool topic_filtern(const char *origin, const char *input, size_t n);
+NNG_DECL bool topic_match_levels(
+    const char *filter, size_t flen, const char *topic, size_t tlen);
+
+// Compiled, read only copy of the subinfo list of a pipe.
+typedef struct nmq_subtrie nmq_subtrie;
+
+NNG_DECL int  nmq_subtrie_build(nmq_subtrie **tp, void *subinfol);
+NNG_DECL void nmq_subtrie_free(nmq_subtrie *t);
+NNG_DECL int  nmq_subtrie_match(nmq_subtrie *t, const char *topic,
+     size_t tlen, uint8_t *qos, uint32_t *subid);
+NNG_DECL int  nmq_subinfo_match(nmq_subtrie **tp, void *subinfol,
+     const char *topic, size_t tlen, uint8_t *qos);
 
 NNG_DECL int nmq_auth_http_connect(conn_param *cparam, conf_auth_http *conf);
 
 NNG_DECL int nmq_auth_http_sub_pub(
     conn_param *cparam, bool is_sub, topic_queue *topics, conf_auth_http *conf);
 
+// Asynchronous forms of the above.  The aio completes with 0 if allowed,
+// NNG_EPERM if the server said no, or the error of the HTTP request.
+// cparam and topics are not referenced after the call returns.
+NNG_DECL void nmq_auth_http_connect_aio(
+    conn_param *cparam, conf_auth_http *conf, nng_aio *aio);
+NNG_DECL void nmq_auth_http_sub_pub_aio(conn_param *cparam, bool is_sub,
+    topic_queue *topics, conf_auth_http *conf, nng_aio *aio);
+
+// nmq_auth_http_fini closes the pooled connections to the auth server and
+// forgets the cached decisions.  Requests in flight fail with NNG_ECLOSED.
+NNG_DECL void nmq_auth_http_fini(conf_auth_http *conf);
+
 NNG_DECL int mqtt_get_remaining_length(uint8_t *, uint32_t, uint32_t *, uint8_t *);
 #endif // NNG_MQTT_H
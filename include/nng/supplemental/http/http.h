@@ -381,6 +381,12 @@ NNG_DECL int nng_http_handler_set_tree(nng_http_handler *);
 // when added to a server.
 NNG_DECL int nng_http_handler_set_tree_exclusive(nng_http_handler *);
 
+// nng_http_handler_set_file_cache enables an in-memory cache of up to the
+// given number of bytes for handlers serving files or directories.  Only
+// small files are cached, and the least recently used are dropped first.
+// Zero (the default) disables the cache.
+NNG_DECL int nng_http_handler_set_file_cache(nng_http_handler *, size_t);
+
 // nng_http_handler_set_data is used to store additional data, along with
 // a possible clean up routine.  (The clean up is a custom de-allocator and
 // will be called with the supplied data as an argument, when the handler
@@ -42,6 +42,9 @@ struct blf_object {
 	void            *arg;
 	blf_file_ranges *ranges;
 	blf_write_type   type;
+	// Files are written per topic, NULL is the same as "".  Allocated
+	// with nng_strdup and freed along with the object.
+	char            *topic;
 };
 
 blf_object *blf_object_alloc(uint64_t *keys, uint8_t **darray, uint32_t *dsize,
@@ -75,6 +75,7 @@ struct conf_tls {
 	char *key_password;
 	bool  verify_peer;
 	bool  set_fail; // fail_if_no_peer_cert
+	bool  ktls;     // hand records to the kernel after the handshake
 };
 
 typedef struct conf_tls conf_tls;
@@ -165,6 +166,9 @@ struct conf_auth_http {
 	uint64_t           timeout;         // seconds
 	uint64_t           connect_timeout; // seconds
 	size_t             pool_size;
+	uint64_t           cache_ttl;  // seconds, 0 disables the cache
+	size_t             cache_size; // decisions kept
+	void              *state; // connections and cached decisions
 };
 
 typedef struct conf_auth_http conf_auth_http;
@@ -416,6 +420,9 @@ struct conf_parquet {
 	uint32_t                limit_frequency;
 	uint8_t                 file_index;
 	int32_t                 file_size;
+	uint32_t                row_group_size; // rows, 0 for the default
+	uint8_t                 write_threads;
+	uint32_t                queue_limit; // objects per topic, 0 for no limit
 	compression_type        comp_type;
 	conf_parquet_encryption encryption;
 };
@@ -428,6 +435,8 @@ struct conf_blf {
 	uint8_t          file_count;
 	uint8_t          file_index;
 	int32_t          file_size;
+	uint8_t          write_threads;
+	uint32_t         queue_limit; // objects per topic, 0 for no limit
 	compression_type comp_type;
 };
 typedef struct conf_blf conf_blf;
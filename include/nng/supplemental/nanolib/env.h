@@ -44,6 +44,7 @@
 #define NANOMQ_TLS_KEY_PASSWORD "NANOMQ_TLS_KEY_PASSWORD"
 #define NANOMQ_TLS_VERIFY_PEER "NANOMQ_TLS_VERIFY_PEER"
 #define NANOMQ_TLS_FAIL_IF_NO_PEER_CERT "NANOMQ_TLS_FAIL_IF_NO_PEER_CERT"
+#define NANOMQ_TLS_KTLS "NANOMQ_TLS_KTLS"
 
 #define NANOMQ_LOG_LEVEL "NANOMQ_LOG_LEVEL"
 #define NANOMQ_LOG_TO "NANOMQ_LOG_TO"
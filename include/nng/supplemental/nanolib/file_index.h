@@ -0,0 +1,52 @@
+#ifndef NANOLIB_FILE_INDEX_H
+#define NANOLIB_FILE_INDEX_H
+
+#include "nng/nng.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Index of the key ranges of the files written by the parquet and blf
+// writers, parsed once from the "-{start_key}~{end_key}." suffix of their
+// names.  Files are kept sorted by start key, so lookups are a binary
+// search as long as the ranges do not overlap, which is the case when
+// keys are monotonic; otherwise they fall back to a scan.  Lookups take
+// a read lock and can run concurrently.
+
+typedef struct file_index file_index;
+
+int  file_index_alloc(file_index **idxp);
+void file_index_free(file_index *idx);
+
+// file_index_add indexes name, the index keeps its own copy. Returns
+// NNG_EINVAL if the name carries no key range.
+int file_index_add(file_index *idx, const char *name);
+int file_index_remove(file_index *idx, const char *name);
+
+// Names are matched ignoring case.  file_index_get returns a copy of the
+// indexed name, to be freed with nng_strfree, or NULL.
+bool     file_index_has(file_index *idx, const char *name);
+char    *file_index_get(file_index *idx, const char *name);
+uint32_t file_index_size(file_index *idx);
+
+// file_index_find returns a copy of the name of a file holding key, to
+// be freed with nng_strfree, or NULL.
+char *file_index_find(file_index *idx, uint64_t key);
+
+// file_index_find_span returns copies of the names of the files that
+// overlap [start_key, end_key], in key order.  Free each name with
+// nng_strfree and the array with nng_free.  NULL if none.
+char **file_index_find_span(
+    file_index *idx, uint64_t start_key, uint64_t end_key, uint32_t *size);
+
+// file_index_parse extracts the key range from a file name.
+int file_index_parse(const char *name, uint64_t *start_key, uint64_t *end_key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
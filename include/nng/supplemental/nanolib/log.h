@@ -75,6 +75,17 @@ NNG_DECL void uds_closelog(void);
 NNG_DECL void log_log(int level, const char *file, int line, const char *func,
     const char *fmt, ...);
 NNG_DECL void log_clear_callback();
+
+// Asynchronous mode for the built in console and file sinks.  Records
+// are formatted by the calling thread and queued on a ring of `records`
+// slots (rounded up to a power of two, 0 picks a default), and written
+// out in batches by a background thread, which also takes care of file
+// rotation.  Records that do not fit in the ring are dropped and counted.
+// Other callbacks are still called synchronously.  Stopping writes out
+// whatever is queued and returns to synchronous mode.
+NNG_DECL int      log_async_start(size_t records);
+NNG_DECL void     log_async_stop(void);
+NNG_DECL uint64_t log_async_dropped(void);
 #ifdef ENABLE_LOG
 
 #define log_trace(...) \
@@ -42,6 +42,8 @@ struct parquet_object {
 	void	        *arg;
 	parquet_file_ranges *ranges;
 	parquet_write_type   type;
+	// Files are written per topic, NULL is the same as "".  Allocated
+	// with nng_strdup and freed along with the object.
 	char                *topic;
 };
 
@@ -28,6 +28,7 @@
 typedef struct ringBuffer_s ringBuffer_t;
 typedef struct ringBufferMsg_s ringBufferMsg_t;
 typedef struct ringBufferRule_s ringBufferRule_t;
+typedef struct ringBufferSpmc_s ringBufferSpmc_t;
 
 /* For RB_FULL_FILE */
 typedef struct ringBufferFile_s ringBufferFile_t;
@@ -63,6 +64,8 @@ struct ringBufferFile_s {
 
 struct ringBuffer_s {
 	char                    name[RBNAME_LEN];
+	/* Topic of the files flushed to, see ringBuffer_set_topic */
+	char                    *topic;
 	unsigned int            head;
 	unsigned int            tail;
 	unsigned int            size;
@@ -86,6 +89,22 @@ struct ringBuffer_s {
 	nng_mtx                 *ring_lock;
 
 	ringBufferMsg_t *msgs;
+
+	/*
+	 * Optional exact key index, key -> slot + 1, see
+	 * ringBuffer_set_key_index. keyIndexExact is cleared once a
+	 * duplicate key is enqueued, searches then fall back to scanning.
+	 */
+	struct nni_id_map       *keyIndex;
+	int                     keyIndexExact;
+	/* Keys have been enqueued in non-decreasing order */
+	int                     keysSorted;
+
+	/*
+	 * Set for ring buffers made by ringBuffer_init_spmc. head, tail,
+	 * size and msgs above are then unused, the state lives here.
+	 */
+	ringBufferSpmc_t        *spmc;
 };
 
 struct ringBufferRule_s {
@@ -110,6 +129,18 @@ int ringBuffer_init(ringBuffer_t **rb,
 					unsigned int cap,
 					enum fullOption fullOp,
 					unsigned long long expiredAt);
+/*
+ * Single producer, multiple consumer ring buffer. One thread may enqueue
+ * while any number of threads dequeue or take snapshots, none of them
+ * taking a lock shared with the producer. Rules must be added before the
+ * ring buffer is shared, and run outside of any critical section. Only
+ * RB_FULL_NONE and RB_FULL_DROP are supported, and searching by key is
+ * done with ringBuffer_snapshot_msgs.
+ */
+int ringBuffer_init_spmc(ringBuffer_t **rb,
+						 unsigned int cap,
+						 enum fullOption fullOp,
+						 unsigned long long expiredAt);
 int ringBuffer_enqueue(ringBuffer_t *rb,
 					   uint64_t key,
 					   void *data,
@@ -125,10 +156,32 @@ int ringBuffer_search_msgs_fuzz(ringBuffer_t *rb,
 								uint64_t end,
 								uint32_t *count,
 								nng_msg ***list);
+/*
+ * Like ringBuffer_search_msgs_fuzz, but every msg in the list holds its
+ * own reference, so it stays valid while the ring buffer moves on. The
+ * caller frees each msg and the list.
+ */
+int ringBuffer_snapshot_msgs(ringBuffer_t *rb,
+							 uint64_t start,
+							 uint64_t end,
+							 uint32_t *count,
+							 nng_msg ***list);
 int ringBuffer_get_and_clean_msgs(ringBuffer_t *rb,
 								  unsigned int *count, nng_msg ***list);
 
 int ringBuffer_set_fullOp(ringBuffer_t *rb, enum fullOption fullOp);
+/*
+ * Keep a hash index of keys so that searching by key is O(1). Range
+ * searches use a binary search as long as keys are monotonic, with or
+ * without the index.
+ */
+int ringBuffer_set_key_index(ringBuffer_t *rb, int enable);
+/*
+ * Topic of the parquet/blf files the messages are flushed to. The writers
+ * keep one queue and one stream of files per topic, and readers find the
+ * files of a topic by it. The ring buffer keeps its own copy.
+ */
+int ringBuffer_set_topic(ringBuffer_t *rb, const char *topic);
 #ifdef SUPP_PARQUET
 int ringBuffer_get_msgs_from_file(ringBuffer_t *rb, void ***msgs, int **msgLen);
 int ringBuffer_get_msgs_from_file_by_keys(ringBuffer_t *rb, uint64_t *keys, uint32_t count,
@@ -88,6 +88,36 @@ typedef struct nng_tls_engine_conn_ops_s {
 	// peer_alt_names returns the subject alternative names.
 	// The return string list and its strings need to be freed.
 	char **(*peer_alt_names)(nng_tls_engine_conn *);
+
+	// session_get returns a reference to the session negotiated on
+	// the connection, for offering again with session_set on a later
+	// connection.  It returns NULL if there is no session that could
+	// be resumed (yet).  The reference is released with session_free.
+	void *(*session_get)(nng_tls_engine_conn *);
+
+	// session_set offers a session obtained with session_get to the
+	// server.  It is called on client connections before the handshake.
+	// The caller keeps its reference.
+	int (*session_set)(nng_tls_engine_conn *, void *);
+
+	// session_free releases a reference obtained with session_get.
+	void (*session_free)(void *);
+
+	// resumed returns true if the handshake resumed an earlier session.
+	bool (*resumed)(nng_tls_engine_conn *);
+
+	// ktls_tx hands protection of outgoing records to the kernel, for
+	// the given socket.  It is only called once the handshake is done,
+	// and everything the engine sent has left.  NNG_EAGAIN asks to be
+	// called again later (the engine may have sent more data to make
+	// progress), and any other error means the engine keeps the job.
+	// After success, the engine must not send anything more.
+	int (*ktls_tx)(nng_tls_engine_conn *, int);
+
+	// ktls_rx is the same for incoming records.  It is only called when
+	// nothing has been read from the socket that the engine has not
+	// been given.  After success, the engine is not given any more data.
+	int (*ktls_rx)(nng_tls_engine_conn *, int);
 } nng_tls_engine_conn_ops;
 
 typedef struct nng_tls_engine_config_ops_s {
@@ -165,13 +195,31 @@ typedef struct nng_tls_engine_config_ops_s {
 	// for v1.3, then NNG_ENOTSUP should be returned.
 	int (*version)(
 	    nng_tls_engine_config *, nng_tls_version, nng_tls_version);
+
+	// session_cache configures a server side cache of sessions that
+	// clients can resume: the number of sessions to keep, and how long
+	// they may be resumed for.  A size of zero disables the cache.
+	int (*session_cache)(nng_tls_engine_config *, size_t, nng_duration);
+
+	// session_tickets configures stateless session tickets on a server:
+	// how long tickets are good for, and how often the keys protecting
+	// them are replaced.  A lifetime of zero disables tickets.
+	int (*session_tickets)(
+	    nng_tls_engine_config *, nng_duration, nng_duration);
+
+	// ktls enables kernel TLS offload for connections, see the ktls_tx
+	// and ktls_rx connection operations.  NNG_ENOTSUP should be
+	// returned if the engine or platform cannot do it.
+	int (*ktls)(nng_tls_engine_config *, bool);
 } nng_tls_engine_config_ops;
 
 typedef enum nng_tls_engine_version_e {
 	NNG_TLS_ENGINE_V0      = 0,
 	NNG_TLS_ENGINE_V1      = 1, // adds FIPS, TLS 1.3 support
 	NNG_TLS_ENGINE_V2      = 2, // adds PSK support
-	NNG_TLS_ENGINE_VERSION = NNG_TLS_ENGINE_V2,
+	NNG_TLS_ENGINE_V3      = 3, // adds session resumption
+	NNG_TLS_ENGINE_V4      = 4, // adds kernel TLS offload
+	NNG_TLS_ENGINE_VERSION = NNG_TLS_ENGINE_V4,
 } nng_tls_engine_version;
 
 typedef struct nng_tls_engine_s {
@@ -134,6 +134,31 @@ NNG_DECL int nng_tls_config_psk(
 NNG_DECL int nng_tls_config_version(
     nng_tls_config *, nng_tls_version, nng_tls_version);
 
+// nng_tls_config_session_cache configures a server to remember up to the
+// given number of sessions, so that clients reconnecting within the
+// lifetime can resume them with an abbreviated handshake.  A size of zero
+// disables the cache.  NNG_DURATION_DEFAULT leaves the lifetime to the
+// TLS engine.  Clients reuse sessions with NNG_OPT_TLS_SESSION_REUSE.
+NNG_DECL int nng_tls_config_session_cache(
+    nng_tls_config *, size_t, nng_duration);
+
+// nng_tls_config_session_tickets configures a server to hand out session
+// tickets, which let clients resume sessions without the server keeping
+// any state.  Tickets are good for the first duration, and the keys
+// protecting them are replaced every second duration (NNG_DURATION_DEFAULT
+// leaves that to the engine).  A lifetime of zero disables tickets.
+NNG_DECL int nng_tls_config_session_tickets(
+    nng_tls_config *, nng_duration, nng_duration);
+
+// nng_tls_config_ktls enables kernel TLS for connections using this
+// configuration.  Once the handshake is done, the negotiated keys are
+// handed to the operating system, which then encrypts and decrypts the
+// records, so that data moves between the application and the socket
+// without passing through the TLS library.  Connections carry on as
+// before where the kernel or the negotiated cipher is not supported.
+// NNG_ENOTSUP is returned if the engine or platform cannot do it at all.
+NNG_DECL int nng_tls_config_ktls(nng_tls_config *, bool);
+
 // nng_tls_engine_name returns the "name" of the TLS engine.  If no
 // TLS engine support is enabled, then "none" is returned.
 NNG_DECL const char *nng_tls_engine_name(void);
@@ -12,12 +12,14 @@
 #include <string.h>
 
 struct nni_aio_expire_q {
-	nni_mtx  eq_mtx;
-	nni_cv   eq_cv;
-	nni_list eq_list;
-	nni_thr  eq_thr;
-	nni_time eq_next; // next expiration
-	bool     eq_exit;
+	nni_mtx   eq_mtx;
+	nni_cv    eq_cv;
+	nni_aio **eq_heap; // binary min-heap, ordered by a_expire
+	size_t    eq_len;
+	size_t    eq_cap;
+	nni_thr   eq_thr;
+	nni_time  eq_next; // next expiration
+	bool      eq_exit;
 };
 
 static nni_aio_expire_q **nni_aio_expire_q_list;
@@ -43,6 +45,12 @@ static int                nni_aio_expire_q_cnt;
 // caused by a single lock.  The number of queues (and threads) can
 // be tuned using the NNG_NUM_EXPIRE_THREADS tunable.
 //
+// Each queue keeps its timed aios in a binary min-heap keyed on the
+// expiration time, and every aio remembers its slot in the heap.  Adding
+// or removing an aio is O(log n), and the expiration thread only ever
+// looks at the top of the heap, so a wake up costs the number of aios
+// that actually expire rather than the number that are outstanding.
+//
 // We will not permit an AIO
 // to be marked done if an expiration is outstanding.
 //
@@ -75,7 +83,7 @@ static nni_reap_list aio_reap_list = {
 	.rl_func   = (nni_cb) nni_aio_free,
 };
 
-static void nni_aio_expire_add(nni_aio *);
+static int  nni_aio_expire_add(nni_aio *);
 static void nni_aio_expire_rm(nni_aio *);
 
 void
@@ -331,7 +339,7 @@ nni_aio_begin(nni_aio *aio)
 	nni_mtx_lock(&eq->eq_mtx);
 	NNI_ASSERT(!nni_aio_list_active(aio));
 	// NNI_ASSERT(aio->a_cancel_fn == NULL);
-	NNI_ASSERT(!nni_list_node_active(&aio->a_expire_node));
+	NNI_ASSERT(aio->a_expire_idx == 0);
 
 	// Some initialization can be done outside the lock, because
 	// we must have exclusive access to the aio.
@@ -392,7 +400,12 @@ nni_aio_schedule(nni_aio *aio, nni_aio_cancel_fn cancel, void *data)
 	// We only schedule expiration if we have a way for the expiration
 	// handler to actively cancel it.
 	if ((aio->a_expire != NNI_TIME_NEVER) && (cancel != NULL)) {
-		nni_aio_expire_add(aio);
+		if (nni_aio_expire_add(aio) != 0) {
+			aio->a_cancel_fn  = NULL;
+			aio->a_cancel_arg = NULL;
+			nni_mtx_unlock(&eq->eq_mtx);
+			return (NNG_ENOMEM);
+		}
 	}
 	nni_mtx_unlock(&eq->eq_mtx);
 	return (0);
@@ -538,23 +551,111 @@ nni_aio_completions_run(nni_aio_completions *clp)
 	}
 }
 
+// Heap slots are stored in the aio one based, so that zero means the
+// aio is not on the heap.
+static void
+nni_aio_expire_place(nni_aio_expire_q *eq, nni_aio *aio, size_t i)
+{
+	eq->eq_heap[i]    = aio;
+	aio->a_expire_idx = i + 1;
+}
+
 static void
+nni_aio_expire_up(nni_aio_expire_q *eq, size_t i)
+{
+	nni_aio *aio = eq->eq_heap[i];
+
+	while (i > 0) {
+		size_t   p   = (i - 1) / 2;
+		nni_aio *par = eq->eq_heap[p];
+		if (par->a_expire <= aio->a_expire) {
+			break;
+		}
+		nni_aio_expire_place(eq, par, i);
+		i = p;
+	}
+	nni_aio_expire_place(eq, aio, i);
+}
+
+static void
+nni_aio_expire_down(nni_aio_expire_q *eq, size_t i)
+{
+	nni_aio *aio = eq->eq_heap[i];
+
+	for (;;) {
+		size_t c = 2 * i + 1;
+		if (c >= eq->eq_len) {
+			break;
+		}
+		if ((c + 1 < eq->eq_len) &&
+		    (eq->eq_heap[c + 1]->a_expire < eq->eq_heap[c]->a_expire)) {
+			c++;
+		}
+		if (aio->a_expire <= eq->eq_heap[c]->a_expire) {
+			break;
+		}
+		nni_aio_expire_place(eq, eq->eq_heap[c], i);
+		i = c;
+	}
+	nni_aio_expire_place(eq, aio, i);
+}
+
+static int
 nni_aio_expire_add(nni_aio *aio)
 {
 	nni_aio_expire_q *eq = aio->a_expire_q;
 
-	nni_list_append(&eq->eq_list, aio);
+	NNI_ASSERT(aio->a_expire_idx == 0);
+	if (eq->eq_len == eq->eq_cap) {
+		nni_aio **heap;
+		size_t    cap = eq->eq_cap ? eq->eq_cap * 2 : 64;
+
+		if ((heap = nni_alloc(cap * sizeof(nni_aio *))) == NULL) {
+			return (NNG_ENOMEM);
+		}
+		if (eq->eq_len > 0) {
+			memcpy(heap, eq->eq_heap, eq->eq_len * sizeof(nni_aio *));
+		}
+		if (eq->eq_heap != NULL) {
+			nni_free(eq->eq_heap, eq->eq_cap * sizeof(nni_aio *));
+		}
+		eq->eq_heap = heap;
+		eq->eq_cap  = cap;
+	}
+	eq->eq_heap[eq->eq_len++] = aio;
+	nni_aio_expire_up(eq, eq->eq_len - 1);
 
 	if (eq->eq_next > aio->a_expire) {
 		eq->eq_next = aio->a_expire;
 		nni_cv_wake(&eq->eq_cv);
 	}
+	return (0);
 }
 
 static void
 nni_aio_expire_rm(nni_aio *aio)
 {
-	nni_list_node_remove(&aio->a_expire_node);
+	nni_aio_expire_q *eq = aio->a_expire_q;
+	nni_aio          *last;
+	size_t            i;
+
+	if (aio->a_expire_idx == 0) {
+		return;
+	}
+	i                 = aio->a_expire_idx - 1;
+	aio->a_expire_idx = 0;
+	last              = eq->eq_heap[--eq->eq_len];
+	if (last != aio) {
+		// Move the last entry into the hole, and let it find
+		// its place in whichever direction it needs to go.
+		eq->eq_heap[i] = last;
+		if ((i > 0) &&
+		    (last->a_expire < eq->eq_heap[(i - 1) / 2]->a_expire)) {
+			nni_aio_expire_up(eq, i);
+		} else {
+			nni_aio_expire_down(eq, i);
+		}
+	}
 
 	// If this item is the one that is going to wake the loop,
 	// don't worry about it.  It will wake up normally, or when we
@@ -584,45 +685,34 @@ nni_aio_expire_loop(void *arg)
 		next = q->eq_next;
 		now  = nni_clock();
 
-		// Each time we wake up, we scan the entire list of elements.
-		// We scan forward, moving up to NNI_EXPIRE_Q_SIZE elements
-		// (a batch) to a saved array of things we are going to cancel.
-		// This mostly runs in O(n), provided you don't have many
-		// elements (> NNI_EXPIRE_Q_SIZE) all expiring simultaneously.
-		aio = nni_list_first(&q->eq_list);
-		if ((aio == NULL) && (q->eq_exit)) {
+		if ((q->eq_len == 0) && (q->eq_exit)) {
 			nni_mtx_unlock(mtx);
 			return;
 		}
 		if (now < next) {
-			// Early wake up (just to reschedule), no need to
-			// rescan the list.  This is an optimization.
+			// Early wake up (just to reschedule), nothing
+			// can have expired yet.
 			nni_cv_until(cv, next);
 			continue;
 		}
-		q->eq_next = NNI_TIME_NEVER;
-		exp_idx    = 0;
-		while (aio != NULL) {
-			if ((aio->a_expire < now) &&
-			    (exp_idx < NNI_EXPIRE_BATCH)) {
-				nni_aio *nxt;
-
-				// This one is expiring.
-				expires[exp_idx++] = aio;
-				// save the next node
-				nxt = nni_list_next(&q->eq_list, aio);
-				nni_list_remove(&q->eq_list, aio);
-				// Place a temporary hold on the aio.
-				// This prevents it from being destroyed.
-				aio->a_expiring = true;
-				aio             = nxt;
-				continue;
-			}
-			if (aio->a_expire < q->eq_next) {
-				q->eq_next = aio->a_expire;
+
+		// Pop expired entries off the top of the heap, up to
+		// NNI_EXPIRE_BATCH at a time.  Anything left over is
+		// picked up on the next pass, as eq_next will be in the past.
+		exp_idx = 0;
+		while ((q->eq_len > 0) && (exp_idx < NNI_EXPIRE_BATCH)) {
+			aio = q->eq_heap[0];
+			if (aio->a_expire >= now) {
+				break;
 			}
-			aio = nni_list_next(&q->eq_list, aio);
+			nni_aio_expire_rm(aio);
+			expires[exp_idx++] = aio;
+			// Place a temporary hold on the aio.
+			// This prevents it from being destroyed.
+			aio->a_expiring = true;
 		}
+		q->eq_next =
+		    q->eq_len > 0 ? q->eq_heap[0]->a_expire : NNI_TIME_NEVER;
 
 		for (uint32_t i = 0; i < exp_idx; i++) {
 			aio = expires[i];
@@ -780,6 +870,9 @@ nni_aio_expire_q_free(nni_aio_expire_q *eq)
 	}
 
 	nni_thr_fini(&eq->eq_thr);
+	if (eq->eq_heap != NULL) {
+		nni_free(eq->eq_heap, eq->eq_cap * sizeof(nni_aio *));
+	}
 	nni_cv_fini(&eq->eq_cv);
 	nni_mtx_fini(&eq->eq_mtx);
 	NNI_FREE_STRUCT(eq);
@@ -795,7 +888,6 @@ nni_aio_expire_q_alloc(void)
 	}
 	nni_mtx_init(&eq->eq_mtx);
 	nni_cv_init(&eq->eq_cv, &eq->eq_mtx);
-	NNI_LIST_INIT(&eq->eq_list, nni_aio, a_expire_node);
 	eq->eq_next = NNI_TIME_NEVER;
 	eq->eq_exit = false;
 
@@ -243,7 +243,7 @@ struct nng_aio {
 	void             *a_prov_data;
 	nni_list_node     a_prov_node; // Linkage on provider list.
 	nni_aio_expire_q *a_expire_q;
-	nni_list_node     a_expire_node; // Expiration node
+	size_t            a_expire_idx; // Heap slot + 1, 0 if not queued
 	nni_reap_node     a_reap_node;
 };
 
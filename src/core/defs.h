@@ -241,6 +241,13 @@ typedef struct subinfo subinfo;
 	(__GNUC__ * 10000 + __GNUC_MINOR__ * 100 + __GNUC_PATCHLEVEL__)
 #endif
 
+// NNI_THREAD_LOCAL marks a variable as having one instance per thread.
+#if defined(_MSC_VER)
+#define NNI_THREAD_LOCAL __declspec(thread)
+#else
+#define NNI_THREAD_LOCAL __thread
+#endif
+
 #if !defined(NNG_BIG_ENDIAN) && !defined(NNG_LITTLE_ENDIAN)
 #if defined(__BYTE_ORDER__)
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
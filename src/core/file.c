@@ -34,6 +34,24 @@ nni_file_delete(const char *name)
 	return (nni_plat_file_delete(name));
 }
 
+int
+nni_file_open(void **hp, const char *name, uint64_t *sizep, uint64_t *mtimep)
+{
+	return (nni_plat_file_open(hp, name, sizep, mtimep));
+}
+
+int
+nni_file_pread(void *h, void *buf, size_t len, uint64_t off, size_t *np)
+{
+	return (nni_plat_file_pread(h, buf, len, off, np));
+}
+
+void
+nni_file_close(void *h)
+{
+	nni_plat_file_close(h);
+}
+
 bool
 nni_file_is_file(const char *name)
 {
@@ -44,6 +44,18 @@ extern int nni_file_get(const char *, void **, size_t *);
 // nni_file_delete deletes the named file.
 extern int nni_file_delete(const char *);
 
+// nni_file_open opens the named file for reading a piece at a time,
+// returning a handle together with the size and modification time
+// (seconds since the epoch).  Directories are rejected with NNG_EINVAL.
+extern int nni_file_open(void **, const char *, uint64_t *, uint64_t *);
+
+// nni_file_pread reads up to the given length at the given offset.
+// The amount read is returned, and is zero at end of file.
+extern int nni_file_pread(void *, void *, size_t, uint64_t, size_t *);
+
+// nni_file_close closes a handle obtained with nni_file_open.
+extern void nni_file_close(void *);
+
 enum nni_file_type_val {
 	NNI_FILE_TYPE_FILE,
 	NNI_FILE_TYPE_DIR,
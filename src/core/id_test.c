@@ -260,6 +260,35 @@ out:
 	nni_id_map_fini(&m);
 }
 
+void
+test_get_min(void)
+{
+	nni_id_map m;
+	int        x, y;
+	uint16_t   pid;
+
+	nni_id_map_init(&m, 0, 0, false);
+	pid = 1;
+	NUTS_NULL(nni_id_get_min(&m, &pid));
+
+	NUTS_PASS(nni_id_set(&m, 5, &x));
+	NUTS_PASS(nni_id_set(&m, 60000, &y));
+	// close enough to probe
+	pid = 1;
+	NUTS_TRUE(nni_id_get_min(&m, &pid) == &x);
+	NUTS_TRUE(pid == 5);
+	// far away in a sparse map
+	pid = 6;
+	NUTS_TRUE(nni_id_get_min(&m, &pid) == &y);
+	NUTS_TRUE(pid == 60000);
+	// wrapping around
+	pid = 60001;
+	NUTS_TRUE(nni_id_get_min(&m, &pid) == &x);
+	NUTS_TRUE(pid == 5);
+
+	nni_id_map_fini(&m);
+}
+
 NUTS_TESTS = {
 	{ "basic", test_basic },
 	{ "random", test_random },
@@ -270,5 +299,6 @@ NUTS_TESTS = {
 	{ "dynamic", test_dynamic },
 	{ "set out of range", test_set_out_of_range },
 	{ "stress", test_stress },
+	{ "get min", test_get_min },
 	{ NULL, NULL },
 };
@@ -136,31 +136,46 @@ nni_id_get(nni_id_map *m, uint64_t id)
 /**
  * get message from idhash, start from *pid on rolling base
  * return the first matched msg with its packet ID
- * Potentially affect QoS msg throughput
+ * A few ids are probed directly, which is enough for a busy map; for a
+ * sparse one the table is scanned instead of probing every packet id.
 */
 void *
 nni_id_get_min(nni_id_map *m, uint16_t *pid)
 {
-	size_t   index = *pid;
-	uint16_t id    = *pid;
+	size_t   index;
+	size_t   best = (size_t) -1;
+	uint16_t dist = 0;
+	uint16_t id   = *pid;
 
 	if (m->id_count == 0 || m->id_entries == NULL) {
 		return NULL;
 	}
 
-	for (;;) {
-		if ((index = id_find(m, id)) == (size_t) -1) {
-			id++;
-			if (id == *pid) {
-				break;
-			}
-		} else {
-			*pid = m->id_entries[index].key;
+	for (int i = 0; i < 16; i++, id++) {
+		if ((index = id_find(m, id)) != (size_t) -1) {
+			*pid = id;
 			return (m->id_entries[index].val);
 		}
 	}
 
-	return NULL;
+	for (index = 0; index < m->id_cap; index++) {
+		nni_id_entry *ent = &m->id_entries[index];
+		uint16_t      d;
+
+		if (ent->val == NULL || ent->key > 0xffff) {
+			continue;
+		}
+		d = (uint16_t) (ent->key - *pid);
+		if (best == (size_t) -1 || d < dist) {
+			best = index;
+			dist = d;
+		}
+	}
+	if (best == (size_t) -1) {
+		return NULL;
+	}
+	*pid = (uint16_t) m->id_entries[best].key;
+	return (m->id_entries[best].val);
 }
 
 
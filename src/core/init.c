@@ -9,6 +9,7 @@
 //
 
 #include "core/nng_impl.h"
+#include "core/msgpool.h"
 
 #include <stdbool.h>
 #include <stdio.h>
@@ -41,6 +42,7 @@ nni_init_helper(void)
 	}
 
 	// following never fail
+	nni_msgpool_sys_init();
 	nni_sp_tran_sys_init();
 	nni_mqtt_tran_sys_init();
 
@@ -168,6 +170,7 @@ nni_fini(void)
 	nni_taskq_sys_fini();
 	nni_reap_sys_fini(); // must be before timer and aio (expire)
 	nni_id_map_sys_fini();
+	nni_msgpool_sys_fini();
 	nni_init_params_fini();
 
 	nni_plat_fini();
@@ -11,6 +11,7 @@
 #include <string.h>
 
 #include "core/nng_impl.h"
+#include "core/msgpool.h"
 
 // Message API.
 
@@ -37,8 +38,26 @@ struct nng_msg {
 	uint8_t *        payload_ptr; // payload
 	nni_time         times;		  // the time msg arrives
 	conn_param      *cparam;      // indicates where it originated
+	nni_atomic_ptr   encs;        // nni_msg_enc list, see nni_msg_enc_get
 };
 
+typedef struct nni_msg_enc nni_msg_enc;
+
+struct nni_msg_enc {
+	nni_msg_enc *me_next;
+	uint64_t     me_key;
+	size_t       me_len;
+	uint64_t     me_data[]; // uint64_t for alignment
+};
+
+// Only taken to add an encoding; lookups walk the list without it.
+static nni_mtx msg_enc_lk = NNI_MTX_INITIALIZER;
+
+// Most fan-outs need only a handful of distinct encodings.  Keys that
+// are unique per peer (like MQTT v5 subscription ids) would otherwise
+// grow the list, and the cost of searching it, with every peer.
+#define NNI_MSG_ENC_MAX 8
+
 #if 0
 static void
 nni_chunk_dump(const nni_chunk *chunk, char *prefix)
@@ -136,14 +155,14 @@ nni_chunk_grow(nni_chunk *ch, size_t newsz, size_t headwanted)
 			newsz = ch->ch_cap - headroom;
 		}
 
-		if ((newbuf = nni_zalloc(newsz + headwanted)) == NULL) {
+		if ((newbuf = nni_msgpool_alloc(newsz + headwanted)) == NULL) {
 			return (NNG_ENOMEM);
 		}
 		// Copy all the data, but not header or trailer.
 		if (ch->ch_len > 0) {
 			memcpy(newbuf + headwanted, ch->ch_ptr, ch->ch_len);
 		}
-		nni_free(ch->ch_buf, ch->ch_cap);
+		nni_msgpool_free(ch->ch_buf, ch->ch_cap);
 		ch->ch_buf = newbuf;
 		ch->ch_ptr = newbuf + headwanted;
 		ch->ch_cap = newsz + headwanted;
@@ -154,10 +173,10 @@ nni_chunk_grow(nni_chunk *ch, size_t newsz, size_t headwanted)
 	// the backing store.  In this case, we just check against the
 	// allocated capacity and grow, or don't grow.
 	if ((newsz + headwanted) >= ch->ch_cap) {
-		if ((newbuf = nni_zalloc(newsz + headwanted)) == NULL) {
+		if ((newbuf = nni_msgpool_alloc(newsz + headwanted)) == NULL) {
 			return (NNG_ENOMEM);
 		}
-		nni_free(ch->ch_buf, ch->ch_cap);
+		nni_msgpool_free(ch->ch_buf, ch->ch_cap);
 		ch->ch_cap = newsz + headwanted;
 		ch->ch_buf = newbuf;
 	}
@@ -170,7 +189,7 @@ static void
 nni_chunk_free(nni_chunk *ch)
 {
 	if ((ch->ch_cap != 0) && (ch->ch_buf != NULL)) {
-		nni_free(ch->ch_buf, ch->ch_cap);
+		nni_msgpool_free(ch->ch_buf, ch->ch_cap);
 	}
 	ch->ch_ptr = NULL;
 	ch->ch_buf = NULL;
@@ -217,7 +236,7 @@ nni_chunk_trim(nni_chunk *ch, size_t len)
 static int
 nni_chunk_dup(nni_chunk *dst, const nni_chunk *src)
 {
-	if ((dst->ch_buf = nni_zalloc(src->ch_cap)) == NULL) {
+	if ((dst->ch_buf = nni_msgpool_alloc(src->ch_cap)) == NULL) {
 		return (NNG_ENOMEM);
 	}
 	dst->ch_cap = src->ch_cap;
@@ -398,13 +417,25 @@ nni_msg_pull_up(nni_msg *m)
 	return (m);
 }
 
+static nni_msg *
+nni_msg_new(void)
+{
+	return (nni_msgpool_alloc(sizeof(nni_msg)));
+}
+
+static void
+nni_msg_release(nni_msg *m)
+{
+	nni_msgpool_free(m, sizeof(nni_msg));
+}
+
 int
 nni_msg_alloc(nni_msg **mp, size_t sz)
 {
 	nni_msg *m;
 	int      rv;
 
-	if ((m = NNI_ALLOC_STRUCT(m)) == NULL) {
+	if ((m = nni_msg_new()) == NULL) {
 		return (NNG_ENOMEM);
 	}
 
@@ -419,7 +450,7 @@ nni_msg_alloc(nni_msg **mp, size_t sz)
 		rv = nni_chunk_grow(&m->m_body, sz, 0);
 	}
 	if (rv != 0) {
-		NNI_FREE_STRUCT(m);
+		nni_msg_release(m);
 		return (rv);
 	}
 	if (nni_chunk_append(&m->m_body, NULL, sz) != 0) {
@@ -440,7 +471,7 @@ nni_msg_dup(nni_msg **dup, const nni_msg *src)
 	nni_msg *            m;
 	int                  rv;
 
-	if ((m = NNI_ALLOC_STRUCT(m)) == NULL) {
+	if ((m = nni_msg_new()) == NULL) {
 		return (NNG_ENOMEM);
 	}
 
@@ -448,7 +479,7 @@ nni_msg_dup(nni_msg **dup, const nni_msg *src)
 	m->m_header_len = src->m_header_len;
 
 	if ((rv = nni_chunk_dup(&m->m_body, &src->m_body)) != 0) {
-		NNI_FREE_STRUCT(m);
+		nni_msg_release(m);
 		return (rv);
 	}
 
@@ -482,7 +513,13 @@ nni_msg_free(nni_msg *m)
 		    m->m_proto_ops->msg_free != NULL) {
 			m->m_proto_ops->msg_free(m->m_proto_data);
 		}
-		NNI_FREE_STRUCT(m);
+		nni_msg_enc *enc = nni_atomic_get_ptr(&m->encs);
+		while (enc != NULL) {
+			nni_msg_enc *next = enc->me_next;
+			nni_free(enc, sizeof(*enc) + enc->me_len);
+			enc = next;
+		}
+		nni_msg_release(m);
 	}
 }
 
@@ -813,6 +850,56 @@ nni_msg_set_timestamp(nni_msg *m, nni_time time)
 	m->times = time;
 }
 
+const void *
+nni_msg_enc_get(nni_msg *m, uint64_t key)
+{
+	nni_msg_enc *enc;
+
+	for (enc = nni_atomic_get_ptr(&m->encs); enc != NULL;
+	     enc = enc->me_next) {
+		if (enc->me_key == key) {
+			return (enc->me_data);
+		}
+	}
+	return (NULL);
+}
+
+const void *
+nni_msg_enc_set(nni_msg *m, uint64_t key, const void *data, size_t len)
+{
+	nni_msg_enc *enc;
+	nni_msg_enc *old;
+	int          n = 0;
+
+	if ((enc = nni_alloc(sizeof(*enc) + len)) == NULL) {
+		return (NULL);
+	}
+	enc->me_key = key;
+	enc->me_len = len;
+	memcpy(enc->me_data, data, len);
+
+	nni_mtx_lock(&msg_enc_lk);
+	for (old = nni_atomic_get_ptr(&m->encs); old != NULL;
+	     old = old->me_next) {
+		if (old->me_key == key) {
+			nni_mtx_unlock(&msg_enc_lk);
+			nni_free(enc, sizeof(*enc) + len);
+			return (old->me_data);
+		}
+		n++;
+	}
+	if (n >= NNI_MSG_ENC_MAX) {
+		nni_mtx_unlock(&msg_enc_lk);
+		nni_free(enc, sizeof(*enc) + len);
+		return (NULL);
+	}
+	// Published fully built, readers never see a partial entry.
+	enc->me_next = nni_atomic_get_ptr(&m->encs);
+	nni_atomic_set_ptr(&m->encs, enc);
+	nni_mtx_unlock(&msg_enc_lk);
+	return (enc->me_data);
+}
+
 nni_time
 nni_msg_get_timestamp(nni_msg *m)
 {
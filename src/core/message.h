@@ -81,6 +81,18 @@ extern uint16_t      nni_msg_get_pub_pid(nni_msg *m);
 
 extern conn_param *nni_msg_get_conn_param(nni_msg *m);
 
+// Transports that fan one message out to many peers can cache derived
+// encodings (like a rewritten fixed header) on the message itself, so
+// the work is done once per distinct encoding rather than once per peer.
+// Entries are immutable once added, can be read concurrently, and are
+// released together with the message.  Only a few encodings are kept per
+// message.  nni_msg_enc_set returns the stored copy, which is the one
+// already present if another thread raced us, or NULL if the cache is
+// full or out of memory, in which case the caller uses its own copy.
+extern const void *nni_msg_enc_get(nni_msg *m, uint64_t key);
+extern const void *nni_msg_enc_set(
+    nni_msg *m, uint64_t key, const void *data, size_t len);
+
 typedef struct conn_propt conn_propt;
 
 struct conn_propt {
@@ -118,7 +130,7 @@ struct conn_param {
 	uint8_t            req_resp_info;
 	uint8_t            req_problem_info;
 	uint8_t            payload_format_indicator;
-	void              *nano_qos_db; // 'sqlite' or 'nni_id_hash_map'
+	void              *nano_qos_db; // 'sqlite' or 'nni_qos_inflight'
 	bool               assignedid;
 	struct mqtt_string pro_name;
 	struct mqtt_string clientid;
@@ -8,6 +8,7 @@
 // found online at https://opensource.org/licenses/MIT.
 //
 
+#include <stdlib.h>
 #include <string.h>
 
 #include <nng/nng.h>
@@ -539,6 +540,98 @@ test_msg_insert_stress(void)
 	}
 }
 
+// msg_bench times allocating (and optionally duplicating) and freeing
+// messages of size sz.  The loop count is kept small so that the unit
+// tests stay quick; raise it with NNG_TEST_MSG_LOOPS for a real
+// measurement.
+static void
+msg_bench(const char *name, size_t sz, bool dup)
+{
+	nng_msg    *msgs[64];
+	nng_time    start;
+	nng_time    end;
+	const char *env;
+	int         loops = 200;
+	int         n     = 0;
+	int         rv    = 0;
+
+	if ((env = getenv("NNG_TEST_MSG_LOOPS")) != NULL) {
+		loops = atoi(env);
+	}
+	start = nng_clock();
+	for (int i = 0; (i < loops) && (rv == 0); i++) {
+		int live = 0;
+
+		// Keep a few messages live at a time, as a broker would.
+		while (live < 64) {
+			if ((rv = nng_msg_alloc(&msgs[live], sz)) != 0) {
+				break;
+			}
+			if (dup) {
+				nng_msg *m;
+				if ((rv = nng_msg_dup(&m, msgs[live])) == 0) {
+					nng_msg_free(msgs[live]);
+					msgs[live] = m;
+				}
+			}
+			live++;
+			if (rv != 0) {
+				break;
+			}
+		}
+		for (int j = 0; j < live; j++) {
+			nng_msg_free(msgs[j]);
+		}
+		n += live;
+	}
+	end = nng_clock();
+	NUTS_PASS(rv);
+	printf("%s %5d bytes: %.0f msgs/s\n", name, (int) sz,
+	    n * 1000.0 / (double) (end - start + 1));
+}
+
+void
+test_msg_bench(void)
+{
+	size_t sizes[] = { 0, 100, 1000, 8000 };
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		msg_bench("alloc/free", sizes[i], false);
+		msg_bench("alloc/dup/free", sizes[i], true);
+	}
+}
+
+#if defined(NNG_ENABLE_MSG_POOL) && defined(NNG_ENABLE_STATS)
+void
+test_msg_pool_stats(void)
+{
+	nng_stat *stats;
+	nng_stat *pool;
+	nng_stat *hits;
+	nng_msg  *msg;
+	uint64_t  before;
+
+	NUTS_PASS(nng_stats_get(&stats));
+	NUTS_ASSERT((pool = nng_stat_find(stats, "msgpool")) != NULL);
+	NUTS_ASSERT((hits = nng_stat_find(pool, "hits")) != NULL);
+	NUTS_ASSERT(nng_stat_find(pool, "misses") != NULL);
+	NUTS_ASSERT(nng_stat_find(pool, "cached") != NULL);
+	before = nng_stat_value(hits);
+	nng_stats_free(stats);
+
+	// The second round is served from the blocks the first freed.
+	for (int i = 0; i < 2; i++) {
+		NUTS_PASS(nng_msg_alloc(&msg, 100));
+		nng_msg_free(msg);
+	}
+	NUTS_PASS(nng_stats_get(&stats));
+	hits = nng_stat_find(nng_stat_find(stats, "msgpool"), "hits");
+	NUTS_ASSERT(hits != NULL);
+	NUTS_ASSERT(nng_stat_value(hits) >= before + 2);
+	nng_stats_free(stats);
+}
+#endif
+
 TEST_LIST = {
 	{ "msg option", test_msg_option },
 	{ "msg empty", test_msg_empty },
@@ -566,5 +659,9 @@ TEST_LIST = {
 	{ "msg capacity", test_msg_capacity },
 	{ "msg reserve", test_msg_reserve },
 	{ "msg insert stress", test_msg_insert_stress },
+	{ "msg bench", test_msg_bench },
+#if defined(NNG_ENABLE_MSG_POOL) && defined(NNG_ENABLE_STATS)
+	{ "msg pool stats", test_msg_pool_stats },
+#endif
 	{ NULL, NULL },
 };
@@ -0,0 +1,369 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <string.h>
+
+#include "core/nng_impl.h"
+#include "core/msgpool.h"
+
+#ifdef NNG_ENABLE_MSG_POOL
+
+// Design notes.
+//
+// Every thread that allocates or frees gets a cache with a small stack of
+// free blocks per size class.  The fast path touches nothing but that
+// cache.  When a stack is empty it is refilled with half a stack from the
+// depot, and when it is full half of it is spilled to the depot, so
+// blocks freed on a different thread than the one that allocated them
+// (which is the common case, messages are received on one thread and
+// freed on another) flow back through the depot.  The depot is bounded,
+// anything beyond that goes back to the system allocator.
+//
+// Library threads hand their cache back when they exit.  Caches of other
+// threads stay registered until nni_msgpool_sys_fini, which releases all
+// of them and bumps a generation number so that threads holding a stale
+// cache pointer allocate a new one.
+
+#define MSGPOOL_CLASSES 9 // NNI_MSGPOOL_MIN << 0 .. NNI_MSGPOOL_MIN << 8
+
+#ifndef NNI_MSGPOOL_CACHE
+#define NNI_MSGPOOL_CACHE 32 // blocks per class, per thread
+#endif
+
+#ifndef NNI_MSGPOOL_DEPOT
+#define NNI_MSGPOOL_DEPOT 1024 // blocks per class in the depot
+#endif
+
+typedef struct msgpool_block msgpool_block;
+struct msgpool_block {
+	msgpool_block *mb_next;
+};
+
+typedef struct {
+	void          *mc_blocks[MSGPOOL_CLASSES][NNI_MSGPOOL_CACHE];
+	unsigned       mc_len[MSGPOOL_CLASSES];
+	nni_atomic_u64 mc_hits;
+	nni_atomic_u64 mc_misses;
+	nni_list_node  mc_node;
+} msgpool_cache;
+
+typedef struct {
+	msgpool_block *md_head;
+	unsigned       md_len;
+} msgpool_depot;
+
+static nni_mtx       msgpool_lk = NNI_MTX_INITIALIZER;
+static msgpool_depot msgpool_depots[MSGPOOL_CLASSES];
+static nni_list      msgpool_caches =
+    NNI_LIST_INITIALIZER(msgpool_caches, msgpool_cache, mc_node);
+static nni_atomic_int msgpool_gen;
+static uint64_t       msgpool_hits;   // of caches already released
+static uint64_t       msgpool_misses; // of caches already released
+
+static NNI_THREAD_LOCAL msgpool_cache *msgpool_tls;
+static NNI_THREAD_LOCAL int            msgpool_tls_gen;
+
+static unsigned
+msgpool_class(size_t sz, size_t *csp)
+{
+	unsigned c  = 0;
+	size_t   cs = NNI_MSGPOOL_MIN;
+
+	while (cs < sz) {
+		cs <<= 1;
+		c++;
+	}
+	*csp = cs;
+	return (c);
+}
+
+static msgpool_cache *
+msgpool_cache_get(void)
+{
+	msgpool_cache *mc;
+
+	if ((msgpool_tls != NULL) &&
+	    (msgpool_tls_gen == nni_atomic_get(&msgpool_gen))) {
+		return (msgpool_tls);
+	}
+	if ((mc = NNI_ALLOC_STRUCT(mc)) == NULL) {
+		return (NULL);
+	}
+	nni_atomic_init64(&mc->mc_hits);
+	nni_atomic_init64(&mc->mc_misses);
+	nni_mtx_lock(&msgpool_lk);
+	nni_list_append(&msgpool_caches, mc);
+	msgpool_tls_gen = nni_atomic_get(&msgpool_gen);
+	nni_mtx_unlock(&msgpool_lk);
+	msgpool_tls = mc;
+	return (mc);
+}
+
+// msgpool_spill moves n blocks of class c from the cache to the depot,
+// or to the system allocator if the depot is full.  Lock held.
+static void
+msgpool_spill(msgpool_cache *mc, unsigned c, unsigned n)
+{
+	msgpool_depot *md = &msgpool_depots[c];
+
+	while ((n-- > 0) && (mc->mc_len[c] > 0)) {
+		msgpool_block *mb = mc->mc_blocks[c][--mc->mc_len[c]];
+		if (md->md_len < NNI_MSGPOOL_DEPOT) {
+			mb->mb_next = md->md_head;
+			md->md_head = mb;
+			md->md_len++;
+		} else {
+			nni_free(mb, (size_t) NNI_MSGPOOL_MIN << c);
+		}
+	}
+}
+
+static void
+msgpool_cache_release(msgpool_cache *mc, bool keep)
+{
+	for (unsigned c = 0; c < MSGPOOL_CLASSES; c++) {
+		if (keep) {
+			msgpool_spill(mc, c, mc->mc_len[c]);
+		}
+		while (mc->mc_len[c] > 0) {
+			nni_free(mc->mc_blocks[c][--mc->mc_len[c]],
+			    (size_t) NNI_MSGPOOL_MIN << c);
+		}
+	}
+	msgpool_hits += nni_atomic_get64(&mc->mc_hits);
+	msgpool_misses += nni_atomic_get64(&mc->mc_misses);
+	nni_list_remove(&msgpool_caches, mc);
+	NNI_FREE_STRUCT(mc);
+}
+
+void *
+nni_msgpool_alloc(size_t sz)
+{
+	msgpool_cache *mc;
+	unsigned       c;
+	size_t         cs;
+	void          *b;
+
+	if ((sz == 0) || (sz > NNI_MSGPOOL_MAX)) {
+		return (nni_zalloc(sz));
+	}
+	c = msgpool_class(sz, &cs);
+	if ((mc = msgpool_cache_get()) == NULL) {
+		return (nni_zalloc(cs));
+	}
+	if (mc->mc_len[c] == 0) {
+		msgpool_depot *md = &msgpool_depots[c];
+
+		nni_mtx_lock(&msgpool_lk);
+		while ((md->md_head != NULL) &&
+		    (mc->mc_len[c] < NNI_MSGPOOL_CACHE / 2)) {
+			msgpool_block *mb = md->md_head;
+			md->md_head       = mb->mb_next;
+			md->md_len--;
+			mc->mc_blocks[c][mc->mc_len[c]++] = mb;
+		}
+		nni_mtx_unlock(&msgpool_lk);
+	}
+	if (mc->mc_len[c] == 0) {
+		nni_atomic_inc64(&mc->mc_misses);
+		return (nni_zalloc(cs));
+	}
+	nni_atomic_inc64(&mc->mc_hits);
+	b = mc->mc_blocks[c][--mc->mc_len[c]];
+	memset(b, 0, sz);
+	return (b);
+}
+
+void
+nni_msgpool_free(void *b, size_t sz)
+{
+	msgpool_cache *mc;
+	unsigned       c;
+	size_t         cs;
+
+	if (b == NULL) {
+		return;
+	}
+	if ((sz > NNI_MSGPOOL_MAX) || ((mc = msgpool_cache_get()) == NULL)) {
+		nni_free(b, sz);
+		return;
+	}
+	c = msgpool_class(sz, &cs);
+	if (mc->mc_len[c] == NNI_MSGPOOL_CACHE) {
+		nni_mtx_lock(&msgpool_lk);
+		msgpool_spill(mc, c, NNI_MSGPOOL_CACHE / 2);
+		nni_mtx_unlock(&msgpool_lk);
+	}
+	mc->mc_blocks[c][mc->mc_len[c]++] = b;
+}
+
+void
+nni_msgpool_thr_fini(void)
+{
+	if ((msgpool_tls == NULL) ||
+	    (msgpool_tls_gen != nni_atomic_get(&msgpool_gen))) {
+		return;
+	}
+	nni_mtx_lock(&msgpool_lk);
+	msgpool_cache_release(msgpool_tls, true);
+	nni_mtx_unlock(&msgpool_lk);
+	msgpool_tls = NULL;
+}
+
+#ifdef NNG_ENABLE_STATS
+static nni_stat_item msgpool_st_root;
+static nni_stat_item msgpool_st_hits;
+static nni_stat_item msgpool_st_misses;
+static nni_stat_item msgpool_st_cached;
+
+static void
+msgpool_stat_hits(nni_stat_item *item)
+{
+	msgpool_cache *mc;
+	uint64_t       n;
+
+	nni_mtx_lock(&msgpool_lk);
+	n = msgpool_hits;
+	NNI_LIST_FOREACH (&msgpool_caches, mc) {
+		n += nni_atomic_get64(&mc->mc_hits);
+	}
+	nni_mtx_unlock(&msgpool_lk);
+	nni_stat_set_value(item, n);
+}
+
+static void
+msgpool_stat_misses(nni_stat_item *item)
+{
+	msgpool_cache *mc;
+	uint64_t       n;
+
+	nni_mtx_lock(&msgpool_lk);
+	n = msgpool_misses;
+	NNI_LIST_FOREACH (&msgpool_caches, mc) {
+		n += nni_atomic_get64(&mc->mc_misses);
+	}
+	nni_mtx_unlock(&msgpool_lk);
+	nni_stat_set_value(item, n);
+}
+
+static void
+msgpool_stat_cached(nni_stat_item *item)
+{
+	uint64_t n = 0;
+
+	// Blocks sitting in the per-thread caches are not counted, they
+	// are owned by their threads and change without the lock.
+	nni_mtx_lock(&msgpool_lk);
+	for (unsigned c = 0; c < MSGPOOL_CLASSES; c++) {
+		n += (uint64_t) msgpool_depots[c].md_len *
+		    ((uint64_t) NNI_MSGPOOL_MIN << c);
+	}
+	nni_mtx_unlock(&msgpool_lk);
+	nni_stat_set_value(item, n);
+}
+#endif
+
+void
+nni_msgpool_sys_init(void)
+{
+#ifdef NNG_ENABLE_STATS
+	static const nni_stat_info root_info = {
+		.si_name = "msgpool",
+		.si_desc = "message allocator",
+		.si_type = NNG_STAT_SCOPE,
+	};
+	static const nni_stat_info hits_info = {
+		.si_name   = "hits",
+		.si_desc   = "allocations served from the pool",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_update = msgpool_stat_hits,
+	};
+	static const nni_stat_info misses_info = {
+		.si_name   = "misses",
+		.si_desc   = "allocations passed to the system allocator",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_update = msgpool_stat_misses,
+	};
+	static const nni_stat_info cached_info = {
+		.si_name   = "cached",
+		.si_desc   = "bytes held in the shared depot",
+		.si_type   = NNG_STAT_LEVEL,
+		.si_unit   = NNG_UNIT_BYTES,
+		.si_update = msgpool_stat_cached,
+	};
+
+	nni_stat_init(&msgpool_st_root, &root_info);
+	nni_stat_init(&msgpool_st_hits, &hits_info);
+	nni_stat_init(&msgpool_st_misses, &misses_info);
+	nni_stat_init(&msgpool_st_cached, &cached_info);
+	nni_stat_add(&msgpool_st_root, &msgpool_st_hits);
+	nni_stat_add(&msgpool_st_root, &msgpool_st_misses);
+	nni_stat_add(&msgpool_st_root, &msgpool_st_cached);
+	nni_stat_register(&msgpool_st_root);
+#endif
+}
+
+void
+nni_msgpool_sys_fini(void)
+{
+	msgpool_cache *mc;
+
+#ifdef NNG_ENABLE_STATS
+	nni_stat_unregister(&msgpool_st_root);
+#endif
+	nni_mtx_lock(&msgpool_lk);
+	while ((mc = nni_list_first(&msgpool_caches)) != NULL) {
+		msgpool_cache_release(mc, false);
+	}
+	for (unsigned c = 0; c < MSGPOOL_CLASSES; c++) {
+		msgpool_depot *md = &msgpool_depots[c];
+		msgpool_block *mb;
+		while ((mb = md->md_head) != NULL) {
+			md->md_head = mb->mb_next;
+			nni_free(mb, (size_t) NNI_MSGPOOL_MIN << c);
+		}
+		md->md_len = 0;
+	}
+	msgpool_hits   = 0;
+	msgpool_misses = 0;
+	nni_atomic_inc(&msgpool_gen);
+	nni_mtx_unlock(&msgpool_lk);
+	msgpool_tls = NULL;
+}
+
+#else // NNG_ENABLE_MSG_POOL
+
+void *
+nni_msgpool_alloc(size_t sz)
+{
+	return (nni_zalloc(sz));
+}
+
+void
+nni_msgpool_free(void *b, size_t sz)
+{
+	nni_free(b, sz);
+}
+
+void
+nni_msgpool_thr_fini(void)
+{
+}
+
+void
+nni_msgpool_sys_init(void)
+{
+}
+
+void
+nni_msgpool_sys_fini(void)
+{
+}
+
+#endif // NNG_ENABLE_MSG_POOL
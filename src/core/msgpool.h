@@ -0,0 +1,41 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#ifndef CORE_MSGPOOL_H
+#define CORE_MSGPOOL_H
+
+#include "core/defs.h"
+
+// Pooled allocator for message headers and bodies, enabled with the
+// NNG_ENABLE_MSG_POOL build option.  Allocations are rounded up to a
+// power of two size class between NNI_MSGPOOL_MIN and NNI_MSGPOOL_MAX,
+// and freed blocks are kept on a small per-thread cache, spilling to and
+// refilling from a shared depot in batches.  A block may be freed on any
+// thread.  Larger requests fall through to nni_zalloc.  Memory returned
+// is always zeroed, like nni_zalloc.
+//
+// Without the option these are thin wrappers around nni_zalloc/nni_free.
+
+#define NNI_MSGPOOL_MIN 64
+#define NNI_MSGPOOL_MAX 16384
+
+// nni_msgpool_alloc allocates sz bytes, and the same size must be passed
+// to nni_msgpool_free.  The rest of the size class is slack, so that
+// callers see exactly the sizes they asked for either way.
+extern void *nni_msgpool_alloc(size_t sz);
+extern void  nni_msgpool_free(void *, size_t sz);
+
+// nni_msgpool_thr_fini returns the blocks cached by the calling thread
+// to the depot.  It is called when library threads exit.
+extern void nni_msgpool_thr_fini(void);
+
+extern void nni_msgpool_sys_init(void);
+extern void nni_msgpool_sys_fini(void);
+
+#endif // CORE_MSGPOOL_H
@@ -582,6 +582,19 @@ extern int nni_plat_getpid(void);
 // nni_plat_file_size get file size.
 extern int nni_plat_file_size(const char *, size_t *);
 
+// nni_plat_file_open opens the named file for reading.  The handle for
+// further operations is returned in the first argument, along with the
+// size of the file and its modification time (seconds since the epoch).
+extern int nni_plat_file_open(void **, const char *, uint64_t *, uint64_t *);
+
+// nni_plat_file_pread reads up to the given number of bytes, starting at
+// the given offset, without disturbing any other reader.  The number of
+// bytes actually read is returned; zero means end of file.
+extern int nni_plat_file_pread(void *, void *, size_t, uint64_t, size_t *);
+
+// nni_plat_file_close closes a handle from nni_plat_file_open.
+extern void nni_plat_file_close(void *);
+
 // nni_access check accessibility of path
 extern int nni_plat_access(const char* name, int flag);
 //
@@ -100,6 +100,13 @@ struct nni_socket {
 	nni_stat_item st_rx_msgs;   // number of msgs received
 	nni_stat_item st_tx_msgs;   // number of msgs sent
 	nni_stat_item st_rejects;   // pipes rejected
+
+	// Message and byte counts are bumped on every send and receive,
+	// from whatever threads the protocol runs on, so they are striped.
+	nni_stat_stripe st_rx_bytes_s[NNI_STAT_STRIPES];
+	nni_stat_stripe st_tx_bytes_s[NNI_STAT_STRIPES];
+	nni_stat_stripe st_rx_msgs_s[NNI_STAT_STRIPES];
+	nni_stat_stripe st_tx_msgs_s[NNI_STAT_STRIPES];
 #endif
 };
 
@@ -418,6 +425,14 @@ sock_stat_init(nni_sock *s, nni_stat_item *item, const nni_stat_info *info)
 	nni_stat_add(&s->st_root, item);
 }
 
+static void
+sock_stat_init_striped(nni_sock *s, nni_stat_item *item,
+    const nni_stat_info *info, nni_stat_stripe *stripes)
+{
+	nni_stat_init_striped(item, info, stripes);
+	nni_stat_add(&s->st_root, item);
+}
+
 static void
 sock_stats_init(nni_sock *s)
 {
@@ -467,32 +482,32 @@ sock_stats_init(nni_sock *s)
 		.si_atomic = true,
 	};
 	static const nni_stat_info tx_msgs_info = {
-		.si_name   = "tx_msgs",
-		.si_desc   = "sent messages",
-		.si_type   = NNG_STAT_COUNTER,
-		.si_unit   = NNG_UNIT_MESSAGES,
-		.si_atomic = true,
+		.si_name    = "tx_msgs",
+		.si_desc    = "sent messages",
+		.si_type    = NNG_STAT_COUNTER,
+		.si_unit    = NNG_UNIT_MESSAGES,
+		.si_striped = true,
 	};
 	static const nni_stat_info rx_msgs_info = {
-		.si_name   = "rx_msgs",
-		.si_desc   = "received messages",
-		.si_type   = NNG_STAT_COUNTER,
-		.si_unit   = NNG_UNIT_MESSAGES,
-		.si_atomic = true,
+		.si_name    = "rx_msgs",
+		.si_desc    = "received messages",
+		.si_type    = NNG_STAT_COUNTER,
+		.si_unit    = NNG_UNIT_MESSAGES,
+		.si_striped = true,
 	};
 	static const nni_stat_info tx_bytes_info = {
-		.si_name   = "tx_bytes",
-		.si_desc   = "sent bytes",
-		.si_type   = NNG_STAT_COUNTER,
-		.si_unit   = NNG_UNIT_BYTES,
-		.si_atomic = true,
+		.si_name    = "tx_bytes",
+		.si_desc    = "sent bytes",
+		.si_type    = NNG_STAT_COUNTER,
+		.si_unit    = NNG_UNIT_BYTES,
+		.si_striped = true,
 	};
 	static const nni_stat_info rx_bytes_info = {
-		.si_name   = "rx_bytes",
-		.si_desc   = "received bytes",
-		.si_type   = NNG_STAT_COUNTER,
-		.si_unit   = NNG_UNIT_BYTES,
-		.si_atomic = true,
+		.si_name    = "rx_bytes",
+		.si_desc    = "received bytes",
+		.si_type    = NNG_STAT_COUNTER,
+		.si_unit    = NNG_UNIT_BYTES,
+		.si_striped = true,
 	};
 
 	// To make collection cheap and atomic for the socket,
@@ -506,10 +521,14 @@ sock_stats_init(nni_sock *s)
 	sock_stat_init(s, &s->st_listeners, &listeners_info);
 	sock_stat_init(s, &s->st_pipes, &pipes_info);
 	sock_stat_init(s, &s->st_rejects, &reject_info);
-	sock_stat_init(s, &s->st_tx_msgs, &tx_msgs_info);
-	sock_stat_init(s, &s->st_rx_msgs, &rx_msgs_info);
-	sock_stat_init(s, &s->st_tx_bytes, &tx_bytes_info);
-	sock_stat_init(s, &s->st_rx_bytes, &rx_bytes_info);
+	sock_stat_init_striped(
+	    s, &s->st_tx_msgs, &tx_msgs_info, s->st_tx_msgs_s);
+	sock_stat_init_striped(
+	    s, &s->st_rx_msgs, &rx_msgs_info, s->st_rx_msgs_s);
+	sock_stat_init_striped(
+	    s, &s->st_tx_bytes, &tx_bytes_info, s->st_tx_bytes_s);
+	sock_stat_init_striped(
+	    s, &s->st_rx_bytes, &rx_bytes_info, s->st_rx_bytes_s);
 
 	nni_stat_set_id(&s->st_id, (int) s->s_id);
 	nni_stat_set_string(&s->st_name, s->s_name);
@@ -139,7 +139,7 @@ struct nni_pipe {
 	bool     cache;
 	uint16_t packet_id;
 	nni_list *subinfol;    // additional info for sub
-	//	nano_qos_db stores qos msgs in 'sqlite' or 'nni_id_hash_map'
+	//	nano_qos_db stores qos msgs in 'sqlite' or 'nni_qos_inflight'
 	void    *nano_qos_db; // protected by pipe lock.
 };
 
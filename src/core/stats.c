@@ -22,6 +22,8 @@ struct nng_stat {
 	nni_stat            *s_parent;
 	nni_list_node        s_node;
 	nni_time             s_timestamp;
+	uint64_t             s_gen;  // s_item->si_gen
+	uint64_t             s_cgen; // s_item->si_cgen when children were built
 	union {
 		int      sv_id;
 		bool     sv_bool;
@@ -42,14 +44,56 @@ static nni_stat_item stats_root = {
 	    stats_root.si_children, nni_stat_item, si_node),
 	.si_info = &stats_root_info,
 };
-static nni_mtx stats_lock     = NNI_MTX_INITIALIZER;
-static nni_mtx stats_val_lock = NNI_MTX_INITIALIZER;
-#endif
+static nni_mtx  stats_lock     = NNI_MTX_INITIALIZER;
+static nni_mtx  stats_val_lock = NNI_MTX_INITIALIZER;
+static uint64_t stats_gen; // protected by stats_lock
 
-void
-nni_stat_add(nni_stat_item *parent, nni_stat_item *child)
+// Each thread sticks to one stripe of the striped counters, handed
+// out round robin the first time it bumps one.
+static nni_atomic_int            stat_stripe_next;
+static NNI_THREAD_LOCAL unsigned stat_stripe_tls;
+
+static inline nni_atomic_u64 *
+stat_stripe(nni_stat_item *item)
+{
+	unsigned id;
+
+	if ((id = stat_stripe_tls) == 0) {
+		id              = (unsigned) -nni_atomic_dec_nv(&stat_stripe_next);
+		stat_stripe_tls = id;
+	}
+	return (&item->si_u.sv_stripes[id % NNI_STAT_STRIPES].ss_val);
+}
+
+static uint64_t
+stat_sum(nni_stat_item *item)
+{
+	uint64_t sum = 0;
+	for (int i = 0; i < NNI_STAT_STRIPES; i++) {
+		sum += nni_atomic_get64(&item->si_u.sv_stripes[i].ss_val);
+	}
+	return (sum);
+}
+
+// stat_stamp gives an item and everything under it a new generation.
+// A snapshot node is only reused for an item with the same address and
+// generation, so items entering the tree must never carry a generation
+// a snapshot might already have seen.
+static void
+stat_stamp(nni_stat_item *item, uint64_t gen)
+{
+	nni_stat_item *child;
+
+	item->si_gen  = gen;
+	item->si_cgen = gen;
+	NNI_LIST_FOREACH (&item->si_children, child) {
+		stat_stamp(child, gen);
+	}
+}
+
+static void
+stat_add(nni_stat_item *parent, nni_stat_item *child)
 {
-#ifdef NNG_ENABLE_STATS
 	// Make sure that the lists for both children and parents
 	// are correctly initialized.
 	if (parent->si_children.ll_head.ln_next == NULL) {
@@ -59,6 +103,20 @@ nni_stat_add(nni_stat_item *parent, nni_stat_item *child)
 		NNI_LIST_INIT(&child->si_children, nni_stat_item, si_node);
 	}
 	nni_list_append(&parent->si_children, child);
+	child->si_parent = parent;
+	stats_gen++;
+	stat_stamp(child, stats_gen);
+	parent->si_cgen = stats_gen;
+}
+#endif
+
+void
+nni_stat_add(nni_stat_item *parent, nni_stat_item *child)
+{
+#ifdef NNG_ENABLE_STATS
+	nni_mtx_lock(&stats_lock);
+	stat_add(parent, child);
+	nni_mtx_unlock(&stats_lock);
 #else
 	NNI_ARG_UNUSED(parent);
 	NNI_ARG_UNUSED(child);
@@ -72,7 +130,7 @@ nni_stat_register(nni_stat_item *child)
 {
 #ifdef NNG_ENABLE_STATS
 	nni_mtx_lock(&stats_lock);
-	nni_stat_add(&stats_root, child);
+	stat_add(&stats_root, child);
 	nni_mtx_unlock(&stats_lock);
 #else
 	NNI_ARG_UNUSED(child);
@@ -92,6 +150,10 @@ stat_unregister(nni_stat_item *item)
 		nni_strfree(item->si_u.sv_string);
 		item->si_u.sv_string = NULL;
 	}
+	if (item->si_parent != NULL) {
+		item->si_parent->si_cgen = ++stats_gen;
+		item->si_parent          = NULL;
+	}
 	nni_list_node_remove(&item->si_node);
 }
 #endif
@@ -121,11 +183,31 @@ nni_stat_init(nni_stat_item *item, const nni_stat_info *info)
 #endif
 }
 
+void
+nni_stat_init_striped(
+    nni_stat_item *item, const nni_stat_info *info, nni_stat_stripe *stripes)
+{
+#ifdef NNG_ENABLE_STATS
+	NNI_ASSERT(info->si_striped);
+	nni_stat_init(item, info);
+	for (int i = 0; i < NNI_STAT_STRIPES; i++) {
+		nni_atomic_init64(&stripes[i].ss_val);
+	}
+	item->si_u.sv_stripes = stripes;
+#else
+	NNI_ARG_UNUSED(item);
+	NNI_ARG_UNUSED(info);
+	NNI_ARG_UNUSED(stripes);
+#endif
+}
+
 void
 nni_stat_inc(nni_stat_item *item, uint64_t inc)
 {
 #ifdef NNG_ENABLE_STATS
-	if (item->si_info->si_atomic) {
+	if (item->si_info->si_striped) {
+		nni_atomic_add64(stat_stripe(item), inc);
+	} else if (item->si_info->si_atomic) {
 		nni_atomic_add64(&item->si_u.sv_atomic, inc);
 	} else {
 		item->si_u.sv_number += inc;
@@ -140,8 +222,11 @@ void
 nni_stat_dec(nni_stat_item *item, uint64_t inc)
 {
 #ifdef NNG_ENABLE_STATS
-
-	if (item->si_info->si_atomic) {
+	// A level may go up on one stripe and down on another, but the
+	// sum still comes out right as the stripes wrap around together.
+	if (item->si_info->si_striped) {
+		nni_atomic_sub64(stat_stripe(item), inc);
+	} else if (item->si_info->si_atomic) {
 		nni_atomic_sub64(&item->si_u.sv_atomic, inc);
 	} else {
 		item->si_u.sv_number -= inc;
@@ -211,7 +296,14 @@ void
 nni_stat_set_value(nni_stat_item *item, uint64_t v)
 {
 #ifdef NNG_ENABLE_STATS
-	if (item->si_info->si_atomic) {
+	if (item->si_info->si_striped) {
+		// Not atomic with respect to concurrent bumps, but setting
+		// a striped value is rare and only done while quiescent.
+		for (int i = 1; i < NNI_STAT_STRIPES; i++) {
+			nni_atomic_set64(&item->si_u.sv_stripes[i].ss_val, 0);
+		}
+		nni_atomic_set64(&item->si_u.sv_stripes[0].ss_val, v);
+	} else if (item->si_info->si_atomic) {
 		nni_atomic_set64(&item->si_u.sv_atomic, v);
 	} else {
 		item->si_u.sv_number = v;
@@ -256,6 +348,8 @@ stat_make_tree(nni_stat_item *item, nni_stat **sp)
 	stat->s_info   = item->si_info;
 	stat->s_item   = item;
 	stat->s_parent = NULL;
+	stat->s_gen    = item->si_gen;
+	stat->s_cgen   = item->si_cgen;
 
 	NNI_LIST_FOREACH (&item->si_children, child) {
 		nni_stat *cs;
@@ -272,13 +366,16 @@ stat_make_tree(nni_stat_item *item, nni_stat **sp)
 }
 
 static void
-stat_update(nni_stat *stat)
+stat_update(nni_stat *stat, nni_time now)
 {
 	const nni_stat_item *item = stat->s_item;
 	const nni_stat_info *info = item->si_info;
 	char                *old;
 	char                *str;
 
+	if (info->si_update != NULL) {
+		info->si_update((nni_stat_item *) item);
+	}
 	switch (info->si_type) {
 	case NNG_STAT_SCOPE:
 	case NNG_STAT_ID:
@@ -289,7 +386,9 @@ stat_update(nni_stat *stat)
 		break;
 	case NNG_STAT_COUNTER:
 	case NNG_STAT_LEVEL:
-		if (info->si_atomic) {
+		if (info->si_striped) {
+			stat->s_val.sv_value = stat_sum((nni_stat_item *) item);
+		} else if (info->si_atomic) {
 			stat->s_val.sv_value = nni_atomic_get64(
 			    (nni_atomic_u64 *) &item->si_u.sv_atomic);
 		} else {
@@ -319,17 +418,80 @@ stat_update(nni_stat *stat)
 		nni_mtx_unlock(&stats_val_lock);
 		break;
 	}
-	stat->s_timestamp = nni_clock();
+	stat->s_timestamp = now;
 }
 
 static void
-stat_update_tree(nni_stat *stat)
+stat_update_tree(nni_stat *stat, nni_time now)
+{
+	nni_stat *child;
+	stat_update(stat, now);
+	NNI_LIST_FOREACH (&stat->s_children, child) {
+		stat_update_tree(child, now);
+	}
+}
+
+// stat_rebuild brings the children of a snapshot node back in line with
+// those of its item, keeping the nodes of items that have not changed.
+// Children are only ever appended, so the survivors are found in the same
+// order in both lists, ahead of any new ones.  Snapshot nodes of removed
+// items may refer to freed memory, so they are only compared, never
+// dereferenced.
+static int
+stat_rebuild(nni_stat *stat)
+{
+	nni_stat_item *item = (nni_stat_item *) stat->s_item;
+	nni_stat_item *ci;
+	nni_stat      *cs;
+	nni_list       old;
+	int            rv = 0;
+
+	NNI_LIST_INIT(&old, nni_stat, s_node);
+	while ((cs = nni_list_first(&stat->s_children)) != NULL) {
+		nni_list_remove(&stat->s_children, cs);
+		nni_list_append(&old, cs);
+	}
+	NNI_LIST_FOREACH (&item->si_children, ci) {
+		while (((cs = nni_list_first(&old)) != NULL) &&
+		    (cs->s_item != ci)) {
+			nni_list_remove(&old, cs);
+			nng_stats_free(cs);
+		}
+		if ((cs != NULL) && (cs->s_gen == ci->si_gen)) {
+			nni_list_remove(&old, cs);
+		} else if ((rv = stat_make_tree(ci, &cs)) != 0) {
+			break;
+		}
+		nni_list_append(&stat->s_children, cs);
+		cs->s_parent = stat;
+	}
+	while ((cs = nni_list_first(&old)) != NULL) {
+		nni_list_remove(&old, cs);
+		nng_stats_free(cs);
+	}
+	if (rv == 0) {
+		stat->s_cgen = item->si_cgen;
+	}
+	return (rv);
+}
+
+static int
+stat_refresh(nni_stat *stat, nni_time now)
 {
 	nni_stat *child;
-	stat_update(stat);
+	int       rv;
+
+	if ((stat->s_cgen != stat->s_item->si_cgen) &&
+	    ((rv = stat_rebuild(stat)) != 0)) {
+		return (rv);
+	}
+	stat_update(stat, now);
 	NNI_LIST_FOREACH (&stat->s_children, child) {
-		stat_update_tree(child);
+		if ((rv = stat_refresh(child, now)) != 0) {
+			return (rv);
+		}
 	}
+	return (0);
 }
 
 int
@@ -346,7 +508,7 @@ nni_stat_snapshot(nni_stat **statp, nni_stat_item *item)
 		nni_mtx_unlock(&stats_lock);
 		return (rv);
 	}
-	stat_update_tree(stat);
+	stat_update_tree(stat, nni_clock());
 	nni_mtx_unlock(&stats_lock);
 	*statp = stat;
 	return (0);
@@ -368,6 +530,25 @@ nng_stats_get(nng_stat **statp)
 #endif
 }
 
+int
+nng_stats_update(nng_stat *stat)
+{
+#ifdef NNG_ENABLE_STATS
+	int rv;
+
+	if ((stat == NULL) || (stat->s_item != &stats_root)) {
+		return (NNG_EINVAL);
+	}
+	nni_mtx_lock(&stats_lock);
+	rv = stat_refresh(stat, nni_clock());
+	nni_mtx_unlock(&stats_lock);
+	return (rv);
+#else
+	NNI_ARG_UNUSED(stat);
+	return (NNG_ENOTSUP);
+#endif
+}
+
 nng_stat *
 nng_stat_parent(nng_stat *stat)
 {
@@ -22,6 +22,11 @@
 //
 // In phase 2, we run the update, and copy the values. We conditionally
 // acquire the lock on the stat first though.
+//
+// Every change to the shape of the tree stamps the affected items with
+// a new generation number.  A snapshot remembers the generations it was
+// built from, which lets nng_stats_update refresh it in place, only
+// rebuilding the parts whose children have come or gone.
 
 typedef struct nni_stat_item nni_stat_item;
 typedef struct nni_stat_info nni_stat_info;
@@ -30,6 +35,20 @@ typedef void (*nni_stat_update)(nni_stat_item *);
 typedef enum nng_stat_type_enum nni_stat_type;
 typedef enum nng_unit_enum      nni_stat_unit;
 
+// Striped counters spread their updates across NNI_STAT_STRIPES cache
+// lines, each thread bumping its own, so that busy counters shared by
+// many threads do not bounce a single line between CPUs.  The stripes
+// are summed when a snapshot is taken.  Storage for the stripes is
+// supplied by the provider, usually next to the item itself.
+#ifndef NNI_STAT_STRIPES
+#define NNI_STAT_STRIPES 8
+#endif
+
+typedef union {
+	nni_atomic_u64 ss_val;
+	char           ss_pad[64]; // one cache line per stripe
+} nni_stat_stripe;
+
 // nni_stat_item is used by providers.  Providers should avoid accessing
 // this directly, but use accessors below.  It is important that we offer
 // this structure so that providers can declare them inline, in order to
@@ -38,13 +57,17 @@ typedef enum nng_unit_enum      nni_stat_unit;
 struct nni_stat_item {
 	nni_list_node        si_node;     // list node, framework use only
 	nni_list             si_children; // children, framework use only
+	nni_stat_item       *si_parent;   // parent, framework use only
+	uint64_t             si_gen;      // generation added, framework use
+	uint64_t             si_cgen;     // generation of last child change
 	const nni_stat_info *si_info;     // statistic description
 	union {
-		uint64_t       sv_number;
-		nni_atomic_u64 sv_atomic;
-		char *         sv_string;
-		bool           sv_bool;
-		int            sv_id;
+		uint64_t         sv_number;
+		nni_atomic_u64   sv_atomic;
+		nni_stat_stripe *sv_stripes;
+		char *           sv_string;
+		bool             sv_bool;
+		int              sv_id;
 	} si_u;
 };
 
@@ -54,12 +77,13 @@ struct nni_stat_info {
 	nni_stat_type   si_type;       // statistic type, e.g. NNG_STAT_LEVEL
 	nni_stat_unit   si_unit;       // statistic unit, e.g. NNG_UNIT_MILLIS
 	nni_stat_update si_update;     // update function (can be NULL)
-	bool            si_atomic : 1; // stat is atomic
-	bool            si_alloc : 1;  // stat string is allocated
+	bool            si_atomic : 1;  // stat is atomic
+	bool            si_alloc : 1;   // stat string is allocated
+	bool            si_striped : 1; // stat is striped, see above
 };
 
-// nni_stat_add adds a statistic, but the operation is unlocked, and the
-// add is to an unregistered stats tree.
+// nni_stat_add adds a statistic to a parent.  This is normally done
+// before the parent is registered, but may also be done later.
 void nni_stat_add(nni_stat_item *, nni_stat_item *);
 
 // nni_stat_register registers a statistic tree into the global tree.
@@ -69,11 +93,21 @@ void nni_stat_register(nni_stat_item *);
 // nni_stat_unregister removes the entire tree.  This is a locked operation.
 void nni_stat_unregister(nni_stat_item *);
 
+// nni_stat_snapshot takes a snapshot of the tree rooted at the item,
+// or of all statistics if it is NULL.  Free it with nng_stats_free.
+int nni_stat_snapshot(nng_stat **, nni_stat_item *);
+
 void nni_stat_set_value(nni_stat_item *, uint64_t);
 void nni_stat_set_id(nni_stat_item *, int);
 void nni_stat_set_bool(nni_stat_item *, bool);
 void nni_stat_set_string(nni_stat_item *, const char *);
 void nni_stat_init(nni_stat_item *, const nni_stat_info *);
+
+// nni_stat_init_striped initializes a counter or level whose info has
+// si_striped set.  The stripes must hold NNI_STAT_STRIPES elements, and
+// must remain valid until the item is unregistered.
+void nni_stat_init_striped(
+    nni_stat_item *, const nni_stat_info *, nni_stat_stripe *);
 void nni_stat_inc(nni_stat_item *, uint64_t);
 void nni_stat_dec(nni_stat_item *, uint64_t);
 
@@ -8,6 +8,7 @@
 // found online at https://opensource.org/licenses/MIT.
 //
 
+#include "core/nng_impl.h"
 #include <nuts.h>
 
 #define SECONDS(x) ((x) *1000)
@@ -89,8 +90,108 @@ test_stats_dump(void)
 #endif
 }
 
+#ifdef NNG_ENABLE_STATS
+#define STRIPE_THREADS 4
+#define STRIPE_BUMPS 100000
+
+static void
+stripe_bump(void *arg)
+{
+	for (int i = 0; i < STRIPE_BUMPS; i++) {
+		nni_stat_inc(arg, 1);
+	}
+	// Levels may come down on a different stripe than they went up.
+	nni_stat_dec(arg, STRIPE_BUMPS / 2);
+}
+#endif
+
+void
+test_stats_striped(void)
+{
+#ifdef NNG_ENABLE_STATS
+	static const nni_stat_info info = {
+		.si_name    = "striped",
+		.si_desc    = "striped counter",
+		.si_type    = NNG_STAT_LEVEL,
+		.si_striped = true,
+	};
+	nni_stat_stripe stripes[NNI_STAT_STRIPES];
+	nni_stat_item   item;
+	nni_thr         thrs[STRIPE_THREADS];
+	nng_stat       *stat;
+
+	NUTS_PASS(nni_init());
+	nni_stat_init_striped(&item, &info, stripes);
+	for (int i = 0; i < STRIPE_THREADS; i++) {
+		NUTS_PASS(nni_thr_init(&thrs[i], stripe_bump, &item));
+	}
+	for (int i = 0; i < STRIPE_THREADS; i++) {
+		nni_thr_run(&thrs[i]);
+	}
+	for (int i = 0; i < STRIPE_THREADS; i++) {
+		nni_thr_fini(&thrs[i]);
+	}
+	stripe_bump(&item);
+	NUTS_PASS(nni_stat_snapshot(&stat, &item));
+	NUTS_TRUE(nng_stat_value(stat) ==
+	    (STRIPE_THREADS + 1) * (STRIPE_BUMPS - STRIPE_BUMPS / 2));
+	nng_stats_free(stat);
+
+	nni_stat_set_value(&item, 7);
+	NUTS_PASS(nni_stat_snapshot(&stat, &item));
+	NUTS_TRUE(nng_stat_value(stat) == 7);
+	nng_stats_free(stat);
+	nng_fini();
+#endif
+}
+
+void
+test_stats_update(void)
+{
+#ifdef NNG_ENABLE_STATS
+	nng_socket s1;
+	nng_socket s2;
+	nng_stat  *stats;
+	nng_stat  *st1;
+	nng_stat  *item;
+
+	NUTS_OPEN(s1);
+	NUTS_PASS(nng_stats_get(&stats));
+	NUTS_ASSERT((st1 = nng_stat_find_socket(stats, s1)) != NULL);
+	NUTS_ASSERT((item = nng_stat_find(st1, "name")) != NULL);
+	NUTS_MATCH(nng_stat_string(item), "1");
+	NUTS_FAIL(nng_stats_update(st1), NNG_EINVAL);
+
+	// Values change, the statistics already there stay put.
+	NUTS_PASS(nng_socket_set_string(s1, NNG_OPT_SOCKNAME, "renamed"));
+	NUTS_PASS(nng_stats_update(stats));
+	NUTS_TRUE(nng_stat_find_socket(stats, s1) == st1);
+	NUTS_TRUE(nng_stat_find(st1, "name") == item);
+	NUTS_MATCH(nng_stat_string(item), "renamed");
+
+	// New sockets show up, closed ones go away.
+	NUTS_OPEN(s2);
+	NUTS_TRUE(nng_stat_find_socket(stats, s2) == NULL);
+	NUTS_PASS(nng_stats_update(stats));
+	NUTS_TRUE(nng_stat_find_socket(stats, s2) != NULL);
+	NUTS_TRUE(nng_stat_find_socket(stats, s1) == st1);
+	NUTS_CLOSE(s2);
+	NUTS_PASS(nng_stats_update(stats));
+	NUTS_TRUE(nng_stat_find_socket(stats, s2) == NULL);
+	NUTS_TRUE(nng_stat_find_socket(stats, s1) == st1);
+	NUTS_MATCH(nng_stat_string(item), "renamed");
+
+	NUTS_CLOSE(s1);
+	NUTS_PASS(nng_stats_update(stats));
+	NUTS_TRUE(nng_stat_find_socket(stats, s1) == NULL);
+	nng_stats_free(stats);
+#endif
+}
+
 NUTS_TESTS = {
 	{ "socket stats", test_stats_socket },
 	{ "dump stats", test_stats_dump },
+	{ "striped stats", test_stats_striped },
+	{ "update stats", test_stats_update },
 	{ NULL, NULL },
 };
@@ -31,6 +31,11 @@ extern int nni_stream_listener_get(
 extern int nni_stream_listener_set(
     nng_stream_listener *, const char *, const void *, size_t, nni_type);
 
+// NNI_OPT_TCP_FD is a private, read-only option returning the descriptor
+// of the socket under a TCP stream, for layers that have to configure
+// the socket itself, such as kernel TLS.
+#define NNI_OPT_TCP_FD "tcp:fd"
+
 // This is the common implementation of a connected byte stream.  It should be
 // the first element of any implementation.  Applications are not permitted to
 // access it directly.
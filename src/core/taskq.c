@@ -10,23 +10,99 @@
 
 #include "core/nng_impl.h"
 
+// Each worker thread owns a queue of tasks, with its own lock and
+// condition variable, so that workers do not all contend on one lock.
+// A task dispatched from one of the workers goes onto that worker's own
+// queue, so continuations stay on the thread (and cache) that produced
+// them.  Tasks dispatched from anywhere else, such as the pollers and
+// the expiration threads, go to the task's home queue, which is fixed
+// for the life of the task, so an aio completing over and over keeps
+// landing on the same worker.
+//
+// A worker that runs out of work becomes idle and steals half of the
+// tasks from the first non-empty queue of another worker.  Dispatching
+// only wakes a thread if the owner of the queue is asleep, or if the
+// owner is busy and some other worker is idle, in which case one idle
+// worker is kicked so that it can steal.  A burst of tasks to a busy
+// worker therefore costs at most one wake up per task, and often none.
+
 typedef struct nni_taskq_thr nni_taskq_thr;
 struct nni_taskq_thr {
 	nni_taskq *tqt_tq;
 	nni_thr    tqt_thread;
+	nni_list   tqt_tasks;
+	unsigned   tqt_len;
+	nni_mtx    tqt_mtx;
+	nni_cv     tqt_cv;
+	bool       tqt_idle; // looking for work, or asleep
+	bool       tqt_kick; // woken to steal work
+	bool       tqt_run;
 };
 struct nni_taskq {
-	nni_list       tq_tasks;
-	nni_mtx        tq_mtx;
-	nni_cv         tq_sched_cv;
-	nni_cv         tq_wait_cv;
 	nni_taskq_thr *tq_threads;
 	int            tq_nthreads;
-	bool           tq_run;
+	nni_atomic_int tq_nidle;
 };
 
 static nni_taskq *nni_taskq_systq = NULL;
 
+// The worker queue of the calling thread, NULL outside of task threads.
+static NNI_THREAD_LOCAL nni_taskq_thr *nni_taskq_self;
+
+static void
+nni_taskq_run(nni_task *task)
+{
+	task->task_cb(task->task_arg);
+
+	nni_mtx_lock(&task->task_mtx);
+	task->task_busy--;
+	if (task->task_busy == 0) {
+		nni_cv_wake(&task->task_cv);
+	}
+	nni_mtx_unlock(&task->task_mtx);
+}
+
+// nni_taskq_steal moves up to half of the tasks queued on another worker
+// onto our own queue.  Only one queue lock is ever held at a time.
+static bool
+nni_taskq_steal(nni_taskq_thr *thr)
+{
+	nni_taskq *tq   = thr->tqt_tq;
+	int        self = (int) (thr - tq->tq_threads);
+	nni_list   stolen;
+	unsigned   n = 0;
+
+	NNI_LIST_INIT(&stolen, nni_task, task_node);
+	for (int i = 1; i < tq->tq_nthreads; i++) {
+		nni_taskq_thr *victim =
+		    &tq->tq_threads[(self + i) % tq->tq_nthreads];
+		nni_task *task;
+		unsigned  take;
+
+		nni_mtx_lock(&victim->tqt_mtx);
+		take = (victim->tqt_len + 1) / 2;
+		while ((n < take) &&
+		    ((task = nni_list_first(&victim->tqt_tasks)) != NULL)) {
+			nni_list_remove(&victim->tqt_tasks, task);
+			victim->tqt_len--;
+			nni_list_append(&stolen, task);
+			n++;
+		}
+		nni_mtx_unlock(&victim->tqt_mtx);
+		if (n > 0) {
+			nni_mtx_lock(&thr->tqt_mtx);
+			while ((task = nni_list_first(&stolen)) != NULL) {
+				nni_list_remove(&stolen, task);
+				nni_list_append(&thr->tqt_tasks, task);
+				thr->tqt_len++;
+			}
+			nni_mtx_unlock(&thr->tqt_mtx);
+			return (true);
+		}
+	}
+	return (false);
+}
+
 static void
 nni_taskq_thread(void *self)
 {
@@ -35,35 +111,48 @@ nni_taskq_thread(void *self)
 	nni_task      *task;
 
 	nni_thr_set_name(NULL, "nng:task");
+	nni_taskq_self = thr;
 
-	nni_mtx_lock(&tq->tq_mtx);
+	nni_mtx_lock(&thr->tqt_mtx);
 	for (;;) {
-		if ((task = nni_list_first(&tq->tq_tasks)) != NULL) {
-
-			nni_list_remove(&tq->tq_tasks, task);
-
-			nni_mtx_unlock(&tq->tq_mtx);
+		if ((task = nni_list_first(&thr->tqt_tasks)) != NULL) {
+			nni_list_remove(&thr->tqt_tasks, task);
+			thr->tqt_len--;
+			nni_mtx_unlock(&thr->tqt_mtx);
 
-			task->task_cb(task->task_arg);
+			nni_taskq_run(task);
 
-			nni_mtx_lock(&task->task_mtx);
-			task->task_busy--;
-			if (task->task_busy == 0) {
-				nni_cv_wake(&task->task_cv);
-			}
-			nni_mtx_unlock(&task->task_mtx);
-
-			nni_mtx_lock(&tq->tq_mtx);
+			nni_mtx_lock(&thr->tqt_mtx);
+			continue;
+		}
 
+		// Announce that we are idle before looking at the other
+		// queues, so that a dispatch that we miss will kick us.
+		thr->tqt_idle = true;
+		thr->tqt_kick = false;
+		nni_mtx_unlock(&thr->tqt_mtx);
+		nni_atomic_inc(&tq->tq_nidle);
+
+		if (nni_taskq_steal(thr)) {
+			nni_atomic_dec(&tq->tq_nidle);
+			nni_mtx_lock(&thr->tqt_mtx);
+			thr->tqt_idle = false;
 			continue;
 		}
 
-		if (!tq->tq_run) {
+		nni_mtx_lock(&thr->tqt_mtx);
+		while ((!thr->tqt_kick) && thr->tqt_run &&
+		    nni_list_empty(&thr->tqt_tasks)) {
+			nni_cv_wait(&thr->tqt_cv);
+		}
+		thr->tqt_idle = false;
+		nni_atomic_dec(&tq->tq_nidle);
+		if ((!thr->tqt_kick) && (!thr->tqt_run) &&
+		    nni_list_empty(&thr->tqt_tasks)) {
 			break;
 		}
-		nni_cv_wait(&tq->tq_sched_cv);
 	}
-	nni_mtx_unlock(&tq->tq_mtx);
+	nni_mtx_unlock(&thr->tqt_mtx);
 }
 
 int
@@ -80,15 +169,19 @@ nni_taskq_init(nni_taskq **tqp, int nthr)
 		return (NNG_ENOMEM);
 	}
 	tq->tq_nthreads = nthr;
-	NNI_LIST_INIT(&tq->tq_tasks, nni_task, task_node);
+	nni_atomic_init(&tq->tq_nidle);
 
-	nni_mtx_init(&tq->tq_mtx);
-	nni_cv_init(&tq->tq_sched_cv, &tq->tq_mtx);
-	nni_cv_init(&tq->tq_wait_cv, &tq->tq_mtx);
+	for (int i = 0; i < nthr; i++) {
+		nni_taskq_thr *thr = &tq->tq_threads[i];
 
+		thr->tqt_tq = tq;
+		NNI_LIST_INIT(&thr->tqt_tasks, nni_task, task_node);
+		nni_mtx_init(&thr->tqt_mtx);
+		nni_cv_init(&thr->tqt_cv, &thr->tqt_mtx);
+		thr->tqt_run = true;
+	}
 	for (int i = 0; i < nthr; i++) {
 		int rv;
-		tq->tq_threads[i].tqt_tq = tq;
 		rv = nni_thr_init(&tq->tq_threads[i].tqt_thread,
 		    nni_taskq_thread, &tq->tq_threads[i]);
 		if (rv != 0) {
@@ -96,7 +189,6 @@ nni_taskq_init(nni_taskq **tqp, int nthr)
 			return (rv);
 		}
 	}
-	tq->tq_run = true;
 	for (int i = 0; i < tq->tq_nthreads; i++) {
 		nni_thr_run(&tq->tq_threads[i].tqt_thread);
 	}
@@ -110,18 +202,20 @@ nni_taskq_fini(nni_taskq *tq)
 	if (tq == NULL) {
 		return;
 	}
-	if (tq->tq_run) {
-		nni_mtx_lock(&tq->tq_mtx);
-		tq->tq_run = false;
-		nni_cv_wake(&tq->tq_sched_cv);
-		nni_mtx_unlock(&tq->tq_mtx);
+	for (int i = 0; i < tq->tq_nthreads; i++) {
+		nni_taskq_thr *thr = &tq->tq_threads[i];
+		nni_mtx_lock(&thr->tqt_mtx);
+		thr->tqt_run = false;
+		nni_cv_wake(&thr->tqt_cv);
+		nni_mtx_unlock(&thr->tqt_mtx);
 	}
 	for (int i = 0; i < tq->tq_nthreads; i++) {
 		nni_thr_fini(&tq->tq_threads[i].tqt_thread);
 	}
-	nni_cv_fini(&tq->tq_wait_cv);
-	nni_cv_fini(&tq->tq_sched_cv);
-	nni_mtx_fini(&tq->tq_mtx);
+	for (int i = 0; i < tq->tq_nthreads; i++) {
+		nni_cv_fini(&tq->tq_threads[i].tqt_cv);
+		nni_mtx_fini(&tq->tq_threads[i].tqt_mtx);
+	}
 	NNI_FREE_STRUCTS(tq->tq_threads, tq->tq_nthreads);
 	NNI_FREE_STRUCT(tq);
 }
@@ -149,6 +243,47 @@ nni_task_exec(nni_task *task)
 	nni_mtx_unlock(&task->task_mtx);
 }
 
+static void
+nni_taskq_push(nni_taskq *tq, nni_task *task)
+{
+	nni_taskq_thr *thr = nni_taskq_self;
+	bool           wake;
+
+	// Workers of other task queues dispatch like any other thread.
+	if (thr == NULL || thr->tqt_tq != tq) {
+		thr = &tq->tq_threads[task->task_home % tq->tq_nthreads];
+	}
+
+	nni_mtx_lock(&thr->tqt_mtx);
+	nni_list_append(&thr->tqt_tasks, task);
+	thr->tqt_len++;
+	if ((wake = thr->tqt_idle)) {
+		nni_cv_wake1(&thr->tqt_cv);
+	}
+	nni_mtx_unlock(&thr->tqt_mtx);
+
+	if (wake || (nni_atomic_get(&tq->tq_nidle) == 0)) {
+		return;
+	}
+	// The owner is busy, so let an idle worker steal the task.
+	for (int i = 0; i < tq->tq_nthreads; i++) {
+		nni_taskq_thr *idle = &tq->tq_threads[i];
+		if (idle == thr) {
+			continue;
+		}
+		nni_mtx_lock(&idle->tqt_mtx);
+		if (idle->tqt_idle && !idle->tqt_kick) {
+			idle->tqt_kick = true;
+			nni_cv_wake1(&idle->tqt_cv);
+			wake = true;
+		}
+		nni_mtx_unlock(&idle->tqt_mtx);
+		if (wake) {
+			break;
+		}
+	}
+}
+
 void
 nni_task_dispatch(nni_task *task)
 {
@@ -168,10 +303,7 @@ nni_task_dispatch(nni_task *task)
 	}
 	nni_mtx_unlock(&task->task_mtx);
 
-	nni_mtx_lock(&tq->tq_mtx);
-	nni_list_append(&tq->tq_tasks, task);
-	nni_cv_wake1(&tq->tq_sched_cv); // waking just one waiter is adequate
-	nni_mtx_unlock(&tq->tq_mtx);
+	nni_taskq_push(tq, task);
 }
 
 void
@@ -228,6 +360,7 @@ nni_task_init(nni_task *task, nni_taskq *tq, nni_cb cb, void *arg)
 	task->task_cb   = cb;
 	task->task_arg  = arg;
 	task->task_tq   = tq != NULL ? tq : nni_taskq_systq;
+	task->task_home = (unsigned) (((uintptr_t) task >> 4) * 2654435761u);
 }
 
 void
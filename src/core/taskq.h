@@ -70,6 +70,7 @@ struct nni_task {
 	void *        task_arg;
 	nni_cb        task_cb;
 	nni_taskq *   task_tq;
+	unsigned      task_home; // preferred worker, see taskq.c
 	unsigned      task_busy;
 	bool          task_prep;
 	nni_mtx       task_mtx;
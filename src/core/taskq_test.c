@@ -0,0 +1,149 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include "nng_impl.h"
+#include <nuts.h>
+
+typedef struct {
+	nni_task        task;
+	nni_atomic_int *count;
+	int             again; // times to redispatch itself
+} bench_task;
+
+static void
+bench_cb(void *arg)
+{
+	bench_task *bt = arg;
+
+	nni_atomic_inc(bt->count);
+	if (bt->again > 0) {
+		bt->again--;
+		nni_task_dispatch(&bt->task);
+	}
+}
+
+// bench_run dispatches ntask tasks from this thread, each of which
+// dispatches itself again nagain times from the worker it ran on, and
+// returns the number of callbacks run per second.
+static double
+bench_run(int nthr, int ntask, int nagain)
+{
+	nni_taskq     *tq;
+	bench_task    *bts;
+	nni_atomic_int count;
+	nni_time       start;
+	nni_time       end;
+
+	nni_atomic_init(&count);
+	NUTS_PASS(nni_taskq_init(&tq, nthr));
+	NUTS_ASSERT((bts = nni_zalloc(sizeof(*bts) * ntask)) != NULL);
+	for (int i = 0; i < ntask; i++) {
+		nni_task_init(&bts[i].task, tq, bench_cb, &bts[i]);
+		bts[i].count = &count;
+		bts[i].again = nagain;
+	}
+	start = nni_clock();
+	for (int i = 0; i < ntask; i++) {
+		nni_task_dispatch(&bts[i].task);
+	}
+	for (int i = 0; i < ntask; i++) {
+		// The redispatch happens inside the callback, so the task
+		// stays busy until the whole chain is done.
+		nni_task_wait(&bts[i].task);
+	}
+	end = nni_clock();
+	NUTS_TRUE(nni_atomic_get(&count) == ntask * (nagain + 1));
+	for (int i = 0; i < ntask; i++) {
+		nni_task_fini(&bts[i].task);
+	}
+	nni_free(bts, sizeof(*bts) * ntask);
+	nni_taskq_fini(tq);
+	return (ntask * (nagain + 1) * 1000.0 / (end > start ? end - start : 1));
+}
+
+static void
+test_taskq_dispatch_all(void)
+{
+	// Everything dispatched runs exactly once, including tasks that
+	// are stolen away from a busy worker.
+	NUTS_PASS(nni_init());
+	for (int nthr = 1; nthr <= 8; nthr *= 2) {
+		(void) bench_run(nthr, 100, 10);
+	}
+	nng_fini();
+}
+
+static void
+count_cb(void *arg)
+{
+	nni_atomic_inc(arg);
+}
+
+static void
+block_cb(void *arg)
+{
+	nng_msleep(*(int *) arg);
+}
+
+static void
+test_taskq_steal(void)
+{
+	nni_taskq     *tq;
+	nni_task       slow;
+	nni_task       tasks[16];
+	nni_atomic_int count;
+	int            ms = 500;
+	nni_time       start;
+
+	// Tasks queued behind a blocked worker are picked up by the others
+	// long before it is free again.
+	NUTS_PASS(nni_init());
+	nni_atomic_init(&count);
+	NUTS_PASS(nni_taskq_init(&tq, 4));
+	nni_task_init(&slow, tq, block_cb, &ms);
+	for (int i = 0; i < 16; i++) {
+		nni_task_init(&tasks[i], tq, count_cb, &count);
+	}
+	start = nni_clock();
+	nni_task_dispatch(&slow);
+	nng_msleep(10);
+	for (int i = 0; i < 16; i++) {
+		nni_task_dispatch(&tasks[i]);
+	}
+	for (int i = 0; i < 16; i++) {
+		nni_task_wait(&tasks[i]);
+	}
+	NUTS_TRUE(nni_clock() - start < (nni_time) ms);
+	NUTS_TRUE(nni_atomic_get(&count) == 16);
+	nni_task_wait(&slow);
+	for (int i = 0; i < 16; i++) {
+		nni_task_fini(&tasks[i]);
+	}
+	nni_task_fini(&slow);
+	nni_taskq_fini(tq);
+	nng_fini();
+}
+
+static void
+test_taskq_bench(void)
+{
+	NUTS_PASS(nni_init());
+	for (int nthr = 1; nthr <= 16; nthr *= 2) {
+		double rate = bench_run(nthr, 1000, 200);
+		printf("%2d threads: %.0f tasks/s\n", nthr, rate);
+	}
+	nng_fini();
+}
+
+NUTS_TESTS = {
+	{ "taskq dispatch all", test_taskq_dispatch_all },
+	{ "taskq steal", test_taskq_steal },
+	{ "taskq bench", test_taskq_bench },
+	{ NULL, NULL },
+};
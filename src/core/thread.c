@@ -8,6 +8,7 @@
 //
 
 #include "core/nng_impl.h"
+#include "core/msgpool.h"
 
 void
 nni_mtx_init(nni_mtx *mtx)
@@ -93,6 +94,7 @@ nni_thr_wrap(void *arg)
 	if ((start) && (thr->fn != NULL)) {
 		thr->fn(thr->arg);
 	}
+	nni_msgpool_thr_fini();
 	nni_plat_mtx_lock(&thr->mtx);
 	thr->done = 1;
 	nni_plat_cv_wake(&thr->cv);
@@ -66,7 +66,18 @@ exchange_init(exchange_t **ex, char *name, char *topic,
 			nng_free(newEx, sizeof(*newEx));
 			return -1;
 		}
+		/* Exchange consumers look messages up by key */
+		(void)ringBuffer_set_key_index(rb, 1);
 		(void)strcpy(rb->name, rbsName[i]);
+		/* Readers find the flushed files by the exchange topic */
+		if (ringBuffer_set_topic(rb, topic) != 0) {
+			ringBuffer_release(rb);
+			for (unsigned int j = 0; j < newEx->rb_count; j++) {
+				ringBuffer_release(newEx->rbs[j]);
+			}
+			nng_free(newEx, sizeof(*newEx));
+			return -1;
+		}
 		newEx->rbs[i] = rb;
 		newEx->rb_count++;
 	}
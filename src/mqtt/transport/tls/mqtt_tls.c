@@ -1484,6 +1484,7 @@ mqtts_tcptran_dialer_init(void **dp, nng_url *url, nni_dialer *ndialer)
 	nng_sockaddr      srcsa;
 	nni_sock *        sock = nni_dialer_sock(ndialer);
 	nng_url           myurl;
+	bool              reuse;
 
 	// Check for invalid URL components. only one dialer is allowed
 	if ((strlen(url->u_path) != 0) && (strcmp(url->u_path, "/") != 0)) {
@@ -1523,6 +1524,11 @@ mqtts_tcptran_dialer_init(void **dp, nng_url *url, nni_dialer *ndialer)
 		mqtts_tcptran_ep_fini(ep);
 		return (rv);
 	}
+	// Reconnects resume the previous TLS session rather than paying
+	// for a full handshake; NNG_OPT_TLS_SESSION_REUSE turns this off.
+	reuse = true;
+	(void) nni_stream_dialer_set(ep->dialer, NNG_OPT_TLS_SESSION_REUSE,
+	    &reuse, sizeof(reuse), NNI_TYPE_BOOL);
 	*dp = ep;
 	return (0);
 }
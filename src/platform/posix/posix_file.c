@@ -356,6 +356,68 @@ nni_plat_file_size(const char *path, size_t *size)
 	return (0);
 }
 
+typedef struct {
+	int fd;
+} posix_file;
+
+int
+nni_plat_file_open(
+    void **handlep, const char *path, uint64_t *sizep, uint64_t *mtimep)
+{
+	posix_file *f;
+	struct stat sbuf;
+	int         fd;
+	int         rv;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return (nni_plat_errno(errno));
+	}
+	if (fstat(fd, &sbuf) != 0) {
+		rv = nni_plat_errno(errno);
+		(void) close(fd);
+		return (rv);
+	}
+	if (!S_ISREG(sbuf.st_mode)) {
+		(void) close(fd);
+		return (NNG_EINVAL);
+	}
+	if ((f = NNI_ALLOC_STRUCT(f)) == NULL) {
+		(void) close(fd);
+		return (NNG_ENOMEM);
+	}
+	f->fd    = fd;
+	*sizep   = (uint64_t) sbuf.st_size;
+	*mtimep  = (uint64_t) sbuf.st_mtime;
+	*handlep = f;
+	return (0);
+}
+
+int
+nni_plat_file_pread(
+    void *handle, void *buf, size_t len, uint64_t off, size_t *nreadp)
+{
+	posix_file *f = handle;
+	ssize_t     n;
+
+	do {
+		n = pread(f->fd, buf, len, (off_t) off);
+	} while ((n < 0) && (errno == EINTR));
+	if (n < 0) {
+		return (nni_plat_errno(errno));
+	}
+	*nreadp = (size_t) n;
+	return (0);
+}
+
+void
+nni_plat_file_close(void *handle)
+{
+	posix_file *f = handle;
+
+	(void) close(f->fd);
+	NNI_FREE_STRUCT(f);
+}
+
 int nni_plat_access(const char* name, int flag)
 {
     return access(name, flag);
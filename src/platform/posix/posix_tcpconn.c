@@ -443,6 +443,14 @@ tcp_get_keepalive(void *arg, void *buf, size_t *szp, nni_type t)
 	return (nni_copyout_bool(val, buf, szp, t));
 }
 
+static int
+tcp_get_fd(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	nni_tcp_conn *c = arg;
+
+	return (nni_copyout_int(nni_posix_pfd_fd(c->pfd), buf, szp, t));
+}
+
 static const nni_option tcp_options[] = {
 	{
 	    .o_name = NNG_OPT_REMADDR,
@@ -462,6 +470,10 @@ static const nni_option tcp_options[] = {
 	    .o_get  = tcp_get_keepalive,
 	    .o_set  = tcp_set_keepalive,
 	},
+	{
+	    .o_name = NNI_OPT_TCP_FD,
+	    .o_get  = tcp_get_fd,
+	},
 	{
 	    .o_name = NULL,
 	},
@@ -16,6 +16,7 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <direct.h>
 
 // File support.
@@ -388,6 +389,69 @@ nni_plat_file_size(const char *path, size_t *size)
 	return (rv);
 }
 
+int
+nni_plat_file_open(
+    void **handlep, const char *path, uint64_t *sizep, uint64_t *mtimep)
+{
+	HANDLE                     h;
+	BY_HANDLE_FILE_INFORMATION info;
+	ULARGE_INTEGER             ft;
+	int                        rv;
+
+	h = CreateFile(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+	    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (h == INVALID_HANDLE_VALUE) {
+		return (nni_win_error(GetLastError()));
+	}
+	if (!GetFileInformationByHandle(h, &info)) {
+		rv = nni_win_error(GetLastError());
+		(void) CloseHandle(h);
+		return (rv);
+	}
+	if (info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+		(void) CloseHandle(h);
+		return (NNG_EINVAL);
+	}
+	*sizep = ((uint64_t) info.nFileSizeHigh << 32) | info.nFileSizeLow;
+
+	// FILETIME counts 100ns intervals since 1601; convert to UNIX time.
+	ft.HighPart = info.ftLastWriteTime.dwHighDateTime;
+	ft.LowPart  = info.ftLastWriteTime.dwLowDateTime;
+	*mtimep     = (ft.QuadPart / 10000000ull) - 11644473600ull;
+	*handlep    = h;
+	return (0);
+}
+
+int
+nni_plat_file_pread(
+    void *handle, void *buf, size_t len, uint64_t off, size_t *nreadp)
+{
+	OVERLAPPED ov;
+	DWORD      nread;
+
+	if (len > 0x40000000) {
+		len = 0x40000000; // ReadFile takes a DWORD
+	}
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset     = (DWORD) (off & 0xffffffffu);
+	ov.OffsetHigh = (DWORD) (off >> 32);
+	if (!ReadFile((HANDLE) handle, buf, (DWORD) len, &nread, &ov)) {
+		DWORD err = GetLastError();
+		if (err != ERROR_HANDLE_EOF) {
+			return (nni_win_error(err));
+		}
+		nread = 0;
+	}
+	*nreadp = (size_t) nread;
+	return (0);
+}
+
+void
+nni_plat_file_close(void *handle)
+{
+	(void) CloseHandle((HANDLE) handle);
+}
+
 int nni_plat_access(const char* name, int flag)
 {
     return _access(name, flag);
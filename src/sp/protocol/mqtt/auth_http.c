@@ -255,106 +255,614 @@ set_data(
 	}
 }
 
+// Requests to the HTTP auth server are asynchronous.  Each configured
+// endpoint keeps up to pool_size idle keep-alive connections, and answers
+// are remembered for cache_ttl seconds in an LRU list of at most
+// cache_size decisions, keyed by everything that was sent to the server.
+// This state hangs off conf_auth_http and is created on first use, it is
+// released with nmq_auth_http_fini.
+//
+// Only answers from the server are cached.  Connection failures and
+// timeouts are reported as errors, which callers treat as not authorized,
+// so that the next attempt asks the server again.
+
+#define AUTH_HTTP_BODY_MAX 4096 // larger bodies are not read, conn dropped
+
+typedef struct auth_http         auth_http;
+typedef struct auth_http_ep      auth_http_ep;
+typedef struct auth_http_conn    auth_http_conn;
+typedef struct auth_http_op      auth_http_op;
+typedef struct auth_http_verdict auth_http_verdict;
+
+struct auth_http_conn {
+	nng_http_conn *conn;
+	nni_list_node  node;
+};
+
+struct auth_http_ep {
+	conf_auth_http_req *req_conf;
+	nng_url            *url;
+	nng_http_client    *client;
+	nni_list            idle; // most recently used last
+	size_t              nidle;
+};
+
+struct auth_http_verdict {
+	uint64_t      hash;
+	nni_time      expire;
+	bool          allow;
+	char         *key;
+	size_t        keylen;
+	nni_list_node node; // least recently used first
+};
+
+struct auth_http {
+	nni_mtx         mtx;
+	nni_cv          cv;
+	conf_auth_http *conf;
+	auth_http_ep    eps[3]; // auth_req, super_req, acl_req
+	nni_id_map      verdicts;
+	nni_list        lru;
+	size_t          nverdicts;
+	nni_list        ops;
+	int             nops; // not yet freed, may be off the list
+	bool            closed;
+};
+
+enum auth_http_state {
+	AUTH_HTTP_CONNECTING,
+	AUTH_HTTP_SENDING,
+	AUTH_HTTP_RECVING,
+	AUTH_HTTP_RECVING_BODY,
+};
+
+struct auth_http_op {
+	auth_http       *ah;
+	nni_list         uaios;
+	nni_aio         *aio;
+	int              state;
+	auth_http_ep    *eps[2]; // asked in order, the first allow wins
+	int              neps;
+	int              ep;
+	auth_http_conn  *conn;
+	bool             reused;
+	bool             keep; // conn may go back to the pool
+	nng_http_req    *req;
+	nng_http_res    *res;
+	void            *body;
+	size_t           bodylen;
+	auth_http_params params;
+	char            *key;
+	size_t           keylen;
+	uint64_t         hash;
+	nni_list_node    node;
+};
+
+// auth_http_lk protects conf->state, and the caller aio of each op.
+static nni_mtx auth_http_lk = NNI_MTX_INITIALIZER;
+
+static nng_duration
+auth_http_ms(uint64_t seconds)
+{
+	return (seconds == 0 ? NNG_DURATION_DEFAULT
+	                     : (nng_duration) (seconds * 1000));
+}
+
+static void
+auth_http_conn_free(auth_http_conn *c)
+{
+	nng_http_conn_close(c->conn);
+	NNI_FREE_STRUCT(c);
+}
+
 static int
-send_request(conf_auth_http *conf, conf_auth_http_req *conf_req,
-    auth_http_params *params)
+auth_http_get(conf_auth_http *conf, auth_http **ahp)
 {
-	nng_http_client *client = NULL;
-	nng_http_conn *  conn   = NULL;
-	nng_url *        url    = NULL;
-	nng_aio *        aio    = NULL;
-	nng_http_req *   req    = NULL;
-	nng_http_res *   res    = NULL;
-	int              status = 0;
-	int              rv;
-
-	if (((rv = nng_url_parse(&url, conf_req->url)) != 0) ||
-	    ((rv = nng_http_client_alloc(&client, url)) != 0) ||
-	    ((rv = nng_http_req_alloc(&req, url)) != 0) ||
-	    ((rv = nng_http_res_alloc(&res)) != 0) ||
-	    ((rv = nng_aio_alloc(&aio, NULL, NULL)) != 0)) {
-		goto out;
-	}
-
-	// Start connection process...
-	nng_aio_set_timeout(aio, conf->connect_timeout * 1000);
-	nng_http_client_connect(client, aio);
-
-	// Wait for it to finish.
-	// TODO It could cause some problems.
-	nng_aio_wait(aio);
-	if ((rv = nng_aio_result(aio)) != 0) {
-		log_error("Connect failed: %s\n", nng_strerror(rv));
-		goto out;
+	auth_http          *ah;
+	conf_auth_http_req *reqs[3] = { &conf->auth_req, &conf->super_req,
+		&conf->acl_req };
+
+	nni_mtx_lock(&auth_http_lk);
+	if ((ah = conf->state) != NULL) {
+		nni_mtx_unlock(&auth_http_lk);
+		*ahp = ah;
+		return (0);
+	}
+	if ((ah = NNI_ALLOC_STRUCT(ah)) == NULL) {
+		nni_mtx_unlock(&auth_http_lk);
+		return (NNG_ENOMEM);
 	}
+	nni_mtx_init(&ah->mtx);
+	nni_cv_init(&ah->cv, &ah->mtx);
+	nni_id_map_init(&ah->verdicts, 0, 0, false);
+	NNI_LIST_INIT(&ah->lru, auth_http_verdict, node);
+	NNI_LIST_INIT(&ah->ops, auth_http_op, node);
+	ah->conf = conf;
+	for (int i = 0; i < 3; i++) {
+		auth_http_ep *ep = &ah->eps[i];
+		int           rv;
 
-	// Get the connection, at the 0th output.
-	conn = nng_aio_get_output(aio, 0);
+		ep->req_conf = reqs[i];
+		NNI_LIST_INIT(&ep->idle, auth_http_conn, node);
+		if (reqs[i]->url == NULL) {
+			continue;
+		}
+		if (((rv = nng_url_parse(&ep->url, reqs[i]->url)) != 0) ||
+		    ((rv = nng_http_client_alloc(&ep->client, ep->url)) !=
+		        0)) {
+			// Requests to this endpoint will fail.
+			log_error("auth url %s: %s", reqs[i]->url,
+			    nng_strerror(rv));
+		}
+	}
+	conf->state = ah;
+	nni_mtx_unlock(&auth_http_lk);
+	*ahp = ah;
+	return (0);
+}
 
-	// Request is already set up with URL, and for GET via HTTP/1.1.
-	// The Host: header is already set up too.
-	set_data(req, conf_req, params);
-	// Send the request, and wait for that to finish.
-	nng_http_conn_write_req(conn, req, aio);
-	nng_aio_set_timeout(aio, conf->timeout * 1000);
-	// TODO It could cause some problems.
-	nng_aio_wait(aio);
+static void
+auth_http_forget(auth_http *ah, auth_http_verdict *v)
+{
+	nni_id_remove(&ah->verdicts, v->hash);
+	nni_list_remove(&ah->lru, v);
+	ah->nverdicts--;
+	nni_free(v->key, v->keylen);
+	NNI_FREE_STRUCT(v);
+}
+
+static auth_http_verdict *
+auth_http_lookup(auth_http *ah, auth_http_op *op)
+{
+	auth_http_verdict *v;
 
-	if ((rv = nng_aio_result(aio)) != 0) {
-		log_error("Write req failed: %s", nng_strerror(rv));
-		goto out;
+	if (((v = nni_id_get(&ah->verdicts, op->hash)) == NULL) ||
+	    (v->keylen != op->keylen) ||
+	    (memcmp(v->key, op->key, op->keylen) != 0)) {
+		return (NULL);
 	}
+	if (v->expire <= nni_clock()) {
+		auth_http_forget(ah, v);
+		return (NULL);
+	}
+	nni_list_remove(&ah->lru, v);
+	nni_list_append(&ah->lru, v);
+	return (v);
+}
 
-	// Read a response.
-	nng_aio_set_timeout(aio, conf->timeout * 1000);
-	nng_http_conn_read_res(conn, res, aio);
-	// TODO It could cause some problems.
-	nng_aio_wait(aio);
+// auth_http_remember takes the key of op.
+static void
+auth_http_remember(auth_http *ah, auth_http_op *op, bool allow)
+{
+	auth_http_verdict *v;
+	conf_auth_http    *conf = ah->conf;
 
-	if ((rv = nng_aio_result(aio)) != 0) {
-		log_error("Read response: %s", nng_strerror(rv));
-		goto out;
+	if ((conf->cache_ttl == 0) || (conf->cache_size == 0)) {
+		return;
+	}
+	if ((v = nni_id_get(&ah->verdicts, op->hash)) != NULL) {
+		auth_http_forget(ah, v);
 	}
+	if ((v = NNI_ALLOC_STRUCT(v)) == NULL) {
+		return;
+	}
+	if (nni_id_set(&ah->verdicts, op->hash, v) != 0) {
+		NNI_FREE_STRUCT(v);
+		return;
+	}
+	v->hash   = op->hash;
+	v->expire = nni_clock() + conf->cache_ttl * 1000;
+	v->allow  = allow;
+	v->key    = op->key;
+	v->keylen = op->keylen;
+	op->key   = NULL;
+	nni_list_append(&ah->lru, v);
+	ah->nverdicts++;
+	while (ah->nverdicts > conf->cache_size) {
+		auth_http_forget(ah, nni_list_first(&ah->lru));
+	}
+}
+
+// auth_http_op_key copies the parameters that go to the server into one
+// buffer, which is the cache key, and points the params of op into it.
+static int
+auth_http_op_key(auth_http_op *op, const auth_http_params *params)
+{
+	const char  *in[5]  = { params->access, params->clientid,
+                params->username, params->password, params->topic };
+	const char **out[5] = { &op->params.access, &op->params.clientid,
+		&op->params.username, &op->params.password,
+		&op->params.topic };
+	size_t       len    = 0;
+	char        *p;
 
-	if ((status = nng_http_res_get_status(res)) != NNG_HTTP_STATUS_OK) {
-		log_error("HTTP Server Responded: %d %s",
-		    nng_http_res_get_status(res),
-		    nng_http_res_get_reason(res));
-		goto out;
+	for (int i = 0; i < 5; i++) {
+		len += (in[i] == NULL ? 0 : strlen(in[i])) + 1;
+	}
+	if ((op->key = nni_alloc(len)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	op->keylen = len;
+	p          = op->key;
+	for (int i = 0; i < 5; i++) {
+		size_t n = in[i] == NULL ? 0 : strlen(in[i]);
+		memcpy(p, in[i] == NULL ? "" : in[i], n);
+		p[n]    = '\0';
+		*out[i] = in[i] == NULL ? NULL : p;
+		p += n + 1;
 	}
 
-out:
-	if (url) {
-		nng_url_free(url);
+	// FNV-1a
+	op->hash = 14695981039346656037ull;
+	for (size_t i = 0; i < len; i++) {
+		op->hash ^= (uint8_t) op->key[i];
+		op->hash *= 1099511628211ull;
+	}
+	return (0);
+}
+
+static void
+auth_http_op_free(auth_http_op *op)
+{
+	if (op->conn != NULL) {
+		auth_http_conn_free(op->conn);
 	}
-	if (conn) {
-		nng_http_conn_close(conn);
+	if (op->req != NULL) {
+		nng_http_req_free(op->req);
 	}
-	if (client) {
-		nng_http_client_free(client);
+	if (op->res != NULL) {
+		nng_http_res_free(op->res);
 	}
-	if (req) {
-		nng_http_req_free(req);
+	if (op->body != NULL) {
+		nni_free(op->body, op->bodylen);
+	}
+	if (op->key != NULL) {
+		nni_free(op->key, op->keylen);
+	}
+	nni_aio_reap(op->aio);
+	NNI_FREE_STRUCT(op);
+}
+
+// auth_http_finish is called with the lock held, and drops it.
+static void
+auth_http_finish(auth_http_op *op, int rv)
+{
+	auth_http *ah = op->ah;
+	nni_aio   *uaio;
+
+	nni_list_remove(&ah->ops, op);
+	nni_mtx_unlock(&ah->mtx);
+
+	nni_mtx_lock(&auth_http_lk);
+	if ((uaio = nni_list_first(&op->uaios)) != NULL) {
+		nni_aio_list_remove(uaio);
 	}
-	if (res) {
-		nng_http_res_free(res);
+	nni_mtx_unlock(&auth_http_lk);
+	auth_http_op_free(op);
+
+	// Only now, so that nmq_auth_http_fini does not return before
+	// the aio of op is handed to the reaper.
+	nni_mtx_lock(&ah->mtx);
+	if ((--ah->nops == 0) && ah->closed) {
+		nni_cv_wake(&ah->cv);
 	}
-	if (aio) {
-		nng_aio_free(aio);
+	nni_mtx_unlock(&ah->mtx);
+	if (uaio != NULL) {
+		nni_aio_finish(uaio, rv, 0);
 	}
+}
 
-	return status;
+// auth_http_orphaned is true once the caller has given up on op.
+static bool
+auth_http_orphaned(auth_http_op *op)
+{
+	bool orphaned;
+
+	nni_mtx_lock(&auth_http_lk);
+	orphaned = nni_list_empty(&op->uaios);
+	nni_mtx_unlock(&auth_http_lk);
+	return (orphaned);
 }
 
-/**
- * NNG_HTTP_STATUS_OK returns CONNACK
- * otherwise disconnect
- * */
-int
-nmq_auth_http_connect(conn_param *cparam, conf_auth_http *conf)
+static void
+auth_http_connect(auth_http_op *op)
+{
+	auth_http_ep *ep = op->eps[op->ep];
+
+	op->reused = false;
+	op->state  = AUTH_HTTP_CONNECTING;
+	nni_aio_set_timeout(
+	    op->aio, auth_http_ms(op->ah->conf->connect_timeout));
+	nng_http_client_connect(ep->client, op->aio);
+}
+
+// auth_http_send starts asking the current endpoint, on a pooled
+// connection if there is one.  Lock held.
+static int
+auth_http_send(auth_http_op *op)
+{
+	auth_http_ep *ep = op->eps[op->ep];
+	int           rv;
+
+	if (ep->client == NULL) {
+		return (NNG_EADDRINVAL);
+	}
+	if (op->req != NULL) {
+		nng_http_req_free(op->req);
+		op->req = NULL;
+	}
+	if (((rv = nng_http_req_alloc(&op->req, ep->url)) != 0) ||
+	    ((op->ah->conf->pool_size == 0) &&
+	        ((rv = nng_http_req_set_header(
+	              op->req, "Connection", "close")) != 0))) {
+		return (rv);
+	}
+	set_data(op->req, ep->req_conf, &op->params);
+
+	if ((op->conn = nni_list_last(&ep->idle)) != NULL) {
+		nni_list_remove(&ep->idle, op->conn);
+		ep->nidle--;
+		op->reused = true;
+		op->state  = AUTH_HTTP_SENDING;
+		nni_aio_set_timeout(
+		    op->aio, auth_http_ms(op->ah->conf->timeout));
+		nng_http_conn_write_req(op->conn->conn, op->req, op->aio);
+		return (0);
+	}
+	auth_http_connect(op);
+	return (0);
+}
+
+// auth_http_release puts the connection of op back in the pool, or closes
+// it.  Lock held.
+static void
+auth_http_release(auth_http_op *op)
+{
+	auth_http    *ah = op->ah;
+	auth_http_ep *ep = op->eps[op->ep];
+
+	if (op->keep && !ah->closed && (ep->nidle < ah->conf->pool_size)) {
+		nni_list_append(&ep->idle, op->conn);
+		ep->nidle++;
+	} else {
+		auth_http_conn_free(op->conn);
+	}
+	op->conn = NULL;
+}
+
+static void
+auth_http_cb(void *arg)
+{
+	auth_http_op *op = arg;
+	auth_http    *ah = op->ah;
+	const char   *str;
+	char         *end;
+	uint64_t      len;
+	uint16_t      status;
+	nng_iov       iov;
+	int           rv;
+
+	nni_mtx_lock(&ah->mtx);
+	if (ah->closed) {
+		rv = NNG_ECLOSED;
+		goto error;
+	}
+	if ((rv = nni_aio_result(op->aio)) != 0) {
+		goto error;
+	}
+	switch (op->state) {
+	case AUTH_HTTP_CONNECTING:
+		if ((op->conn = NNI_ALLOC_STRUCT(op->conn)) == NULL) {
+			nng_http_conn_close(nni_aio_get_output(op->aio, 0));
+			rv = NNG_ENOMEM;
+			goto error;
+		}
+		op->conn->conn = nni_aio_get_output(op->aio, 0);
+		op->state      = AUTH_HTTP_SENDING;
+		nni_aio_set_timeout(op->aio, auth_http_ms(ah->conf->timeout));
+		nng_http_conn_write_req(op->conn->conn, op->req, op->aio);
+		nni_mtx_unlock(&ah->mtx);
+		return;
+
+	case AUTH_HTTP_SENDING:
+		if (op->res != NULL) {
+			nng_http_res_free(op->res);
+			op->res = NULL;
+		}
+		if ((rv = nng_http_res_alloc(&op->res)) != 0) {
+			goto error;
+		}
+		op->state = AUTH_HTTP_RECVING;
+		nng_http_conn_read_res(op->conn->conn, op->res, op->aio);
+		nni_mtx_unlock(&ah->mtx);
+		return;
+
+	case AUTH_HTTP_RECVING:
+		// The body, if any, has to be read for the connection to be
+		// good for another request.  Chunked or large bodies are not
+		// worth it, the connection is dropped instead.
+		op->keep = (((str = nng_http_res_get_header(
+		                  op->res, "Connection")) == NULL) ||
+		               (nni_strcasestr(str, "close") == NULL)) &&
+		    (nng_http_res_get_header(op->res, "Transfer-Encoding") ==
+		        NULL);
+		if (op->keep &&
+		    ((str = nng_http_res_get_header(
+		          op->res, "Content-Length")) != NULL) &&
+		    ((len = (uint64_t) strtoull(str, &end, 10)) != 0)) {
+			if ((*end != '\0') || (len > AUTH_HTTP_BODY_MAX) ||
+			    ((op->body = nni_alloc((size_t) len)) == NULL)) {
+				op->keep = false;
+				break;
+			}
+			op->bodylen = (size_t) len;
+			iov.iov_buf = op->body;
+			iov.iov_len = op->bodylen;
+			nni_aio_set_iov(op->aio, 1, &iov);
+			op->state = AUTH_HTTP_RECVING_BODY;
+			nng_http_conn_read_all(op->conn->conn, op->aio);
+			nni_mtx_unlock(&ah->mtx);
+			return;
+		}
+		break;
+
+	case AUTH_HTTP_RECVING_BODY:
+		break;
+	}
+
+	if (op->body != NULL) {
+		nni_free(op->body, op->bodylen);
+		op->body = NULL;
+	}
+	auth_http_release(op);
+	if ((status = nng_http_res_get_status(op->res)) ==
+	    NNG_HTTP_STATUS_OK) {
+		auth_http_remember(ah, op, true);
+		auth_http_finish(op, 0);
+		return;
+	}
+	log_error("HTTP Server Responded: %d %s", status,
+	    nng_http_res_get_reason(op->res));
+	if (++op->ep < op->neps) {
+		if ((rv = auth_http_send(op)) == 0) {
+			nni_mtx_unlock(&ah->mtx);
+			return;
+		}
+		auth_http_finish(op, rv);
+		return;
+	}
+	auth_http_remember(ah, op, false);
+	auth_http_finish(op, NNG_EPERM);
+	return;
+
+error:
+	if (op->conn != NULL) {
+		auth_http_conn_free(op->conn);
+		op->conn = NULL;
+	}
+	if (ah->closed || auth_http_orphaned(op)) {
+		auth_http_finish(op, rv);
+		return;
+	}
+	// The server may have closed a pooled connection while it sat idle.
+	if (op->reused && (rv != NNG_ETIMEDOUT)) {
+		auth_http_connect(op);
+		nni_mtx_unlock(&ah->mtx);
+		return;
+	}
+	log_error("auth request to %s failed: %s",
+	    op->eps[op->ep]->req_conf->url, nng_strerror(rv));
+	while (++op->ep < op->neps) {
+		if (auth_http_send(op) == 0) {
+			nni_mtx_unlock(&ah->mtx);
+			return;
+		}
+	}
+	auth_http_finish(op, rv);
+}
+
+static void
+auth_http_cancel(nni_aio *aio, void *arg, int rv)
 {
+	auth_http_op *op = arg;
+
+	nni_mtx_lock(&auth_http_lk);
+	if (nni_aio_list_active(aio)) {
+		nni_aio_list_remove(aio);
+		nni_aio_abort(op->aio, rv);
+		nni_mtx_unlock(&auth_http_lk);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_mtx_unlock(&auth_http_lk);
+}
+
+// auth_http_start asks the endpoints of eps in order, unless the answer
+// is already cached.  The aio completes with 0 on the first 200 response,
+// with NNG_EPERM if every endpoint said something else, or with the error
+// of the last endpoint that could not be asked.
+static void
+auth_http_start(conf_auth_http *conf, int *eps, int neps,
+    auth_http_params *params, nni_aio *aio)
+{
+	auth_http         *ah;
+	auth_http_op      *op;
+	auth_http_verdict *v;
+	int                rv;
+
+	if (nni_aio_begin(aio) != 0) {
+		return;
+	}
+	if ((rv = auth_http_get(conf, &ah)) != 0) {
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	if ((op = NNI_ALLOC_STRUCT(op)) == NULL) {
+		nni_aio_finish_error(aio, NNG_ENOMEM);
+		return;
+	}
+	if (((rv = auth_http_op_key(op, params)) != 0) ||
+	    ((rv = nni_aio_alloc(&op->aio, auth_http_cb, op)) != 0)) {
+		if (op->key != NULL) {
+			nni_free(op->key, op->keylen);
+		}
+		NNI_FREE_STRUCT(op);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_list_init(&op->uaios);
+	op->ah = ah;
+	for (int i = 0; i < neps; i++) {
+		op->eps[i] = &ah->eps[eps[i]];
+	}
+	op->neps = neps;
+
+	nni_mtx_lock(&ah->mtx);
+	if (ah->closed) {
+		nni_mtx_unlock(&ah->mtx);
+		auth_http_op_free(op);
+		nni_aio_finish_error(aio, NNG_ECLOSED);
+		return;
+	}
+	if ((v = auth_http_lookup(ah, op)) != NULL) {
+		rv = v->allow ? 0 : NNG_EPERM;
+		nni_mtx_unlock(&ah->mtx);
+		auth_http_op_free(op);
+		nni_aio_finish(aio, rv, 0);
+		return;
+	}
+	nni_mtx_lock(&auth_http_lk);
+	if ((rv = nni_aio_schedule(aio, auth_http_cancel, op)) != 0) {
+		nni_mtx_unlock(&auth_http_lk);
+		nni_mtx_unlock(&ah->mtx);
+		auth_http_op_free(op);
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_list_append(&op->uaios, aio);
+	nni_mtx_unlock(&auth_http_lk);
+	nni_list_append(&ah->ops, op);
+	ah->nops++;
+	while ((rv = auth_http_send(op)) != 0) {
+		if (++op->ep == op->neps) {
+			auth_http_finish(op, rv);
+			return;
+		}
+	}
+	nni_mtx_unlock(&ah->mtx);
+}
+
+void
+nmq_auth_http_connect_aio(
+    conn_param *cparam, conf_auth_http *conf, nng_aio *aio)
+{
+	int eps[1] = { 0 };
+
 	if (conf->enable == false || conf->auth_req.url == NULL) {
-		return NNG_HTTP_STATUS_OK;
+		if (nni_aio_begin(aio) == 0) {
+			nni_aio_finish(aio, 0, 0);
+		}
+		return;
 	}
 
 	auth_http_params auth_params = {
@@ -369,9 +877,28 @@ nmq_auth_http_connect(conn_param *cparam, conf_auth_http *conf)
 		// .subject = ,
 	};
 
-	int status = send_request(conf, &conf->auth_req, &auth_params);
+	auth_http_start(conf, eps, 1, &auth_params, aio);
+}
+
+/**
+ * NNG_HTTP_STATUS_OK returns CONNACK
+ * otherwise disconnect
+ * */
+int
+nmq_auth_http_connect(conn_param *cparam, conf_auth_http *conf)
+{
+	nng_aio *aio;
+	int      rv;
+
+	if ((rv = nng_aio_alloc(&aio, NULL, NULL)) != 0) {
+		return NOT_AUTHORIZED;
+	}
+	nmq_auth_http_connect_aio(cparam, conf, aio);
+	nng_aio_wait(aio);
+	rv = nng_aio_result(aio);
+	nng_aio_free(aio);
 
-	return status == NNG_HTTP_STATUS_OK ? SUCCESS : NOT_AUTHORIZED;
+	return rv == 0 ? SUCCESS : NOT_AUTHORIZED;
 }
 
 char *parse_topics(topic_queue *head)
@@ -408,19 +935,27 @@ char *parse_topics(topic_queue *head)
 	return result;
 }
 
-int
-nmq_auth_http_sub_pub(
-    conn_param *cparam, bool is_sub, topic_queue *topics, conf_auth_http *conf)
+void
+nmq_auth_http_sub_pub_aio(conn_param *cparam, bool is_sub,
+    topic_queue *topics, conf_auth_http *conf, nng_aio *aio)
 {
-	if (conf->enable == false ||
-	    (conf->super_req.url == NULL && conf->acl_req.url == NULL)) {
-		return SUCCESS;
-	}
+	int   eps[2];
+	int   neps = 0;
+	char *topic_str;
 
-	char *topic_str = parse_topics(topics);
-	if (topic_str == NULL) {
-		return SUCCESS;
+	// Without an acl_req everything is allowed, whatever super_req
+	// would say.
+	if (conf->enable == false || conf->acl_req.url == NULL ||
+	    (topic_str = parse_topics(topics)) == NULL) {
+		if (nni_aio_begin(aio) == 0) {
+			nni_aio_finish(aio, 0, 0);
+		}
+		return;
 	}
+	if (conf->super_req.url != NULL) {
+		eps[neps++] = 1;
+	}
+	eps[neps++] = 2;
 
 	auth_http_params auth_params = {
 		.clientid = (const char *) conn_param_get_clientid(cparam),
@@ -436,20 +971,73 @@ nmq_auth_http_sub_pub(
 		// .common = ,
 		// .subject = ,
 	};
-	int status = 0;
-	if (conf->super_req.url) {
-		status = send_request(conf, &conf->super_req, &auth_params);
-		if (status == NNG_HTTP_STATUS_OK) {
-			nni_free(topic_str, strlen(topic_str) + 1);
-			return SUCCESS;
-		}
+
+	auth_http_start(conf, eps, neps, &auth_params, aio);
+	free(topic_str);
+}
+
+int
+nmq_auth_http_sub_pub(
+    conn_param *cparam, bool is_sub, topic_queue *topics, conf_auth_http *conf)
+{
+	nng_aio *aio;
+	int      rv;
+
+	if ((rv = nng_aio_alloc(&aio, NULL, NULL)) != 0) {
+		return NOT_AUTHORIZED;
 	}
+	nmq_auth_http_sub_pub_aio(cparam, is_sub, topics, conf, aio);
+	nng_aio_wait(aio);
+	rv = nng_aio_result(aio);
+	nng_aio_free(aio);
 
-	status = conf->acl_req.url == NULL
-	    ? NNG_HTTP_STATUS_OK
-	    : send_request(conf, &conf->acl_req, &auth_params);
+	return rv == 0 ? SUCCESS : NOT_AUTHORIZED;
+}
 
-	nni_free(topic_str, strlen(topic_str) + 1);
+void
+nmq_auth_http_fini(conf_auth_http *conf)
+{
+	auth_http         *ah;
+	auth_http_op      *op;
+	auth_http_conn    *c;
+	auth_http_verdict *v;
 
-	return status == NNG_HTTP_STATUS_OK ? SUCCESS : NOT_AUTHORIZED;
+	nni_mtx_lock(&auth_http_lk);
+	ah          = conf->state;
+	conf->state = NULL;
+	nni_mtx_unlock(&auth_http_lk);
+	if (ah == NULL) {
+		return;
+	}
+
+	nni_mtx_lock(&ah->mtx);
+	ah->closed = true;
+	NNI_LIST_FOREACH (&ah->ops, op) {
+		nni_aio_abort(op->aio, NNG_ECLOSED);
+	}
+	while (ah->nops != 0) {
+		nni_cv_wait(&ah->cv);
+	}
+	while ((v = nni_list_first(&ah->lru)) != NULL) {
+		auth_http_forget(ah, v);
+	}
+	nni_mtx_unlock(&ah->mtx);
+
+	for (int i = 0; i < 3; i++) {
+		auth_http_ep *ep = &ah->eps[i];
+		while ((c = nni_list_first(&ep->idle)) != NULL) {
+			nni_list_remove(&ep->idle, c);
+			auth_http_conn_free(c);
+		}
+		if (ep->client != NULL) {
+			nng_http_client_free(ep->client);
+		}
+		if (ep->url != NULL) {
+			nng_url_free(ep->url);
+		}
+	}
+	nni_id_map_fini(&ah->verdicts);
+	nni_cv_fini(&ah->cv);
+	nni_mtx_fini(&ah->mtx);
+	NNI_FREE_STRUCT(ah);
 }
@@ -1,4 +1,7 @@
+#include "core/nng_impl.h"
+#include "supplemental/http/http_api.h"
 #include "nng/protocol/mqtt/mqtt_parser.h"
+#include "nng/supplemental/http/http.h"
 #include <nuts.h>
 
 static void conf_auth_http_init(conf_auth_http **conf)
@@ -7,9 +10,12 @@ static void conf_auth_http_init(conf_auth_http **conf)
 	if (*conf == NULL) {
 		return;
 	}
+	memset(*conf, 0, sizeof(conf_auth_http));
 	(*conf)->enable = true;
 	(*conf)->acl_req.header_count = 0;
 	(*conf)->auth_req.header_count = 0;
+	(*conf)->timeout = 1;
+	(*conf)->connect_timeout = 1;
 
 	return;
 }
@@ -46,6 +52,7 @@ void test_auth_http_connect(void)
 	/* send_request will be failed */
 	NUTS_TRUE(rc != 0);
 
+	nmq_auth_http_fini(conf);
 	nng_free(conf->auth_req.url, strlen(conf->auth_req.url) + 1);
 	nng_free(conf, sizeof(conf_auth_http));
 	conn_param_free(conn_param);
@@ -82,6 +89,7 @@ void test_auth_http_sub_pub(void)
 	NUTS_TRUE(rc != 0);
 
 	topic_queue_release(tq);
+	nmq_auth_http_fini(conf);
 	nng_free(conf->acl_req.url, strlen(conf->acl_req.url) + 1);
 	nng_free(conf, sizeof(conf_auth_http));
 	conn_param_free(conn_param);
@@ -89,8 +97,275 @@ void test_auth_http_sub_pub(void)
 	return;
 }
 
+// A stub auth server, which allows everybody but the user "bad", and
+// counts the requests and the connections they came in on.
+
+#define STUB_PORTS 64
+
+typedef struct {
+	nng_http_server  *server;
+	nng_http_handler *handler;
+	char              url[64];
+	nni_mtx           mtx;
+	int               hits;
+	uint16_t          ports[STUB_PORTS];
+	int               nports;
+} auth_stub;
+
+static auth_stub stub;
+
+static void
+stub_cb(nng_aio *aio)
+{
+	nng_http_req *req  = nng_aio_get_input(aio, 0);
+	nng_http_conn *conn = nng_aio_get_input(aio, 2);
+	nng_http_res *res;
+	nng_sockaddr  sa;
+	size_t        sz = sizeof(sa);
+	void         *body;
+	size_t        len;
+	const char   *answer = "{\"result\": \"allow\"}";
+	uint16_t      status = NNG_HTTP_STATUS_OK;
+	int           rv;
+
+	nng_http_req_get_data(req, &body, &len);
+	for (size_t i = 0; i + 12 <= len; i++) {
+		if (memcmp((char *) body + i, "username=bad", 12) == 0) {
+			answer = "{\"result\": \"deny\"}";
+			status = NNG_HTTP_STATUS_FORBIDDEN;
+		}
+	}
+
+	nni_mtx_lock(&stub.mtx);
+	stub.hits++;
+	if (nni_http_conn_getopt(conn, NNG_OPT_REMADDR, &sa, &sz,
+	        NNI_TYPE_SOCKADDR) == 0) {
+		int i;
+		for (i = 0; i < stub.nports; i++) {
+			if (stub.ports[i] == sa.s_in.sa_port) {
+				break;
+			}
+		}
+		if ((i == stub.nports) && (i < STUB_PORTS)) {
+			stub.ports[stub.nports++] = sa.s_in.sa_port;
+		}
+	}
+	nni_mtx_unlock(&stub.mtx);
+
+	if (((rv = nng_http_res_alloc(&res)) != 0) ||
+	    ((rv = nng_http_res_copy_data(res, answer, strlen(answer))) !=
+	        0) ||
+	    ((rv = nng_http_res_set_status(res, status)) != 0)) {
+		nng_aio_finish(aio, rv);
+		return;
+	}
+	nng_aio_set_output(aio, 0, res);
+	nng_aio_finish(aio, 0);
+}
+
+static void
+stub_start(void)
+{
+	nng_url *url;
+
+	memset(&stub, 0, sizeof(stub));
+	nni_mtx_init(&stub.mtx);
+	(void) snprintf(stub.url, sizeof(stub.url),
+	    "http://127.0.0.1:%u/mqtt/auth", nuts_next_port());
+	NUTS_PASS(nng_url_parse(&url, stub.url));
+	NUTS_PASS(nng_http_server_hold(&stub.server, url));
+	NUTS_PASS(nng_http_handler_alloc(&stub.handler, url->u_path, stub_cb));
+	NUTS_PASS(nng_http_handler_set_method(stub.handler, "POST"));
+	NUTS_PASS(nng_http_server_add_handler(stub.server, stub.handler));
+	NUTS_PASS(nng_http_server_start(stub.server));
+	nng_url_free(url);
+}
+
+static void
+stub_stop(void)
+{
+	nng_http_server_stop(stub.server);
+	nng_http_server_release(stub.server);
+	nni_mtx_fini(&stub.mtx);
+}
+
+static int
+stub_hits(void)
+{
+	int n;
+	nni_mtx_lock(&stub.mtx);
+	n = stub.hits;
+	nni_mtx_unlock(&stub.mtx);
+	return (n);
+}
+
+static conf_http_header  stub_header = { "Accept", "application/json" };
+static conf_http_header *stub_headers[] = { &stub_header };
+static conf_http_param   stub_param_clientid = { "clientid", CLIENTID };
+static conf_http_param   stub_param_username = { "username", USERNAME };
+static conf_http_param  *stub_params[] = { &stub_param_clientid,
+	 &stub_param_username };
+
+static conf_auth_http *
+stub_conf(size_t pool_size, uint64_t cache_ttl, size_t cache_size)
+{
+	conf_auth_http *conf;
+
+	conf_auth_http_init(&conf);
+	NUTS_ASSERT(conf != NULL);
+	conf->auth_req.url          = stub.url;
+	conf->auth_req.method       = "post";
+	conf->auth_req.headers      = stub_headers;
+	conf->auth_req.header_count = 1;
+	conf->auth_req.params       = stub_params;
+	conf->auth_req.param_count  = 2;
+	conf->pool_size             = pool_size;
+	conf->cache_ttl             = cache_ttl;
+	conf->cache_size            = cache_size;
+	return (conf);
+}
+
+static int
+stub_connect(conf_auth_http *conf, const char *clientid, const char *user)
+{
+	conn_param *cp;
+	int         rv;
+
+	NUTS_PASS(conn_param_alloc(&cp));
+	conn_param_set_clientid(cp, clientid);
+	conn_param_set_username(cp, user);
+	conn_param_set_password(cp, "password");
+	cp->con_flag |= 0xc0; // username and password present
+	rv = nmq_auth_http_connect(cp, conf);
+	conn_param_free(cp);
+	return (rv);
+}
+
+void
+test_auth_http_pool(void)
+{
+	conf_auth_http *conf;
+
+	NUTS_PASS(nni_init());
+	stub_start();
+	conf = stub_conf(4, 0, 0);
+
+	// Without the cache every request goes to the server, but all of
+	// them on the same connection.
+	for (int i = 0; i < 10; i++) {
+		NUTS_TRUE(
+		    stub_connect(conf, "clientid", "username") == SUCCESS);
+	}
+	NUTS_TRUE(stub_hits() == 10);
+	NUTS_TRUE(stub.nports == 1);
+	NUTS_TRUE(stub_connect(conf, "clientid", "bad") == NOT_AUTHORIZED);
+	NUTS_TRUE(stub_hits() == 11);
+	NUTS_TRUE(stub.nports == 1);
+
+	nmq_auth_http_fini(conf);
+	nng_free(conf, sizeof(conf_auth_http));
+
+	// Without a pool every request gets its own connection.
+	conf = stub_conf(0, 0, 0);
+	for (int i = 0; i < 3; i++) {
+		NUTS_TRUE(
+		    stub_connect(conf, "clientid", "username") == SUCCESS);
+	}
+	NUTS_TRUE(stub_hits() == 14);
+	NUTS_TRUE(stub.nports == 4);
+
+	nmq_auth_http_fini(conf);
+	nng_free(conf, sizeof(conf_auth_http));
+	stub_stop();
+	nng_fini();
+}
+
+void
+test_auth_http_cache(void)
+{
+	conf_auth_http *conf;
+
+	NUTS_PASS(nni_init());
+	stub_start();
+	conf = stub_conf(4, 60, 2);
+
+	// Both answers are remembered.
+	for (int i = 0; i < 5; i++) {
+		NUTS_TRUE(stub_connect(conf, "a", "username") == SUCCESS);
+		NUTS_TRUE(stub_connect(conf, "a", "bad") == NOT_AUTHORIZED);
+	}
+	NUTS_TRUE(stub_hits() == 2);
+
+	// The least recently used decision goes first.
+	NUTS_TRUE(stub_connect(conf, "b", "username") == SUCCESS);
+	NUTS_TRUE(stub_hits() == 3);
+	NUTS_TRUE(stub_connect(conf, "a", "bad") == NOT_AUTHORIZED);
+	NUTS_TRUE(stub_hits() == 3);
+	NUTS_TRUE(stub_connect(conf, "a", "username") == SUCCESS);
+	NUTS_TRUE(stub_hits() == 4);
+
+	nmq_auth_http_fini(conf);
+	nng_free(conf, sizeof(conf_auth_http));
+
+	// And forgotten once they expire.
+	conf = stub_conf(4, 1, 16);
+	NUTS_TRUE(stub_connect(conf, "a", "username") == SUCCESS);
+	NUTS_TRUE(stub_connect(conf, "a", "username") == SUCCESS);
+	NUTS_TRUE(stub_hits() == 5);
+	nng_msleep(1100);
+	NUTS_TRUE(stub_connect(conf, "a", "username") == SUCCESS);
+	NUTS_TRUE(stub_hits() == 6);
+
+	nmq_auth_http_fini(conf);
+	nng_free(conf, sizeof(conf_auth_http));
+	stub_stop();
+	nng_fini();
+}
+
+#define ASYNC_CLIENTS 16
+
+void
+test_auth_http_async(void)
+{
+	conf_auth_http *conf;
+	conn_param     *cp;
+	nng_aio        *aios[ASYNC_CLIENTS];
+	char            clientid[16];
+
+	NUTS_PASS(nni_init());
+	stub_start();
+	conf = stub_conf(4, 60, 1024);
+
+	// All of them are in flight at once, and finish on their own.
+	for (int i = 0; i < ASYNC_CLIENTS; i++) {
+		NUTS_PASS(nng_aio_alloc(&aios[i], NULL, NULL));
+		NUTS_PASS(conn_param_alloc(&cp));
+		(void) snprintf(clientid, sizeof(clientid), "client%d", i);
+		conn_param_set_clientid(cp, clientid);
+		conn_param_set_username(cp, i % 2 ? "bad" : "username");
+		cp->con_flag |= 0x80;
+		nmq_auth_http_connect_aio(cp, conf, aios[i]);
+		conn_param_free(cp);
+	}
+	for (int i = 0; i < ASYNC_CLIENTS; i++) {
+		nng_aio_wait(aios[i]);
+		NUTS_FAIL(nng_aio_result(aios[i]), i % 2 ? NNG_EPERM : 0);
+		nng_aio_free(aios[i]);
+	}
+	NUTS_TRUE(stub_hits() == ASYNC_CLIENTS);
+	NUTS_TRUE(stub.nports <= ASYNC_CLIENTS);
+
+	nmq_auth_http_fini(conf);
+	nng_free(conf, sizeof(conf_auth_http));
+	stub_stop();
+	nng_fini();
+}
+
 NUTS_TESTS = {
 	{ "auth_http_connect", test_auth_http_connect },
 	{ "auth_http_sub_pub", test_auth_http_sub_pub },
+	{ "auth_http_pool", test_auth_http_pool },
+	{ "auth_http_cache", test_auth_http_cache },
+	{ "auth_http_async", test_auth_http_async },
 	{ NULL, NULL },
 };
@@ -1958,6 +1958,52 @@ topic_parse(const char *topic)
 }
 
 
+/**
+ * @brief match topic against filter level by level, in place.
+ * 	  Same semantics as check_ifwildcard, without splitting
+ * 	  either of them into allocated token arrays.
+ *
+ * @param f filter (may contain + and #), not NUL terminated
+ * @param flen length of filter
+ * @param t topic from publish, not NUL terminated
+ * @param tlen length of topic
+ */
+bool
+topic_match_levels(const char *f, size_t flen, const char *t, size_t tlen)
+{
+	const char *fe = f + flen;
+	const char *te = t + tlen;
+
+	for (;;) {
+		const char *fl, *tl;
+
+		if ((fl = memchr(f, '/', fe - f)) == NULL) {
+			fl = fe;
+		}
+		if ((tl = memchr(t, '/', te - t)) == NULL) {
+			tl = te;
+		}
+		if ((fl - f) != (tl - t) || memcmp(f, t, fl - f) != 0) {
+			if (fl - f == 1 && *f == '#') {
+				return true;
+			}
+			if (fl - f != 1 || *f != '+') {
+				return false;
+			}
+		}
+		if (fl == fe) {
+			// filter exhausted, match only if topic is too
+			return (tl == te);
+		}
+		f = fl + 1;
+		if (tl == te) {
+			// topic exhausted, parent level matches "a/#"
+			return (fe > f && *f == '#' && (fe - f == 1 || f[1] == '/'));
+		}
+		t = tl + 1;
+	}
+}
+
 bool
 check_ifwildcard(const char *w, const char *n)
 {
@@ -2021,7 +2067,7 @@ topic_filter(const char *origin, const char *input)
 	if (strcmp(origin, input) == 0) {
 		return true;
 	}
-	return check_ifwildcard(origin, input);
+	return topic_match_levels(origin, strlen(origin), input, strlen(input));
 }
 
 bool
@@ -2030,18 +2076,14 @@ topic_filtern(const char *origin, const char *input, size_t n)
 	// Wrong topic or invalid topic alias
 	if (input == NULL || origin == NULL)
 		return false;
-		
-	char *buff = nni_zalloc(n + 1);
-	strncpy(buff, input, n);
-	bool res = false;
+
 	size_t len = strlen(origin);
+	// input is not NUL terminated, but might be shorter than n
+	n = nni_strnlen(input, n);
 	if (len == n && strncmp(origin, input, n) == 0) {
-		res = true;
-	} else {
-		res = check_ifwildcard(origin, buff);
+		return true;
 	}
-	nni_free(buff, n + 1);
-	return res;
+	return topic_match_levels(origin, len, input, n);
 }
 
 /**
@@ -1,7 +1,10 @@
+#include "core/nng_impl.h"
+#include "core/sockimpl.h"
 #include "nng/protocol/mqtt/mqtt_parser.h"
 #include <assert.h>
 #include <nuts.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 static void test_pub_extra()
 {
@@ -165,6 +168,311 @@ test_topic_filtern()
 	NUTS_ASSERT(topic_filtern(orgin, input, 11) == false);
 }
 
+static void
+test_topic_filter_wildcard()
+{
+	NUTS_ASSERT(topic_filter("a/+/c", "a/b/c") == true);
+	NUTS_ASSERT(topic_filter("a/+/c", "a/b/d") == false);
+	NUTS_ASSERT(topic_filter("a/+", "a/b/c") == false);
+	NUTS_ASSERT(topic_filter("a/#", "a") == true);
+	NUTS_ASSERT(topic_filter("a/#", "a/b/c") == true);
+	NUTS_ASSERT(topic_filter("a/#", "ab") == false);
+	NUTS_ASSERT(topic_filter("#", "a/b") == true);
+	NUTS_ASSERT(topic_filter("+/+", "a/b") == true);
+	NUTS_ASSERT(topic_filter("+", "a/b") == false);
+	NUTS_ASSERT(topic_filter("a/b", "a/b/") == false);
+	NUTS_ASSERT(topic_filter("a/+/", "a/b/") == true);
+	NUTS_ASSERT(topic_filtern("a/+/c", "a/b/cd", 5) == true);
+	NUTS_ASSERT(topic_filtern("a/#", "a/b/c", 1) == true);
+}
+
+static struct subinfo *
+subinfo_add(nni_list *l, const char *topic, uint8_t qos, int subid)
+{
+	struct subinfo *info;
+
+	NUTS_TRUE((info = nni_zalloc(sizeof(*info))) != NULL);
+	NUTS_TRUE((info->topic = nni_strdup(topic)) != NULL);
+	info->qos   = qos;
+	info->subid = subid;
+	NNI_LIST_NODE_INIT(&info->node);
+	nni_list_append(l, info);
+	return (info);
+}
+
+static void
+subinfo_free_all(nni_list *l)
+{
+	struct subinfo *info;
+
+	while ((info = nni_list_first(l)) != NULL) {
+		nni_list_remove(l, info);
+		nni_strfree(info->topic);
+		nni_free(info, sizeof(*info));
+	}
+}
+
+static void
+test_subtrie_match()
+{
+	nni_list     l;
+	nmq_subtrie *t;
+	uint8_t      qos;
+	uint32_t     subid;
+
+	NNI_LIST_INIT(&l, struct subinfo, node);
+	subinfo_add(&l, "a/b/c", 0, 1);
+	subinfo_add(&l, "a/+/c", 1, 2);
+	subinfo_add(&l, "a/#", 2, 3);
+	subinfo_add(&l, "$share/g1/x/+", 1, 4);
+	subinfo_add(&l, "y/#", 1, 5);
+
+	NUTS_PASS(nmq_subtrie_build(&t, &l));
+	NUTS_TRUE(nmq_subtrie_match(t, "a/b/c", 5, &qos, &subid) == 3);
+	NUTS_TRUE(qos == 2);
+	NUTS_TRUE(subid == 3);
+	NUTS_TRUE(nmq_subtrie_match(t, "a", 1, &qos, NULL) == 1);
+	// Shared filters only match as written, like topic_filtern.
+	NUTS_TRUE(nmq_subtrie_match(t, "x/z", 3, &qos, &subid) == 0);
+	NUTS_TRUE(
+	    nmq_subtrie_match(t, "$share/g1/x/z", 13, &qos, &subid) == 1);
+	NUTS_TRUE(qos == 1 && subid == 4);
+	NUTS_TRUE(nmq_subtrie_match(t, "y", 1, &qos, NULL) == 1);
+	// topic is not NUL terminated
+	NUTS_TRUE(nmq_subtrie_match(t, "yz", 1, &qos, NULL) == 1);
+	NUTS_TRUE(nmq_subtrie_match(t, "b/a", 3, &qos, NULL) == 0);
+	nmq_subtrie_free(t);
+
+	subinfo_free_all(&l);
+}
+
+// The QoS an offline session grants a publish, through the trie and
+// through the list walk used when the trie cannot be built.
+static void
+test_subinfo_match_offline()
+{
+	nni_list     l;
+	nmq_subtrie *t = NULL;
+	uint8_t      qos;
+
+	NNI_LIST_INIT(&l, struct subinfo, node);
+	subinfo_add(&l, "$share/g1/t/+", 2, 1);
+	subinfo_add(&l, "a/#", 1, 2);
+	subinfo_add(&l, "a/b", 2, 3);
+
+	for (int i = 0; i < 2; i++) {
+		nmq_subtrie **tp = i == 0 ? &t : NULL;
+
+		qos = 0;
+		NUTS_TRUE(nmq_subinfo_match(tp, &l, "t/x", 3, &qos) == 0);
+		NUTS_TRUE(qos == 0);
+		NUTS_TRUE(nmq_subinfo_match(tp, &l, "a/c", 3, &qos) == 1);
+		NUTS_TRUE(qos == 1);
+		NUTS_TRUE(nmq_subinfo_match(tp, &l, "a/b", 3, &qos) == 2);
+		NUTS_TRUE(qos == 2);
+	}
+	NUTS_TRUE(t != NULL);
+	nmq_subtrie_free(t);
+	subinfo_free_all(&l);
+}
+
+// A copy of the matcher that the offline session path used before the
+// trie: it splits filter and topic into allocated level arrays for every
+// filter it tries.  Kept here only as the baseline of the benchmark.
+static char **
+old_topic_parse(const char *topic)
+{
+	int         cnt = 1;
+	int         row = 0;
+	const char *b   = topic;
+	const char *pos;
+	char      **q;
+
+	for (pos = topic; (pos = strchr(pos, '/')) != NULL; pos++) {
+		cnt++;
+	}
+	q = nni_zalloc(sizeof(char *) * (cnt + 1));
+	while ((pos = strchr(b, '/')) != NULL) {
+		q[row] = nni_zalloc(pos - b + 1);
+		memcpy(q[row++], b, pos - b);
+		b = pos + 1;
+	}
+	q[row] = nni_zalloc(strlen(b) + 1);
+	memcpy(q[row++], b, strlen(b));
+	q[row] = NULL;
+	return (q);
+}
+
+static void
+old_topic_free(char **q)
+{
+	int n;
+
+	for (n = 0; q[n] != NULL; n++) {
+		nni_free(q[n], strlen(q[n]) + 1);
+	}
+	nni_free(q, sizeof(char *) * (n + 1));
+}
+
+static bool
+old_check_ifwildcard(const char *w, const char *n)
+{
+	char **wq     = old_topic_parse(w);
+	char **nq     = old_topic_parse(n);
+	char **w_q    = wq;
+	char **n_q    = nq;
+	bool   result = true;
+	bool   flag   = false;
+
+	while (*w_q != NULL && *n_q != NULL) {
+		if (strcmp(*w_q, *n_q) != 0) {
+			if (strcmp(*w_q, "#") == 0) {
+				flag = true;
+				break;
+			} else if (strcmp(*w_q, "+") != 0) {
+				result = false;
+				break;
+			}
+		}
+		w_q++;
+		n_q++;
+	}
+	if (*w_q && strcmp(*w_q, "#") == 0) {
+		flag = true;
+	}
+	if (*w_q && strcmp(*w_q, "+") == 0) {
+		flag = false;
+	}
+	if (!flag && (*w_q || *n_q)) {
+		result = false;
+	}
+	old_topic_free(wq);
+	old_topic_free(nq);
+	return (result);
+}
+
+static bool
+old_topic_filtern(const char *origin, const char *input, size_t n)
+{
+	char *buff = nni_zalloc(n + 1);
+	bool  res;
+
+	strncpy(buff, input, n);
+	if (strlen(origin) == n && strncmp(origin, input, n) == 0) {
+		res = true;
+	} else {
+		res = old_check_ifwildcard(origin, buff);
+	}
+	nni_free(buff, n + 1);
+	return (res);
+}
+
+// Checks the trie against the per-subscription list walk that it
+// replaces, and reports the time taken by both.  The rounds can be
+// raised with NNG_TEST_SUBTRIE_ROUNDS for a steadier figure.
+static void
+test_subtrie_bench()
+{
+	nni_list        l;
+	nmq_subtrie    *t;
+	struct subinfo *info;
+	char            buf[64];
+	char          **topics;
+	int             ntopics = 1000;
+	int             rounds  = 2;
+	const char     *env;
+	int             hits    = 0;
+	int             differ  = 0;
+	nng_time        start;
+	nng_duration    walk, trie;
+
+	if ((env = getenv("NNG_TEST_SUBTRIE_ROUNDS")) != NULL) {
+		rounds = atoi(env);
+	}
+	NNI_LIST_INIT(&l, struct subinfo, node);
+	for (int i = 0; i < 500; i++) {
+		switch (i % 5) {
+		case 0:
+			snprintf(buf, sizeof(buf), "site/%d/+/temp", i);
+			break;
+		case 1:
+			snprintf(buf, sizeof(buf), "site/%d/dev/#", i);
+			break;
+		case 2:
+			snprintf(buf, sizeof(buf), "+/%d/dev%d/temp", i, i);
+			break;
+		default:
+			snprintf(buf, sizeof(buf), "site/%d/dev%d/temp", i, i);
+			break;
+		}
+		subinfo_add(&l, buf, i % 3, i);
+	}
+	NUTS_TRUE((topics = nni_zalloc(ntopics * sizeof(char *))) != NULL);
+	for (int i = 0; i < ntopics; i++) {
+		snprintf(buf, sizeof(buf), "site/%d/dev%d/%s", i % 600, i % 7,
+		    i % 2 ? "temp" : "hum");
+		NUTS_TRUE((topics[i] = nni_strdup(buf)) != NULL);
+	}
+
+	NUTS_PASS(nmq_subtrie_build(&t, &l));
+	for (int i = 0; i < ntopics; i++) {
+		uint8_t qos  = 0;
+		int     cnt  = 0;
+		uint8_t lqos = 0;
+		NNI_LIST_FOREACH (&l, info) {
+			size_t n = strlen(topics[i]);
+			bool   m = topic_filtern(info->topic, topics[i], n);
+			if (m != old_topic_filtern(info->topic, topics[i], n)) {
+				differ++;
+			}
+			if (m) {
+				cnt++;
+				lqos = info->qos > lqos ? info->qos : lqos;
+			}
+		}
+		NUTS_TRUE(nmq_subtrie_match(t, topics[i], strlen(topics[i]),
+		              &qos, NULL) == cnt);
+		if (cnt > 0) {
+			NUTS_TRUE(qos == lqos);
+			hits++;
+		}
+	}
+	NUTS_TRUE(hits > 0);
+	NUTS_TRUE(differ == 0);
+
+	start = nng_clock();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < ntopics; i++) {
+			NNI_LIST_FOREACH (&l, info) {
+				if (old_topic_filtern(info->topic, topics[i],
+				        strlen(topics[i]))) {
+					break;
+				}
+			}
+		}
+	}
+	walk  = (nng_duration) (nng_clock() - start);
+	start = nng_clock();
+	for (int r = 0; r < rounds; r++) {
+		for (int i = 0; i < ntopics; i++) {
+			uint8_t qos;
+			nmq_subtrie_match(
+			    t, topics[i], strlen(topics[i]), &qos, NULL);
+		}
+	}
+	trie = (nng_duration) (nng_clock() - start);
+	NUTS_MSG("%d lookups over 500 filters: old list walk %d ms, trie %d "
+	         "ms",
+	    rounds * ntopics, walk, trie);
+
+	nmq_subtrie_free(t);
+	for (int i = 0; i < ntopics; i++) {
+		nni_strfree(topics[i]);
+	}
+	nni_free(topics, ntopics * sizeof(char *));
+	subinfo_free_all(&l);
+}
+
 NUTS_TESTS = {
 	{ "mqtt_parser pub_extras", test_pub_extra },
 	{ "mqtt_parser utf8_check", test_utf8_check },
@@ -178,6 +486,10 @@ NUTS_TESTS = {
 	// TODO more tests needed.
 	{ "mqtt_parser topic_filter", test_topic_filter },
 	{ "mqtt_parser topic_filtern", test_topic_filtern },
+	{ "mqtt_parser topic_filter wildcard", test_topic_filter_wildcard },
+	{ "mqtt_parser subtrie match", test_subtrie_match },
+	{ "mqtt_parser subinfo match offline", test_subinfo_match_offline },
+	{ "mqtt_parser subtrie bench", test_subtrie_bench },
 
 	{ NULL, NULL },
 };
@@ -24,6 +24,17 @@
 
 #define DB_NAME "nano_qos_db.db"
 
+// Unacked messages retransmitted per pipe per timer tick.
+#ifndef NANO_RESEND_BATCH
+#define NANO_RESEND_BATCH 8
+#endif
+
+#ifdef NNG_ENABLE_STATS
+#define NANO_STAT_INC(s, st) nni_stat_inc(&(s)->st, 1)
+#else
+#define NANO_STAT_INC(s, st)
+#endif
+
 typedef struct nano_pipe   nano_pipe;
 typedef struct nano_sock   nano_sock;
 typedef struct nano_ctx    nano_ctx;
@@ -31,7 +42,9 @@ typedef struct cs_msg_list cs_msg_list;
 
 static void        nano_pipe_send_cb(void *);
 static void        nano_pipe_recv_cb(void *);
+static void        nano_pipe_auth_cb(void *);
 static void        nano_pipe_fini(void *);
+static bool        nano_pipe_resend(nano_pipe *p);
 static int         nano_pipe_close(void *);
 static inline void close_pipe(nano_pipe *p);
 
@@ -65,6 +78,16 @@ struct nano_sock {
 #ifdef NNG_SUPP_SQLITE
 	sqlite3 *sqlite_db;
 #endif
+#ifdef NNG_ENABLE_STATS
+	nni_stat_item   st_pub_in;
+	nni_stat_item   st_pub_out;
+	nni_stat_item   st_drop;
+	nni_stat_item   st_inflight;
+	nni_stat_stripe st_pub_in_s[NNI_STAT_STRIPES];
+	nni_stat_stripe st_pub_out_s[NNI_STAT_STRIPES];
+	nni_stat_stripe st_drop_s[NNI_STAT_STRIPES];
+	nni_stat_stripe st_inflight_s[NNI_STAT_STRIPES];
+#endif
 };
 
 // nano_pipe is our per-pipe protocol private structure.
@@ -77,18 +100,23 @@ struct nano_pipe {
 	uint8_t     reason_code;
 	uint32_t    id;  // pipe id of nni_pipe
 	uint16_t    rid; // index of packet ID for resending
+	uint16_t    resend; // retransmissions left in this timer tick
 	uint16_t    keepalive;
 	uint16_t 	ka_refresh; // ka_refresh count how many times the keepalive
 	                     	// timer has been triggered
 	bool          busy;
 	bool          event; // indicates if exposure disconnect event is valid
 	void         *tree;  // root node of db tree
-	void         *nano_qos_db; // 'sqlite' or 'nni_id_hash_map'
+	void         *nano_qos_db; // 'sqlite' or 'nni_qos_inflight'
+	nmq_subtrie  *subtrie;     // compiled subinfol, built on demand
 	nni_aio       aio_send;
 	nni_aio       aio_recv;
 	nni_aio       aio_timer;
+	nni_aio       aio_auth; // HTTP auth of the CONNECT
+	bool          authing;  // aio_auth in flight, under the sock lock
 	nni_list_node rnode; // receivable list linkage
 	nni_atomic_bool closed;
+	uint64_t      inflight; // our share of the socket's st_inflight
 };
 
 void
@@ -172,6 +200,103 @@ nano_nni_lmq_fini(nni_lmq *lmq)
 	nni_free(lmq->lmq_msgs, lmq->lmq_alloc * sizeof(nng_msg *));
 }
 
+// Brings the socket wide count of unacknowledged QoS messages in line
+// with the window of this pipe.  The transport adds to the window as it
+// sends, so this is called with p->lk held when a send completes, and
+// whenever we take messages out of it ourselves.
+static void
+nano_pipe_sync_inflight(nano_pipe *p)
+{
+#ifdef NNG_ENABLE_STATS
+	nano_sock *s = p->broker;
+	uint64_t   n = 0;
+
+	if (!s->conf->sqlite.enable && p->pipe->nano_qos_db != NULL) {
+		n = nni_qos_inflight_count(p->pipe->nano_qos_db);
+	}
+	if (n > p->inflight) {
+		nni_stat_inc(&s->st_inflight, n - p->inflight);
+	} else if (n < p->inflight) {
+		nni_stat_dec(&s->st_inflight, p->inflight - n);
+	}
+	p->inflight = n;
+#else
+	NNI_ARG_UNUSED(p);
+#endif
+}
+
+// Sends the unacked message that was sent longest ago if it is due for
+// retransmission, dropping expired ones on the way.  Called with p->lk
+// held and aio_send idle.  Returns true if aio_send was started.
+static bool
+nano_pipe_resend(nano_pipe *p)
+{
+	nni_pipe      *npipe        = p->pipe;
+	uint32_t       qos_duration = p->broker->conf->qos_duration;
+	bool           is_sqlite    = p->broker->conf->sqlite.enable;
+	nni_msg       *rmsg;
+	property      *prop;
+	property_data *data;
+	nni_time       ntime, mtime;
+	uint16_t       pid;
+
+	while (p->resend > 0) {
+		pid  = p->rid;
+		rmsg = nni_qos_db_get_one(
+		    is_sqlite, npipe->nano_qos_db, npipe->p_id, &pid);
+		if (rmsg == NULL) {
+			break;
+		}
+		prop = NULL;
+		data = NULL;
+		if (p->conn_param->pro_ver == MQTT_PROTOCOL_VERSION_v5) {
+			if (nni_msg_get_proto_data(rmsg) != NULL)
+				prop = nni_mqtt_msg_get_publish_property(rmsg);
+		}
+		if (prop) {
+			data = property_get_value(prop, MESSAGE_EXPIRY_INTERVAL);
+		}
+		ntime = nni_clock();
+		mtime = nni_msg_get_timestamp(rmsg);
+		if (data && ntime > mtime + data->p_value.u32 * 1000) {
+			log_info("QoS msg %d expired!", pid);
+			// remove expired msg from qos db
+			nni_qos_db_remove_msg(
+			    is_sqlite, npipe->nano_qos_db, rmsg);
+			nni_qos_db_remove(
+			    is_sqlite, npipe->nano_qos_db, npipe->p_id, pid);
+			p->resend--;
+			continue;
+		}
+		if ((ntime - mtime) < (long unsigned) qos_duration * 1250) {
+			// the oldest one is not due, so neither is the rest
+			if (is_sqlite) {
+				nni_msg_free(rmsg);
+			}
+			break;
+		}
+		p->resend--;
+		p->busy = true;
+		p->rid  = pid + 1;
+		nni_qos_db_touch(
+		    is_sqlite, npipe->nano_qos_db, npipe->p_id, pid);
+		// TODO set max retrying times in nanomq.conf
+		nano_msg_set_dup(rmsg);
+		// deliver packet id to transport here
+		nni_aio_set_prov_data(&p->aio_send, (void *) (uintptr_t) pid);
+		// SQLite hands out a copy, the id map keeps its own
+		if (!is_sqlite) {
+			nni_msg_clone(rmsg);
+		}
+		nni_aio_set_msg(&p->aio_send, rmsg);
+		log_info("resending qos msg packetid: %d", pid);
+		nni_pipe_send(p->pipe, &p->aio_send);
+		return (true);
+	}
+	p->resend = 0;
+	return (false);
+}
+
 static void
 nano_pipe_timer_cb(void *arg)
 {
@@ -182,7 +307,9 @@ nano_pipe_timer_cb(void *arg)
 	nni_time         time;
 	int 		 rv = 0;
 
+#ifdef NNG_SUPP_SQLITE
 	bool is_sqlite = p->broker->conf->sqlite.enable;
+#endif
 
 	if (nng_aio_result(&p->aio_timer) != 0) {
 		return;
@@ -246,47 +373,11 @@ nano_pipe_timer_cb(void *arg)
 	}
 	p->ka_refresh++;
 
+	// The first retransmission goes out here, the rest of the batch from
+	// nano_pipe_send_cb as each one completes.
+	p->resend = NANO_RESEND_BATCH;
 	if (!p->busy) {
-		nni_msg *msg, *rmsg;
-		uint16_t pid = p->rid;
-
-		// trying to resend msg
-		msg = nni_qos_db_get_one(
-		    is_sqlite, npipe->nano_qos_db, npipe->p_id, &pid);
-		if (msg != NULL) {
-			rmsg = msg;
-			property      *prop = NULL;
-			property_data *data = NULL;
-			if (p->conn_param->pro_ver == MQTT_PROTOCOL_VERSION_v5) {
-				if (nni_msg_get_proto_data(rmsg) != NULL)
-					prop = nni_mqtt_msg_get_publish_property(rmsg);
-			}
-			if (prop) {
-				data = property_get_value(prop, MESSAGE_EXPIRY_INTERVAL);
-			}
-			nni_time ntime = nni_clock();
-			nni_time mtime = nni_msg_get_timestamp(rmsg);
-			if (data && ntime > mtime + data->p_value.u32 * 1000) {
-				log_info("QoS msg %d expired!", pid);
-				// remove expired msg from qos db
-				nni_qos_db_remove_msg(
-				    is_sqlite, npipe->nano_qos_db, rmsg);
-				nni_qos_db_remove(is_sqlite,
-				    npipe->nano_qos_db, npipe->p_id, pid);
-			} else if ((ntime - mtime) >=
-			    (long unsigned) qos_duration * 1250) {
-				p->busy = true;
-				// TODO set max retrying times in nanomq.conf
-				nano_msg_set_dup(rmsg);
-				// deliver packet id to transport here
-				nni_aio_set_prov_data(&p->aio_send, (void *)(uintptr_t)pid);
-				// put original msg into sending
-				nni_msg_clone(rmsg);
-				nni_aio_set_msg(&p->aio_send, rmsg);
-				log_info("resending qos msg packetid: %d", pid);
-				nni_pipe_send(p->pipe, &p->aio_send);
-			}
-		}
+		nano_pipe_resend(p);
 	}
 	nni_sleep_aio(qos_duration * 1000, &p->aio_timer);
 	nni_mtx_unlock(&p->lk);
@@ -403,15 +494,14 @@ nano_ctx_send(void *arg, nni_aio *aio)
 		void *qos_db = NULL;
 		if (s->conf->ext_qos_db)
 			 qos_db = nng_id_get(s->conf->ext_qos_db, pipe);
-		if (qos_db != NULL) {
-			if (nni_msg_get_type(msg) == CMD_PUBLISH &&
-			    nni_msg_get_pub_qos(msg) > 0) {
-				nni_msg_clone(msg); // for line 422
-				packetid = nni_msg_get_pub_pid(msg);
-				nni_qos_db_set(is_sqlite, qos_db,
-				    pipe, packetid, msg);
-				log_debug("msg cached for preset session");
-			}
+		if (qos_db != NULL && nni_msg_get_type(msg) == CMD_PUBLISH &&
+		    nni_msg_get_pub_qos(msg) > 0) {
+			nni_msg_clone(msg); // for line 422
+			packetid = nni_msg_get_pub_pid(msg);
+			nni_qos_db_set(is_sqlite, qos_db, pipe, packetid, msg);
+			log_debug("msg cached for preset session");
+		} else {
+			NANO_STAT_INC(s, st_drop);
 		}
 		// Pipe is gone.  Make this look like a good send to avoid
 		// disrupting the state machine.  We don't care if the peer
@@ -432,14 +522,12 @@ nano_ctx_send(void *arg, nni_aio *aio)
 			qos_pac = nni_msg_get_pub_qos(msg);
 			pld_pac = nni_msg_get_pub_topic(msg, &tlen_pac);
 		}
-		subinfo *info = NULL;
-		NNI_LIST_FOREACH(p->pipe->subinfol, info) {
-			if (!info)
-				continue;
-			if (topic_filtern(info->topic, pld_pac, tlen_pac)) {
-				qos = qos_pac > info->qos ? info->qos : qos_pac; // MIN
-				break;
-			}
+		// Offline sessions see the whole publish stream, so match
+		// against the compiled filters instead of the subinfo list.
+		if (pld_pac != NULL && tlen_pac > 0 &&
+		    nmq_subinfo_match(&p->subtrie, p->pipe->subinfol, pld_pac,
+		        (size_t) tlen_pac, &qos) > 0) {
+			qos = qos_pac > qos ? qos : qos_pac; // MIN
 		}
 		if (qos > 0) {
 			packetid = nni_pipe_inc_packetid(p->pipe);
@@ -449,10 +537,12 @@ nano_ctx_send(void *arg, nni_aio *aio)
 			nni_qos_db_remove_oldest(is_sqlite,
 			    p->pipe->nano_qos_db,
 			    s->conf->sqlite.disk_cache_size);
+			nano_pipe_sync_inflight(p);
 			log_debug("msg cached for session");
 		} else {
 			// only cache QoS messages
 			log_debug("Drop msg due to qos == 0");
+			NANO_STAT_INC(s, st_drop);
 			nni_msg_free(msg);
 		}
 		nni_mtx_unlock(&p->lk);
@@ -461,6 +551,9 @@ nano_ctx_send(void *arg, nni_aio *aio)
 	}
 
 	if (!p->busy) {
+		if (nni_msg_get_type(msg) == CMD_PUBLISH) {
+			NANO_STAT_INC(s, st_pub_out);
+		}
 		p->busy = true;
 		nni_aio_set_msg(&p->aio_send, msg);
 		nni_pipe_send(p->pipe, &p->aio_send);
@@ -470,6 +563,7 @@ nano_ctx_send(void *arg, nni_aio *aio)
 	}
 
 	if ((rv = nni_aio_schedule(aio, nano_ctx_cancel_send, ctx)) != 0) {
+		NANO_STAT_INC(s, st_drop);
 		nni_msg_free(msg);
 		nni_mtx_unlock(&p->lk);
 		return;
@@ -484,11 +578,13 @@ nano_ctx_send(void *arg, nni_aio *aio)
 				nni_msg *old;
 				nni_lmq_get(&p->rlmq, &old);
 				nni_msg_free(old);
+				NANO_STAT_INC(s, st_drop);
 			}
 		} else {
 			// Warning msg lost due to reach the limit of lmq
 			log_warn(
 			    "Warning: msg lost due to reach the limit of lmq");
+			NANO_STAT_INC(s, st_drop);
 			nni_msg_free(msg);
 			nni_mtx_unlock(&p->lk);
 			nni_aio_set_msg(aio, NULL);
@@ -496,6 +592,7 @@ nano_ctx_send(void *arg, nni_aio *aio)
 		}
 	}
 
+	// counted as sent once it leaves rlmq, it may be dropped first
 	nni_lmq_put(&p->rlmq, msg);
 
 	nni_mtx_unlock(&p->lk);
@@ -514,6 +611,7 @@ nano_sock_fini(void *arg)
 #endif
 	nni_id_map_fini(&s->pipes);
 	nni_id_map_fini(&s->cached_sessions);
+	nmq_auth_http_fini(&s->conf->auth_http);
 	// flush msg and conn params in waitlmq
 	nano_nni_lmq_flush(&s->waitlmq, true);
 	nni_lmq_fini(&s->waitlmq);
@@ -531,8 +629,6 @@ nano_sock_init(void *arg, nni_sock *sock)
 {
 	nano_sock *s = arg;
 
-	NNI_ARG_UNUSED(sock);
-
 	nni_mtx_init(&s->lk);
 
 	nni_id_map_init(&s->pipes, 0, 0, false);
@@ -562,6 +658,50 @@ nano_sock_init(void *arg, nni_sock *sock)
 		buf[1] = 0x00;
 		nni_msg_header_append(s->pingmsg, buf, 2);
 	}
+
+#ifdef NNG_ENABLE_STATS
+	// Bumped from every pipe's callbacks, hence striped.
+	static const nni_stat_info pub_in_info = {
+		.si_name    = "mqtt_publish_in",
+		.si_desc    = "PUBLISH packets received from clients",
+		.si_type    = NNG_STAT_COUNTER,
+		.si_unit    = NNG_UNIT_MESSAGES,
+		.si_striped = true,
+	};
+	static const nni_stat_info pub_out_info = {
+		.si_name    = "mqtt_publish_out",
+		.si_desc    = "PUBLISH packets sent to clients",
+		.si_type    = NNG_STAT_COUNTER,
+		.si_unit    = NNG_UNIT_MESSAGES,
+		.si_striped = true,
+	};
+	static const nni_stat_info drop_info = {
+		.si_name    = "mqtt_msg_drop",
+		.si_desc    = "messages dropped on the way to clients",
+		.si_type    = NNG_STAT_COUNTER,
+		.si_unit    = NNG_UNIT_MESSAGES,
+		.si_striped = true,
+	};
+	static const nni_stat_info inflight_info = {
+		.si_name    = "mqtt_qos_inflight",
+		.si_desc    = "QoS messages awaiting acknowledgement",
+		.si_type    = NNG_STAT_LEVEL,
+		.si_unit    = NNG_UNIT_MESSAGES,
+		.si_striped = true,
+	};
+	nni_stat_init_striped(&s->st_pub_in, &pub_in_info, s->st_pub_in_s);
+	nni_stat_init_striped(
+	    &s->st_pub_out, &pub_out_info, s->st_pub_out_s);
+	nni_stat_init_striped(&s->st_drop, &drop_info, s->st_drop_s);
+	nni_stat_init_striped(
+	    &s->st_inflight, &inflight_info, s->st_inflight_s);
+	nni_sock_add_stat(sock, &s->st_pub_in);
+	nni_sock_add_stat(sock, &s->st_pub_out);
+	nni_sock_add_stat(sock, &s->st_drop);
+	nni_sock_add_stat(sock, &s->st_inflight);
+#else
+	NNI_ARG_UNUSED(sock);
+#endif
 }
 
 static void
@@ -590,6 +730,7 @@ nano_pipe_stop(void *arg)
 	nni_aio_stop(&p->aio_send);
 	nni_aio_stop(&p->aio_timer);
 	nni_aio_stop(&p->aio_recv);
+	nni_aio_stop(&p->aio_auth);
 }
 
 static void
@@ -605,6 +746,10 @@ nano_pipe_fini(void *arg)
 	}
 	nni_mtx_lock(&s->lk);
 	nni_mtx_lock(&p->lk);
+#ifdef NNG_ENABLE_STATS
+	nni_stat_dec(&s->st_inflight, p->inflight);
+	p->inflight = 0;
+#endif
 	if ((msg = nni_aio_get_msg(&p->aio_recv)) != NULL) {
 		nni_aio_set_msg(&p->aio_recv, NULL);
 	}
@@ -626,6 +771,8 @@ nano_pipe_fini(void *arg)
 		// we keep all structs in broker layer, except this conn_param
 		conn_param_free(p->conn_param);
 	}
+	nmq_subtrie_free(p->subtrie);
+	p->subtrie = NULL;
 	nni_mtx_unlock(&p->lk);
 
 	nni_mtx_fini(&p->lk);
@@ -639,6 +786,7 @@ nano_pipe_fini(void *arg)
 	nni_aio_fini(&p->aio_send);
 	nni_aio_fini(&p->aio_recv);
 	nni_aio_fini(&p->aio_timer);
+	nni_aio_fini(&p->aio_auth);
 	nano_nni_lmq_fini(&p->rlmq);
 }
 
@@ -655,11 +803,13 @@ nano_pipe_init(void *arg, nni_pipe *pipe, void *s)
 	nni_aio_init(&p->aio_send, nano_pipe_send_cb, p);
 	nni_aio_init(&p->aio_timer, nano_pipe_timer_cb, p);
 	nni_aio_init(&p->aio_recv, nano_pipe_recv_cb, p);
+	nni_aio_init(&p->aio_auth, nano_pipe_auth_cb, p);
 
 	p->conn_param  = nni_pipe_get_conn_param(pipe);
 	conn_param_free(p->conn_param);
 	p->id          = nni_pipe_id(pipe);
 	p->rid         = 1;
+	p->resend      = 0;
 	p->pipe        = pipe;
 	p->reason_code = 0x00;
 	p->broker      = s;
@@ -675,11 +825,13 @@ nano_pipe_init(void *arg, nni_pipe *pipe, void *s)
 	return (0);
 }
 
+// nano_pipe_session restores or cleans the session of the client, and
+// hands the CONNACK up.  auth is the verdict of the HTTP auth.  Called
+// with the sock lock held, which it drops.
 static int
-nano_pipe_start(void *arg)
+nano_pipe_session(nano_pipe *p, uint8_t auth)
 {
 	char      *clientid;
-	nano_pipe *p = arg;
 	nano_pipe *old = NULL;
 	nano_sock *s = p->broker;
 	nni_msg   *msg;
@@ -688,10 +840,7 @@ nano_pipe_start(void *arg)
 
 	bool is_sqlite = s->conf->sqlite.enable;
 
-	log_trace(" ########## nano_pipe_start ########## ");
-
 	nni_msg_alloc(&msg, 0);
-	nni_mtx_lock(&s->lk);
 
 #ifdef NNG_SUPP_SQLITE
 	if (is_sqlite) {
@@ -749,6 +898,12 @@ session_keeping:
 			nni_list *l = npipe->subinfol;
 			npipe->subinfol = old->pipe->subinfol;
 			old->pipe->subinfol = l;
+			nmq_subtrie_free(p->subtrie);
+			p->subtrie = NULL;
+			nni_mtx_lock(&old->lk);
+			nmq_subtrie_free(old->subtrie);
+			old->subtrie = NULL;
+			nni_mtx_unlock(&old->lk);
 			p->id = nni_pipe_id(npipe);
 			// set event to false so that no notification will be sent
 			p->event = false;
@@ -788,10 +943,7 @@ session_keeping:
 	conn_param_clone(p->conn_param);
 	rv = verify_connect(p->conn_param, s->conf);
 	if (rv == SUCCESS) {
-		if (s->conf->auth_http.enable) {
-			rv = nmq_auth_http_connect(
-			    p->conn_param, &s->conf->auth_http);
-		}
+		rv = auth;
 	}
 	nmq_connack_encode(msg, p->conn_param, rv);
 	conn_param_free(p->conn_param);
@@ -847,6 +999,47 @@ session_keeping:
 	return (rv);
 }
 
+static void
+nano_pipe_auth_cb(void *arg)
+{
+	nano_pipe *p = arg;
+	nano_sock *s = p->broker;
+
+	nni_mtx_lock(&s->lk);
+	p->authing = false;
+	if (nni_pipe_is_closed(p->pipe)) {
+		nni_mtx_unlock(&s->lk);
+		return;
+	}
+	if (nano_pipe_session(p,
+	        nni_aio_result(&p->aio_auth) == 0 ? SUCCESS
+	                                          : NOT_AUTHORIZED) != 0) {
+		nni_pipe_close(p->pipe);
+	}
+}
+
+static int
+nano_pipe_start(void *arg)
+{
+	nano_pipe *p = arg;
+	nano_sock *s = p->broker;
+
+	log_trace(" ########## nano_pipe_start ########## ");
+
+	nni_mtx_lock(&s->lk);
+	// Asking the auth server takes a while, the CONNACK is finished
+	// from nano_pipe_auth_cb when the answer is in.
+	if (s->conf->auth_http.enable &&
+	    verify_connect(p->conn_param, s->conf) == SUCCESS) {
+		p->authing = true;
+		nni_mtx_unlock(&s->lk);
+		nmq_auth_http_connect_aio(
+		    p->conn_param, &s->conf->auth_http, &p->aio_auth);
+		return (0);
+	}
+	return (nano_pipe_session(p, SUCCESS));
+}
+
 // please use it within a pipe+sock lock
 static inline void
 close_pipe(nano_pipe *p)
@@ -886,12 +1079,14 @@ nano_pipe_close(void *arg)
 		nni_atomic_swap_bool(&npipe->p_closed, false);
 		return -1;
 	}
+	nni_aio_close(&p->aio_auth);
 	nni_mtx_lock(&s->lk);
 	nni_mtx_lock(&p->lk);
 	log_info("%s pipe close!", p->conn_param->clientid.body);
 	// we freed the conn_param when restoring pipe
 	// so check status of conn_param. just let it close silently
-	if (p->conn_param->clean_start == 0) {
+	// and a client still waiting to be authorized has no session.
+	if (p->conn_param->clean_start == 0 && !p->authing) {
 		// cache this pipe
 		clientid = (char *) conn_param_get_clientid(p->conn_param);
 	}
@@ -945,6 +1140,8 @@ nano_pipe_close(void *arg)
 		nni_list *l        = new_pipe->subinfol;
 		new_pipe->subinfol = npipe->subinfol;
 		npipe->subinfol    = l;
+		nmq_subtrie_free(p->subtrie);
+		p->subtrie = NULL;
 		log_info("client kick itself while keeping session!");
 	} else {
 		nni_aio_close(&p->aio_send);
@@ -1017,9 +1214,13 @@ nano_pipe_send_cb(void *arg)
 		return;
 	}
 	nni_mtx_lock(&p->lk);
+	nano_pipe_sync_inflight(p);
 
 	nni_aio_set_prov_data(&p->aio_send, 0);
 	if (nni_lmq_get(&p->rlmq, &msg) == 0) {
+		if (nni_msg_get_type(msg) == CMD_PUBLISH) {
+			NANO_STAT_INC(p->broker, st_pub_out);
+		}
 		nni_aio_set_msg(&p->aio_send, msg);
 		log_trace("rlmq msg resending! %ld msgs left\n",
 		    nni_lmq_len(&p->rlmq));
@@ -1027,6 +1228,10 @@ nano_pipe_send_cb(void *arg)
 		nni_mtx_unlock(&p->lk);
 		return;
 	}
+	if (p->resend > 0 && nano_pipe_resend(p)) {
+		nni_mtx_unlock(&p->lk);
+		return;
+	}
 
 	p->busy = false;
 	nni_mtx_unlock(&p->lk);
@@ -1164,6 +1369,8 @@ nano_pipe_recv_cb(void *arg)
 		// Store Subid RAP Topic for sub
 		nni_mtx_lock(&p->lk);
 		rv = nmq_subinfo_decode(msg, npipe->subinfol, cparam->pro_ver);
+		nmq_subtrie_free(p->subtrie);
+		p->subtrie = NULL;
 		log_debug("Processing subinfo done");
 		if (rv < 0) {
 			log_error("Invalid subscribe packet!");
@@ -1187,6 +1394,11 @@ nano_pipe_recv_cb(void *arg)
 	case CMD_UNSUBSCRIBE:
 		// 1. Clone for App layer 2. Clone should be called before being used
 		conn_param_clone(cparam);
+		// subinfol was already updated by the transport
+		nni_mtx_lock(&p->lk);
+		nmq_subtrie_free(p->subtrie);
+		p->subtrie = NULL;
+		nni_mtx_unlock(&p->lk);
 		if (cparam->pro_ver == MQTT_PROTOCOL_VERSION_v5) {
 			len = get_var_integer(ptr + 2, &len_of_varint);
 			nni_msg_set_payload_ptr(
@@ -1225,8 +1437,10 @@ nano_pipe_recv_cb(void *arg)
 		}
 		nni_pipe_close(p->pipe);
 		break;
-	case CMD_CONNACK:
 	case CMD_PUBLISH:
+		NANO_STAT_INC(s, st_pub_in);
+		// FALLTHROUGH
+	case CMD_CONNACK:
 		// 1. Clone for App layer 2. Clone should be called before being used
 		conn_param_clone(cparam);
 		break;
@@ -1241,6 +1455,7 @@ nano_pipe_recv_cb(void *arg)
 			    is_sqlite, npipe->nano_qos_db, qos_msg);
 			nni_qos_db_remove(
 			    is_sqlite, npipe->nano_qos_db, npipe->p_id, ackid);
+			nano_pipe_sync_inflight(p);
 		} else {
 			log_warn("ACK failed! qos msg %ld not found!", ackid);
 		}
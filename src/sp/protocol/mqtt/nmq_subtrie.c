@@ -0,0 +1,374 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <string.h>
+
+#include "core/nng_impl.h"
+#include "core/sockimpl.h"
+#include "nng/protocol/mqtt/mqtt_parser.h"
+
+// Compiled form of the subscriptions of one pipe.  Filters are split
+// into levels once, levels shared between filters share a node, and
+// literal children are kept sorted so that a topic can be matched by
+// walking it level by level without allocating anything.  Nodes keep
+// copies of the tokens and the granted QoS/subid rather than pointers to
+// subinfo, so a trie that is stale with respect to the list is never
+// unsafe to use, only out of date.
+
+typedef struct subtrie_node subtrie_node;
+
+struct subtrie_node {
+	char          *tok;
+	size_t         toklen;
+	subtrie_node **kids; // literal levels, sorted by (len, bytes)
+	size_t         nkids;
+	size_t         kidcap;
+	subtrie_node  *plus;   // '+' level
+	int8_t         qos;    // a filter ends here, -1 if none
+	int8_t         hqos;   // a filter ending in "/#" ends here, -1 if none
+	uint32_t       subid;
+	uint32_t       hsubid;
+};
+
+struct nmq_subtrie {
+	subtrie_node root;
+	size_t       nfilters;
+};
+
+typedef struct {
+	int      count;
+	int      qos;
+	uint32_t subid;
+} subtrie_result;
+
+static int
+subtrie_tokcmp(const subtrie_node *n, const char *tok, size_t len)
+{
+	if (n->toklen != len) {
+		return (n->toklen < len ? -1 : 1);
+	}
+	return (memcmp(n->tok, tok, len));
+}
+
+// subtrie_find returns the index of the child matching tok, or the index
+// where it should be inserted, in which case *found is false.
+static size_t
+subtrie_find(subtrie_node *n, const char *tok, size_t len, bool *found)
+{
+	size_t lo = 0;
+	size_t hi = n->nkids;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		int    c   = subtrie_tokcmp(n->kids[mid], tok, len);
+		if (c == 0) {
+			*found = true;
+			return (mid);
+		}
+		if (c < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	*found = false;
+	return (lo);
+}
+
+static subtrie_node *
+subtrie_node_alloc(const char *tok, size_t len)
+{
+	subtrie_node *n;
+
+	if ((n = NNI_ALLOC_STRUCT(n)) == NULL) {
+		return (NULL);
+	}
+	n->qos  = -1;
+	n->hqos = -1;
+	if (len > 0) {
+		if ((n->tok = nni_alloc(len)) == NULL) {
+			NNI_FREE_STRUCT(n);
+			return (NULL);
+		}
+		memcpy(n->tok, tok, len);
+	}
+	n->toklen = len;
+	return (n);
+}
+
+static void
+subtrie_node_fini(subtrie_node *n)
+{
+	for (size_t i = 0; i < n->nkids; i++) {
+		subtrie_node_fini(n->kids[i]);
+		NNI_FREE_STRUCT(n->kids[i]);
+	}
+	if (n->kids != NULL) {
+		nni_free(n->kids, n->kidcap * sizeof(subtrie_node *));
+	}
+	if (n->plus != NULL) {
+		subtrie_node_fini(n->plus);
+		NNI_FREE_STRUCT(n->plus);
+	}
+	if (n->tok != NULL) {
+		nni_free(n->tok, n->toklen);
+	}
+}
+
+static subtrie_node *
+subtrie_child(subtrie_node *n, const char *tok, size_t len)
+{
+	subtrie_node *kid;
+	bool          found;
+	size_t        idx;
+
+	if (len == 1 && tok[0] == '+') {
+		if (n->plus == NULL) {
+			n->plus = subtrie_node_alloc(tok, len);
+		}
+		return (n->plus);
+	}
+	idx = subtrie_find(n, tok, len, &found);
+	if (found) {
+		return (n->kids[idx]);
+	}
+	if (n->nkids == n->kidcap) {
+		subtrie_node **kids;
+		size_t         cap = n->kidcap ? n->kidcap * 2 : 4;
+		if ((kids = nni_alloc(cap * sizeof(subtrie_node *))) == NULL) {
+			return (NULL);
+		}
+		if (n->nkids > 0) {
+			memcpy(kids, n->kids, n->nkids * sizeof(subtrie_node *));
+			nni_free(n->kids, n->kidcap * sizeof(subtrie_node *));
+		}
+		n->kids   = kids;
+		n->kidcap = cap;
+	}
+	if ((kid = subtrie_node_alloc(tok, len)) == NULL) {
+		return (NULL);
+	}
+	memmove(&n->kids[idx + 1], &n->kids[idx],
+	    (n->nkids - idx) * sizeof(subtrie_node *));
+	n->kids[idx] = kid;
+	n->nkids++;
+	return (kid);
+}
+
+static void
+subtrie_grant(int8_t *qosp, uint32_t *subidp, uint8_t qos, uint32_t subid)
+{
+	if (*qosp < (int8_t) qos) {
+		*qosp   = (int8_t) qos;
+		*subidp = subid;
+	}
+}
+
+static int
+subtrie_insert(nmq_subtrie *t, const char *f, uint8_t qos, uint32_t subid)
+{
+	subtrie_node *n  = &t->root;
+	const char   *fe = f + strlen(f);
+
+	for (;;) {
+		const char *fl;
+
+		if ((fl = memchr(f, '/', fe - f)) == NULL) {
+			fl = fe;
+		}
+		if (fl - f == 1 && *f == '#') {
+			// nothing after # can change what matches
+			subtrie_grant(&n->hqos, &n->hsubid, qos, subid);
+			break;
+		}
+		if ((n = subtrie_child(n, f, fl - f)) == NULL) {
+			return (NNG_ENOMEM);
+		}
+		if (fl == fe) {
+			subtrie_grant(&n->qos, &n->subid, qos, subid);
+			break;
+		}
+		f = fl + 1;
+	}
+	t->nfilters++;
+	return (0);
+}
+
+static void
+subtrie_fold(subtrie_result *r, int8_t qos, uint32_t subid)
+{
+	r->count++;
+	if (qos > r->qos) {
+		r->qos   = qos;
+		r->subid = subid;
+	}
+}
+
+// t points at the start of the next topic level when more is true.
+static void
+subtrie_walk(
+    subtrie_node *n, const char *t, const char *te, bool more, subtrie_result *r)
+{
+	const char   *tl, *nt;
+	subtrie_node *kid;
+	bool          found, nmore;
+	size_t        idx;
+
+	if (n->hqos >= 0) {
+		// "a/#" matches "a" as well as everything below it
+		subtrie_fold(r, n->hqos, n->hsubid);
+	}
+	if (!more) {
+		if (n->qos >= 0) {
+			subtrie_fold(r, n->qos, n->subid);
+		}
+		return;
+	}
+	if ((tl = memchr(t, '/', te - t)) == NULL) {
+		tl = te;
+	}
+	nmore = tl < te;
+	nt    = nmore ? tl + 1 : te;
+	if (n->nkids > 0) {
+		idx = subtrie_find(n, t, tl - t, &found);
+		if (found) {
+			kid = n->kids[idx];
+			subtrie_walk(kid, nt, te, nmore, r);
+		}
+	}
+	if (n->plus != NULL) {
+		subtrie_walk(n->plus, nt, te, nmore, r);
+	}
+}
+
+/**
+ * @brief compile the subinfo list of a pipe.
+ * 	  Filters go in as written, so that the trie matches exactly what
+ * 	  topic_filtern does on the list: a "$share/<group>/..." filter
+ * 	  does not match the plain topics its group is fed.  Shared
+ * 	  subscriptions are delivered by group dispatch, not queued for
+ * 	  an offline session.
+ *
+ * @param tp returns the new trie
+ * @param l nni_list of struct subinfo
+ * @return 0 or NNG_ENOMEM
+ */
+int
+nmq_subtrie_build(nmq_subtrie **tp, void *l)
+{
+	nmq_subtrie    *t;
+	struct subinfo *info;
+	nni_list       *subinfol = l;
+	int             rv;
+
+	if ((t = NNI_ALLOC_STRUCT(t)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	t->root.qos  = -1;
+	t->root.hqos = -1;
+	if (subinfol != NULL) {
+		NNI_LIST_FOREACH (subinfol, info) {
+			if (info->topic == NULL) {
+				continue;
+			}
+			rv = subtrie_insert(t, info->topic, info->qos,
+			    (uint32_t) info->subid);
+			if (rv != 0) {
+				nmq_subtrie_free(t);
+				return (rv);
+			}
+		}
+	}
+	*tp = t;
+	return (0);
+}
+
+void
+nmq_subtrie_free(nmq_subtrie *t)
+{
+	if (t == NULL) {
+		return;
+	}
+	subtrie_node_fini(&t->root);
+	NNI_FREE_STRUCT(t);
+}
+
+/**
+ * @brief match a publish topic against the compiled subscriptions.
+ *
+ * @param t compiled trie
+ * @param topic topic of publish, not NUL terminated
+ * @param tlen length of topic
+ * @param qos returns the max QoS granted among matching filters
+ * @param subid returns the subid that came with that QoS, may be NULL
+ * @return number of matching filters, 0 if none
+ */
+int
+nmq_subtrie_match(nmq_subtrie *t, const char *topic, size_t tlen,
+    uint8_t *qos, uint32_t *subid)
+{
+	subtrie_result r;
+
+	r.count = 0;
+	r.qos   = -1;
+	r.subid = 0;
+	if (t == NULL || topic == NULL) {
+		return (0);
+	}
+	subtrie_walk(&t->root, topic, topic + tlen, true, &r);
+	if (r.count > 0) {
+		if (qos != NULL) {
+			*qos = (uint8_t) r.qos;
+		}
+		if (subid != NULL) {
+			*subid = r.subid;
+		}
+	}
+	return (r.count);
+}
+
+/**
+ * @brief match a publish topic against the subscriptions of a pipe,
+ * 	  compiling them into *tp first if that was not done yet.  If the
+ * 	  trie cannot be built (or tp is NULL) the list is walked instead,
+ * 	  with the same result.
+ *
+ * @param tp cached trie of the list, may be NULL
+ * @param subinfol nni_list of struct subinfo
+ * @param topic topic of publish, not NUL terminated
+ * @param tlen length of topic
+ * @param qos returns the max QoS granted among matching filters
+ * @return number of matching filters, 0 if none
+ */
+int
+nmq_subinfo_match(nmq_subtrie **tp, void *subinfol, const char *topic,
+    size_t tlen, uint8_t *qos)
+{
+	nni_list       *l   = subinfol;
+	struct subinfo *info;
+	int             cnt = 0;
+
+	if (tp != NULL && (*tp != NULL || nmq_subtrie_build(tp, l) == 0)) {
+		return (nmq_subtrie_match(*tp, topic, tlen, qos, NULL));
+	}
+	if (l == NULL || topic == NULL) {
+		return (0);
+	}
+	NNI_LIST_FOREACH (l, info) {
+		if (info->topic == NULL ||
+		    !topic_filtern(info->topic, topic, tlen)) {
+			continue;
+		}
+		if (cnt == 0 || info->qos > *qos) {
+			*qos = info->qos;
+		}
+		cnt++;
+	}
+	return (cnt);
+}
@@ -19,7 +19,9 @@
 #include "nng/supplemental/nanolib/conf.h"
 #include "nng/supplemental/tls/tls.h"
 #include "supplemental/mqtt/mqtt_msg.h"
+#include "supplemental/mqtt/mqtt_pubenc.h"
 #include "supplemental/mqtt/mqtt_qos_db_api.h"
+#include "supplemental/mqtt/mqtt_rxbuf.h"
 
 // TLS over TCP transport.   Platform specific TLS Over TCP operations must be
 // supplied as well.
@@ -44,6 +46,7 @@ struct tlstran_pipe {
 	uint8_t         pro_ver;
 	uint8_t        *conn_buf;
 	uint8_t        *qos_buf; // msg trunk for qos & V4/V5 conversion
+	nni_mqtt_pubenc txenc[4]; // used if an encoding can't be cached
 	nni_aio        *txaio;
 	nni_aio        *rxaio;
 	nni_aio        *qsaio;   // send qos ack/rel
@@ -51,6 +54,8 @@ struct tlstran_pipe {
 	nni_aio        *negoaio; // deal with connect
 	nni_lmq         rslmq;
 	nni_msg        *rxmsg, *cnmsg;
+	size_t          rxremain; // body bytes of rxmsg still to be read
+	nni_mqtt_rxbuf  rxbuf;
 	nni_mtx         mtx;
 	conn_param     *tcp_cparam;
 	nni_list        recvq;
@@ -221,6 +226,7 @@ tlstran_pipe_fini(void *arg)
 	nni_aio_free(p->negoaio);
 
 	nni_lmq_fini(&p->rslmq);
+	nni_mqtt_rxbuf_fini(&p->rxbuf);
 	nni_mtx_fini(&p->mtx);
 	NNI_FREE_STRUCT(p);
 	log_trace(" ************ tlstran_pipe_finit [%p] ************ ", p);
@@ -252,7 +258,8 @@ tlstran_pipe_alloc(tlstran_pipe **pipep)
 	    ((rv = nni_aio_alloc(&p->rpaio, NULL, p)) != 0) ||
 	    ((rv = nni_aio_alloc(&p->rxaio, tlstran_pipe_recv_cb, p)) != 0) ||
 	    ((rv = nni_aio_alloc(&p->negoaio, tlstran_pipe_nego_cb, p)) !=
-	        0)) {
+	        0) ||
+	    ((rv = nni_mqtt_rxbuf_init(&p->rxbuf, NNI_MQTT_RXBUF_SIZE)) != 0)) {
 		tlstran_pipe_fini(p);
 		return (rv);
 	}
@@ -645,8 +652,7 @@ tlstran_pipe_recv_cb(void *arg)
 	nni_aio      *aio;
 	nni_iov       iov[2];
 	uint8_t       type, rv;
-	uint8_t       pos = 0;
-	uint32_t      len = 0;
+	size_t        n;
 	nni_msg      *msg   = NULL, *qmsg;
 	tlstran_pipe *p     = arg;
 	nni_aio      *rxaio = p->rxaio;
@@ -671,87 +677,55 @@ tlstran_pipe_recv_cb(void *arg)
 		goto recv_error;
 	}
 
-	p->gotrxhead += nni_aio_count(rxaio);
-
-	nni_aio_iov_advance(rxaio, nni_aio_count(rxaio));
-	log_trace("newly recevied %ld totoal received: %ld",
-	    nni_aio_count(rxaio), p->gotrxhead);
-	// not receive enough bytes, deal with remaining length
-	if (nni_aio_iov_count(rxaio) > 0) {
-		log_trace("got: %x %x, %ld!!\n", p->rxlen[0], p->rxlen[1],
-		    strlen((char *) p->rxlen));
-		nng_stream_recv(p->conn, rxaio);
-		nni_mtx_unlock(&p->mtx);
-		return;
-	} else if (p->gotrxhead <= NNI_NANO_MAX_HEADER_SIZE &&
-	    p->rxlen[p->gotrxhead - 1] > 0x7f) {
-		// length error
-		if (p->gotrxhead == NNI_NANO_MAX_HEADER_SIZE) {
-			rv = NNG_EMSGSIZE;
-			log_warn("MALFORMED_PACKET received.");
-			goto recv_error;
-		}
-		// same packet, continue receving next byte of remaining length
-		iov[0].iov_buf = &p->rxlen[p->gotrxhead];
-		iov[0].iov_len = 1;
-		nni_aio_set_iov(rxaio, 1, iov);
-		nng_stream_recv(p->conn, rxaio);
-		nni_mtx_unlock(&p->mtx);
-		return;
-	}
-
+	n = nni_aio_count(rxaio);
 	if (p->rxmsg == NULL) {
-		if ((rv = mqtt_get_remaining_length(
-		         p->rxlen, p->gotrxhead, &len, &pos)) != 0) {
+		// Carve the next packet out of whatever is buffered.
+		nni_mqtt_rxbuf_produce(&p->rxbuf, n);
+		rv = nni_mqtt_rxbuf_get(&p->rxbuf, p->conf->max_packet_size,
+		    &p->rxmsg, &p->rxremain);
+		if (rv == NNG_EAGAIN) {
+			// not even a complete fixed header yet
+			nni_mqtt_rxbuf_iov(&p->rxbuf, &iov[0]);
+			nni_aio_set_iov(rxaio, 1, iov);
+			nng_stream_recv(p->conn, rxaio);
+			nni_mtx_unlock(&p->mtx);
+			return;
+		} else if (rv == NNG_EPROTO) {
+			log_warn("MALFORMED_PACKET received.");
 			rv = PAYLOAD_FORMAT_INVALID;
 			goto recv_error;
-		}
-
-		// finish fixed header
-		p->wantrxhead = len + p->gotrxhead;
-		// We should have gotten a message header. len -> remaining
-		// length to define how many bytes left
-		log_trace("pipe %p header got: %x %x %x %x %x, %ld!!\n", p,
-		    p->rxlen[0], p->rxlen[1], p->rxlen[2], p->rxlen[3],
-		    p->rxlen[4], p->wantrxhead);
-		// Make sure the message payload is not too big.  If it is
-		// the caller will shut down the pipe.
-		if (len > p->conf->max_packet_size) {
+		} else if (rv == NNG_EMSGSIZE) {
 			log_error("Size of packet exceeds limitation: 0x95\n");
 			rv = NMQ_PACKET_TOO_LARGE;
 			goto recv_error;
-		}
-
-		if ((rv = nni_msg_alloc(&p->rxmsg, (size_t) len)) != 0) {
-			log_error("Mem error %ld\n", (size_t) len);
-			rv = NMQ_SERVER_UNAVAILABLE;
-			goto recv_error;
-		}
-
-		if ((rv = nni_msg_header_append(p->rxmsg, p->rxlen, pos+1)) != 0) {
+		} else if (rv != 0) {
+			log_error("Mem error %d\n", rv);
 			rv = NMQ_SERVER_UNAVAILABLE;
 			goto recv_error;
 		}
-		// Submit the rest of the data for a read -- seperate Fixed
-		// header with variable header and so on
-		//  we want to read the entire message now.
-		if (len != 0) {
-			iov[0].iov_buf = nni_msg_body(p->rxmsg);
-			iov[0].iov_len = (size_t) len;
-
-			nni_aio_set_iov(rxaio, 1, iov);
-			// second recv action
-			nng_stream_recv(p->conn, rxaio);
-			nni_mtx_unlock(&p->mtx);
-			return;
-		}
+		log_trace("pipe %p packet %x remaining %ld buffered %ld", p,
+		    *(uint8_t *) nni_msg_header(p->rxmsg), p->rxremain,
+		    nni_mqtt_rxbuf_len(&p->rxbuf));
+	} else {
+		p->rxremain -= n;
+	}
+	if (p->rxremain > 0) {
+		// Packet is larger than what was buffered, read the rest of
+		// it directly into the message body.
+		iov[0].iov_buf = (uint8_t *) nni_msg_body(p->rxmsg) +
+		    nni_msg_len(p->rxmsg) - p->rxremain;
+		iov[0].iov_len = p->rxremain;
+		nni_aio_set_iov(rxaio, 1, iov);
+		nng_stream_recv(p->conn, rxaio);
+		nni_mtx_unlock(&p->mtx);
+		return;
 	}
 
 	// We read a message completely.  Let the user know the good news. use
 	// as application message callback of users
 	nni_aio_list_remove(aio);
 	msg      = p->rxmsg;
-	type     = p->rxlen[0] & 0xf0;
+	type     = nni_msg_cmd_type(msg);
 	p->rxmsg = NULL;
 
 	if (nni_msg_len(msg) == 0 &&
@@ -931,6 +905,7 @@ recv_error:
 		nni_msg_free(p->rxmsg);
 	msg      = NULL;
 	p->rxmsg = NULL;
+	nni_mqtt_rxbuf_reset(&p->rxbuf);
 	nni_mtx_unlock(&p->mtx);
 	nni_aio_set_msg(aio, NULL);
 	// error code cannot be 0. otherwise connection will sustain
@@ -986,7 +961,7 @@ tlstran_pipe_send_start_v4(tlstran_pipe *p, nni_msg *msg, nni_aio *aio)
 	}
 
 	bool      is_sqlite = p->conf->sqlite.enable;
-	int       qlen = 0, topic_len = 0;
+	int       qlen = 0, topic_len = 0, nenc = 0;
 	subinfo  *tinfo = NULL, *info = NULL;
 	nni_list *subinfol = p->npipe->subinfol;
 	char     *topic    = nni_msg_get_pub_topic(msg, &topic_len);
@@ -1020,45 +995,21 @@ tlstran_pipe_send_start_v4(tlstran_pipe *p, nni_msg *msg, nni_aio *aio)
 			break;
 		}
 
-		uint8_t  *body, *header, qos_pac, property_bytes = 0, pos = 1;
-		uint8_t   var_extra[2], fixheader, tmp[4] = { 0 };
-		int       len_offset = 0;
-		uint32_t  property_len = 0;;
-		nni_pipe *pipe;
-		uint16_t  pid;
-		size_t    tlen, rlen, mlen, plength;
+		const nni_mqtt_pubenc *enc;
+		uint8_t               *body, *header, qos_pac;
+		nni_pipe              *pipe;
+		uint16_t               pid = 0;
+		size_t                 tlen;
 
-		pipe   = p->npipe;
-		body   = nni_msg_body(msg);
-		header = nni_msg_header(msg);
-
-		plength = 0;
-		mlen    = nni_msg_len(msg);
+		pipe    = p->npipe;
+		body    = nni_msg_body(msg);
+		header  = nni_msg_header(msg);
 		qos_pac = nni_msg_get_pub_qos(msg);
 		NNI_GET16(body, tlen);
 		if (qos_pac == 0) {
 			// simply set DUP flag to 0 & correct error from client
 			*header &= ~(1 << 3);
-		}
-		if (nni_msg_cmd_type(msg) == CMD_PUBLISH_V5) {
-			// V5 to V4 shrink msg, remove property length
-			// APP layer must give topic name even if topic
-			// alias is set
-			if (qos_pac > 0) {
-				property_len = get_var_integer(
-				    body + 4 + tlen, &property_bytes);
-
-			} else {
-				property_len = get_var_integer(
-				    body + 2 + tlen, &property_bytes);
-			}
-			// V5 msg sent to V4 client
-			// caculate property length and delete it
-
-			plength = property_len + property_bytes;
-		} else if (nni_msg_cmd_type(msg) == CMD_PUBLISH) {
-
-			if (qos_pac == 0) {
+			if (nni_msg_cmd_type(msg) == CMD_PUBLISH) {
 				if (nni_msg_header_len(msg) > 0) {
 					iov[niov].iov_buf = nni_msg_header(msg);
 					iov[niov].iov_len = nni_msg_header_len(msg);
@@ -1074,37 +1025,15 @@ tlstran_pipe_send_start_v4(tlstran_pipe *p, nni_msg *msg, nni_aio *aio)
 			}
 		}
 
-		qos = info->qos;
-		log_trace("qos_pac %d sub %d\n", qos_pac, qos);
-		fixheader = *header;
-		// get final qos
-		qos = qos_pac > qos ? qos : qos_pac;
-
-		// alter qos according to sub qos
-		if (qos_pac > qos) {
-			if (qos == 1) {
-				// set qos to 1
-				fixheader = fixheader & 0xF9;
-				fixheader = fixheader | 0x02;
-			} else {
-				// set qos to 0
-				fixheader  = fixheader & 0xF9;
-				len_offset = len_offset - 2;
-			}
-		}
-		// copy remaining length
-		rlen = put_var_integer(
-		    tmp, get_var_integer(header, &pos) + len_offset - plength);
-		*(p->qos_buf + qlen) = fixheader;
-		// rlen : max 4 bytes
-		memcpy(p->qos_buf + 1 + qlen, tmp, rlen);
-
-		// 1st part of variable header: topic
-		len_offset = 0; // now use it to indicates the pid length
+		// Fixed header and the V5 to V4 shrinking are shared by
+		// every subscriber of this msg, only the pid is ours.
+		enc = nni_mqtt_pubenc_get(
+		    msg, p->pro_ver, info->qos, true, 0, &p->txenc[nenc++]);
+		qos = enc->qos;
+		log_trace("qos_pac %d sub %d\n", qos_pac, info->qos);
+
 		// packet id
 		if (qos > 0) {
-			// set pid
-			len_offset = 2;
 			nni_msg *old;
 			// to differ resend msg
 			pid = (uint16_t) (size_t) nni_aio_get_prov_data(aio);
@@ -1132,35 +1061,28 @@ tlstran_pipe_send_start_v4(tlstran_pipe *p, nni_msg *msg, nni_aio *aio)
 				    pipe->nano_qos_db,
 				    p->conf->sqlite.disk_cache_size);
 			}
-			NNI_PUT16(var_extra, pid);
-		} else if (qos_pac > 0) {
-			len_offset += 2;
 		}
 		// fixed header
-		iov[niov].iov_buf = p->qos_buf+qlen;
-		iov[niov].iov_len = 1+rlen;
+		iov[niov].iov_buf = (void *) enc->hdr;
+		iov[niov].iov_len = enc->hdrlen;
 		niov++;
-		qlen += rlen + 1;
 		// topic + tlen
 		iov[niov].iov_buf = body;
-		iov[niov].iov_len = 2+tlen;
+		iov[niov].iov_len = 2 + tlen;
 		niov++;
 		// packet id if any
-		if (qos > 0) {
-			// copy packet id
-			memcpy(p->qos_buf + 5 + qlen, var_extra, 2);
-			iov[niov].iov_buf = p->qos_buf + 5 + qlen;
-			iov[niov].iov_len = 2;
+		if (enc->pidlen > 0) {
+			memcpy(p->qos_buf + qlen, enc->var, enc->varlen);
+			NNI_PUT16(p->qos_buf + qlen, pid);
+			iov[niov].iov_buf = p->qos_buf + qlen;
+			iov[niov].iov_len = enc->varlen;
 			niov++;
-			qlen += 2;
+			qlen += enc->varlen;
 		}
-		// variable header + payload
-		if (mlen > 0) {
-			// determine if it needs to skip packet id field
-			iov[niov].iov_buf =
-			    body + 2 + tlen + len_offset + plength;
-			iov[niov].iov_len =
-			    mlen - 2 - len_offset - tlen - plength;
+		// payload
+		if (enc->tail > 0) {
+			iov[niov].iov_buf = body + enc->skip;
+			iov[niov].iov_len = enc->tail;
 			niov++;
 		}
 	}
@@ -1223,12 +1145,10 @@ tlstran_pipe_send_start_v5(tlstran_pipe *p, nni_msg *msg, nni_aio *aio)
 	}
 	// never modify the original msg
 
-	uint8_t *     body, *header, qos_pac, prop_bytes = 0;
-	target_prover target_prover = 0;
-	int           len_offset = 0, sub_id = 0, qos = 0;
-	uint16_t      pid;
-	uint32_t tprop_bytes = 0, id_bytes = 0, property_len = 0;
-	size_t   tlen, rlen, mlen, hlen, qlength, plength;
+	uint8_t *body, *header, qos_pac;
+	int      qos = 0, nenc = 0;
+	uint16_t pid;
+	size_t   tlen, mlen, hlen, qlength;
 
 	bool is_sqlite = p->conf->sqlite.enable;
 
@@ -1237,7 +1157,6 @@ tlstran_pipe_send_start_v5(tlstran_pipe *p, nni_msg *msg, nni_aio *aio)
 	header  = nni_msg_header(msg);
 	niov    = 0;
 	qlength = 0;
-	plength = 0;
 	mlen    = nni_msg_len(msg);
 	hlen    = nni_msg_header_len(msg);
 	qos_pac = nni_msg_get_pub_qos(msg);
@@ -1260,174 +1179,102 @@ tlstran_pipe_send_start_v5(tlstran_pipe *p, nni_msg *msg, nni_aio *aio)
 		nni_aio_finish(aio, 0, 0);
 		return;
 	}
-	if (nni_msg_cmd_type(msg) == CMD_PUBLISH_V5) {
-		if (qos_pac > 0) {
-			property_len =
-			    get_var_integer(body + 4 + tlen, &prop_bytes);
-		} else {
-			property_len =
-			    get_var_integer(body + 2 + tlen, &prop_bytes);
-		}
-		target_prover = MQTTV5;
-		tprop_bytes   = prop_bytes;
-	}
 	// subid
 	subinfo *info, *tinfo;
 	tinfo = nni_aio_get_prov_data(txaio);
+
 	nni_aio_set_prov_data(txaio, NULL);
 	NNI_LIST_FOREACH (p->npipe->subinfol, info) {
 		if (tinfo != NULL && info != tinfo) {
 			continue;
 		}
-		if (info->no_local == 1 && p->npipe->p_id == nni_msg_get_pipe(msg)) {
+		if (info->no_local == 1 &&
+		    p->npipe->p_id == nni_msg_get_pipe(msg)) {
 			continue;
 		}
 		tinfo           = NULL;
-		len_offset      = 0;
 		char *sub_topic = info->topic;
 		if (sub_topic[0] == '$') {
-			if (0 == strncmp(sub_topic, "$share/", strlen("$share/"))) {
+			if (0 ==
+			    strncmp(sub_topic, "$share/", strlen("$share/"))) {
 				sub_topic = strchr(sub_topic, '/');
 				sub_topic++;
 				sub_topic = strchr(sub_topic, '/');
 				sub_topic++;
 			}
 		}
-		if (topic_filtern(sub_topic, (char *)(body + 2), tlen)) {
-			if (niov >= 8) {
-				// nng aio only allow 2 msgs at a time
+		if (topic_filtern(sub_topic, (char *) (body + 2), tlen)) {
+			if (niov > 4) {
+				// up to 4 iovs per msg, keep within iov[8]
 				nni_aio_set_prov_data(txaio, info);
 				break;
 			}
-			uint8_t  var_extra[2], fixheader, tmp[4] = { 0 }, pos = 1;
-			uint8_t  proplen[4] = { 0 }, var_subid[5] = { 0 };
-			sub_id       = info->subid;
-			qos          = info->qos;
+			const nni_mqtt_pubenc *enc;
+			bool                   retain = info->rap != 0 ||
+			    nni_mqtt_msg_get_sub_retain_bool(msg);
+
+			// Fixed header, property length and subid are
+			// shared by every subscriber with the same
+			// qos/rap/subid, only the packet id is ours.
+			enc = nni_mqtt_pubenc_get(msg, p->pro_ver, info->qos,
+			    retain, (uint32_t) info->subid, &p->txenc[nenc++]);
+			qos = enc->qos;
 
-			fixheader = *header;
-			if (nni_msg_cmd_type(msg) == CMD_PUBLISH) {
-				// V4 to V5 add 0 property length
-				target_prover = MQTTV4_V5;
-				prop_bytes    = 1;
-				tprop_bytes   = 1;
-				len_offset    = 1;
-			}
-			if (info->rap == 0 && !nni_mqtt_msg_get_sub_retain_bool(msg)) {
-				fixheader = fixheader & 0xFE;
-			}
-			if (sub_id != 0) {
-				var_subid[0] = 0x0B;
-				id_bytes = put_var_integer(var_subid+1, sub_id);
-				tprop_bytes = put_var_integer(proplen, property_len+1+id_bytes);
-				len_offset += (tprop_bytes - prop_bytes + 1 + id_bytes);
-			}
-			// get final qos
-			qos = qos_pac > qos ? qos : qos_pac;
-
-			// alter qos according to sub qos
-			if (qos_pac > qos) {
-				if (qos == 1) {
-					// set qos to 1
-					fixheader = fixheader & 0xF9;
-					fixheader = fixheader | 0x02;
-				} else {
-					// set qos to 0
-					fixheader  = fixheader & 0xF9;
-					len_offset = len_offset - 2;
-				}
-			}
 			// fixed header + remaining length
-			pos  = 1;
-			rlen = put_var_integer(
-			    tmp, get_var_integer(header, &pos) + len_offset);
-			// or just copy to qosbuf directly?
-			*(p->qos_buf + qlength) = fixheader;
-			memcpy(p->qos_buf + qlength + 1, tmp, rlen);
-			iov[niov].iov_buf = p->qos_buf + qlength;
-			iov[niov].iov_len = rlen + 1;
+			iov[niov].iov_buf = (void *) enc->hdr;
+			iov[niov].iov_len = enc->hdrlen;
 			niov++;
-			qlength += rlen + 1;
 			// 1st part of variable header: topic + topic len
 			iov[niov].iov_buf = body;
 			iov[niov].iov_len = tlen + 2;
 			niov++;
-			// len to indicate the offset in packet
-			len_offset = 0;
-			plength    = 0;
 			if (qos > 0) {
-				// set pid
-				len_offset = 2;
 				nni_msg *old;
 				// packetid in aio to differ resend msg
-				// TODO replace it with set prov data/pipe
-				pid = (uint16_t)(size_t) nni_aio_get_prov_data(aio);
+				pid = (uint16_t) (size_t) nni_aio_get_prov_data(aio);
 				if (pid == 0) {
 					// first time send this msg
 					pid = nni_pipe_inc_packetid(pipe);
 					// store msg for qos retry
 					nni_msg_clone(msg);
-					if ((old = nni_qos_db_get(is_sqlite,
-					         pipe->nano_qos_db, pipe->p_id,
-					         pid)) != NULL) {
+					if ((old = nni_qos_db_get(is_sqlite, pipe->nano_qos_db,
+											  pipe->p_id, pid)) != NULL) {
 						// TODO packetid already
 						// exists. do we need to
 						// replace old with new one ?
 						// print warning to users
-						log_error("packet id "
-						          "duplicates in "
-						          "nano_qos_db");
-
+						log_error("packet id duplicates in nano_qos_db");
 						nni_qos_db_remove_msg(
 						    is_sqlite,
 						    pipe->nano_qos_db, old);
 					}
 					old = msg;
 					nni_qos_db_set(is_sqlite,
-					    pipe->nano_qos_db, pipe->p_id, pid,
-					    old);
+					    pipe->nano_qos_db, pipe->p_id, pid, old);
 					nni_qos_db_remove_oldest(is_sqlite,
 					    pipe->nano_qos_db,
 					    p->conf->sqlite.disk_cache_size);
 				}
-				NNI_PUT16(var_extra, pid);
-				// copy packet id
-				memcpy(p->qos_buf + qlength, var_extra, 2);
-				qlength += 2;
-				plength += 2;
-			} else if (qos_pac > 0) {
-				//ignore the packet id of original packet
-				len_offset += 2;
+				// 2nd part of variable header: pid +
+				// proplen+0x0B+subid, patch our pid in
+				memcpy(p->qos_buf + qlength, enc->var,
+				    enc->varlen);
+				NNI_PUT16(p->qos_buf + qlength, pid);
+				iov[niov].iov_buf = p->qos_buf + qlength;
+				iov[niov].iov_len = enc->varlen;
+				niov++;
+				qlength += enc->varlen;
+			} else if (enc->varlen > 0) {
+				iov[niov].iov_buf = (void *) enc->var;
+				iov[niov].iov_len = enc->varlen;
+				niov++;
 			}
-			// prop len + sub id if any
-			if (sub_id != 0) {
-				memcpy(p->qos_buf + qlength, proplen,
-				    tprop_bytes);
-				qlength += tprop_bytes;
-				plength += tprop_bytes;
-				memcpy(p->qos_buf + qlength, var_subid,
-				    id_bytes + 1);
-				qlength += id_bytes + 1;
-				plength += id_bytes + 1;
-				if (target_prover == MQTTV5)
-					len_offset += prop_bytes;
-			} else {
-				//need to add 0 len for V4 msg
-				if (target_prover == MQTTV4_V5) {
-					// add proplen even 0
-					memcpy(p->qos_buf + qlength, proplen,
-					    tprop_bytes);
-					qlength += tprop_bytes;
-					plength += tprop_bytes;
-				}
-			}
-			// 2nd part of variable header: pid + proplen+0x0B+subid
-			iov[niov].iov_buf = p->qos_buf+qlength-plength;
-			iov[niov].iov_len = plength;
-			niov++;
 			// prop + body
-			iov[niov].iov_buf = body + 2 + tlen + len_offset;
-			iov[niov].iov_len = mlen - 2 - len_offset - tlen;
-			niov++;
+			if (enc->tail > 0) {
+				iov[niov].iov_buf = body + enc->skip;
+				iov[niov].iov_len = enc->tail;
+				niov++;
+			}
 		}
 	}
 
@@ -1641,13 +1488,17 @@ tlstran_pipe_recv_start(tlstran_pipe *p)
 		return;
 	}
 
-	// Schedule a read of the fixed header.
-	rxaio         = p->rxaio;
-	p->gotrxhead  = 0;
-	p->wantrxhead = NANO_MIN_FIXED_HEADER_LEN;
-	iov.iov_buf   = p->rxlen;
-	iov.iov_len   = NANO_MIN_FIXED_HEADER_LEN;
-	memset(p->rxlen, '\0', NNI_NANO_MAX_HEADER_SIZE * sizeof(p->rxlen[0]));
+	rxaio = p->rxaio;
+	if (nni_mqtt_rxbuf_ready(&p->rxbuf)) {
+		// Next packet is already buffered, complete the rxaio without
+		// going down to the TLS stream.
+		if (nni_aio_begin(rxaio) == 0) {
+			nni_aio_finish(rxaio, 0, 0);
+		}
+		return;
+	}
+	// Read as much as is available, we parse packets out of the buffer.
+	nni_mqtt_rxbuf_iov(&p->rxbuf, &iov);
 	nni_aio_set_iov(rxaio, 1, &iov);
 	nng_stream_recv(p->conn, rxaio);
 }
@@ -2046,6 +1897,43 @@ tlstran_ep_set_recvmaxsz(void *arg, const void *v, size_t sz, nni_opt_type t)
 	return (rv);
 }
 
+// tlstran_ep_tls_conf finds the TLS settings of this listener, which is
+// either one of the extra listeners or the main one.
+static conf_tls *
+tlstran_ep_tls_conf(tlstran_ep *ep)
+{
+	conf *c = ep->conf;
+
+	for (size_t i = 0; i < c->tls_list.count; i++) {
+		conf_tls *node = c->tls_list.nodes[i];
+		if ((node->url != NULL) &&
+		    (strcmp(node->url, ep->url->u_rawurl) == 0)) {
+			return (node);
+		}
+	}
+	return (&c->tls);
+}
+
+// tlstran_ep_ktls turns on kernel TLS for the listener's configuration
+// if asked to.  Not having it is not fatal, connections simply stay with
+// the TLS engine.
+static void
+tlstran_ep_ktls(tlstran_ep *ep)
+{
+	nng_tls_config *cfg;
+	int             rv;
+
+	if ((ep->conf == NULL) || !tlstran_ep_tls_conf(ep)->ktls) {
+		return;
+	}
+	if (((rv = nng_stream_listener_get_ptr(ep->listener,
+	          NNG_OPT_TLS_CONFIG, (void **) &cfg)) != 0) ||
+	    ((rv = nng_tls_config_ktls(cfg, true)) != 0)) {
+		log_warn("kernel TLS not enabled for %s: %s",
+		    ep->url->u_rawurl, nng_strerror(rv));
+	}
+}
+
 static int
 tlstran_ep_bind(void *arg)
 {
@@ -2053,6 +1941,7 @@ tlstran_ep_bind(void *arg)
 	int         rv;
 
 	nni_mtx_lock(&ep->mtx);
+	tlstran_ep_ktls(ep);
 	rv = nng_stream_listener_listen(ep->listener);
 	nni_mtx_unlock(&ep->mtx);
 
@@ -28,6 +28,8 @@
 #include "nng/supplemental/nanolib/conf.h"
 #include "supplemental/mqtt/mqtt_qos_db_api.h"
 #include "supplemental/mqtt/mqtt_msg.h"
+#include "supplemental/mqtt/mqtt_pubenc.h"
+#include "supplemental/mqtt/mqtt_rxbuf.h"
 
 typedef struct ws_listener ws_listener;
 typedef struct ws_pipe     ws_pipe;
@@ -141,8 +143,10 @@ wstran_pipe_recv_cb(void *arg)
 {
 	ws_pipe *p = arg;
 	nni_iov  iov[2];
-	uint8_t  rv, count = 0, pos = 1;
+	uint8_t  rv, count = 0;
 	uint64_t len = 0;
+	uint32_t remlen;
+	size_t   hdrlen, index = 0;
 	uint8_t *ptr;
 	nni_msg *smsg = NULL, *msg = NULL;
 	nni_msg **msg_vec = NULL;
@@ -182,23 +186,18 @@ wstran_pipe_recv_cb(void *arg)
 	ptr = nni_msg_body(p->tmp_msg); // packet might be sticky?
 
 	if (p->wantrxhead == 0) {
-		if (p->gotrxhead == 1) {
-			goto recv;
-		}
-		len = get_var_integer(ptr, &pos);
-		if (*(ptr + pos - 1) > 0x7f) {
+		rv = nni_mqtt_frame_parse(ptr, p->gotrxhead, &hdrlen, &remlen);
+		if (rv == NNG_EAGAIN) {
 			// continue to next byte of remaining length
-			if (p->gotrxhead >= NNI_NANO_MAX_HEADER_SIZE) {
-				// length error
-				rv = NNG_EMSGSIZE;
-				goto reset;
-			}
 			goto recv;
-		} else {
-			// Fixed header finished
-			p->wantrxhead = len + pos;
-			nni_msg_set_cmd_type(p->tmp_msg, *ptr & 0xf0);
+		} else if (rv != 0) {
+			// length error
+			rv = NNG_EMSGSIZE;
+			goto reset;
 		}
+		// Fixed header finished
+		p->wantrxhead = remlen + hdrlen;
+		nni_msg_set_cmd_type(p->tmp_msg, *ptr & 0xf0);
 	}
 	if (p->wantrxhead > p->gotrxhead)
 		goto recv;
@@ -207,12 +206,16 @@ wstran_pipe_recv_cb(void *arg)
 		goto done;
 	}
 
-	size_t index = 0;
-	pos = 1;
+	// Split every complete packet out of the buffer, a trailing partial
+	// one is kept for the next read.
 	while (p->gotrxhead > index) {
-		len = get_var_integer(ptr, &pos);
-		// Fixed header finished
-		index += len + pos;
+		if (nni_mqtt_frame_parse(ptr, p->gotrxhead - index, &hdrlen,
+		        &remlen) != 0 ||
+		    hdrlen + remlen > p->gotrxhead - index) {
+			break;
+		}
+		len = remlen;
+		index += hdrlen + len;
 		nni_msg *new;
 		count ++;
 		if (nni_msg_alloc(&new, 0) != 0) {
@@ -228,15 +231,9 @@ wstran_pipe_recv_cb(void *arg)
 			nni_lmq_put(&p->recvlmq, new);
 		}
 		cvector_push_back(msg_vec, new);
-		ptr = ptr + len + pos;
-		pos = 1;
-	}
-	if (p->gotrxhead < index) {
-		log_error("Decoding error!");
-		goto skip;
-	} else if (p->gotrxhead == index) {
-		goto done;
+		ptr = ptr + hdrlen + len;
 	}
+	goto done;
 recv:
 	nni_msg_free(msg);
 	msg = NULL;
@@ -294,8 +291,14 @@ done:
 		nni_mtx_unlock(&p->mtx);
 		return;
 	}
-	nni_msg_free(p->tmp_msg);
-	p->tmp_msg = NULL;
+	if (index < nni_msg_len(p->tmp_msg)) {
+		// keep the partial packet that followed for the next read
+		nni_msg_trim(p->tmp_msg, index);
+		p->gotrxhead = nni_msg_len(p->tmp_msg);
+	} else {
+		nni_msg_free(p->tmp_msg);
+		p->tmp_msg = NULL;
+	}
 	if (p->ws_param == NULL) {
 		log_warn("Malformed Packet!");
 		goto reset;
@@ -527,59 +530,81 @@ wstran_pipe_send_cancel(nni_aio *aio, void *arg, int rv)
 	nni_aio_finish_error(aio, rv);
 }
 
+// Appends msg, encoded as enc describes, to smsg.  Stores msg for
+// retrying if the granted QoS needs a packet id.
+static void
+wstran_pipe_append_pub(ws_pipe *p, nni_msg *smsg, nni_msg *msg,
+    const nni_mqtt_pubenc *enc, nni_aio *aio)
+{
+	nni_pipe *pipe = p->npipe;
+	uint8_t  *body = nni_msg_body(msg);
+	uint8_t   var[sizeof(enc->var)];
+	uint16_t  pid;
+	size_t    tlen;
+	bool      is_sqlite = p->conf->sqlite.enable;
+
+	NNI_GET16(body, tlen);
+	memcpy(var, enc->var, enc->varlen);
+	if (enc->pidlen > 0) {
+		nni_msg *old;
+		// packetid in aio to differ resend msg
+		pid = (uint16_t) (size_t) nni_aio_get_prov_data(aio);
+		if (pid == 0) {
+			// first time send this msg
+			pid = nni_pipe_inc_packetid(pipe);
+			// store msg for qos retrying
+			nni_msg_clone(msg);
+			if ((old = nni_qos_db_get(is_sqlite, pipe->nano_qos_db,
+			         pipe->p_id, pid)) != NULL) {
+				// TODO packetid already exists.
+				// we need to replace old with new one
+				// print warning to users
+				nni_println("ERROR: packet id duplicates in "
+				            "nano_qos_db");
+				nni_qos_db_remove_msg(
+				    is_sqlite, pipe->nano_qos_db, old);
+			}
+			old = msg;
+			nni_qos_db_set(
+			    is_sqlite, pipe->nano_qos_db, pipe->p_id, pid, old);
+			nni_qos_db_remove_oldest(is_sqlite, pipe->nano_qos_db,
+			    p->conf->sqlite.disk_cache_size);
+		}
+		NNI_PUT16(var, pid);
+	}
+	nni_msg_append(smsg, enc->hdr, enc->hdrlen);
+	// 1st part of variable header: topic + topic len
+	nni_msg_append(smsg, body, tlen + 2);
+	// 2nd part of variable header: pid + proplen+0x0B+subid
+	nni_msg_append(smsg, var, enc->varlen);
+	// prop + body
+	nni_msg_append(smsg, body + enc->skip, enc->tail);
+}
+
 static inline void
 wstran_pipe_send_start_v4(ws_pipe *p, nni_msg *msg, nni_aio *aio)
 {
-	nni_msg  *smsg = NULL;
-	int       niov;
-	nni_iov   iov[8];
-	nni_pipe *pipe = p->npipe;
-	uint8_t   qos = 0;
+	nni_msg *smsg = NULL;
 
 
 	if (nni_msg_get_type(msg) != CMD_PUBLISH)
 		goto send;
 
 	// never modify the original msg
-	int           len_offset = 0;
-	uint8_t *     body, *header, qos_pac, prop_bytes = 0;
-	uint16_t      pid;
-	uint32_t      property_len = 0;
-	size_t        tlen, rlen, mlen, qlength, plength;
-	bool          is_sqlite = p->conf->sqlite.enable;
-
-	body    = nni_msg_body(msg);
-	header  = nni_msg_header(msg);
-	niov    = 0;
-	qlength = 0;
-	plength = 0;
-	mlen    = nni_msg_len(msg);
-	qos_pac = nni_msg_get_pub_qos(msg);
+	uint8_t *body;
+	size_t   tlen;
+
+	body = nni_msg_body(msg);
 	NNI_GET16(body, tlen);
 
 	subinfo *info, *tinfo = NULL;
 	nni_msg_alloc(&smsg, 0);
-	if (nni_msg_cmd_type(msg) == CMD_PUBLISH_V5) {
-		// V5 to V4 shrink msg, remove property length
-		// APP layer must give topic name even if topic
-		// alias is set
-		if (qos_pac > 0) {
-			property_len =
-			    get_var_integer(body + 4 + tlen, &prop_bytes);
-
-		} else {
-			property_len =
-			    get_var_integer(body + 2 + tlen, &prop_bytes);
-		}
-		plength       = property_len + prop_bytes;
-	}
 
 	NNI_LIST_FOREACH (p->npipe->subinfol, info) {
 		if (tinfo != NULL && info != tinfo ) {
 			continue;
 		}
 		tinfo = NULL;
-		len_offset=0;
 		char *sub_topic = info->topic;
 		if (sub_topic[0] == '$') {
 			if (0 == strncmp(sub_topic, "$share/", strlen("$share/"))) {
@@ -590,99 +615,12 @@ wstran_pipe_send_start_v4(ws_pipe *p, nni_msg *msg, nni_aio *aio)
 			}
 		}
 		if (topic_filtern(sub_topic, (char *) (body + 2), tlen)) {
-			uint8_t pos    = 1, var_extra[2], fixheader,
-			        tmp[4] = { 0 };
-			qos            = info->qos;
-			fixheader      = *header;
-
-			// get final qos
-			qos = qos_pac > qos ? qos : qos_pac;
-
-			// alter qos according to sub qos
-			if (qos_pac > qos) {
-				if (qos == 1) {
-					// set qos to 1
-					fixheader = fixheader & 0xF9;
-					fixheader = fixheader | 0x02;
-				} else {
-					// set qos to 0
-					fixheader = fixheader & 0xF9;
-					len_offset   = len_offset - 2;
-				}
-			}
-			// fixed header + remaining length
-			rlen = put_var_integer(tmp,
-			    get_var_integer(header, &pos) + len_offset -
-			        plength);
-			*(p->qos_buf + qlength) = fixheader;
-			// copy remaining length
-			memcpy(p->qos_buf + qlength + 1, tmp, rlen);
-			iov[niov].iov_buf = p->qos_buf + qlength;
-			iov[niov].iov_len = rlen + 1;
-			niov++;
-			qlength += rlen + 1;
-			// 1st part of variable header: topic + topic len
-			iov[niov].iov_buf = body;
-			iov[niov].iov_len = tlen+2;
-			niov++;
-			// len to indicate the offset in packet
-			len_offset = 0;
-			if (qos > 0) {
-				// set pid
-				len_offset = 2;
-				nni_msg *old;
-				// packetid in aio to differ resend msg
-				// TODO replace it with set prov data
-				pid = (uint16_t)(size_t) nni_aio_get_prov_data(aio);
-				if (pid == 0) {
-					// first time send this msg
-					pid = nni_pipe_inc_packetid(pipe);
-					// store msg for qos retrying
-					nni_msg_clone(msg);
-					if ((old = nni_qos_db_get(is_sqlite,
-					         pipe->nano_qos_db, pipe->p_id,
-					         pid)) != NULL) {
-						// TODO packetid already
-						// exists. we need to
-						// replace old with new one
-						// print warning to users
-						nni_println("ERROR: packet id "
-						            "duplicates in "
-						            "nano_qos_db");
-						nni_qos_db_remove_msg(
-						    is_sqlite,
-						    pipe->nano_qos_db, old);
-					}
-					old = msg;
-					nni_qos_db_set(is_sqlite,
-					    pipe->nano_qos_db, pipe->p_id, pid,
-					    old);
-					nni_qos_db_remove_oldest(is_sqlite,
-					    pipe->nano_qos_db,
-					    p->conf->sqlite.disk_cache_size);
-				}
-				NNI_PUT16(var_extra, pid);
-				// copy packet id
-				memcpy(p->qos_buf + qlength, var_extra, 2);
-			} else if (qos_pac > 0) {
-				//ignore the packet id of original packet
-				len_offset += 2;
-			}
-			// 2nd part of variable header: pid
-			iov[niov].iov_buf = p->qos_buf + qlength;
-			iov[niov].iov_len = qos > 0 ? 2 : 0;
-			niov++;
-			qlength += qos > 0 ? 2 : 0;
-			// body
-			iov[niov].iov_buf = body + 2 + tlen + len_offset + plength;
-			iov[niov].iov_len = mlen - 2 - len_offset - tlen - plength;
-			niov++;
-			// apending directly
-			for (int i = 0; i < niov; i++) {
-				nni_msg_append(
-				    smsg, iov[i].iov_buf, iov[i].iov_len);
-			}
-			niov = 0;
+			const nni_mqtt_pubenc *enc;
+			nni_mqtt_pubenc        scratch;
+
+			enc = nni_mqtt_pubenc_get(msg, p->ws_param->pro_ver,
+			    info->qos, true, 0, &scratch);
+			wstran_pipe_append_pub(p, smsg, msg, enc, aio);
 		}
 	}
 
@@ -714,33 +652,20 @@ send:
 static inline void
 wstran_pipe_send_start_v5(ws_pipe *p, nni_msg *msg, nni_aio *aio)
 {
-	nni_msg  *smsg = NULL;
-	int       niov;
-	nni_iov   iov[8];
-	nni_pipe *pipe = p->npipe;
-	uint8_t   qos = 0;
+	nni_msg *smsg = NULL;
+	uint8_t  qos  = 0;
 
 
 	if (nni_msg_get_type(msg) != CMD_PUBLISH)
 		goto send;
 
 	// never modify the original msg
-	uint8_t *     body, *header, qos_pac, tprop_bytes = 0, prop_bytes = 0;
-	target_prover target_prover;
-	int           len_offset = 0, sub_id = 0;
-	uint16_t      pid;
-	uint32_t      id_bytes = 0, property_len = 0;
-	size_t        tlen, rlen, mlen, hlen, qlength, plength;
-	bool          is_sqlite = p->conf->sqlite.enable;
-
-	body    = nni_msg_body(msg);
-	header  = nni_msg_header(msg);
-	niov    = 0;
-	qlength = 0;
-	plength = 0;
-	mlen    = nni_msg_len(msg);
-	hlen    = nni_msg_header_len(msg);
-	qos_pac = nni_msg_get_pub_qos(msg);
+	uint8_t *body;
+	size_t   tlen, mlen, hlen;
+
+	body = nni_msg_body(msg);
+	mlen = nni_msg_len(msg);
+	hlen = nni_msg_header_len(msg);
 	NNI_GET16(body, tlen);
 
 	// check max packet size for this client/msg
@@ -757,22 +682,6 @@ wstran_pipe_send_start_v5(ws_pipe *p, nni_msg *msg, nni_aio *aio)
 		return;
 	}
 
-	if (nni_msg_cmd_type(msg) == CMD_PUBLISH_V5) {
-		// V5 to V4 shrink msg, remove property length
-		// APP layer must give topic name even if topic
-		// alias is set
-		if (qos_pac > 0) {
-			property_len = get_var_integer(
-			    body + 4 + tlen, &prop_bytes);
-
-		} else {
-			property_len = get_var_integer(
-			    body + 2 + tlen, &prop_bytes);
-		}
-		target_prover = MQTTV5;
-		plength = property_len + prop_bytes;
-	}
-
 	// subid
 	subinfo *info = NULL;
 	nni_msg_alloc(&smsg, 0);
@@ -782,7 +691,6 @@ wstran_pipe_send_start_v5(ws_pipe *p, nni_msg *msg, nni_aio *aio)
 		    p->npipe->p_id == nni_msg_get_pipe(msg)) {
 			continue;
 		}
-		len_offset      = 0;
 		char *sub_topic = info->topic;
 		if (sub_topic[0] == '$') {
 			if (0 ==
@@ -794,142 +702,15 @@ wstran_pipe_send_start_v5(ws_pipe *p, nni_msg *msg, nni_aio *aio)
 			}
 		}
 		if (topic_filtern(sub_topic, (char *) (body + 2), tlen)) {
-			uint8_t  var_extra[2], fixheader, tmp[4] = { 0 }, pos = 1;
-			uint8_t  proplen[4] = { 0 }, var_subid[5] = { 0 };
-			sub_id       = info->subid;
-			qos          = info->qos;
-
-			//else use original var payload & pid
-			fixheader = *header;
-			if (nni_msg_cmd_type(msg) == CMD_PUBLISH) {
-				// V4 to V5 add 0 property length
-				target_prover = MQTTV4_V5;
-				prop_bytes    = 1;
-				tprop_bytes   = 1;
-				len_offset    = 1;
-			}
-			if (info->rap == 0 && !nni_mqtt_msg_get_sub_retain_bool(msg)) {
-				fixheader = fixheader & 0xFE;
-			}
-			if (sub_id != 0) {
-				var_subid[0] = 0x0B;
-				id_bytes = put_var_integer(var_subid+1, sub_id);
-				tprop_bytes = put_var_integer(proplen, property_len+1+id_bytes);
-				len_offset += (tprop_bytes - prop_bytes + 1 + id_bytes);
-			}
-
-			// get final qos
-			qos = qos_pac > qos ? qos : qos_pac;
-
-			// alter qos according to sub qos
-			if (qos_pac > qos) {
-				if (qos == 1) {
-					// set qos to 1
-					fixheader = fixheader & 0xF9;
-					fixheader = fixheader | 0x02;
-				} else {
-					// set qos to 0
-					fixheader = fixheader & 0xF9;
-					len_offset   = len_offset - 2;
-				}
-			}
-			// fixed header + remaining length
-			rlen = put_var_integer(
-			    tmp, get_var_integer(header, &pos) + len_offset);
-			// or just copy to qosbuf directly?
-			*(p->qos_buf + qlength) = fixheader;
-			memcpy(p->qos_buf + qlength + 1, tmp, rlen);
-			iov[niov].iov_buf = p->qos_buf + qlength;
-			iov[niov].iov_len = rlen + 1;
-			niov++;
-			qlength += rlen + 1;
-			// 1st part of variable header: topic + topic len
-			iov[niov].iov_buf = body;
-			iov[niov].iov_len = tlen+2;
-			niov++;
-			// len to indicate the offset in packet
-			len_offset = 0;
-			plength = 0;
-			if (qos > 0) {
-				// set pid
-				len_offset = 2;
-				nni_msg *old;
-				// packetid in aio to differ resend msg
-				// TODO replace it with set prov data
-				pid = (uint16_t)(size_t) nni_aio_get_prov_data(
-				    aio);
-				if (pid == 0) {
-					// first time send this msg
-					pid = nni_pipe_inc_packetid(pipe);
-					// store msg for qos retrying
-					nni_msg_clone(msg);
-					if ((old = nni_qos_db_get(is_sqlite,
-					         pipe->nano_qos_db, pipe->p_id,
-					         pid)) != NULL) {
-						// TODO packetid already
-						// exists. we need to
-						// replace old with new one
-						// print warning to users
-						nni_println("ERROR: packet id "
-						            "duplicates in "
-						            "nano_qos_db");
-						nni_qos_db_remove_msg(
-						    is_sqlite,
-						    pipe->nano_qos_db, old);
-					}
-					old = msg;
-					nni_qos_db_set(is_sqlite,
-					    pipe->nano_qos_db, pipe->p_id, pid,
-					    old);
-					nni_qos_db_remove_oldest(is_sqlite,
-					    pipe->nano_qos_db,
-					    p->conf->sqlite.disk_cache_size);
-				}
-				NNI_PUT16(var_extra, pid);
-				// copy packet id
-				memcpy(p->qos_buf + qlength, var_extra, 2);
-				qlength += 2;
-				plength += 2;
-			} else if (qos_pac > 0) {
-				//ignore the packet id of original packet
-				len_offset += 2;
-			}
-			// prop len + sub id if any
-			if (sub_id != 0) {
-				memcpy(p->qos_buf + qlength, proplen,
-				    tprop_bytes);
-				qlength += tprop_bytes;
-				plength += tprop_bytes;
-				memcpy(p->qos_buf + qlength, var_subid,
-				    id_bytes + 1);
-				qlength += id_bytes + 1;
-				plength += id_bytes + 1;
-				if (target_prover == MQTTV5)
-					len_offset += prop_bytes;
-			} else {
-				//need to add 0 len for V4 msg
-				if (target_prover == MQTTV4_V5) {
-					// add proplen even 0
-					memcpy(p->qos_buf + qlength, proplen,
-					    tprop_bytes);
-					qlength += tprop_bytes;
-					plength += tprop_bytes;
-				}
-			}
-			// 2nd part of variable header: pid + proplen+0x0B+subid
-			iov[niov].iov_buf = p->qos_buf+qlength-plength;
-			iov[niov].iov_len = plength;
-			niov++;
-			// prop + body
-			iov[niov].iov_buf = body + 2 + tlen + len_offset;
-			iov[niov].iov_len = mlen - 2 - len_offset - tlen;
-			niov++;
-			// apending directly
-			for (int i = 0; i < niov; i++) {
-				nni_msg_append(
-				    smsg, iov[i].iov_buf, iov[i].iov_len);
-			}
-			niov = 0;
+			const nni_mqtt_pubenc *enc;
+			nni_mqtt_pubenc        scratch;
+			bool                   retain = info->rap != 0 ||
+			    nni_mqtt_msg_get_sub_retain_bool(msg);
+
+			enc = nni_mqtt_pubenc_get(msg, p->ws_param->pro_ver, info->qos,
+			    retain, (uint32_t) info->subid, &scratch);
+			qos = enc->qos;
+			wstran_pipe_append_pub(p, smsg, msg, enc, aio);
 		}
 	}
 
@@ -284,6 +284,12 @@ extern int nni_http_handler_init_file_ctype(
 extern int nni_http_handler_init_directory(
     nni_http_handler **, const char *, const char *);
 
+// nni_http_handler_set_file_cache lets a file or directory handler keep
+// up to the given number of bytes of small, recently served files in
+// memory.  The cache is disabled (zero) by default.  Cached files are
+// still checked against the file system on every request.
+extern int nni_http_handler_set_file_cache(nni_http_handler *, size_t);
+
 // nni_http_handler_init_static creates a handler that serves up static content
 // supplied, with the Content-Type supplied in the final argument.
 extern int nni_http_handler_init_static(
@@ -649,6 +649,18 @@ nng_http_handler_set_tree_exclusive(nng_http_handler *h)
 #endif
 }
 
+int
+nng_http_handler_set_file_cache(nng_http_handler *h, size_t max)
+{
+#ifdef NNG_SUPP_HTTP
+	return (nni_http_handler_set_file_cache(h, max));
+#else
+	NNI_ARG_UNUSED(h);
+	NNI_ARG_UNUSED(max);
+	return (NNG_ENOTSUP);
+#endif
+}
+
 int
 nng_http_handler_set_data(nng_http_handler *h, void *dat, void (*dtor)(void *))
 {
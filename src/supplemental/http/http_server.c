@@ -40,6 +40,21 @@ struct nng_http_handler {
 	void (*cb)(nni_aio *);
 };
 
+// Files (or ranges of them) larger than this are not read into memory
+// whole, but streamed out to the client this much at a time once the
+// response header has been sent.
+#define HTTP_FILE_CHUNK (64 * 1024)
+
+// http_body is the remainder of a file being streamed after the response
+// header.  The handler passes it to the server as output 1 of the aio.
+typedef struct http_body {
+	void *   file;
+	uint64_t off;
+	uint64_t rem;
+	void *   buf;
+} http_body;
+
+
 typedef struct http_sconn {
 	nni_list_node     node;
 	nni_http_conn *   conn;
@@ -48,6 +63,7 @@ typedef struct http_sconn {
 	nni_http_res *    res;
 	nni_http_handler *handler; // set if we deferred to read body
 	nni_http_handler *release; // set if we dispatched handler
+	http_body *       body;    // file body still to send after header
 	bool              close;
 	bool              closed;
 	bool              finished;
@@ -65,12 +81,16 @@ typedef struct http_error {
 	size_t        len;
 } http_error;
 
+typedef struct http_route http_route;
+
 struct nng_http_server {
 	nng_sockaddr         addr;
 	nni_list_node        node;
 	int                  refcnt;
 	int                  starts;
 	nni_list             handlers;
+	http_route *         routes;    // handlers indexed by path
+	nni_rwlock           routes_lk; // lookups only take read lock
 	nni_list             conns;
 	nni_mtx              mtx;
 	bool                 closed;
@@ -92,6 +112,8 @@ static nni_reap_list http_sc_reap_list = {
 };
 
 static void http_server_fini(nni_http_server *);
+static void http_body_free(http_body *);
+static int  http_file_read(void *, void *, size_t, uint64_t);
 
 static nni_reap_list http_server_reap_list = {
 	.rl_offset = offsetof(nni_http_server, reap),
@@ -294,11 +316,16 @@ http_sc_reap(void *arg)
 	nni_aio_stop(sc->txdataio);
 	nni_aio_stop(sc->cbaio);
 
+	if (sc->handler != NULL) {
+		// Closed while reading the request body.
+		nni_http_handler_fini(sc->handler);
+	}
 	if (sc->conn != NULL) {
 		nni_http_conn_fini(sc->conn);
 	}
 	nni_http_req_free(sc->req);
 	nni_http_res_free(sc->res);
+	http_body_free(sc->body);
 	nni_aio_free(sc->rxaio);
 	nni_aio_free(sc->txaio);
 	nni_aio_free(sc->txdataio);
@@ -350,6 +377,28 @@ http_sconn_close(http_sconn *sc)
 	nni_mtx_unlock(&s->mtx);
 }
 
+// http_sconn_txbody sends the next chunk of a streamed file body.
+static void
+http_sconn_txbody(http_sconn *sc)
+{
+	http_body *body = sc->body;
+	nni_iov    iov;
+	size_t     n;
+
+	n = body->rem > HTTP_FILE_CHUNK ? HTTP_FILE_CHUNK : (size_t) body->rem;
+	if (http_file_read(body->file, body->buf, n, body->off) != 0) {
+		// We cannot honor the Content-Length we sent.
+		http_sconn_close(sc);
+		return;
+	}
+	body->off += n;
+	body->rem -= n;
+	iov.iov_buf = body->buf;
+	iov.iov_len = n;
+	nni_aio_set_iov(sc->txdataio, 1, &iov);
+	nni_http_write_full(sc->conn, sc->txdataio);
+}
+
 static void
 http_sconn_txdatdone(void *arg)
 {
@@ -361,6 +410,13 @@ http_sconn_txdatdone(void *arg)
 		return;
 	}
 
+	if (sc->body->rem > 0) {
+		http_sconn_txbody(sc);
+		return;
+	}
+	http_body_free(sc->body);
+	sc->body = NULL;
+
 	nni_http_res_free(sc->res);
 	sc->res = NULL;
 
@@ -385,6 +441,11 @@ http_sconn_txdone(void *arg)
 		return;
 	}
 
+	if (sc->body != NULL) {
+		http_sconn_txbody(sc);
+		return;
+	}
+
 	if (sc->close) {
 		http_sconn_close(sc);
 		return;
@@ -577,6 +638,238 @@ http_handler_host_match(nni_http_handler *h, const char *host)
 	return (true);
 }
 
+// Handlers are indexed by path in a tree with one level per path segment,
+// so that finding the handler for a request costs time in proportion to
+// the depth of its path rather than to the number of handlers.  Each node
+// holds the handlers registered for exactly its path (any host or method)
+// in the order they are tried, and its children sorted by segment.  A
+// trailing '/' is an empty final segment, just as the old prefix compare
+// treated it.
+struct http_route {
+	char *             seg;
+	size_t             seglen;
+	http_route **      kids;
+	int                nkids;
+	int                kidcap;
+	nni_http_handler **hands;
+	int                nhands;
+	int                handcap;
+};
+
+typedef struct {
+	const char *      host;
+	const char *      method;
+	nni_http_handler *head; // GET handler to use for HEAD
+	bool              badmeth;
+} http_route_query;
+
+static void
+http_route_free(http_route *r)
+{
+	if (r == NULL) {
+		return;
+	}
+	for (int i = 0; i < r->nkids; i++) {
+		http_route_free(r->kids[i]);
+	}
+	if (r->kidcap > 0) {
+		nni_free(r->kids, sizeof(http_route *) * r->kidcap);
+	}
+	if (r->handcap > 0) {
+		nni_free(r->hands, sizeof(nni_http_handler *) * r->handcap);
+	}
+	if (r->seg != NULL) {
+		nni_free(r->seg, r->seglen + 1);
+	}
+	NNI_FREE_STRUCT(r);
+}
+
+// http_route_kid finds the child for the segment, returning its index,
+// or if there is none, the index at which to insert it.
+static int
+http_route_kid(http_route *r, const char *seg, size_t len, bool *found)
+{
+	int lo = 0;
+	int hi = r->nkids;
+
+	while (lo < hi) {
+		int         mid = lo + (hi - lo) / 2;
+		http_route *k   = r->kids[mid];
+		int         c;
+
+		c = memcmp(k->seg, seg, k->seglen < len ? k->seglen : len);
+		if (c == 0) {
+			c = (k->seglen > len) - (k->seglen < len);
+		}
+		if (c == 0) {
+			*found = true;
+			return (mid);
+		}
+		if (c < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	*found = false;
+	return (lo);
+}
+
+static int
+http_route_add(http_route **rootp, nni_http_handler *h)
+{
+	http_route *r;
+	const char *path = h->uri;
+
+	if (((r = *rootp) == NULL) &&
+	    ((r = *rootp = NNI_ALLOC_STRUCT(r)) == NULL)) {
+		return (NNG_ENOMEM);
+	}
+	while (*path == '/') {
+		const char *seg = path + 1;
+		size_t      len = strcspn(seg, "/");
+		http_route *k;
+		bool        found;
+		int         idx;
+
+		idx = http_route_kid(r, seg, len, &found);
+		if (!found) {
+			if (r->nkids == r->kidcap) {
+				int           cap = r->kidcap ? r->kidcap * 2 : 4;
+				http_route **kids;
+				if ((kids = nni_alloc(sizeof(*kids) * cap)) ==
+				    NULL) {
+					return (NNG_ENOMEM);
+				}
+				if (r->kidcap > 0) {
+					memcpy(kids, r->kids,
+					    sizeof(*kids) * r->nkids);
+					nni_free(
+					    r->kids, sizeof(*kids) * r->kidcap);
+				}
+				r->kids   = kids;
+				r->kidcap = cap;
+			}
+			if (((k = NNI_ALLOC_STRUCT(k)) == NULL) ||
+			    ((k->seg = nni_alloc(len + 1)) == NULL)) {
+				if (k != NULL) {
+					NNI_FREE_STRUCT(k);
+				}
+				return (NNG_ENOMEM);
+			}
+			memcpy(k->seg, seg, len);
+			k->seg[len] = '\0';
+			k->seglen   = len;
+			memmove(&r->kids[idx + 1], &r->kids[idx],
+			    sizeof(http_route *) * (r->nkids - idx));
+			r->kids[idx] = k;
+			r->nkids++;
+		}
+		r    = r->kids[idx];
+		path = seg + len;
+	}
+	if (r->nhands == r->handcap) {
+		int                cap = r->handcap ? r->handcap * 2 : 2;
+		nni_http_handler **hands;
+		if ((hands = nni_alloc(sizeof(*hands) * cap)) == NULL) {
+			return (NNG_ENOMEM);
+		}
+		if (r->handcap > 0) {
+			memcpy(hands, r->hands, sizeof(*hands) * r->nhands);
+			nni_free(r->hands, sizeof(*hands) * r->handcap);
+		}
+		r->hands   = hands;
+		r->handcap = cap;
+	}
+	r->hands[r->nhands++] = h;
+	return (0);
+}
+
+// http_route_del removes the handler from the tree, along with any nodes
+// left empty.  It returns true if the node passed in is now empty.
+static bool
+http_route_del(http_route *r, const char *path, nni_http_handler *h)
+{
+	if (*path == '/') {
+		const char *seg = path + 1;
+		size_t      len = strcspn(seg, "/");
+		bool        found;
+		int         idx;
+
+		idx = http_route_kid(r, seg, len, &found);
+		if (found && http_route_del(r->kids[idx], seg + len, h)) {
+			http_route_free(r->kids[idx]);
+			r->nkids--;
+			memmove(&r->kids[idx], &r->kids[idx + 1],
+			    sizeof(http_route *) * (r->nkids - idx));
+		}
+	} else {
+		for (int i = 0; i < r->nhands; i++) {
+			if (r->hands[i] == h) {
+				r->nhands--;
+				memmove(&r->hands[i], &r->hands[i + 1],
+				    sizeof(nni_http_handler *) *
+				        (r->nhands - i));
+				break;
+			}
+		}
+	}
+	return ((r->nhands == 0) && (r->nkids == 0));
+}
+
+// http_route_find looks for a handler for the rest of the path below
+// node r, trying the most specific paths first.
+static nni_http_handler *
+http_route_find(http_route *r, const char *rest, http_route_query *q)
+{
+	nni_http_handler *h;
+
+	if (*rest == '/') {
+		const char *seg = rest + 1;
+		size_t      len = strcspn(seg, "/");
+		bool        found;
+		int         idx;
+
+		idx = http_route_kid(r, seg, len, &found);
+		if (found &&
+		    ((h = http_route_find(r->kids[idx], seg + len, q)) !=
+		        NULL)) {
+			return (h);
+		}
+	}
+	for (int i = 0; i < r->nhands; i++) {
+		h = r->hands[i];
+
+		// The path must match exactly, or with a trailing '/',
+		// unless the handler takes the whole tree.
+		if ((rest[0] != '\0') && ((rest[0] != '/') || (rest[1] != '\0')) &&
+		    (!h->tree)) {
+			continue;
+		}
+		if (!http_handler_host_match(h, q->host)) {
+			continue;
+		}
+		if ((h->method == NULL) || (h->method[0] == '\0')) {
+			// Handler wants to process *all* methods.
+			return (h);
+		}
+		if (strcmp(q->method, h->method) == 0) {
+			return (h);
+		}
+		// HEAD is remapped to GET, but only if no HEAD specific
+		// handler registered.
+		if ((strcmp(q->method, "HEAD") == 0) &&
+		    (strcmp(h->method, "GET") == 0)) {
+			if (q->head == NULL) {
+				q->head = h;
+			}
+			continue;
+		}
+		q->badmeth = true;
+	}
+	return (NULL);
+}
+
 static void
 http_sconn_rxdone(void *arg)
 {
@@ -585,13 +878,12 @@ http_sconn_rxdone(void *arg)
 	nni_aio *         aio = sc->rxaio;
 	int               rv;
 	nni_http_handler *h    = NULL;
-	nni_http_handler *head = NULL;
 	const char *      val;
 	nni_http_req *    req = sc->req;
 	char *            uri;
 	size_t            urisz;
 	char *            path;
-	bool              badmeth  = false;
+	http_route_query  q;
 	bool              needhost = false;
 	const char *      host;
 	const char *      cls;
@@ -602,7 +894,6 @@ http_sconn_rxdone(void *arg)
 	}
 
 	if ((h = sc->handler) != NULL) {
-		nni_mtx_lock(&s->mtx);
 		goto finish;
 	}
 
@@ -658,57 +949,29 @@ http_sconn_rxdone(void *arg)
 		return;
 	}
 
-	nni_mtx_lock(&s->mtx);
-	NNI_LIST_FOREACH (&s->handlers, h) {
-		size_t len;
-
-		if (!http_handler_host_match(h, host)) {
-			continue;
-		}
+	q.host    = host;
+	q.method  = nni_http_req_get_method(req);
+	q.head    = NULL;
+	q.badmeth = false;
 
-		len = strlen(h->uri);
-		if (strncmp(path, h->uri, len) != 0) {
-			continue;
+	nni_rwlock_rdlock(&s->routes_lk);
+	h = NULL;
+	if ((s->routes != NULL) && ((path[0] == '/') || (path[0] == '\0'))) {
+		if ((h = http_route_find(s->routes, path, &q)) == NULL) {
+			h = q.head;
 		}
-		switch (path[len]) {
-		case '\0':
-			break;
-		case '/':
-			if ((path[len + 1] != '\0') && (!h->tree)) {
-				// Trailing component and not a directory.
-				continue;
-			}
-			break;
-		default:
-			continue; // Some other substring, not matched.
-		}
-
-		if ((h->method == NULL) || (h->method[0] == '\0')) {
-			// Handler wants to process *all* methods.
-			break;
-		}
-		// So, what about the method?
-		val = nni_http_req_get_method(req);
-		if (strcmp(val, h->method) == 0) {
-			break;
-		}
-		// HEAD is remapped to GET, but only if no HEAD specific
-		// handler registered.
-		if ((strcmp(val, "HEAD") == 0) &&
-		    (strcmp(h->method, "GET") == 0)) {
-			head = h;
-			continue;
-		}
-		badmeth = 1;
 	}
-
-	if ((h == NULL) && (head != NULL)) {
-		h = head;
+	if (h != NULL) {
+		// Take a reference -- this because the callback may be
+		// running asynchronously even after it gets removed from
+		// the server.
+		nni_atomic_inc64(&h->ref);
 	}
+	nni_rwlock_unlock(&s->routes_lk);
+
 	nni_free(uri, urisz);
 	if (h == NULL) {
-		nni_mtx_unlock(&s->mtx);
-		if (badmeth) {
+		if (q.badmeth) {
 			http_sconn_error(
 			    sc, NNG_HTTP_STATUS_METHOD_NOT_ALLOWED);
 		} else {
@@ -724,7 +987,7 @@ http_sconn_rxdone(void *arg)
 
 		len = strtoull(cls, &end, 10);
 		if ((end == NULL) || (*end != '\0') || (len > h->maxbody)) {
-			nni_mtx_unlock(&s->mtx);
+			nni_http_handler_fini(h);
 			http_sconn_error(sc, NNG_HTTP_STATUS_BAD_REQUEST);
 			return;
 		}
@@ -732,14 +995,14 @@ http_sconn_rxdone(void *arg)
 			nng_iov iov;
 			if ((nni_http_req_alloc_data(req, (size_t) len)) !=
 			    0) {
-				nni_mtx_unlock(&s->mtx);
+				nni_http_handler_fini(h);
 				http_sconn_error(
 				    sc, NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR);
 				return;
 			}
 			nng_http_req_get_data(req, &iov.iov_buf, &iov.iov_len);
+			// We keep our reference while the body is read.
 			sc->handler = h;
-			nni_mtx_unlock(&s->mtx);
 			nni_aio_set_iov(sc->rxaio, 1, &iov);
 			nni_http_read_full(sc->conn, aio);
 			return;
@@ -753,17 +1016,12 @@ finish:
 	nni_aio_set_input(sc->cbaio, 1, h);
 	nni_aio_set_input(sc->cbaio, 2, sc->conn);
 
-	// Set a reference -- this because the callback may be running
-	// asynchronously even after it gets removed from the server.
-	nni_atomic_inc64(&h->ref);
-
 	// Documented that we call this on behalf of the callback.
 	if (nni_aio_begin(sc->cbaio) != 0) {
-		nni_mtx_unlock(&s->mtx);
+		sc->release = NULL;
+		nni_http_handler_fini(h);
 		return;
 	}
-
-	nni_mtx_unlock(&s->mtx);
 	h->cb(sc->cbaio);
 }
 
@@ -773,6 +1031,7 @@ http_sconn_cbdone(void *arg)
 	http_sconn *      sc  = arg;
 	nni_aio *         aio = sc->cbaio;
 	nni_http_res *    res;
+	http_body *       body;
 	nni_http_handler *h;
 	nni_http_server * s = sc->server;
 
@@ -784,8 +1043,13 @@ http_sconn_cbdone(void *arg)
 		nni_http_handler_fini(h);
 	}
 
+	// Only our own file handlers supply a body to stream.
+	body = nni_aio_get_output(aio, 1);
+	nni_aio_set_output(aio, 1, NULL);
+
 	if (nni_aio_result(aio) != 0) {
 		// Hard close, no further feedback.
+		http_body_free(body);
 		http_sconn_close(sc);
 		return;
 	}
@@ -798,6 +1062,7 @@ http_sconn_cbdone(void *arg)
 	if (sc->conn == NULL) {
 		// If this happens, then the session was hijacked.
 		// We close the context, but the http channel stays up.
+		http_body_free(body);
 		http_sconn_close(sc);
 		return;
 	}
@@ -820,15 +1085,20 @@ http_sconn_cbdone(void *arg)
 			// the HTTP header.
 			nni_http_res_get_data(res, &data, &size);
 			nni_http_res_set_data(res, NULL, size);
+			http_body_free(body);
+			body = NULL;
 		} else if (nni_http_res_is_error(res)) {
 			(void) nni_http_server_res_error(s, res);
 		}
+		sc->body = body;
 		nni_http_write_res(sc->conn, res, sc->txaio);
 	} else if (sc->close) {
+		http_body_free(body);
 		http_sconn_close(sc);
 	} else {
 		// Presumably client already sent a response.
 		// Wait for another request.
+		http_body_free(body);
 		sc->handler = NULL;
 		nni_http_req_reset(sc->req);
 		nni_http_read_req(sc->conn, sc->req, sc->rxaio);
@@ -923,6 +1193,8 @@ http_server_fini(nni_http_server *s)
 		nni_list_remove(&s->handlers, h);
 		nni_http_handler_fini(h);
 	}
+	http_route_free(s->routes);
+	s->routes = NULL;
 	nni_mtx_unlock(&s->mtx);
 	nni_mtx_lock(&s->errors_mtx);
 	while ((epage = nni_list_first(&s->errors)) != NULL) {
@@ -934,6 +1206,7 @@ http_server_fini(nni_http_server *s)
 	nni_mtx_fini(&s->errors_mtx);
 
 	nni_aio_free(s->accaio);
+	nni_rwlock_fini(&s->routes_lk);
 	nni_mtx_fini(&s->mtx);
 	nni_strfree(s->hostname);
 	NNI_FREE_STRUCT(s);
@@ -959,6 +1232,7 @@ http_server_init(nni_http_server **serverp, const nni_url *url)
 	}
 	nni_mtx_init(&s->mtx);
 	nni_mtx_init(&s->errors_mtx);
+	nni_rwlock_init(&s->routes_lk);
 	NNI_LIST_INIT(&s->handlers, nni_http_handler, node);
 	NNI_LIST_INIT(&s->conns, http_sconn, node);
 
@@ -1212,6 +1486,7 @@ nni_http_server_add_handler(nni_http_server *s, nni_http_handler *h)
 {
 	nni_http_handler *h2;
 	size_t            len;
+	int               rv;
 
 	// Must have a legal method (and not one that is HEAD), path,
 	// and handler.  (The reason HEAD is verboten is that we supply
@@ -1293,17 +1568,16 @@ nni_http_server_add_handler(nni_http_server *s, nni_http_handler *h)
 		}
 	}
 
-	// Maintain list of handlers in longest uri first order
-	NNI_LIST_FOREACH (&s->handlers, h2) {
-		size_t len2 = strlen(h2->uri);
-		if (len > len2) {
-			nni_list_insert_before(&s->handlers, h, h2);
-			break;
-		}
-	}
-	if (h2 == NULL) {
-		nni_list_append(&s->handlers, h);
+	nni_rwlock_wrlock(&s->routes_lk);
+	if ((rv = http_route_add(&s->routes, h)) != 0) {
+		// Prune any nodes we added on the way.
+		(void) http_route_del(s->routes, h->uri, h);
+		nni_rwlock_unlock(&s->routes_lk);
+		nni_mtx_unlock(&s->mtx);
+		return (rv);
 	}
+	nni_rwlock_unlock(&s->routes_lk);
+	nni_list_append(&s->handlers, h);
 
 	// Note that we have borrowed the reference count on the handler.
 	// Thus we own it, and if the server is destroyed while we have it,
@@ -1326,6 +1600,9 @@ nni_http_server_del_handler(nni_http_server *s, nni_http_handler *h)
 			// NB: We are giving the caller our reference
 			// on the handler.
 			nni_list_remove(&s->handlers, h);
+			nni_rwlock_wrlock(&s->routes_lk);
+			(void) http_route_del(s->routes, h->uri, h);
+			nni_rwlock_unlock(&s->routes_lk);
 			rv = 0;
 			break;
 		}
@@ -1393,48 +1670,361 @@ http_lookup_type(const char *path)
 	return (NULL);
 }
 
+// Only files up to this size are kept in a handler's file cache.
+#define HTTP_FILE_CACHE_MAX HTTP_FILE_CHUNK
+
+typedef struct http_file_ent {
+	nni_list_node node;
+	char *        path;
+	uint64_t      size;
+	uint64_t      mtime;
+	void *        data;
+} http_file_ent;
+
 typedef struct http_file {
-	char *path;
-	char *ctype;
+	char *   path;
+	char *   ctype;
+	nni_mtx  mtx;
+	nni_list cache;      // most recently used first
+	size_t   cache_size; // bytes of file data cached
+	size_t   cache_max;  // zero disables the cache
 } http_file;
 
 static void
-http_handle_file(nni_aio *aio)
+http_body_free(http_body *body)
 {
-	nni_http_handler *h   = nni_aio_get_input(aio, 1);
-	nni_http_res *    res = NULL;
-	void *            data;
-	size_t            size;
-	int               rv;
-	http_file *       hf = nni_http_handler_get_data(h);
-	const char *      ctype;
+	if (body != NULL) {
+		nni_file_close(body->file);
+		nni_free(body->buf, HTTP_FILE_CHUNK);
+		NNI_FREE_STRUCT(body);
+	}
+}
 
-	if ((ctype = hf->ctype) == NULL) {
-		ctype = "application/octet-stream";
+static int
+http_file_read(void *f, void *buf, size_t len, uint64_t off)
+{
+	uint8_t *ptr = buf;
+	size_t   n;
+	int      rv;
+
+	while (len > 0) {
+		if ((rv = nni_file_pread(f, ptr, len, off, &n)) != 0) {
+			return (rv);
+		}
+		if (n == 0) {
+			// The file was truncated underneath us; we can no
+			// longer supply what Content-Length promised.
+			return (NNG_EINVAL);
+		}
+		ptr += n;
+		off += n;
+		len -= n;
 	}
+	return (0);
+}
 
-	// This is a very simplistic file server, suitable only for small
-	// files.  In the future we can use an AIO based file read, where
-	// we read files a bit at a time, or even mmap them, and serve
-	// them up chunkwise.  Applications could even come up with their own
-	// caching version of the http handler.
-	if ((rv = nni_file_get(hf->path, &data, &size)) != 0) {
-		uint16_t status;
-		switch (rv) {
-		case NNG_ENOMEM:
-			status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
-			break;
-		case NNG_ENOENT:
-			status = NNG_HTTP_STATUS_NOT_FOUND;
-			break;
-		case NNG_EPERM:
-			status = NNG_HTTP_STATUS_FORBIDDEN;
-			break;
-		default:
-			status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
+static void
+http_file_ent_free(http_file_ent *ent)
+{
+	nni_strfree(ent->path);
+	nni_free(ent->data, (size_t) ent->size);
+	NNI_FREE_STRUCT(ent);
+}
+
+// http_file_cache_trim evicts the least recently used files until the
+// cache fits in max bytes.  Called with the lock held.
+static void
+http_file_cache_trim(http_file *hf, size_t max)
+{
+	http_file_ent *ent;
+
+	while ((hf->cache_size > max) &&
+	    ((ent = nni_list_last(&hf->cache)) != NULL)) {
+		nni_list_remove(&hf->cache, ent);
+		hf->cache_size -= (size_t) ent->size;
+		http_file_ent_free(ent);
+	}
+}
+
+// http_file_cache_copy copies the given range of a cached file into the
+// response.  NNG_ENOENT means the file was not cached, or has changed
+// since it was.
+static int
+http_file_cache_copy(http_file *hf, const char *path, uint64_t size,
+    uint64_t mtime, nni_http_res *res, uint64_t start, uint64_t len)
+{
+	http_file_ent *ent;
+	int            rv = NNG_ENOENT;
+
+	nni_mtx_lock(&hf->mtx);
+	NNI_LIST_FOREACH (&hf->cache, ent) {
+		if (strcmp(ent->path, path) == 0) {
 			break;
 		}
-		if ((rv = nni_http_res_alloc_error(&res, status)) != 0) {
+	}
+	if (ent != NULL) {
+		nni_list_remove(&hf->cache, ent);
+		if ((ent->size == size) && (ent->mtime == mtime)) {
+			nni_list_prepend(&hf->cache, ent);
+			rv = nni_http_res_copy_data(
+			    res, (uint8_t *) ent->data + start, (size_t) len);
+		} else {
+			hf->cache_size -= (size_t) ent->size;
+			http_file_ent_free(ent);
+		}
+	}
+	nni_mtx_unlock(&hf->mtx);
+	return (rv);
+}
+
+// http_file_cache_put adds the file contents to the cache, taking
+// ownership of the data.
+static void
+http_file_cache_put(http_file *hf, const char *path, uint64_t size,
+    uint64_t mtime, void *data)
+{
+	http_file_ent *ent;
+
+	if (((ent = NNI_ALLOC_STRUCT(ent)) == NULL) ||
+	    ((ent->path = nni_strdup(path)) == NULL)) {
+		if (ent != NULL) {
+			NNI_FREE_STRUCT(ent);
+		}
+		nni_free(data, (size_t) size);
+		return;
+	}
+	ent->size  = size;
+	ent->mtime = mtime;
+	ent->data  = data;
+
+	nni_mtx_lock(&hf->mtx);
+	if (size > hf->cache_max) {
+		nni_mtx_unlock(&hf->mtx);
+		http_file_ent_free(ent);
+		return;
+	}
+	http_file_cache_trim(hf, hf->cache_max - (size_t) size);
+	nni_list_prepend(&hf->cache, ent);
+	hf->cache_size += (size_t) size;
+	nni_mtx_unlock(&hf->mtx);
+}
+
+// http_etag_match checks an If-None-Match list against our entity tag,
+// using the weak comparison that RFC 7232 requires for it.
+static bool
+http_etag_match(const char *list, const char *etag)
+{
+	size_t len = strlen(etag);
+
+	while (*list != '\0') {
+		while ((*list == ' ') || (*list == '\t') || (*list == ',')) {
+			list++;
+		}
+		if (*list == '*') {
+			return (true);
+		}
+		if (strncmp(list, "W/", 2) == 0) {
+			list += 2;
+		}
+		if ((strncmp(list, etag, len) == 0) &&
+		    ((list[len] == '\0') || (list[len] == ',') ||
+		        (list[len] == ' ') || (list[len] == '\t'))) {
+			return (true);
+		}
+		while ((*list != '\0') && (*list != ',')) {
+			list++;
+		}
+	}
+	return (false);
+}
+
+// http_parse_range looks at a Range header, and returns the status to
+// respond with: 206 with the range to send, 416 if the range cannot be
+// satisfied, or 200 when the whole file should be sent instead.  Multiple
+// ranges are not supported; the RFC allows us to ignore them.
+static uint16_t
+http_parse_range(
+    const char *val, uint64_t size, uint64_t *startp, uint64_t *lenp)
+{
+	uint64_t first;
+	uint64_t last;
+	char *   end;
+
+	if ((nni_strncasecmp(val, "bytes=", 6) != 0) ||
+	    (strchr(val, ',') != NULL)) {
+		return (NNG_HTTP_STATUS_OK);
+	}
+	val += 6;
+	if (*val == '-') {
+		// Suffix range, the last so many bytes.
+		if (!isdigit((unsigned char) val[1])) {
+			return (NNG_HTTP_STATUS_OK);
+		}
+		last = (uint64_t) strtoull(val + 1, &end, 10);
+		if (*end != '\0') {
+			return (NNG_HTTP_STATUS_OK);
+		}
+		if ((last == 0) || (size == 0)) {
+			return (NNG_HTTP_STATUS_RANGE_NOT_SATISFIABLE);
+		}
+		if (last > size) {
+			last = size;
+		}
+		*startp = size - last;
+		*lenp   = last;
+		return (NNG_HTTP_STATUS_PARTIAL_CONTENT);
+	}
+	if (!isdigit((unsigned char) *val)) {
+		return (NNG_HTTP_STATUS_OK);
+	}
+	first = (uint64_t) strtoull(val, &end, 10);
+	if (*end != '-') {
+		return (NNG_HTTP_STATUS_OK);
+	}
+	val = end + 1;
+	if (*val == '\0') {
+		last = size - 1;
+	} else {
+		if (!isdigit((unsigned char) *val)) {
+			return (NNG_HTTP_STATUS_OK);
+		}
+		last = (uint64_t) strtoull(val, &end, 10);
+		if ((*end != '\0') || (last < first)) {
+			return (NNG_HTTP_STATUS_OK);
+		}
+	}
+	if (first >= size) {
+		return (NNG_HTTP_STATUS_RANGE_NOT_SATISFIABLE);
+	}
+	if (last >= size) {
+		last = size - 1;
+	}
+	*startp = first;
+	*lenp   = last - first + 1;
+	return (NNG_HTTP_STATUS_PARTIAL_CONTENT);
+}
+
+// http_file_body reads the given range of a small file into the response,
+// going through the cache if it is enabled.
+static int
+http_file_body(http_file *hf, void *f, const char *path, uint64_t size,
+    uint64_t mtime, nni_http_res *res, uint64_t start, uint64_t len)
+{
+	void *   data;
+	bool     cache;
+	uint64_t off = start;
+	uint64_t n   = len;
+	int      rv;
+
+	nni_mtx_lock(&hf->mtx);
+	cache = (size <= HTTP_FILE_CACHE_MAX) && (size <= hf->cache_max);
+	nni_mtx_unlock(&hf->mtx);
+	if (cache) {
+		rv = http_file_cache_copy(hf, path, size, mtime, res, start, len);
+		if (rv != NNG_ENOENT) {
+			return (rv);
+		}
+		// Read the whole file, so that it can be cached.
+		off = 0;
+		n   = size;
+	}
+	if ((data = nni_alloc((size_t) n)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	if (((rv = http_file_read(f, data, (size_t) n, off)) != 0) ||
+	    ((rv = nni_http_res_copy_data(res, (uint8_t *) data + (start - off),
+	          (size_t) len)) != 0) ||
+	    (!cache)) {
+		nni_free(data, (size_t) n);
+	} else {
+		http_file_cache_put(hf, path, size, mtime, data);
+	}
+	return (rv);
+}
+
+static void
+http_file_error(nni_aio *aio, int rv)
+{
+	nni_http_res *res;
+	uint16_t      status;
+
+	switch (rv) {
+	case NNG_ENOMEM:
+		status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
+		break;
+	case NNG_ENOENT:
+	case NNG_EINVAL: // not a regular file
+		status = NNG_HTTP_STATUS_NOT_FOUND;
+		break;
+	case NNG_EPERM:
+		status = NNG_HTTP_STATUS_FORBIDDEN;
+		break;
+	default:
+		status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
+		break;
+	}
+	if ((rv = nni_http_res_alloc_error(&res, status)) != 0) {
+		nni_aio_finish_error(aio, rv);
+		return;
+	}
+	nni_aio_set_output(aio, 0, res);
+	nni_aio_finish(aio, 0, 0);
+}
+
+// http_serve_file answers a request for the named file.  Conditional
+// (If-None-Match) and single range requests are supported, using an
+// entity tag made from the file size and modification time.  Small
+// bodies are read (or copied from the cache) into the response; larger
+// ones are handed to the server to stream once the header is written.
+static void
+http_serve_file(
+    nni_aio *aio, http_file *hf, const char *path, const char *ctype)
+{
+	nni_http_req *req  = nni_aio_get_input(aio, 0);
+	nni_http_res *res  = NULL;
+	http_body *   body = NULL;
+	void *        f;
+	uint64_t      size;
+	uint64_t      mtime;
+	uint64_t      start;
+	uint64_t      len;
+	uint16_t      status = NNG_HTTP_STATUS_OK;
+	const char *  val;
+	char          etag[48];
+	char          range[80];
+	int           rv;
+
+	if ((rv = nni_file_open(&f, path, &size, &mtime)) != 0) {
+		http_file_error(aio, rv);
+		return;
+	}
+	(void) snprintf(etag, sizeof(etag), "\"%llx-%llx\"",
+	    (unsigned long long) mtime, (unsigned long long) size);
+
+	start = 0;
+	len   = size;
+	if (((val = nni_http_req_get_header(req, "If-None-Match")) != NULL) &&
+	    http_etag_match(val, etag)) {
+		status = NNG_HTTP_STATUS_NOT_MODIFIED;
+		len    = 0;
+	} else if ((val = nni_http_req_get_header(req, "Range")) != NULL) {
+		const char *ifr = nni_http_req_get_header(req, "If-Range");
+
+		// A range conditional on some other version of the file
+		// is ignored, and the whole (current) file is sent.
+		if ((ifr == NULL) || (strcmp(ifr, etag) == 0)) {
+			status = http_parse_range(val, size, &start, &len);
+		}
+	}
+
+	if (status == NNG_HTTP_STATUS_RANGE_NOT_SATISFIABLE) {
+		nni_file_close(f);
+		(void) snprintf(range, sizeof(range), "bytes */%llu",
+		    (unsigned long long) size);
+		if (((rv = nni_http_res_alloc_error(&res, status)) != 0) ||
+		    ((rv = nni_http_res_set_header(
+		          res, "Content-Range", range)) != 0)) {
+			nni_http_res_free(res);
 			nni_aio_finish_error(aio, rv);
 			return;
 		}
@@ -1442,20 +2032,98 @@ http_handle_file(nni_aio *aio)
 		nni_aio_finish(aio, 0, 0);
 		return;
 	}
+
 	if (((rv = nni_http_res_alloc(&res)) != 0) ||
-	    ((rv = nni_http_res_set_status(res, NNG_HTTP_STATUS_OK)) != 0) ||
-	    ((rv = nni_http_res_set_header(res, "Content-Type", ctype)) !=
-	        0) ||
-	    ((rv = nni_http_res_copy_data(res, data, size)) != 0)) {
-		nni_http_res_free(res);
-		nni_free(data, size);
-		nni_aio_finish_error(aio, rv);
+	    ((rv = nni_http_res_set_status(res, status)) != 0) ||
+	    ((rv = nni_http_res_set_header(res, "ETag", etag)) != 0) ||
+	    ((rv = nni_http_res_set_header(res, "Accept-Ranges", "bytes")) !=
+	        0)) {
+		goto fail;
+	}
+	if (status == NNG_HTTP_STATUS_NOT_MODIFIED) {
+		// No body, and no Content-Length either, as that would
+		// have to describe the body we are not sending.
+		nni_file_close(f);
+		nni_aio_set_output(aio, 0, res);
+		nni_aio_finish(aio, 0, 0);
 		return;
 	}
+	if ((rv = nni_http_res_set_header(res, "Content-Type", ctype)) != 0) {
+		goto fail;
+	}
+	if (status == NNG_HTTP_STATUS_PARTIAL_CONTENT) {
+		(void) snprintf(range, sizeof(range), "bytes %llu-%llu/%llu",
+		    (unsigned long long) start,
+		    (unsigned long long) (start + len - 1),
+		    (unsigned long long) size);
+		if ((rv = nni_http_res_set_header(
+		         res, "Content-Range", range)) != 0) {
+			goto fail;
+		}
+	}
 
-	nni_free(data, size);
+	if (len == 0) {
+		rv = nni_http_res_set_data(res, NULL, 0);
+	} else if (len <= HTTP_FILE_CHUNK) {
+		rv = http_file_body(hf, f, path, size, mtime, res, start, len);
+	} else if ((body = NNI_ALLOC_STRUCT(body)) == NULL) {
+		rv = NNG_ENOMEM;
+	} else if ((body->buf = nni_alloc(HTTP_FILE_CHUNK)) == NULL) {
+		NNI_FREE_STRUCT(body);
+		body = NULL;
+		rv   = NNG_ENOMEM;
+	} else {
+		// The data is left NULL, so only the header is written
+		// by the server, but Content-Length reflects the body.
+		body->file = f;
+		body->off  = start;
+		body->rem  = len;
+		f          = NULL;
+		rv         = nni_http_res_set_data(res, NULL, (size_t) len);
+	}
+	if (rv != 0) {
+		http_body_free(body);
+		goto fail;
+	}
+	if (f != NULL) {
+		nni_file_close(f);
+	}
 	nni_aio_set_output(aio, 0, res);
+	nni_aio_set_output(aio, 1, body);
 	nni_aio_finish(aio, 0, 0);
+	return;
+
+fail:
+	if (f != NULL) {
+		nni_file_close(f);
+	}
+	nni_http_res_free(res);
+	nni_aio_finish_error(aio, rv);
+}
+
+static void
+http_handle_file(nni_aio *aio)
+{
+	nni_http_handler *h  = nni_aio_get_input(aio, 1);
+	http_file *       hf = nni_http_handler_get_data(h);
+	const char *      ctype;
+
+	if ((ctype = hf->ctype) == NULL) {
+		ctype = "application/octet-stream";
+	}
+	http_serve_file(aio, hf, hf->path, ctype);
+}
+
+static http_file *
+http_file_alloc(void)
+{
+	http_file *hf;
+
+	if ((hf = NNI_ALLOC_STRUCT(hf)) != NULL) {
+		nni_mtx_init(&hf->mtx);
+		NNI_LIST_INIT(&hf->cache, http_file_ent, node);
+	}
+	return (hf);
 }
 
 static void
@@ -1463,6 +2131,8 @@ http_file_free(void *arg)
 {
 	http_file *hf;
 	if ((hf = arg) != NULL) {
+		http_file_cache_trim(hf, 0);
+		nni_mtx_fini(&hf->mtx);
 		nni_strfree(hf->path);
 		nni_strfree(hf->ctype);
 		NNI_FREE_STRUCT(hf);
@@ -1477,7 +2147,7 @@ nni_http_handler_init_file_ctype(nni_http_handler **hpp, const char *uri,
 	http_file *       hf;
 	int               rv;
 
-	if ((hf = NNI_ALLOC_STRUCT(hf)) == NULL) {
+	if ((hf = http_file_alloc()) == NULL) {
 		return (NNG_ENOMEM);
 	}
 
@@ -1525,9 +2195,6 @@ http_handle_dir(nni_aio *aio)
 {
 	nni_http_req *    req = nni_aio_get_input(aio, 0);
 	nni_http_handler *h   = nni_aio_get_input(aio, 1);
-	nni_http_res *    res = NULL;
-	void *            data;
-	size_t            size;
 	int               rv;
 	http_file *       hf   = nni_http_handler_get_data(h);
 	const char *      path = hf->path;
@@ -1580,12 +2247,6 @@ http_handle_dir(nni_aio *aio)
 
 	*dst = '\0';
 
-	// This is a very simplistic file server, suitable only for small
-	// files.  In the future we can use an AIO based file read, where
-	// we read files a bit at a time, or even mmap them, and serve
-	// them up chunkwise.  Applications could even come up with their
-	// own caching version of the http handler.
-
 	rv = 0;
 	if (nni_file_is_dir(pn)) {
 		sprintf(dst, "%s%s", NNG_PLATFORM_DIR_SEP, "index.html");
@@ -1597,58 +2258,16 @@ http_handle_dir(nni_aio *aio)
 		}
 	}
 
-	if (rv == 0) {
-		rv = nni_file_get(pn, &data, &size);
-	} else {
-		data = NULL;
-		size = 0;
-	}
-	ctype = http_lookup_type(pn);
-	if (ctype == NULL) {
-		ctype = "application/octet-stream";
-	}
-
-	nni_free(pn, pnsz);
 	if (rv != 0) {
-		uint16_t status;
-
-		switch (rv) {
-		case NNG_ENOMEM:
-			status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
-			break;
-		case NNG_ENOENT:
-			status = NNG_HTTP_STATUS_NOT_FOUND;
-			break;
-		case NNG_EPERM:
-			status = NNG_HTTP_STATUS_FORBIDDEN;
-			break;
-		default:
-			status = NNG_HTTP_STATUS_INTERNAL_SERVER_ERROR;
-			break;
-		}
-		if ((rv = nni_http_res_alloc_error(&res, status)) != 0) {
-			nni_aio_finish_error(aio, rv);
-			return;
-		}
-		nni_aio_set_output(aio, 0, res);
-		nni_aio_finish(aio, 0, 0);
+		nni_free(pn, pnsz);
+		http_file_error(aio, rv);
 		return;
 	}
-
-	if (((rv = nni_http_res_alloc(&res)) != 0) ||
-	    ((rv = nni_http_res_set_status(res, NNG_HTTP_STATUS_OK)) != 0) ||
-	    ((rv = nni_http_res_set_header(res, "Content-Type", ctype)) !=
-	        0) ||
-	    ((rv = nni_http_res_copy_data(res, data, size)) != 0)) {
-		nni_http_res_free(res);
-		nni_free(data, size);
-		nni_aio_finish_error(aio, rv);
-		return;
+	if ((ctype = http_lookup_type(pn)) == NULL) {
+		ctype = "application/octet-stream";
 	}
-
-	nni_free(data, size);
-	nni_aio_set_output(aio, 0, res);
-	nni_aio_finish(aio, 0, 0);
+	http_serve_file(aio, hf, pn, ctype);
+	nni_free(pn, pnsz);
 }
 
 int
@@ -1659,11 +2278,11 @@ nni_http_handler_init_directory(
 	nni_http_handler *h;
 	int               rv;
 
-	if ((hf = NNI_ALLOC_STRUCT(hf)) == NULL) {
+	if ((hf = http_file_alloc()) == NULL) {
 		return (NNG_ENOMEM);
 	}
 	if ((hf->path = nni_strdup(path)) == NULL) {
-		NNI_FREE_STRUCT(hf);
+		http_file_free(hf);
 		return (NNG_ENOMEM);
 	}
 
@@ -1685,6 +2304,22 @@ nni_http_handler_init_directory(
 	return (0);
 }
 
+int
+nni_http_handler_set_file_cache(nni_http_handler *h, size_t max)
+{
+	http_file *hf;
+
+	if ((h->cb != http_handle_file) && (h->cb != http_handle_dir)) {
+		return (NNG_EINVAL);
+	}
+	hf = h->data;
+	nni_mtx_lock(&hf->mtx);
+	hf->cache_max = max;
+	http_file_cache_trim(hf, max);
+	nni_mtx_unlock(&hf->mtx);
+	return (0);
+}
+
 typedef struct http_redirect {
 	uint16_t code;
 	char *   where;
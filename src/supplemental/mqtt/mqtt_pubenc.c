@@ -0,0 +1,154 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <string.h>
+
+#include "core/nng_impl.h"
+#include "mqtt_pubenc.h"
+#include "nng/mqtt/mqtt_client.h"
+
+static uint8_t
+pubenc_put_varint(uint8_t *dst, uint32_t val)
+{
+	uint8_t n = 0;
+
+	do {
+		uint8_t b = val % 128;
+		val /= 128;
+		dst[n++] = val > 0 ? (b | 0x80) : b;
+	} while (val > 0 && n < 4);
+	return (n);
+}
+
+// Callers have validated the packet already, so this only bounds the
+// number of bytes it looks at.
+static uint32_t
+pubenc_get_varint(const uint8_t *src, uint8_t *bytes)
+{
+	uint32_t val = 0, mult = 1;
+	uint8_t  n   = 0;
+
+	do {
+		val += (uint32_t) (src[n] & 0x7f) * mult;
+		mult *= 128;
+	} while ((src[n++] & 0x80) != 0 && n < 4);
+	*bytes = n;
+	return (val);
+}
+
+static uint64_t
+mqtt_pubenc_key(uint8_t ver, uint8_t qos, bool retain, uint32_t subid)
+{
+	// 'P' keeps these apart from other users of the message cache.
+	return (((uint64_t) 'P' << 56) | ((uint64_t) ver << 48) |
+	    ((uint64_t) qos << 40) | ((uint64_t) retain << 32) | subid);
+}
+
+static void
+mqtt_pubenc_encode(nni_msg *msg, uint8_t ver, uint8_t sub_qos, bool retain,
+    uint32_t subid, nni_mqtt_pubenc *enc)
+{
+	uint8_t *header = nni_msg_header(msg);
+	uint8_t *body   = nni_msg_body(msg);
+	uint8_t  qos_pac, qos, fixheader, hbytes, pbytes = 0;
+	uint32_t remlen, plen = 0, tlen;
+	size_t   off;
+
+	memset(enc, 0, sizeof(*enc));
+	qos_pac = nni_msg_get_pub_qos(msg);
+	qos     = qos_pac > sub_qos ? sub_qos : qos_pac;
+	NNI_GET16(body, tlen);
+	off    = 2 + tlen + (qos_pac > 0 ? 2 : 0);
+	remlen = pubenc_get_varint(header + 1, &hbytes);
+
+	fixheader = header[0];
+	if (qos_pac == 0) {
+		// DUP must be 0 for QoS 0
+		fixheader &= ~(1 << 3);
+	}
+	if (qos_pac > qos) {
+		fixheader = (fixheader & 0xF9) | (uint8_t) (qos << 1);
+		if (qos == 0) {
+			remlen -= 2;
+		}
+	}
+	if (qos > 0) {
+		// placeholder, patched by each peer
+		enc->pidlen = 2;
+		enc->varlen = 2;
+	}
+	if (nni_msg_cmd_type(msg) == CMD_PUBLISH_V5) {
+		plen = pubenc_get_varint(body + off, &pbytes);
+	}
+
+	if (ver == MQTT_PROTOCOL_VERSION_v5) {
+		uint32_t nplen = plen;
+		uint8_t  idbytes = 0, lbytes;
+		uint8_t  subidbuf[5];
+
+		if (!retain) {
+			fixheader &= 0xFE;
+		}
+		if (subid != 0) {
+			idbytes = pubenc_put_varint(subidbuf, subid);
+			nplen += 1 + idbytes;
+		}
+		// original property length is replaced, or added for V4 msgs
+		lbytes = pubenc_put_varint(enc->var + enc->varlen, nplen);
+		enc->varlen += lbytes;
+		if (subid != 0) {
+			enc->var[enc->varlen++] = SUBSCRIPTION_IDENTIFIER;
+			memcpy(enc->var + enc->varlen, subidbuf, idbytes);
+			enc->varlen += idbytes;
+		}
+		remlen += lbytes - pbytes + (subid != 0 ? 1 + idbytes : 0);
+		enc->skip = (uint32_t) (off + pbytes);
+	} else {
+		// V5 msg to V4 client, drop the properties
+		remlen -= plen + pbytes;
+		enc->skip = (uint32_t) (off + pbytes + plen);
+	}
+
+	enc->hdr[0] = fixheader;
+	enc->hdrlen = 1 + pubenc_put_varint(enc->hdr + 1, remlen);
+	enc->qos    = qos;
+	enc->src0   = header[0];
+	enc->srclen = (uint32_t) nni_msg_len(msg);
+	enc->tail   = (uint32_t) (nni_msg_len(msg) - enc->skip);
+}
+
+const nni_mqtt_pubenc *
+nni_mqtt_pubenc_get(nni_msg *msg, uint8_t ver, uint8_t sub_qos, bool retain,
+    uint32_t subid, nni_mqtt_pubenc *scratch)
+{
+	const nni_mqtt_pubenc *enc;
+	uint64_t               key;
+
+	if (ver != MQTT_PROTOCOL_VERSION_v5) {
+		// neither applies to V4 peers
+		retain = true;
+		subid  = 0;
+	}
+	key = mqtt_pubenc_key(ver, sub_qos, retain, subid);
+	if ((enc = nni_msg_enc_get(msg, key)) != NULL &&
+	    enc->src0 == *(uint8_t *) nni_msg_header(msg) &&
+	    enc->srclen == nni_msg_len(msg)) {
+		return (enc);
+	}
+	mqtt_pubenc_encode(msg, ver, sub_qos, retain, subid, scratch);
+	if (enc != NULL) {
+		// the message changed under the cache, don't use it
+		return (scratch);
+	}
+	if ((enc = nni_msg_enc_set(msg, key, scratch, sizeof(*scratch))) ==
+	    NULL) {
+		return (scratch);
+	}
+	return (enc);
+}
@@ -0,0 +1,48 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#ifndef NNG_SUPPLEMENTAL_MQTT_MQTT_PUBENC_H
+#define NNG_SUPPLEMENTAL_MQTT_MQTT_PUBENC_H
+
+#include "core/nng_impl.h"
+
+// Per subscriber parts of an outgoing PUBLISH.  A broker sends
+//
+//   hdr | body[0, 2 + topic len) | var | body[skip, skip + tail)
+//
+// where hdr is the rewritten fixed header and var holds the packet id
+// (pidlen bytes, to be patched per peer) followed by the property length
+// and subscription identifier if the peer needs them.  These only depend
+// on the target protocol version, granted QoS, retain flag and
+// subscription id, so they are computed once per message and cached on it
+// with nni_msg_enc_set; fanning out to many peers then only patches the
+// packet id.
+
+typedef struct nni_mqtt_pubenc {
+	uint8_t  hdr[5];
+	uint8_t  hdrlen;
+	uint8_t  var[16];
+	uint8_t  varlen;
+	uint8_t  pidlen; // 2 if var starts with a packet id, else 0
+	uint8_t  qos;    // granted QoS
+	uint8_t  src0;   // first header byte of the source, to validate
+	uint32_t srclen; // body length of the source, to validate
+	uint32_t skip;
+	uint32_t tail;
+} nni_mqtt_pubenc;
+
+// nni_mqtt_pubenc_get returns the encoding of PUBLISH msg for a peer
+// speaking ver (MQTT_PROTOCOL_VERSION_*), with the given subscription QoS,
+// whether the retain flag is kept, and subscription id (0 for none).  The
+// result is cached on msg, and stays valid as long as msg is.  If the
+// cache cannot be allocated the encoding is written to scratch instead.
+extern const nni_mqtt_pubenc *nni_mqtt_pubenc_get(nni_msg *msg, uint8_t ver,
+    uint8_t sub_qos, bool retain, uint32_t subid, nni_mqtt_pubenc *scratch);
+
+#endif // NNG_SUPPLEMENTAL_MQTT_MQTT_PUBENC_H
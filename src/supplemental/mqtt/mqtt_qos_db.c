@@ -35,8 +35,11 @@ static void    remove_oldest_msg(
        sqlite3 *db, const char *table_name, const char *col_name, uint64_t limit);
 static void    remove_oldest_client_msg(sqlite3 *db, const char *table_name,
        const char *col_name, uint64_t limit, const char *config_name);
-static int64_t get_id_by_msg(sqlite3 *db, nni_msg *msg);
-static int64_t insert_msg(sqlite3 *db, nni_msg *msg);
+static int64_t msg_hash(const uint8_t *blob, size_t len);
+static int64_t get_id_by_msg(
+    sqlite3 *db, int64_t hash, const uint8_t *blob, size_t len);
+static int64_t insert_msg(
+    sqlite3 *db, int64_t hash, const uint8_t *blob, size_t len);
 static int64_t get_id_by_pipe(sqlite3 *db, uint32_t pipe_id);
 static int64_t get_id_by_client_id(sqlite3 *db, const char *client_id);
 static int     get_id_by_p_id(sqlite3 *db, int64_t p_id, uint16_t packet_id,
@@ -49,6 +52,196 @@ static int update_main(
 static void set_main(sqlite3 *db, uint32_t pipe_id, uint16_t packet_id,
     uint8_t qos, nni_msg *msg);
 
+// Per database state.  Prepared statements are cached by their SQL text
+// instead of being prepared and finalized on every call, and every
+// statement of a database runs under its mtx so that a cached statement
+// is never stepped by two threads at once.  Reads take the lock only,
+// writes also run in a transaction of their own.
+typedef struct {
+	char         *sql;
+	sqlite3_stmt *stmt;
+} qos_db_stmt;
+
+typedef struct {
+	sqlite3   *db;
+	nni_mtx    mtx;
+	nni_id_map stmts; // hash of the SQL -> qos_db_stmt
+} qos_db_ctx;
+
+static nni_mtx    qos_db_lk   = NNI_MTX_INITIALIZER;
+static nni_id_map qos_db_ctxs = NNI_ID_MAP_INITIALIZER(0, 0, 0);
+
+static qos_db_ctx *
+qos_db_ctx_get(sqlite3 *db)
+{
+	qos_db_ctx *ctx;
+
+	nni_mtx_lock(&qos_db_lk);
+	ctx = nni_id_get(&qos_db_ctxs, (uint64_t) (uintptr_t) db);
+	nni_mtx_unlock(&qos_db_lk);
+	return (ctx);
+}
+
+static int
+qos_db_ctx_alloc(sqlite3 *db)
+{
+	qos_db_ctx *ctx;
+	int         rv;
+
+	if ((ctx = NNI_ALLOC_STRUCT(ctx)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	ctx->db = db;
+	nni_mtx_init(&ctx->mtx);
+	nni_id_map_init(&ctx->stmts, 0, 0, false);
+
+	nni_mtx_lock(&qos_db_lk);
+	rv = nni_id_set(&qos_db_ctxs, (uint64_t) (uintptr_t) db, ctx);
+	nni_mtx_unlock(&qos_db_lk);
+	if (rv != 0) {
+		nni_id_map_fini(&ctx->stmts);
+		nni_mtx_fini(&ctx->mtx);
+		NNI_FREE_STRUCT(ctx);
+	}
+	return (rv);
+}
+
+static void
+qos_db_ctx_free(sqlite3 *db)
+{
+	qos_db_ctx  *ctx;
+	qos_db_stmt *cs;
+	uint64_t     key;
+	uint32_t     cursor = 0;
+
+	nni_mtx_lock(&qos_db_lk);
+	ctx = nni_id_get(&qos_db_ctxs, (uint64_t) (uintptr_t) db);
+	nni_id_remove(&qos_db_ctxs, (uint64_t) (uintptr_t) db);
+	nni_mtx_unlock(&qos_db_lk);
+	if (ctx == NULL) {
+		return;
+	}
+
+	while (nni_id_visit(&ctx->stmts, &key, (void **) &cs, &cursor)) {
+		sqlite3_finalize(cs->stmt);
+		nni_strfree(cs->sql);
+		NNI_FREE_STRUCT(cs);
+	}
+	nni_id_map_fini(&ctx->stmts);
+	nni_mtx_fini(&ctx->mtx);
+	NNI_FREE_STRUCT(ctx);
+}
+
+// Take the database for a statement that needs no transaction.
+static void
+qos_db_lock(sqlite3 *db)
+{
+	qos_db_ctx *ctx = qos_db_ctx_get(db);
+
+	if (ctx != NULL) {
+		nni_mtx_lock(&ctx->mtx);
+	}
+}
+
+static void
+qos_db_unlock(sqlite3 *db)
+{
+	qos_db_ctx *ctx = qos_db_ctx_get(db);
+
+	if (ctx != NULL) {
+		nni_mtx_unlock(&ctx->mtx);
+	}
+}
+
+static void
+qos_db_begin(sqlite3 *db)
+{
+	qos_db_ctx *ctx = qos_db_ctx_get(db);
+
+	if (ctx == NULL) {
+		sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+		return;
+	}
+	nni_mtx_lock(&ctx->mtx);
+	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+}
+
+static int
+qos_db_commit(sqlite3 *db)
+{
+	qos_db_ctx *ctx = qos_db_ctx_get(db);
+	int         rv;
+
+	if (ctx == NULL) {
+		return (sqlite3_exec(db, "COMMIT;", 0, 0, 0));
+	}
+	rv = sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	nni_mtx_unlock(&ctx->mtx);
+	return (rv);
+}
+
+// Returns the cached statement for sql, prepared on first use.  Must be
+// called between qos_db_begin/qos_db_commit or qos_db_lock/qos_db_unlock,
+// and handed back with qos_db_finalize.
+static sqlite3_stmt *
+qos_db_prepare(sqlite3 *db, const char *sql)
+{
+	qos_db_ctx   *ctx = qos_db_ctx_get(db);
+	qos_db_stmt  *cs;
+	sqlite3_stmt *stmt = NULL;
+	uint64_t      key;
+
+	if (ctx == NULL) {
+		sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+		return (stmt);
+	}
+	key = (uint64_t) msg_hash((const uint8_t *) sql, strlen(sql));
+	if ((cs = nni_id_get(&ctx->stmts, key)) != NULL) {
+		if (strcmp(cs->sql, sql) == 0) {
+			return (cs->stmt);
+		}
+		// a hash collision, leave the cached one alone
+		sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+		return (stmt);
+	}
+	if (sqlite3_prepare_v3(db, sql, strlen(sql), SQLITE_PREPARE_PERSISTENT,
+	        &stmt, 0) != SQLITE_OK) {
+		return (stmt);
+	}
+	if ((cs = NNI_ALLOC_STRUCT(cs)) == NULL ||
+	    (cs->sql = nni_strdup(sql)) == NULL) {
+		if (cs != NULL) {
+			NNI_FREE_STRUCT(cs);
+		}
+		return (stmt);
+	}
+	cs->stmt = stmt;
+	if (nni_id_set(&ctx->stmts, key, cs) != 0) {
+		nni_strfree(cs->sql);
+		NNI_FREE_STRUCT(cs);
+	}
+	return (stmt);
+}
+
+static void
+qos_db_finalize(sqlite3 *db, sqlite3_stmt *stmt)
+{
+	qos_db_ctx  *ctx = qos_db_ctx_get(db);
+	qos_db_stmt *cs;
+	const char  *sql;
+
+	if (ctx != NULL && stmt != NULL && (sql = sqlite3_sql(stmt)) != NULL &&
+	    (cs = nni_id_get(&ctx->stmts,
+	         (uint64_t) msg_hash((const uint8_t *) sql, strlen(sql)))) !=
+	        NULL &&
+	    cs->stmt == stmt) {
+		sqlite3_reset(stmt);
+		sqlite3_clear_bindings(stmt);
+		return;
+	}
+	sqlite3_finalize(stmt);
+}
+
 static int
 create_client_msg_table(sqlite3 *db)
 {
@@ -91,14 +284,48 @@ create_client_info_table(sqlite3 *db)
 	return sqlite3_exec(db, sql, 0, 0, 0);
 }
 
+// Messages are looked up by a hash of their serialized form, the data is
+// only compared for rows whose hash matches.  Databases created before the
+// hash column existed get it added, and filled in, here.
 static int
 create_msg_table(sqlite3 *db)
 {
-	char sql[] = "CREATE TABLE IF NOT EXISTS " table_msg ""
+	sqlite3_stmt *stmt;
+	sqlite3_stmt *update;
+	char          sql[] = "CREATE TABLE IF NOT EXISTS " table_msg ""
 	             " (id INTEGER PRIMARY KEY AUTOINCREMENT, "
+	             "  hash INTEGER, "
 	             "  data BLOB)";
+	char sql_old[] = "SELECT id, data FROM " table_msg
+	                 " WHERE hash IS NULL";
+	char sql_set[] = "UPDATE " table_msg " SET hash = ? WHERE id = ?";
+	int  rv;
 
-	return sqlite3_exec(db, sql, 0, 0, 0);
+	if ((rv = sqlite3_exec(db, sql, 0, 0, 0)) != 0) {
+		return rv;
+	}
+	// fails harmlessly if the column is already there
+	sqlite3_exec(db, "ALTER TABLE " table_msg " ADD COLUMN hash INTEGER",
+	    0, 0, 0);
+
+	qos_db_begin(db);
+	sqlite3_prepare_v2(db, sql_old, strlen(sql_old), &stmt, 0);
+	sqlite3_prepare_v2(db, sql_set, strlen(sql_set), &update, 0);
+	while (SQLITE_ROW == sqlite3_step(stmt)) {
+		const uint8_t *blob = sqlite3_column_blob(stmt, 1);
+		size_t         len  = sqlite3_column_bytes(stmt, 1);
+		sqlite3_reset(update);
+		sqlite3_bind_int64(update, 1, msg_hash(blob, len));
+		sqlite3_bind_int64(update, 2, sqlite3_column_int64(stmt, 0));
+		sqlite3_step(update);
+	}
+	sqlite3_finalize(update);
+	qos_db_finalize(db, stmt);
+	qos_db_commit(db);
+
+	return sqlite3_exec(db,
+	    "CREATE INDEX IF NOT EXISTS idx_msg_hash ON " table_msg " (hash)",
+	    0, 0, 0);
 }
 
 static int
@@ -107,7 +334,9 @@ create_pipe_client_table(sqlite3 *db)
 	char sql[] = "CREATE TABLE IF NOT EXISTS " table_pipe_client ""
 	             "(id INTEGER PRIMARY KEY  AUTOINCREMENT, "
 	             " pipe_id    INTEGER NOT NULL, "
-	             " client_id  TEXT NOT NULL)";
+	             " client_id  TEXT NOT NULL);"
+	             "CREATE INDEX IF NOT EXISTS idx_pipe_client_pipe ON "
+	             table_pipe_client " (pipe_id)";
 	return sqlite3_exec(db, sql, 0, 0, 0);
 }
 
@@ -121,7 +350,11 @@ create_main_table(sqlite3 *db)
 	             " qos  TINYINT NOT NULL , "
 	             " m_id INTEGER NOT NULL , "
 	             " ts DATETIME DEFAULT CURRENT_TIMESTAMP "
-	             " )";
+	             " );"
+	             "CREATE INDEX IF NOT EXISTS idx_main_packet ON "
+	             table_main " (p_id, packet_id);"
+	             "CREATE INDEX IF NOT EXISTS idx_main_msg ON "
+	             table_main " (m_id)";
 
 	return sqlite3_exec(db, sql, 0, 0, 0);
 }
@@ -179,6 +412,9 @@ nni_mqtt_qos_db_init(sqlite3 **db, const char *user_path, const char *db_name, b
 		    sqlite3_errmsg(*db));
 		return;
 	}
+	if (qos_db_ctx_alloc(*db) != 0) {
+		log_warn("no statement cache for %s", db_path);
+	}
 	set_db_pragma(*db);
 	if (is_broker) {
 		if (create_msg_table(*db) != 0) {
@@ -209,50 +445,61 @@ nni_mqtt_qos_db_init(sqlite3 **db, const char *user_path, const char *db_name, b
 void
 nni_mqtt_qos_db_close(sqlite3 *db)
 {
+	qos_db_ctx_free(db);
 	sqlite3_close(db);
 }
 
+// 64-bit FNV-1a of a serialized message, stored as a signed INTEGER.
 static int64_t
-get_id_by_msg(sqlite3 *db, nni_msg *msg)
+msg_hash(const uint8_t *blob, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	for (size_t i = 0; i < len; i++) {
+		h ^= blob[i];
+		h *= 0x100000001b3ULL;
+	}
+	return ((int64_t) h);
+}
+
+static int64_t
+get_id_by_msg(sqlite3 *db, int64_t hash, const uint8_t *blob, size_t len)
 {
 	int64_t       id = 0;
 	sqlite3_stmt *stmt;
-	size_t        len   = 0;
-	uint8_t *     blob  = nni_msg_serialize(msg, &len);
-	char          sql[] = "SELECT id FROM " table_msg " where data = ?";
+	char          sql[] =
+	    "SELECT id FROM " table_msg " WHERE hash = ? AND data = ?";
 
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_lock(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 
-	sqlite3_bind_blob64(stmt, 1, blob, len, SQLITE_TRANSIENT);
+	sqlite3_bind_int64(stmt, 1, hash);
+	sqlite3_bind_blob64(stmt, 2, blob, len, SQLITE_STATIC);
 	if (SQLITE_ROW == sqlite3_step(stmt)) {
 		id = sqlite3_column_int64(stmt, 0);
 	}
 
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
-	nng_free(blob, len);
+	qos_db_finalize(db, stmt);
+	qos_db_unlock(db);
 	return id;
 }
 
 static int64_t
-insert_msg(sqlite3 *db, nni_msg *msg)
+insert_msg(sqlite3 *db, int64_t hash, const uint8_t *blob, size_t len)
 {
 	int64_t       id = 0;
 	sqlite3_stmt *stmt;
-	char *        sql = "INSERT INTO  " table_msg " (data) VALUES (?)";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	char *sql = "INSERT INTO  " table_msg " (hash, data) VALUES (?, ?)";
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
-	size_t   len  = 0;
-	uint8_t *blob = nni_msg_serialize(msg, &len);
-	sqlite3_bind_blob64(stmt, 1, blob, len, SQLITE_TRANSIENT);
+	sqlite3_bind_int64(stmt, 1, hash);
+	sqlite3_bind_blob64(stmt, 2, blob, len, SQLITE_STATIC);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-	nng_free(blob, len);
+	qos_db_finalize(db, stmt);
 	id = sqlite3_last_insert_rowid(db);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_commit(db);
 	return id;
 }
 
@@ -263,8 +510,8 @@ get_id_by_pipe(sqlite3 *db, uint32_t pipe_id)
 	sqlite3_stmt *stmt;
 	char sql[] = "SELECT id FROM " table_pipe_client " WHERE pipe_id = ?";
 
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_lock(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 
 	sqlite3_bind_int64(stmt, 1, pipe_id);
@@ -272,8 +519,8 @@ get_id_by_pipe(sqlite3 *db, uint32_t pipe_id)
 		id = sqlite3_column_int64(stmt, 0);
 	}
 
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_unlock(db);
 	return id;
 }
 
@@ -284,8 +531,8 @@ get_id_by_client_id(sqlite3 *db, const char *client_id)
 	sqlite3_stmt *stmt;
 	char          sql[] =
 	    "SELECT id FROM " table_pipe_client " WHERE client_id = ?";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_lock(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 
 	sqlite3_bind_text(
@@ -294,8 +541,8 @@ get_id_by_client_id(sqlite3 *db, const char *client_id)
 		id = sqlite3_column_int64(stmt, 0);
 	}
 
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_unlock(db);
 	return id;
 }
 
@@ -307,8 +554,8 @@ get_id_by_p_id(sqlite3 *db, int64_t p_id, uint16_t packet_id, uint8_t *out_qos,
 	sqlite3_stmt *stmt;
 	char          sql[] = "SELECT id, qos, m_id FROM " table_main
 	             " WHERE p_id = ? AND packet_id = ?";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_lock(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 
 	sqlite3_bind_int64(stmt, 1, p_id);
@@ -319,8 +566,8 @@ get_id_by_p_id(sqlite3 *db, int64_t p_id, uint16_t packet_id, uint8_t *out_qos,
 		*out_m_id = sqlite3_column_int64(stmt, 2);
 	}
 
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_unlock(db);
 	return id;
 }
 
@@ -331,16 +578,16 @@ insert_main(
 	sqlite3_stmt *stmt;
 	char *        sql = "INSERT INTO " table_main ""
 	            " (p_id, packet_id, qos, m_id) VALUES (?, ?, ?, ?)";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int64(stmt, 1, p_id);
 	sqlite3_bind_int(stmt, 2, packet_id);
 	sqlite3_bind_int(stmt, 3, qos);
 	sqlite3_bind_int64(stmt, 4, m_id);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-	return sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	return qos_db_commit(db);
 }
 
 static int
@@ -350,16 +597,16 @@ update_main(
 	sqlite3_stmt *stmt;
 	char *        sql = "UPDATE " table_main ""
 	            " SET qos = ?, m_id = ? WHERE p_id = ? AND packet_id = ?";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int(stmt, 1, qos);
 	sqlite3_bind_int64(stmt, 2, m_id);
 	sqlite3_bind_int64(stmt, 3, p_id);
 	sqlite3_bind_int(stmt, 4, packet_id);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-	return sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	return qos_db_commit(db);
 }
 
 static void
@@ -374,14 +621,14 @@ remove_oldest_msg(
 	    " %s DESC LIMIT ?)",
 	    table_name, col_name, col_name, table_name, col_name);
 
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int64(stmt, 1, limit);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_commit(db);
 }
 
 void
@@ -397,15 +644,15 @@ nni_mqtt_qos_db_insert_pipe(
 	sqlite3_stmt *stmt;
 	char *        sql = "INSERT INTO " table_pipe_client ""
 	            " (pipe_id, client_id) VALUES (?, ?)";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int64(stmt, 1, pipe_id);
 	sqlite3_bind_text(
 	    stmt, 2, client_id, strlen(client_id), SQLITE_TRANSIENT);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_commit(db);
 }
 
 void
@@ -414,13 +661,13 @@ nni_mqtt_qos_db_remove_pipe(sqlite3 *db, uint32_t pipe_id)
 	sqlite3_stmt *stmt;
 	char *        sql = "DELETE FROM " table_pipe_client ""
 	            " where pipe_id = ?";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int64(stmt, 1, pipe_id);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_commit(db);
 }
 
 void
@@ -430,15 +677,15 @@ nni_mqtt_qos_db_update_pipe_by_clientid(
 	sqlite3_stmt *stmt;
 	char *        sql = "UPDATE " table_pipe_client " SET pipe_id = ?"
 	            " where client_id = ?";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int64(stmt, 1, pipe_id);
 	sqlite3_bind_text(
 	    stmt, 2, client_id, strlen(client_id), SQLITE_TRANSIENT);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_commit(db);
 }
 
 void
@@ -460,30 +707,31 @@ nni_mqtt_qos_db_update_all_pipe(sqlite3 *db, uint32_t pipe_id)
 	sqlite3_stmt *stmt;
 	char *        sql = "UPDATE " table_pipe_client " SET pipe_id = ?"
 	            " where id > 0";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int64(stmt, 1, pipe_id);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_commit(db);
 }
 
 void
 nni_mqtt_qos_db_remove_msg(sqlite3 *db, nni_msg *msg)
 {
 	sqlite3_stmt *stmt;
-	char *        sql = "DELETE FROM " table_msg " WHERE data = ?";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	char *sql = "DELETE FROM " table_msg " WHERE hash = ? AND data = ?";
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	size_t   len  = 0;
 	uint8_t *blob = nni_msg_serialize(msg, &len);
-	sqlite3_bind_blob64(stmt, 1, blob, len, SQLITE_TRANSIENT);
+	sqlite3_bind_int64(stmt, 1, msg_hash(blob, len));
+	sqlite3_bind_blob64(stmt, 2, blob, len, SQLITE_STATIC);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 	nng_free(blob, len);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_commit(db);
 }
 
 void
@@ -491,9 +739,9 @@ nni_mqtt_qos_db_remove_all_msg(sqlite3 *db)
 {
 	char *sql = "UPDATE " table_main " SET m_id = 0 WHERE m_id > 0;"
 	            "DELETE FROM " table_msg " WHERE id > 0;";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+	qos_db_begin(db);
 	sqlite3_exec(db, sql, 0, 0, NULL);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_commit(db);
 }
 
 void
@@ -502,21 +750,20 @@ nni_mqtt_qos_db_check_remove_msg(sqlite3 *db, nni_msg *msg)
 	sqlite3_stmt *stmt;
 	// remove the msg if it was not referenced by table `t_main`
 	char sql[] = "DELETE FROM " table_msg " AS msg WHERE "
-	             "( SELECT COUNT(main.id) FROM " table_main " AS main  "
-	             "WHERE  m_id = "
-	             "( SELECT msg.id FROM t_msg "
-	             "AS msg WHERE data = ? )) = 0 AND msg.data = ?";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	             "msg.hash = ? AND msg.data = ? AND NOT EXISTS "
+	             "( SELECT 1 FROM " table_main " AS main "
+	             "WHERE main.m_id = msg.id )";
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	size_t   len  = 0;
 	uint8_t *blob = nni_msg_serialize(msg, &len);
-	sqlite3_bind_blob64(stmt, 1, blob, len, SQLITE_TRANSIENT);
-	sqlite3_bind_blob64(stmt, 2, blob, len, SQLITE_TRANSIENT);
+	sqlite3_bind_int64(stmt, 1, msg_hash(blob, len));
+	sqlite3_bind_blob64(stmt, 2, blob, len, SQLITE_STATIC);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 	nng_free(blob, len);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_commit(db);
 }
 
 void
@@ -526,12 +773,12 @@ nni_mqtt_qos_db_remove_unused_msg(sqlite3 *db)
 	// remove the msg if it was not referenced by table `t_main`
 	char sql[] = "DELETE FROM " table_msg
 	             " WHERE id NOT IN (SELECT m_id FROM t_main)";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_commit(db);
 }
 
 void
@@ -552,10 +799,17 @@ set_main(sqlite3 *db, uint32_t pipe_id, uint16_t packet_id, uint8_t qos,
 		// can not find client
 		return;
 	}
-	int64_t msg_id = get_id_by_msg(db, msg);
+	size_t   len  = 0;
+	uint8_t *blob = nni_msg_serialize(msg, &len);
+	if (blob == NULL) {
+		return;
+	}
+	int64_t hash   = msg_hash(blob, len);
+	int64_t msg_id = get_id_by_msg(db, hash, blob, len);
 	if (msg_id == 0) {
-		msg_id = insert_msg(db, msg);
+		msg_id = insert_msg(db, hash, blob, len);
 	}
+	nng_free(blob, len);
 	uint8_t main_qos  = 0;
 	int64_t main_m_id = 0;
 	int64_t main_id =
@@ -583,8 +837,8 @@ nni_mqtt_qos_db_get(sqlite3 *db, uint32_t pipe_id, uint16_t packet_id)
 	    " AS msg ON  main.m_id = msg.id "
 	    "WHERE pipe.pipe_id = ? AND main.packet_id = ?";
 
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_lock(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 
 	sqlite3_bind_int64(stmt, 1, pipe_id);
@@ -600,8 +854,8 @@ nni_mqtt_qos_db_get(sqlite3 *db, uint32_t pipe_id, uint16_t packet_id)
 		msg = MQTT_DB_PACKED_MSG_QOS(msg, qos);
 		sqlite3_free(bytes);
 	}
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_unlock(db);
 
 	return msg;
 }
@@ -621,8 +875,8 @@ nni_mqtt_qos_db_get_one(sqlite3 *db, uint32_t pipe_id, uint16_t *packet_id)
 	    " main.m_id = msg.id WHERE pipe.pipe_id = ? AND main.m_id > 0 "
 	    "LIMIT 1";
 
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_lock(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int(stmt, 1, pipe_id);
 
@@ -637,8 +891,8 @@ nni_mqtt_qos_db_get_one(sqlite3 *db, uint32_t pipe_id, uint16_t *packet_id)
 		msg = MQTT_DB_PACKED_MSG_QOS(msg, qos);
 		sqlite3_free(bytes);
 	}
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_unlock(db);
 
 	return msg;
 }
@@ -650,16 +904,16 @@ nni_mqtt_qos_db_remove(sqlite3 *db, uint32_t pipe_id, uint16_t packet_id)
 	char *sql = "DELETE FROM " table_main " AS main WHERE main.p_id = "
 	            "(SELECT pipe.id FROM " table_pipe_client ""
 	            " AS pipe where  pipe.pipe_id = ? AND packet_id = ?)";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 
 	sqlite3_bind_int(stmt, 1, pipe_id);
 	sqlite3_bind_int(stmt, 2, packet_id);
 	sqlite3_step(stmt);
 
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_commit(db);
 }
 
 void
@@ -669,15 +923,15 @@ nni_mqtt_qos_db_remove_by_pipe(sqlite3 *db, uint32_t pipe_id)
 	char *sql = "DELETE FROM " table_main " AS main WHERE main.p_id = "
 	            "(SELECT pipe.id FROM " table_pipe_client ""
 	            " AS pipe where  pipe.pipe_id = ?)";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 
 	sqlite3_bind_int(stmt, 1, pipe_id);
 	sqlite3_step(stmt);
 
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_commit(db);
 }
 
 void
@@ -690,8 +944,8 @@ nni_mqtt_qos_db_foreach(sqlite3 *db, nni_idhash_cb cb)
 	    " AS msg ON main.m_id = msg.id JOIN " table_pipe_client " "
 	    " AS pipe ON main.p_id = pipe.id";
 
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_lock(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 
 	while (SQLITE_ROW == sqlite3_step(stmt)) {
@@ -708,8 +962,8 @@ nni_mqtt_qos_db_foreach(sqlite3 *db, nni_idhash_cb cb)
 		sqlite3_free(bytes);
 	}
 
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_unlock(db);
 }
 
 int
@@ -725,8 +979,8 @@ nni_mqtt_qos_db_set_retain(
 		return -1;
 	}
 	sqlite3_stmt *stmt;
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 
 	sqlite3_bind_text(stmt, 1, topic, strlen(topic), SQLITE_TRANSIENT);
@@ -734,8 +988,8 @@ nni_mqtt_qos_db_set_retain(
 	sqlite3_bind_int(stmt, 3, proto_ver);
 	sqlite3_step(stmt);
 
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_commit(db);
 	nng_free(blob, len);
 
 	return 0;
@@ -750,8 +1004,8 @@ nni_mqtt_qos_db_get_retain(sqlite3 *db, const char *topic)
 
 	sqlite3_stmt *stmt;
 
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_lock(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 
 	sqlite3_bind_text(stmt, 1, topic, strlen(topic), SQLITE_TRANSIENT);
@@ -773,8 +1027,8 @@ nni_mqtt_qos_db_get_retain(sqlite3 *db, const char *topic)
 		nni_mqtt_msg_set_publish_proto_version(msg, proto_ver);
 	}
 
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_unlock(db);
 
 	return msg;
 }
@@ -801,7 +1055,7 @@ nni_mqtt_qos_db_find_retain(sqlite3 *db, const char *topic_pattern)
 
 	sqlite3_stmt *stmt;
 
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+	qos_db_lock(db);
 	sqlite3_prepare_v2(db, full_sql,
 	    strlen(full_sql), &stmt, 0);
 	sqlite3_reset(stmt);
@@ -823,8 +1077,8 @@ nni_mqtt_qos_db_find_retain(sqlite3 *db, const char *topic_pattern)
 		cvector_push_back(msg_vec, msg);
 	}
 
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_unlock(db);
 	nng_strfree(topic_str);
 	nng_free(full_sql, full_sql_sz);
 
@@ -838,15 +1092,15 @@ nni_mqtt_qos_db_remove_retain(sqlite3 *db, const char *topic)
 
 	sqlite3_stmt *stmt;
 
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 
 	sqlite3_bind_text(stmt, 1, topic, strlen(topic), SQLITE_TRANSIENT);
 	sqlite3_step(stmt);
 
-	sqlite3_finalize(stmt);
-	return sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	return qos_db_commit(db);
 }
 
 int
@@ -865,8 +1119,8 @@ nni_mqtt_qos_db_set_client_msg(sqlite3 *db, uint32_t pipe_id,
 		return -1;
 	}
 	sqlite3_stmt *stmt;
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int(stmt, 1, pipe_id);
 	sqlite3_bind_int64(stmt, 2, packet_id);
@@ -875,9 +1129,9 @@ nni_mqtt_qos_db_set_client_msg(sqlite3 *db, uint32_t pipe_id,
 	sqlite3_bind_text(
 	    stmt, 5, config_name, strlen(config_name), SQLITE_TRANSIENT);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 	nng_free(blob, len);
-	int rv = sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	int rv = qos_db_commit(db);
 	nni_msg_free(msg);
 	return rv;
 }
@@ -893,8 +1147,8 @@ nni_mqtt_qos_db_get_client_msg(
 	    "SELECT proto_ver, data FROM " table_client_msg ""
 	    " WHERE pipe_id = ? AND packet_id = ? AND info_id = (SELECT id "
 	    "FROM " table_client_info " WHERE config_name = ? LIMIT 1) ";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_lock(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int64(stmt, 1, pipe_id);
 	sqlite3_bind_int(stmt, 2, packet_id);
@@ -911,9 +1165,9 @@ nni_mqtt_qos_db_get_client_msg(
 		    bytes, nbyte, pipe_id > 0 ? true : false, proto_ver);
 		sqlite3_free(bytes);
 	}
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_unlock(db);
 
 	return msg;
 }
@@ -928,17 +1182,17 @@ nni_mqtt_qos_db_remove_client_msg(
 	    "DELETE FROM " table_client_msg
 	    " WHERE pipe_id = ? AND packet_id = ? AND info_id = (SELECT id "
 	    "FROM "table_client_info" WHERE config_name = ? LIMIT 1)";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int64(stmt, 1, pipe_id);
 	sqlite3_bind_int(stmt, 2, packet_id);
 	sqlite3_bind_text(
 	    stmt, 3, config_name, strlen(config_name), SQLITE_TRANSIENT);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_commit(db);
 }
 
 void
@@ -947,14 +1201,14 @@ nni_mqtt_qos_db_remove_client_msg_by_id(sqlite3 *db, uint64_t id)
 	sqlite3_stmt *stmt;
 
 	char sql[] = "DELETE FROM " table_client_msg " WHERE id = ?";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int64(stmt, 1, id);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_commit(db);
 }
 
 void
@@ -966,15 +1220,15 @@ nni_mqtt_qos_db_reset_client_msg_pipe_id(sqlite3 *db, const char *config_name)
 	    "UPDATE " table_client_msg " SET pipe_id = 0 WHERE info_id = "
 	    "(SELECT id FROM " table_client_info
 	    " WHERE config_name = ? LIMIT 1)";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_text(
 	    stmt, 1, config_name, strlen(config_name), SQLITE_TRANSIENT);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_commit(db);
 }
 
 static void
@@ -992,16 +1246,16 @@ remove_oldest_client_msg(sqlite3 *db, const char *table_name,
 	    " %s DESC LIMIT ?)",
 	    table_name, col_name, col_name, table_name, col_name);
 
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_text(
 	    stmt, 1, config_name, strlen(config_name), SQLITE_TRANSIENT);
 	sqlite3_bind_int64(stmt, 2, limit);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_commit(db);
 }
 
 void
@@ -1024,8 +1278,8 @@ nni_mqtt_qos_db_get_one_client_msg(
 	    " WHERE info_id = (SELECT id FROM " table_client_info
 	    " WHERE config_name = ? LIMIT 1) "
 	    " ORDER BY id LIMIT 1";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_lock(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_text(
 	    stmt, 1, config_name, strlen(config_name), SQLITE_TRANSIENT);
@@ -1044,9 +1298,9 @@ nni_mqtt_qos_db_get_one_client_msg(
 		    bytes, nbyte, pipe_id > 0 ? true : false, proto_ver);
 		sqlite3_free(bytes);
 	}
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_unlock(db);
 
 	return msg;
 }
@@ -1069,17 +1323,17 @@ nni_mqtt_qos_db_set_client_offline_msg(
 	}
 
 	sqlite3_stmt *stmt;
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_int(stmt, 1, proto_ver);
 	sqlite3_bind_blob64(stmt, 2, blob, len, SQLITE_TRANSIENT);
 	sqlite3_bind_text(
 	    stmt, 3, config_name, strlen(config_name), SQLITE_TRANSIENT);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 	nng_free(blob, len);
-	int rv = sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	int rv = qos_db_commit(db);
 	nni_msg_free(msg);
 	return rv;
 }
@@ -1098,8 +1352,8 @@ nni_mqtt_qos_db_set_client_offline_msg_batch(
 	    "VALUES ( ? , ? , ?)";
 
 	sqlite3_stmt *stmt;
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	size_t lmq_len = nni_lmq_len(lmq);
 	for (size_t i = 0; i < lmq_len; i++) {
 		nni_msg *msg;
@@ -1121,8 +1375,8 @@ nni_mqtt_qos_db_set_client_offline_msg_batch(
 			nni_msg_free(msg);
 		}
 	}
-	sqlite3_finalize(stmt);
-	int rv = sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	int rv = qos_db_commit(db);
 
 	return rv;
 }
@@ -1139,8 +1393,8 @@ nni_mqtt_qos_db_get_client_offline_msg(
 	             " WHERE config_name = ? LIMIT 1) "
 	             " ORDER BY id ASC LIMIT 1 ";
 
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_lock(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_text(
 	    stmt, 1, config_name, strlen(config_name), SQLITE_TRANSIENT);
@@ -1155,8 +1409,8 @@ nni_mqtt_qos_db_get_client_offline_msg(
 		msg = nni_mqtt_msg_deserialize(bytes, nbyte, false, proto_ver);
 		sqlite3_free(bytes);
 	}
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_unlock(db);
 
 	return msg;
 }
@@ -1174,15 +1428,15 @@ nni_mqtt_qos_db_remove_client_offline_msg(sqlite3 *db, int64_t row_id)
 {
 	sqlite3_stmt *stmt;
 	char sql[] = "DELETE FROM " table_client_offline_msg " WHERE id = ?";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 
 	sqlite3_bind_int64(stmt, 1, row_id);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 
-	return sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	return qos_db_commit(db);
 }
 
 int
@@ -1192,15 +1446,15 @@ nni_mqtt_qos_db_remove_all_client_offline_msg(sqlite3 *db, const char *config_na
 	char          sql[] = "DELETE FROM " table_client_offline_msg
 	             " WHERE info_id = (SELECT id FROM " table_client_info
 	             " WHERE config_name = ? LIMIT 1)";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_text(
 	    stmt, 1, config_name, strlen(config_name), SQLITE_TRANSIENT);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
+	qos_db_finalize(db, stmt);
 
-	return sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	return qos_db_commit(db);
 }
 
 static int
@@ -1210,16 +1464,16 @@ get_client_info_id(sqlite3 *db, const char *config_name)
 	sqlite3_stmt *stmt;
 	char          sql[] = "SELECT id FROM " table_client_info
 	             " WHERE config_name = ? LIMIT 1";
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_lock(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_text(
 	    stmt, 1, config_name, strlen(config_name), SQLITE_TRANSIENT);
 	if (SQLITE_ROW == sqlite3_step(stmt)) {
 		id = sqlite3_column_int(stmt, 0);
 	}
-	sqlite3_finalize(stmt);
-	sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	qos_db_unlock(db);
 	return id;
 }
 
@@ -1233,8 +1487,8 @@ nni_mqtt_qos_db_set_client_info(sqlite3 *db, const char *config_name,
 	             " WHERE config_name = ? LIMIT 1 ), ?, ?, ?, ? )";
 
 	sqlite3_stmt *stmt;
-	sqlite3_exec(db, "BEGIN;", 0, 0, 0);
-	sqlite3_prepare_v2(db, sql, strlen(sql), &stmt, 0);
+	qos_db_begin(db);
+	stmt = qos_db_prepare(db, sql);
 	sqlite3_reset(stmt);
 	sqlite3_bind_text(
 	    stmt, 1, config_name, strlen(config_name), SQLITE_TRANSIENT);
@@ -1250,8 +1504,8 @@ nni_mqtt_qos_db_set_client_info(sqlite3 *db, const char *config_name,
 	    stmt, 4, proto_name, strlen(proto_name), SQLITE_TRANSIENT);
 	sqlite3_bind_int(stmt, 5, proto_ver);
 	sqlite3_step(stmt);
-	sqlite3_finalize(stmt);
-	int rv = sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+	qos_db_finalize(db, stmt);
+	int rv = qos_db_commit(db);
 	return rv;
 }
 
@@ -3,6 +3,141 @@
 #include "nng/protocol/mqtt/mqtt_parser.h"
 #endif
 
+typedef struct {
+	nni_list_node node;
+	nni_msg      *msg;
+	uint64_t      key; // packet id, handed to foreach callbacks
+} qos_inflight_ent;
+
+struct nni_qos_inflight {
+	nni_id_map map;   // packet id -> qos_inflight_ent
+	nni_list   order; // least recently sent first
+};
+
+int
+nni_qos_inflight_alloc(nni_qos_inflight **infp)
+{
+	nni_qos_inflight *inf;
+
+	if ((inf = NNI_ALLOC_STRUCT(inf)) == NULL) {
+		*infp = NULL;
+		return (NNG_ENOMEM);
+	}
+	nni_id_map_init(&inf->map, 0, 0, false);
+	NNI_LIST_INIT(&inf->order, qos_inflight_ent, node);
+	*infp = inf;
+	return (0);
+}
+
+// Messages still in the db are not freed, see nni_qos_db_remove_all_msg.
+void
+nni_qos_inflight_free(nni_qos_inflight *inf)
+{
+	qos_inflight_ent *ent;
+
+	if (inf == NULL) {
+		return;
+	}
+	while ((ent = nni_list_first(&inf->order)) != NULL) {
+		nni_list_remove(&inf->order, ent);
+		NNI_FREE_STRUCT(ent);
+	}
+	nni_id_map_fini(&inf->map);
+	NNI_FREE_STRUCT(inf);
+}
+
+// Storing a packet id again replaces its message, like nni_id_set, and
+// counts as sending it again.
+int
+nni_qos_inflight_set(nni_qos_inflight *inf, uint16_t pid, nni_msg *msg)
+{
+	qos_inflight_ent *ent;
+	int               rv;
+
+	if ((ent = nni_id_get(&inf->map, pid)) != NULL) {
+		nni_list_remove(&inf->order, ent);
+	} else {
+		if ((ent = NNI_ALLOC_STRUCT(ent)) == NULL) {
+			return (NNG_ENOMEM);
+		}
+		if ((rv = nni_id_set(&inf->map, pid, ent)) != 0) {
+			NNI_FREE_STRUCT(ent);
+			return (rv);
+		}
+		ent->key = pid;
+	}
+	ent->msg = msg;
+	nni_list_append(&inf->order, ent);
+	return (0);
+}
+
+nni_msg *
+nni_qos_inflight_get(nni_qos_inflight *inf, uint16_t pid)
+{
+	qos_inflight_ent *ent;
+
+	if ((ent = nni_id_get(&inf->map, pid)) == NULL) {
+		return (NULL);
+	}
+	return (ent->msg);
+}
+
+void
+nni_qos_inflight_remove(nni_qos_inflight *inf, uint16_t pid)
+{
+	qos_inflight_ent *ent;
+
+	if ((ent = nni_id_get(&inf->map, pid)) == NULL) {
+		return;
+	}
+	nni_id_remove(&inf->map, pid);
+	nni_list_remove(&inf->order, ent);
+	NNI_FREE_STRUCT(ent);
+}
+
+// Returns the message that was sent longest ago, and its packet id.
+nni_msg *
+nni_qos_inflight_first(nni_qos_inflight *inf, uint16_t *pid)
+{
+	qos_inflight_ent *ent;
+
+	if ((ent = nni_list_first(&inf->order)) == NULL) {
+		return (NULL);
+	}
+	*pid = (uint16_t) ent->key;
+	return (ent->msg);
+}
+
+// Marks the message as just (re)sent, moving it behind all others.
+void
+nni_qos_inflight_touch(nni_qos_inflight *inf, uint16_t pid)
+{
+	qos_inflight_ent *ent;
+
+	if ((ent = nni_id_get(&inf->map, pid)) == NULL) {
+		return;
+	}
+	nni_list_remove(&inf->order, ent);
+	nni_list_append(&inf->order, ent);
+}
+
+size_t
+nni_qos_inflight_count(nni_qos_inflight *inf)
+{
+	return (nni_id_count(&inf->map));
+}
+
+// The callback may free the message but must not modify the db.
+void
+nni_qos_inflight_foreach(nni_qos_inflight *inf, nni_idhash_cb cb)
+{
+	qos_inflight_ent *ent;
+
+	NNI_LIST_FOREACH (&inf->order, ent) {
+		cb((void *) &ent->key, ent->msg);
+	}
+}
+
 void
 nni_qos_db_set(bool is_sqlite, void *db, uint32_t pipe_id, uint16_t packet_id,
     nng_msg *msg)
@@ -19,7 +154,8 @@ nni_qos_db_set(bool is_sqlite, void *db, uint32_t pipe_id, uint16_t packet_id,
 		NNI_ARG_UNUSED(msg);
 #endif
 	} else {
-		if (nni_id_set((nni_id_map *) (db), packet_id, msg) != 0) {
+		if (nni_qos_inflight_set(
+		        (nni_qos_inflight *) (db), packet_id, msg) != 0) {
 			log_warn("insert QoS msg into hashmap failed! msg lost");
 			nni_msg_free(msg);
 		}
@@ -39,7 +175,7 @@ nni_qos_db_get(bool is_sqlite, void *db, uint32_t pipe_id, uint16_t packet_id)
 #endif
 	} else {
 		NNI_ARG_UNUSED(pipe_id);
-		msg = nni_id_get((nni_id_map *) (db), packet_id);
+		msg = nni_qos_inflight_get((nni_qos_inflight *) (db), packet_id);
 	}
 	return msg;
 }
@@ -57,12 +193,25 @@ nni_qos_db_get_one(
 		    (sqlite3 *) (db), pipe_id, (uint16_t *) packet_id);
 #endif
 	} else {
+		// the oldest one, wherever packet_id points
 		NNI_ARG_UNUSED(pipe_id);
-		msg = nni_id_get_min((nni_id_map *) (db), packet_id);
+		msg = nni_qos_inflight_first(
+		    (nni_qos_inflight *) (db), packet_id);
 	}
 	return msg;
 }
 
+void
+nni_qos_db_touch(
+    bool is_sqlite, void *db, uint32_t pipe_id, uint16_t packet_id)
+{
+	NNI_ARG_UNUSED(pipe_id);
+	// SQLite keeps packet id order, callers move their cursor instead
+	if (db != NULL && !is_sqlite) {
+		nni_qos_inflight_touch((nni_qos_inflight *) (db), packet_id);
+	}
+}
+
 void
 nni_qos_db_remove(
     bool is_sqlite, void *db, uint32_t pipe_id, uint16_t packet_id)
@@ -75,7 +224,7 @@ nni_qos_db_remove(
 #endif
 	} else {
 		NNI_ARG_UNUSED(pipe_id);
-		nni_id_remove((nni_id_map *) (db), packet_id);
+		nni_qos_inflight_remove((nni_qos_inflight *) (db), packet_id);
 	}
 }
 
@@ -139,7 +288,7 @@ nni_qos_db_remove_all_msg(bool is_sqlite, void *db, nni_idhash_cb cb)
 		nni_mqtt_qos_db_remove_all_msg((sqlite3 *) (db));
 #endif
 	} else if (db != NULL) {
-		nni_id_map_foreach((nni_id_map *) (db), cb);
+		nni_qos_inflight_foreach((nni_qos_inflight *) (db), cb);
 	}
 }
 
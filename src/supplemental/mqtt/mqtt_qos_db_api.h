@@ -13,16 +13,25 @@
 	nni_mqtt_qos_db_init((sqlite3 **) &(db), user_path, db_name, is_broker)
 #define nni_qos_db_fini_sqlite(db) nni_mqtt_qos_db_close((sqlite3 *) (db))
 
-#define nni_qos_db_init_id_hash(db)                              \
-	{                                                        \
-		db = nng_zalloc(sizeof(nni_id_map));             \
-		nni_id_map_init((nni_id_map *) db, 0, 0, false); \
-	}
-#define nni_qos_db_fini_id_hash(db)                                \
-	{                                                          \
-		nni_id_map_fini((nni_id_map *) (db));              \
-		nni_free((nni_id_map *) (db), sizeof(nni_id_map)); \
-	}
+// The in memory QoS db of a session.  Unacked messages are indexed by
+// packet id and also kept in the order they were last sent, so finding
+// the next one to retransmit does not probe the id space.
+typedef struct nni_qos_inflight nni_qos_inflight;
+
+extern int      nni_qos_inflight_alloc(nni_qos_inflight **);
+extern void     nni_qos_inflight_free(nni_qos_inflight *);
+extern int      nni_qos_inflight_set(nni_qos_inflight *, uint16_t, nni_msg *);
+extern nni_msg *nni_qos_inflight_get(nni_qos_inflight *, uint16_t);
+extern void     nni_qos_inflight_remove(nni_qos_inflight *, uint16_t);
+extern nni_msg *nni_qos_inflight_first(nni_qos_inflight *, uint16_t *);
+extern void     nni_qos_inflight_touch(nni_qos_inflight *, uint16_t);
+extern size_t   nni_qos_inflight_count(nni_qos_inflight *);
+extern void     nni_qos_inflight_foreach(nni_qos_inflight *, nni_idhash_cb);
+
+#define nni_qos_db_init_id_hash(db) \
+	nni_qos_inflight_alloc((nni_qos_inflight **) &(db))
+#define nni_qos_db_fini_id_hash(db) \
+	nni_qos_inflight_free((nni_qos_inflight *) (db))
 
 #define nni_qos_db_init_id_hash_with_opt(db, lo, hi, randomize)        \
 	{                                                              \
@@ -36,6 +45,8 @@ extern nng_msg *nni_qos_db_get(
     bool is_sqlite, void *db, uint32_t pipe_id, uint16_t packet_id);
 extern nng_msg *nni_qos_db_get_one(
     bool is_sqlite, void *db, uint32_t pipe_id, uint16_t *packet_id);
+extern void     nni_qos_db_touch(
+        bool is_sqlite, void *db, uint32_t pipe_id, uint16_t packet_id);
 extern void nni_qos_db_remove(
     bool is_sqlite, void *db, uint32_t pipe_id, uint16_t packet_id);
 extern void nni_qos_db_remove_oldest(bool is_sqlite, void *db, uint64_t limit);
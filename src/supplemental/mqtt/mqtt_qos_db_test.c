@@ -1,3 +1,5 @@
+#include <inttypes.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "mqtt_msg.h"
@@ -7,6 +9,10 @@
 #include "nng/supplemental/nanolib/cvector.h"
 
 #define test_db "test.db"
+#define bench_db "bench.db"
+
+#define BENCH_MSGS 100000
+#define BENCH_SESSIONS 10000
 
 void
 test_db_init(void)
@@ -417,6 +423,95 @@ test_remove_retain_msg(void)
 	nni_mqtt_qos_db_close(db);
 }
 
+static void
+bench_db_remove(void)
+{
+	remove(bench_db);
+	remove(bench_db "-wal");
+	remove(bench_db "-shm");
+}
+
+static nni_msg *
+bench_msg(int i)
+{
+	nni_msg *msg;
+	char     body[64];
+
+	snprintf(body, sizeof(body), "bench message payload %d", i);
+	nni_msg_alloc(&msg, 0);
+	nni_msg_header_append(msg, "uvwxyz", 6);
+	nni_msg_append(msg, body, strlen(body));
+	nni_msg_set_timestamp(msg, 1648004331);
+	return (msg);
+}
+
+// Stores one publish for every session while BENCH_MSGS other messages
+// are already in the table, which is what an offline fan-out looks like.
+void
+test_qos_db_set_bench(void)
+{
+	sqlite3 *db = NULL;
+	nni_msg *msg;
+	nni_time start;
+	nni_time took;
+	char     client_id[32];
+
+	bench_db_remove();
+	nni_mqtt_qos_db_init(&db, NULL, bench_db, true);
+	// measure the lookups, not the disk
+	sqlite3_exec(db, "PRAGMA synchronous=OFF", NULL, 0, 0);
+
+	for (int i = 0; i < BENCH_SESSIONS; i++) {
+		snprintf(client_id, sizeof(client_id), "bench-%d", i);
+		nni_mqtt_qos_db_set_pipe(db, i + 1, client_id);
+	}
+	start = nni_clock();
+	for (int i = 0; i < BENCH_MSGS; i++) {
+		msg = bench_msg(i);
+		nni_mqtt_qos_db_set(db, i % BENCH_SESSIONS + 1,
+		    i / BENCH_SESSIONS + 1, MQTT_DB_PACKED_MSG_QOS(msg, 1));
+		nni_msg_free(msg);
+	}
+	took = nni_clock() - start;
+	printf("qos db: stored %d messages in %" PRIu64 " ms\n", BENCH_MSGS,
+	    (uint64_t) took);
+
+	msg   = bench_msg(BENCH_MSGS);
+	start = nni_clock();
+	for (int i = 0; i < BENCH_SESSIONS; i++) {
+		nni_mqtt_qos_db_set(
+		    db, i + 1, 60000, MQTT_DB_PACKED_MSG_QOS(msg, 1));
+	}
+	took = nni_clock() - start;
+	printf("qos db: one message to %d sessions in %" PRIu64
+	       " ms (%.0f sets/s)\n",
+	    BENCH_SESSIONS, (uint64_t) took,
+	    took > 0 ? BENCH_SESSIONS * 1000.0 / took : 0.0);
+	nni_msg_free(msg);
+
+	// every session got the same stored copy
+	sqlite3_stmt *stmt;
+	sqlite3_prepare_v2(db,
+	    "SELECT COUNT(DISTINCT m_id) FROM t_main WHERE packet_id = 60000",
+	    -1, &stmt, 0);
+	NUTS_TRUE(sqlite3_step(stmt) == SQLITE_ROW);
+	NUTS_TRUE(sqlite3_column_int(stmt, 0) == 1);
+	sqlite3_finalize(stmt);
+
+	nni_msg *got = nni_mqtt_qos_db_get(db, BENCH_SESSIONS, 60000);
+	NUTS_TRUE(got != NULL);
+	got = MQTT_DB_GET_MSG_POINTER(got);
+	msg = bench_msg(BENCH_MSGS);
+	NUTS_TRUE(nni_msg_len(got) == nni_msg_len(msg));
+	NUTS_TRUE(memcmp(nni_msg_body(got), nni_msg_body(msg),
+	              nni_msg_len(msg)) == 0);
+	nni_msg_free(got);
+	nni_msg_free(msg);
+
+	nni_mqtt_qos_db_close(db);
+	bench_db_remove();
+}
+
 TEST_LIST = {
 	{ "db_init", test_db_init },
 	{ "db_pipe_set", test_pipe_set },
@@ -428,6 +523,7 @@ TEST_LIST = {
 	{ "db_remove", test_qos_db_remove },
 	{ "db_check_remove_msg", test_qos_db_check_remove_msg },
 	{ "db_pipe_remove", test_pipe_remove },
+	{ "db_set_bench", test_qos_db_set_bench },
 	{ "db_set_retain", test_set_retain_msg },
 	{ "db_get_retain", test_get_retain_msg },
 	{ "db_find_retain", test_find_retain_msg },
@@ -0,0 +1,195 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <string.h>
+
+#include "core/nng_impl.h"
+#include "mqtt_rxbuf.h"
+
+int
+nni_mqtt_frame_parse(
+    const uint8_t *buf, size_t len, size_t *hdrlen, uint32_t *remlen)
+{
+	uint32_t val  = 0;
+	uint32_t mult = 1;
+
+	// One type byte and at most four remaining length bytes.
+	for (size_t i = 1; i < 5; i++) {
+		if (i >= len) {
+			return (NNG_EAGAIN);
+		}
+		val += (uint32_t) (buf[i] & 0x7f) * mult;
+		if ((buf[i] & 0x80) == 0) {
+			// Reject non-minimal encodings, like the parser does.
+			if (i > 1 && buf[i] == 0) {
+				return (NNG_EPROTO);
+			}
+			*hdrlen = i + 1;
+			*remlen = val;
+			return (0);
+		}
+		mult *= 128;
+	}
+	return (NNG_EPROTO);
+}
+
+int
+nni_mqtt_rxbuf_init(nni_mqtt_rxbuf *rb, size_t cap)
+{
+	if (cap == 0) {
+		cap = NNI_MQTT_RXBUF_SIZE;
+	}
+	if ((rb->rb_buf = nni_alloc(cap)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	rb->rb_cap  = cap;
+	rb->rb_head = 0;
+	rb->rb_tail = 0;
+	return (0);
+}
+
+void
+nni_mqtt_rxbuf_fini(nni_mqtt_rxbuf *rb)
+{
+	if (rb->rb_buf != NULL) {
+		nni_free(rb->rb_buf, rb->rb_cap);
+		rb->rb_buf = NULL;
+	}
+	rb->rb_cap  = 0;
+	rb->rb_head = 0;
+	rb->rb_tail = 0;
+}
+
+void
+nni_mqtt_rxbuf_reset(nni_mqtt_rxbuf *rb)
+{
+	rb->rb_head = 0;
+	rb->rb_tail = 0;
+}
+
+size_t
+nni_mqtt_rxbuf_len(nni_mqtt_rxbuf *rb)
+{
+	return (rb->rb_tail - rb->rb_head);
+}
+
+bool
+nni_mqtt_rxbuf_ready(nni_mqtt_rxbuf *rb)
+{
+	size_t   hdrlen;
+	uint32_t remlen;
+
+	// A malformed header is also "ready", the error surfaces in get.
+	return (nni_mqtt_frame_parse(rb->rb_buf + rb->rb_head,
+	            rb->rb_tail - rb->rb_head, &hdrlen, &remlen) != NNG_EAGAIN);
+}
+
+static void
+mqtt_rxbuf_compact(nni_mqtt_rxbuf *rb)
+{
+	size_t len = rb->rb_tail - rb->rb_head;
+
+	if (rb->rb_head == 0) {
+		return;
+	}
+	if (len > 0) {
+		memmove(rb->rb_buf, rb->rb_buf + rb->rb_head, len);
+	}
+	rb->rb_head = 0;
+	rb->rb_tail = len;
+}
+
+void
+nni_mqtt_rxbuf_iov(nni_mqtt_rxbuf *rb, nni_iov *iov)
+{
+	// Only a partial fixed header can be left behind by get, so
+	// compacting here is cheap.
+	mqtt_rxbuf_compact(rb);
+	iov->iov_buf = rb->rb_buf + rb->rb_tail;
+	iov->iov_len = rb->rb_cap - rb->rb_tail;
+}
+
+void
+nni_mqtt_rxbuf_produce(nni_mqtt_rxbuf *rb, size_t n)
+{
+	NNI_ASSERT(rb->rb_tail + n <= rb->rb_cap);
+	rb->rb_tail += n;
+}
+
+int
+nni_mqtt_rxbuf_append(nni_mqtt_rxbuf *rb, const void *data, size_t len)
+{
+	if (rb->rb_tail + len > rb->rb_cap) {
+		mqtt_rxbuf_compact(rb);
+	}
+	if (rb->rb_tail + len > rb->rb_cap) {
+		uint8_t *nbuf;
+		size_t   ncap = rb->rb_cap * 2;
+		while (ncap < rb->rb_tail + len) {
+			ncap *= 2;
+		}
+		if ((nbuf = nni_alloc(ncap)) == NULL) {
+			return (NNG_ENOMEM);
+		}
+		if (rb->rb_tail > 0) {
+			memcpy(nbuf, rb->rb_buf, rb->rb_tail);
+		}
+		nni_free(rb->rb_buf, rb->rb_cap);
+		rb->rb_buf = nbuf;
+		rb->rb_cap = ncap;
+	}
+	memcpy(rb->rb_buf + rb->rb_tail, data, len);
+	rb->rb_tail += len;
+	return (0);
+}
+
+int
+nni_mqtt_rxbuf_get(
+    nni_mqtt_rxbuf *rb, size_t maxsz, nni_msg **msgp, size_t *remain)
+{
+	nni_msg *msg;
+	uint8_t *ptr = rb->rb_buf + rb->rb_head;
+	size_t   avail = rb->rb_tail - rb->rb_head;
+	size_t   hdrlen;
+	size_t   body;
+	uint32_t remlen;
+	int      rv;
+
+	if ((rv = nni_mqtt_frame_parse(ptr, avail, &hdrlen, &remlen)) != 0) {
+		return (rv);
+	}
+	if (maxsz != 0 && remlen > maxsz) {
+		return (NNG_EMSGSIZE);
+	}
+	if ((rv = nni_msg_alloc(&msg, (size_t) remlen)) != 0) {
+		return (rv);
+	}
+	if ((rv = nni_msg_header_append(msg, ptr, hdrlen)) != 0) {
+		nni_msg_free(msg);
+		return (rv);
+	}
+	nni_msg_set_cmd_type(msg, ptr[0] & 0xf0);
+
+	body = avail - hdrlen;
+	if (body > remlen) {
+		body = remlen;
+	}
+	if (body > 0) {
+		memcpy(nni_msg_body(msg), ptr + hdrlen, body);
+	}
+	rb->rb_head += hdrlen + body;
+	if (rb->rb_head == rb->rb_tail) {
+		rb->rb_head = 0;
+		rb->rb_tail = 0;
+	}
+
+	*remain = remlen - body;
+	*msgp   = msg;
+	return (0);
+}
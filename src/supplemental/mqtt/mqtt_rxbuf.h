@@ -0,0 +1,77 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#ifndef NNG_SUPPLEMENTAL_MQTT_MQTT_RXBUF_H
+#define NNG_SUPPLEMENTAL_MQTT_MQTT_RXBUF_H
+
+#include "core/nng_impl.h"
+
+// Per pipe receive buffer shared by the broker side stream transports
+// (TCP, TLS and WebSocket).  Bytes are read opportunistically into the
+// buffer, and as many complete MQTT packets as are already buffered are
+// carved out of it, so that small packets do not cost one recv per
+// remaining length byte.  Packets larger than what is buffered are handed
+// back partially filled, and the transport reads the rest of the body
+// directly into the message.
+
+#ifndef NNI_MQTT_RXBUF_SIZE
+#define NNI_MQTT_RXBUF_SIZE 4096
+#endif
+
+typedef struct nni_mqtt_rxbuf {
+	uint8_t *rb_buf;
+	size_t   rb_cap;
+	size_t   rb_head; // first unconsumed byte
+	size_t   rb_tail; // end of valid data
+} nni_mqtt_rxbuf;
+
+// nni_mqtt_frame_parse inspects the fixed header at the start of buf.
+// On success the size of the fixed header (type byte plus remaining length)
+// and the remaining length are returned.  NNG_EAGAIN means that more bytes
+// are needed to decode the fixed header, NNG_EPROTO means that the remaining
+// length is malformed.
+extern int nni_mqtt_frame_parse(
+    const uint8_t *buf, size_t len, size_t *hdrlen, uint32_t *remlen);
+
+extern int  nni_mqtt_rxbuf_init(nni_mqtt_rxbuf *, size_t);
+extern void nni_mqtt_rxbuf_fini(nni_mqtt_rxbuf *);
+extern void nni_mqtt_rxbuf_reset(nni_mqtt_rxbuf *);
+
+// nni_mqtt_rxbuf_len returns the number of buffered, unconsumed bytes.
+extern size_t nni_mqtt_rxbuf_len(nni_mqtt_rxbuf *);
+
+// nni_mqtt_rxbuf_ready returns true if a complete packet, or at least a
+// complete fixed header, is buffered; i.e. nni_mqtt_rxbuf_get would make
+// progress without further reads.
+extern bool nni_mqtt_rxbuf_ready(nni_mqtt_rxbuf *);
+
+// nni_mqtt_rxbuf_iov compacts the buffer if needed and fills in an iov
+// covering the free space at the end of it, to be used for the next read.
+extern void nni_mqtt_rxbuf_iov(nni_mqtt_rxbuf *, nni_iov *);
+
+// nni_mqtt_rxbuf_produce accounts for n bytes read into the iov.
+extern void nni_mqtt_rxbuf_produce(nni_mqtt_rxbuf *, size_t);
+
+// nni_mqtt_rxbuf_append copies data into the buffer, growing it if needed.
+// This is for transports like WebSocket that are handed messages rather
+// than reading into our buffer.
+extern int nni_mqtt_rxbuf_append(nni_mqtt_rxbuf *, const void *, size_t);
+
+// nni_mqtt_rxbuf_get carves the next packet out of the buffer.  The
+// message is allocated with room for the whole body, the fixed header is
+// placed in the message header, and as much of the body as is buffered is
+// copied in.  *remain is set to the number of body bytes still missing,
+// which the caller must read into the tail of the message body.  Returns
+// NNG_EAGAIN if a fixed header is not yet buffered, NNG_EPROTO for a
+// malformed remaining length, NNG_EMSGSIZE if the packet exceeds maxsz
+// (0 for no limit), or NNG_ENOMEM.
+extern int nni_mqtt_rxbuf_get(
+    nni_mqtt_rxbuf *, size_t maxsz, nni_msg **msgp, size_t *remain);
+
+#endif // NNG_SUPPLEMENTAL_MQTT_MQTT_RXBUF_H
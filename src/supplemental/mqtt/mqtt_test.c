@@ -5,6 +5,9 @@
 #include "nng/protocol/mqtt/mqtt_parser.h"
 
 #include "mqtt_msg.h"
+#include "mqtt_pubenc.h"
+#include "mqtt_qos_db_api.h"
+#include "mqtt_rxbuf.h"
 #include "nuts.h"
 
 #define MQTT_MSG_DUMP 0
@@ -1582,6 +1585,244 @@ test_property_api(void)
 	NUTS_PASS(mqtt_property_free(plist));
 }
 
+void
+test_rxbuf(void)
+{
+	nni_mqtt_rxbuf rb;
+	nni_iov        iov;
+	nni_msg       *msg;
+	size_t         remain;
+	// PINGREQ, PUBLISH qos0 "a/b" "hi", then the start of a PUBACK
+	uint8_t packets[] = { 0xC0, 0x00, 0x30, 0x07, 0x00, 0x03, 'a', '/',
+		'b', 'h', 'i', 0x40 };
+	// PUBLISH with a 200 byte remaining length, two length bytes
+	uint8_t big[] = { 0x30, 0xC8, 0x01, 0x00, 0x01, 'x' };
+	uint8_t bad[] = { 0x30, 0xFF, 0xFF, 0xFF, 0xFF, 0x01 };
+
+	NUTS_PASS(nni_mqtt_rxbuf_init(&rb, 16));
+	NUTS_TRUE(!nni_mqtt_rxbuf_ready(&rb));
+	NUTS_FAIL(nni_mqtt_rxbuf_get(&rb, 0, &msg, &remain), NNG_EAGAIN);
+
+	nni_mqtt_rxbuf_iov(&rb, &iov);
+	NUTS_TRUE(iov.iov_len == 16);
+	memcpy(iov.iov_buf, packets, sizeof(packets));
+	nni_mqtt_rxbuf_produce(&rb, sizeof(packets));
+
+	NUTS_TRUE(nni_mqtt_rxbuf_ready(&rb));
+	NUTS_PASS(nni_mqtt_rxbuf_get(&rb, 0, &msg, &remain));
+	NUTS_TRUE(remain == 0);
+	NUTS_TRUE(nni_msg_cmd_type(msg) == CMD_PINGREQ);
+	NUTS_TRUE(nni_msg_header_len(msg) == 2);
+	NUTS_TRUE(nni_msg_len(msg) == 0);
+	nni_msg_free(msg);
+
+	NUTS_PASS(nni_mqtt_rxbuf_get(&rb, 0, &msg, &remain));
+	NUTS_TRUE(remain == 0);
+	NUTS_TRUE(nni_msg_cmd_type(msg) == CMD_PUBLISH);
+	NUTS_TRUE(nni_msg_len(msg) == 7);
+	NUTS_TRUE(memcmp(nni_msg_body(msg), packets + 4, 7) == 0);
+	nni_msg_free(msg);
+
+	// Only the type byte of the PUBACK is here.
+	NUTS_TRUE(nni_mqtt_rxbuf_len(&rb) == 1);
+	NUTS_TRUE(!nni_mqtt_rxbuf_ready(&rb));
+	NUTS_FAIL(nni_mqtt_rxbuf_get(&rb, 0, &msg, &remain), NNG_EAGAIN);
+	nni_mqtt_rxbuf_iov(&rb, &iov);
+	NUTS_TRUE(iov.iov_len == 15);
+	nni_mqtt_rxbuf_reset(&rb);
+
+	// Packet larger than the buffer is returned partially filled.
+	NUTS_PASS(nni_mqtt_rxbuf_append(&rb, big, sizeof(big)));
+	NUTS_FAIL(nni_mqtt_rxbuf_get(&rb, 100, &msg, &remain), NNG_EMSGSIZE);
+	NUTS_PASS(nni_mqtt_rxbuf_get(&rb, 0, &msg, &remain));
+	NUTS_TRUE(nni_msg_header_len(msg) == 3);
+	NUTS_TRUE(nni_msg_len(msg) == 200);
+	NUTS_TRUE(remain == 197);
+	NUTS_TRUE(nni_mqtt_rxbuf_len(&rb) == 0);
+	nni_msg_free(msg);
+
+	// Appending grows the buffer.
+	for (int i = 0; i < 10; i++) {
+		NUTS_PASS(nni_mqtt_rxbuf_append(&rb, packets, 11));
+	}
+	for (int i = 0; i < 20; i++) {
+		NUTS_PASS(nni_mqtt_rxbuf_get(&rb, 0, &msg, &remain));
+		NUTS_TRUE(remain == 0);
+		nni_msg_free(msg);
+	}
+	NUTS_TRUE(nni_mqtt_rxbuf_len(&rb) == 0);
+
+	NUTS_PASS(nni_mqtt_rxbuf_append(&rb, bad, sizeof(bad)));
+	NUTS_FAIL(nni_mqtt_rxbuf_get(&rb, 0, &msg, &remain), NNG_EPROTO);
+	nni_mqtt_rxbuf_fini(&rb);
+}
+
+
+static size_t
+pubenc_flatten(
+    nni_msg *msg, const nni_mqtt_pubenc *enc, uint16_t pid, uint8_t *out)
+{
+	uint8_t *body = nni_msg_body(msg);
+	size_t   tlen, len = 0;
+
+	NNI_GET16(body, tlen);
+	memcpy(out, enc->hdr, enc->hdrlen);
+	len += enc->hdrlen;
+	memcpy(out + len, body, 2 + tlen);
+	len += 2 + tlen;
+	memcpy(out + len, enc->var, enc->varlen);
+	if (enc->pidlen > 0) {
+		NNI_PUT16(out + len, pid);
+	}
+	len += enc->varlen;
+	memcpy(out + len, body + enc->skip, enc->tail);
+	len += enc->tail;
+	return (len);
+}
+
+void
+test_pubenc(void)
+{
+	nni_msg               *msg;
+	nni_mqtt_pubenc        scratch;
+	const nni_mqtt_pubenc *enc, *enc2;
+	uint8_t                out[64];
+	size_t                 len;
+	// V5 PUBLISH, qos 1, retain, topic "a/b", pid 0x0102,
+	// payload format indicator property, payload "hi"
+	uint8_t header[] = { 0x33, 0x0C };
+	uint8_t body[]   = { 0x00, 0x03, 'a', '/', 'b', 0x01, 0x02, 0x02, 0x01,
+		0x01, 'h', 'i' };
+	// to a V5 peer with subid 5, keeping retain
+	uint8_t v5_subid[] = { 0x33, 0x0E, 0x00, 0x03, 'a', '/', 'b', 0x12,
+		0x34, 0x04, 0x0B, 0x05, 0x01, 0x01, 'h', 'i' };
+	// to a V5 peer without subid, dropping retain
+	uint8_t v5_plain[] = { 0x32, 0x0C, 0x00, 0x03, 'a', '/', 'b', 0x12,
+		0x34, 0x02, 0x01, 0x01, 'h', 'i' };
+	// to a V4 peer at qos 0: no pid, no properties
+	uint8_t v4_qos0[] = { 0x31, 0x07, 0x00, 0x03, 'a', '/', 'b', 'h', 'i' };
+
+	NUTS_PASS(nni_msg_alloc(&msg, 0));
+	NUTS_PASS(nni_msg_header_append(msg, header, sizeof(header)));
+	NUTS_PASS(nni_msg_append(msg, body, sizeof(body)));
+	nni_msg_set_cmd_type(msg, CMD_PUBLISH_V5);
+
+	enc = nni_mqtt_pubenc_get(
+	    msg, MQTT_PROTOCOL_VERSION_v5, 2, true, 5, &scratch);
+	NUTS_TRUE(enc != &scratch);
+	NUTS_TRUE(enc->qos == 1);
+	len = pubenc_flatten(msg, enc, 0x1234, out);
+	NUTS_TRUE(len == sizeof(v5_subid));
+	NUTS_TRUE(memcmp(out, v5_subid, len) == 0);
+
+	// the second subscriber with the same options reuses it
+	enc2 = nni_mqtt_pubenc_get(
+	    msg, MQTT_PROTOCOL_VERSION_v5, 2, true, 5, &scratch);
+	NUTS_TRUE(enc2 == enc);
+
+	enc = nni_mqtt_pubenc_get(
+	    msg, MQTT_PROTOCOL_VERSION_v5, 1, false, 0, &scratch);
+	NUTS_TRUE(enc != enc2);
+	len = pubenc_flatten(msg, enc, 0x1234, out);
+	NUTS_TRUE(len == sizeof(v5_plain));
+	NUTS_TRUE(memcmp(out, v5_plain, len) == 0);
+
+	// retain and subid are ignored for V4 peers
+	enc = nni_mqtt_pubenc_get(
+	    msg, MQTT_PROTOCOL_VERSION_v311, 0, false, 7, &scratch);
+	NUTS_TRUE(enc->qos == 0);
+	NUTS_TRUE(enc->pidlen == 0);
+	len = pubenc_flatten(msg, enc, 0, out);
+	NUTS_TRUE(len == sizeof(v4_qos0));
+	NUTS_TRUE(memcmp(out, v4_qos0, len) == 0);
+	enc2 = nni_mqtt_pubenc_get(
+	    msg, MQTT_PROTOCOL_VERSION_v311, 0, true, 0, &scratch);
+	NUTS_TRUE(enc2 == enc);
+
+	// distinct subids stop being cached once the message has a few,
+	// but are still encoded correctly
+	for (uint32_t subid = 100; subid < 120; subid++) {
+		enc = nni_mqtt_pubenc_get(
+		    msg, MQTT_PROTOCOL_VERSION_v5, 2, true, subid, &scratch);
+		len = pubenc_flatten(msg, enc, 0x1234, out);
+		NUTS_TRUE(len == sizeof(v5_subid));
+		NUTS_TRUE(out[10] == 0x0B && out[11] == subid);
+	}
+	NUTS_TRUE(enc == &scratch);
+	enc = nni_mqtt_pubenc_get(
+	    msg, MQTT_PROTOCOL_VERSION_v5, 2, true, 5, &scratch);
+	NUTS_TRUE(enc != &scratch);
+	len = pubenc_flatten(msg, enc, 0x1234, out);
+	NUTS_TRUE(memcmp(out, v5_subid, len) == 0);
+
+	// the original message is left alone
+	NUTS_TRUE(memcmp(nni_msg_header(msg), header, sizeof(header)) == 0);
+	NUTS_TRUE(memcmp(nni_msg_body(msg), body, sizeof(body)) == 0);
+	nni_msg_free(msg);
+}
+
+static void
+inflight_free_cb(void *key, void *val)
+{
+	NNI_ARG_UNUSED(key);
+	nni_msg_free(val);
+}
+
+void
+test_qos_inflight(void)
+{
+	void    *db = NULL;
+	nni_msg *msg[4];
+	nni_msg *m;
+	uint16_t pid;
+
+	NUTS_PASS(nni_qos_db_init_id_hash(db));
+	NUTS_TRUE(db != NULL);
+	pid = 1;
+	NUTS_NULL(nni_qos_db_get_one(false, db, 0, &pid));
+
+	// stored in send order, whatever the packet ids
+	uint16_t ids[] = { 65535, 3, 40000, 7 };
+	for (int i = 0; i < 4; i++) {
+		NUTS_PASS(nni_msg_alloc(&msg[i], 0));
+		nni_qos_db_set(false, db, 0, ids[i], msg[i]);
+	}
+	NUTS_TRUE(nni_qos_inflight_count(db) == 4);
+	NUTS_TRUE(nni_qos_db_get(false, db, 0, 40000) == msg[2]);
+	NUTS_NULL(nni_qos_db_get(false, db, 0, 4));
+
+	pid = 1;
+	NUTS_TRUE(nni_qos_db_get_one(false, db, 0, &pid) == msg[0]);
+	NUTS_TRUE(pid == 65535);
+
+	// a retransmitted message goes behind the others
+	nni_qos_db_touch(false, db, 0, 65535);
+	NUTS_TRUE(nni_qos_db_get_one(false, db, 0, &pid) == msg[1]);
+	NUTS_TRUE(pid == 3);
+
+	// acking the oldest one exposes the next
+	nni_qos_db_remove(false, db, 0, 3);
+	nni_msg_free(msg[1]);
+	NUTS_TRUE(nni_qos_db_get_one(false, db, 0, &pid) == msg[2]);
+	NUTS_TRUE(pid == 40000);
+	nni_qos_db_remove(false, db, 0, 40000);
+	nni_msg_free(msg[2]);
+	NUTS_TRUE(nni_qos_db_get_one(false, db, 0, &pid) == msg[3]);
+	NUTS_TRUE(pid == 7);
+
+	// storing a packet id again replaces it and counts as a send
+	NUTS_PASS(nni_msg_alloc(&m, 0));
+	nni_qos_db_set(false, db, 0, 7, m);
+	nni_msg_free(msg[3]);
+	NUTS_TRUE(nni_qos_inflight_count(db) == 2);
+	NUTS_TRUE(nni_qos_db_get_one(false, db, 0, &pid) == msg[0]);
+	NUTS_TRUE(pid == 65535);
+	NUTS_TRUE(nni_qos_db_get(false, db, 0, 7) == m);
+
+	nni_qos_db_remove_all_msg(false, db, inflight_free_cb);
+	nni_qos_db_fini_id_hash(db);
+}
+
 TEST_LIST = {
 	// TODO: there is still some encode & decode functions should be
 	// tested.
@@ -1634,5 +1875,8 @@ TEST_LIST = {
 	{ "test topic_qos create & free", test_topic_qos_array_create_free },
 	{ "test topic create & free", test_topic_array_create_free },
 	{ "test property api", test_property_api },
+	{ "test rx buffer framing", test_rxbuf },
+	{ "test publish encoding cache", test_pubenc },
+	{ "test in memory qos db order", test_qos_inflight },
 	{ NULL, NULL },
 };
@@ -1,4 +1,5 @@
 #include "nng/supplemental/nanolib/blf.h"
+#include "nng/supplemental/nanolib/file_index.h"
 #include "nng/supplemental/nanolib/log.h"
 #include "nng/supplemental/nanolib/queue.h"
 #include <Vector/BLF.h>
@@ -8,6 +9,7 @@
 #include <codecvt>
 #include <cstring>
 #include <ctime>
+#include <deque>
 #include <dirent.h>
 #include <fstream>
 #include <inttypes.h>
@@ -16,12 +18,13 @@
 #include <locale>
 #include <sstream>
 #include <string>
+#include <stdarg.h>
 #include <sys/stat.h>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
-#define UINT64_MAX_DIGITS 20
 #define _Atomic(X) std::atomic<X>
 static atomic_bool is_available = { false };
 #define WAIT_FOR_AVAILABLE    \
@@ -49,11 +52,26 @@ static conf_blf *g_conf = NULL;
 		}                                                             \
 	} while (0);
 
-CircularQueue   blf_queue;
 CircularQueue   blf_file_queue;
 pthread_mutex_t blf_queue_mutex     = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t  blf_queue_not_empty = PTHREAD_COND_INITIALIZER;
 
+// Objects of one topic waiting to be written.  A topic is handed to one
+// writer thread at a time so its files are written in order, while
+// different topics are written in parallel.  Guarded by blf_queue_mutex.
+struct blf_topic_queue {
+	deque<blf_object *> objs;
+	bool                busy = false; // on blf_ready or taken
+};
+
+// Objects a thread writes for a topic before letting the next topic in.
+#define BLF_TOPIC_BATCH 8
+
+static unordered_map<string, blf_topic_queue *> blf_topics;
+static deque<blf_topic_queue *>                 blf_ready;
+// Key ranges of the files in blf_file_queue, for lookups
+static file_index *blf_file_index = NULL;
+
 static bool
 directory_exists(const std::string &directory_path)
 {
@@ -104,11 +122,14 @@ blf_object_alloc(uint64_t *keys, uint8_t **darray, uint32_t *dsize,
 	elem->ranges->range = NULL;
 	elem->ranges->start = 0;
 	elem->ranges->size  = 0;
+	elem->topic         = NULL;
 	return elem;
 }
 
-void
-blf_object_free(blf_object *elem)
+// Hand the ranges written so far back through the aio, finished with rv,
+// and free elem.
+static void
+blf_object_finish(blf_object *elem, int rv)
 {
 	if (elem) {
 		FREE_IF_NOT_NULL(elem->keys, elem->size);
@@ -118,34 +139,61 @@ blf_object_free(blf_object *elem)
 		uint32_t *szp = (uint32_t *) malloc(sizeof(uint32_t));
 		*szp          = elem->size;
 		nng_aio_set_msg(elem->aio, (nng_msg *) szp);
-		DO_IT_IF_NOT_NULL(nng_aio_finish_sync, elem->aio, 0);
+		DO_IT_IF_NOT_NULL(nng_aio_finish_sync, elem->aio, rv);
 		FREE_IF_NOT_NULL(elem->darray, elem->size);
 		for (int i = 0; i < elem->ranges->size; i++) {
 			blf_file_range_free(elem->ranges->range[i]);
 		}
 		free(elem->ranges->range);
 		delete elem->ranges;
+		nng_strfree(elem->topic);
 		delete elem;
 	}
 }
 
-static char *
-get_file_name(conf_blf *conf, uint64_t key_start, uint64_t key_end)
+void
+blf_object_free(blf_object *elem)
 {
-	char *file_name = NULL;
-	char *dir       = conf->dir;
-	char *prefix    = conf->file_name_prefix;
+	blf_object_finish(elem, 0);
+}
 
-	file_name = (char *) malloc(strlen(prefix) + strlen(dir) +
-	    UINT64_MAX_DIGITS + UINT64_MAX_DIGITS + 16);
-	if (file_name == NULL) {
+// Format a file name into a buffer of the size it needs, freed with free().
+static char *
+file_name_printf(const char *fmt, ...)
+{
+	va_list ap;
+	char   *file_name;
+	int     len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if (len < 0 || (file_name = (char *) malloc(len + 1)) == NULL) {
 		log_error("Failed to allocate memory for file name.");
 		return NULL;
 	}
+	va_start(ap, fmt);
+	vsnprintf(file_name, len + 1, fmt, ap);
+	va_end(ap);
+	return file_name;
+}
 
-	sprintf(file_name, "%s/%s-%" PRIu64 "~%" PRIu64 ".blf", dir, prefix,
-	    key_start, key_end);
+// {dir}/{prefix}[_{topic}]-{start_key}~{end_key}.blf
+static char *
+get_file_name(
+    conf_blf *conf, const char *topic, uint64_t key_start, uint64_t key_end)
+{
+	char *file_name;
+
+	// Topics written in parallel may cover the same keys
+	file_name = file_name_printf("%s/%s%s%s-%" PRIu64 "~%" PRIu64 ".blf",
+	    conf->dir, conf->file_name_prefix, topic[0] != '\0' ? "_" : "",
+	    topic, key_start, key_end);
+	if (file_name == NULL) {
+		return NULL;
+	}
 	ENQUEUE(blf_file_queue, file_name);
+	file_index_add(blf_file_index, file_name);
 	return file_name;
 }
 
@@ -165,6 +213,7 @@ static int
 remove_old_file(void)
 {
 	char *filename = (char *) DEQUEUE(blf_file_queue);
+	file_index_remove(blf_file_index, filename);
 	if (remove(filename) == 0) {
 		log_debug("File '%s' removed successfully.\n", filename);
 	} else {
@@ -268,7 +317,8 @@ again:
 	uint64_t key_start = elem->keys[old_index];
 	uint64_t key_end   = elem->keys[new_index];
 	pthread_mutex_lock(&blf_queue_mutex);
-	char *filename = get_file_name(conf, key_start, key_end);
+	char *filename = get_file_name(conf,
+	    elem->topic != NULL ? elem->topic : "", key_start, key_end);
 	if (filename == NULL) {
 		pthread_mutex_unlock(&blf_queue_mutex);
 		log_error("Failed to get file name");
@@ -296,52 +346,91 @@ again:
 	return 0;
 }
 
+static void
+blf_topic_schedule(blf_topic_queue *q)
+{
+	q->busy = true;
+	blf_ready.push_back(q);
+	pthread_cond_signal(&blf_queue_not_empty);
+}
+
 void
 blf_write_loop(void *config)
 {
 	if (config == NULL) {
 		log_error("blf conf is NULL");
+		return;
 	}
 
 	conf_blf *conf = (conf_blf *) config;
-	if (!directory_exists(conf->dir)) {
-		if (!create_directory(conf->dir)) {
-			log_error("Failed to create directory %s", conf->dir);
-			return;
-		}
-	}
 
 	while (true) {
-		// wait for mqtt messages to send method request
+		// wait for a topic with something to write
 		pthread_mutex_lock(&blf_queue_mutex);
-
-		while (IS_EMPTY(blf_queue)) {
+		while (blf_ready.empty()) {
 			pthread_cond_wait(
 			    &blf_queue_not_empty, &blf_queue_mutex);
 		}
+		blf_topic_queue *q = blf_ready.front();
+		blf_ready.pop_front();
 
-		log_debug("fetch element from blf queue");
-		blf_object *ele = (blf_object *) DEQUEUE(blf_queue);
+		for (int n = 0; n < BLF_TOPIC_BATCH && !q->objs.empty(); n++) {
+			log_debug("fetch element from blf queue");
+			blf_object *ele = q->objs.front();
+			q->objs.pop_front();
+			pthread_mutex_unlock(&blf_queue_mutex);
 
-		pthread_mutex_unlock(&blf_queue_mutex);
+			blf_write(conf, ele);
 
-		blf_write(conf, ele);
+			pthread_mutex_lock(&blf_queue_mutex);
+		}
+
+		if (q->objs.empty()) {
+			q->busy = false;
+		} else {
+			// give other topics a turn
+			blf_topic_schedule(q);
+		}
+		pthread_mutex_unlock(&blf_queue_mutex);
 	}
 }
 
+// Queue elem behind the other objects of its topic.  If the topic already
+// has queue_limit objects waiting, elem is finished right away with
+// NNG_EAGAIN instead, so that a slow disk pushes back on the producer.
 int
 blf_write_batch_async(blf_object *elem)
 {
-    if (g_conf == NULL || g_conf->enable == false) {
-        log_error("BLF is not ready or not launch!");
-        return -1;
-    }
+	if (g_conf == NULL || g_conf->enable == false) {
+		log_error("BLF is not ready or not launch!");
+		return -1;
+	}
+	const char *topic = elem->topic != NULL ? elem->topic : "";
+
 	WAIT_FOR_AVAILABLE
 	pthread_mutex_lock(&blf_queue_mutex);
-	if (IS_EMPTY(blf_queue)) {
-		pthread_cond_broadcast(&blf_queue_not_empty);
+	blf_topic_queue *q  = NULL;
+	auto             it = blf_topics.find(topic);
+	if (it != blf_topics.end()) {
+		q = it->second;
+	} else if ((q = new (std::nothrow) blf_topic_queue) != NULL) {
+		blf_topics.emplace(topic, q);
+	} else {
+		pthread_mutex_unlock(&blf_queue_mutex);
+		log_error("Failed to allocate queue of topic %s", topic);
+		blf_object_finish(elem, NNG_ENOMEM);
+		return -1;
+	}
+	if (g_conf->queue_limit != 0 && q->objs.size() >= g_conf->queue_limit) {
+		pthread_mutex_unlock(&blf_queue_mutex);
+		log_warn("blf queue of topic '%s' is full", topic);
+		blf_object_finish(elem, NNG_EAGAIN);
+		return -1;
+	}
+	q->objs.push_back(elem);
+	if (!q->busy) {
+		blf_topic_schedule(q);
 	}
-	ENQUEUE(blf_queue, elem);
 	log_debug("enqueue element.");
 
 	pthread_mutex_unlock(&blf_queue_mutex);
@@ -352,36 +441,24 @@ int
 blf_write_launcher(conf_blf *conf)
 {
 	g_conf = conf;
-	INIT_QUEUE(blf_queue);
+	if (!directory_exists(conf->dir) && !create_directory(conf->dir)) {
+		log_error("Failed to create directory %s", conf->dir);
+		return -1;
+	}
+	if (file_index_alloc(&blf_file_index) != 0) {
+		log_error("Failed to allocate blf file index.");
+		return -1;
+	}
 	INIT_QUEUE(blf_file_queue);
 	is_available = true;
-	thread write_loop(blf_write_loop, conf);
-	write_loop.detach();
-	return 0;
-}
-
-static void
-get_range(const char *name, uint64_t range[2])
-{
-	const char *start = strrchr(name, '-');
-	sscanf(start, "-%ld~%ld.parquet", &range[0], &range[1]);
-	return;
-}
 
-static bool
-compare_callback(void *name, uint64_t key)
-{
-	uint64_t range[2] = { 0 };
-	get_range((const char *) name, range);
-	return (key >= range[0] && key <= range[1]);
-}
-
-static bool
-compare_callback_span(void *name, uint64_t low, uint64_t high)
-{
-	uint64_t range[2] = { 0 };
-	get_range((const char *) name, range);
-	return !(low > range[1] || high < range[0]);
+	int threads = conf->write_threads > 0 ? conf->write_threads : 1;
+	for (int i = 0; i < threads; i++) {
+		thread write_loop(blf_write_loop, conf);
+		write_loop.detach();
+	}
+	log_info("started %d blf write threads", threads);
+	return 0;
 }
 
 const char *
@@ -392,18 +469,7 @@ blf_find(uint64_t key)
         return NULL;
     }
 	WAIT_FOR_AVAILABLE
-	const char *value = NULL;
-	void       *elem  = NULL;
-	pthread_mutex_lock(&blf_queue_mutex);
-	FOREACH_QUEUE(blf_file_queue, elem)
-	{
-		if (elem && compare_callback(elem, key)) {
-			value = nng_strdup((char *) elem);
-			break;
-		}
-	}
-	pthread_mutex_unlock(&blf_queue_mutex);
-	return value;
+	return file_index_find(blf_file_index, key);
 }
 
 const char **
@@ -420,34 +486,6 @@ blf_find_span(uint64_t start_key, uint64_t end_key, uint32_t *size)
 	}
 
 	WAIT_FOR_AVAILABLE
-
-	uint64_t     low        = start_key;
-	uint64_t     high       = end_key;
-	uint32_t     local_size = 0;
-	const char  *value      = NULL;
-	const char **array      = NULL;
-	const char **ret        = NULL;
-	void        *elem       = NULL;
-
-	pthread_mutex_lock(&blf_queue_mutex);
-	if (blf_file_queue.size != 0) {
-		array = (const char **) nng_alloc(
-		    sizeof(char *) * blf_file_queue.size);
-
-		ret = array;
-		FOREACH_QUEUE(blf_file_queue, elem)
-		{
-			if (elem) {
-				if (compare_callback_span(elem, low, high)) {
-					++local_size;
-					value    = nng_strdup((char *) elem);
-					*array++ = value;
-				}
-			}
-		}
-	}
-
-	pthread_mutex_unlock(&blf_queue_mutex);
-	(*size) = local_size;
-	return ret;
+	return (const char **) file_index_find_span(
+	    blf_file_index, start_key, end_key, size);
 }
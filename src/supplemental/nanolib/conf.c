@@ -371,6 +371,10 @@ conf_tls_parse(
 		                "tls.fail_if_no_peer_cert")) != NULL) {
 			tls->set_fail = nni_strcasecmp(value, "true") == 0;
 			nng_strfree(value);
+		} else if ((value = get_conf_value_with_prefix2(line, sz,
+		                prefix1, prefix2, "tls.ktls")) != NULL) {
+			tls->ktls = nni_strcasecmp(value, "true") == 0;
+			nng_strfree(value);
 		}
 		free(line);
 		line = NULL;
@@ -791,6 +795,7 @@ conf_tls_init(conf_tls *tls)
 	tls->key_password = NULL;
 	tls->set_fail     = false;
 	tls->verify_peer  = false;
+	tls->ktls         = false;
 }
 
 void
@@ -975,6 +980,9 @@ conf_init(conf *nanomq_conf)
 	nanomq_conf->parquet.limit_frequency  = 5;
 	nanomq_conf->parquet.file_count       = 5;
 	nanomq_conf->parquet.file_size        = (10240 * 1024);
+	nanomq_conf->parquet.row_group_size   = 0;
+	nanomq_conf->parquet.write_threads    = 1;
+	nanomq_conf->parquet.queue_limit      = 0;
 	nanomq_conf->parquet.comp_type        = UNCOMPRESSED;
 	nanomq_conf->parquet.file_name_prefix = NULL;
 	nanomq_conf->parquet.dir              = NULL;
@@ -982,6 +990,8 @@ conf_init(conf *nanomq_conf)
 	nanomq_conf->blf.enable           = false;
 	nanomq_conf->blf.file_count       = 5;
 	nanomq_conf->blf.file_size        = (10240 * 1024);
+	nanomq_conf->blf.write_threads    = 1;
+	nanomq_conf->blf.queue_limit      = 0;
 	nanomq_conf->blf.comp_type        = UNCOMPRESSED;
 	nanomq_conf->blf.file_name_prefix = NULL;
 	nanomq_conf->blf.dir              = NULL;
@@ -994,6 +1004,9 @@ conf_init(conf *nanomq_conf)
 	nanomq_conf->auth_http.timeout         = 5;
 	nanomq_conf->auth_http.connect_timeout = 5;
 	nanomq_conf->auth_http.pool_size       = 32;
+	nanomq_conf->auth_http.cache_ttl       = 60;
+	nanomq_conf->auth_http.cache_size      = 1024;
+	nanomq_conf->auth_http.state           = NULL;
 	nanomq_conf->ext_qos_db                = NULL;
 }
 
@@ -1237,6 +1250,9 @@ print_parquet_conf(conf_parquet *parquet)
 	log_info("parquet file_name_prefix: %s", parquet->file_name_prefix);
 	log_info("parquet file_count:       %d", parquet->file_count);
 	log_info("parquet file_size:        %d", parquet->file_size);
+	log_info("parquet row_group_size:   %u", parquet->row_group_size);
+	log_info("parquet write_threads:    %u", parquet->write_threads);
+	log_info("parquet queue_limit:      %u", parquet->queue_limit);
 	log_info("parquet limit_frequency:  %d", parquet->limit_frequency);
 }
 
@@ -1251,6 +1267,8 @@ print_blf_conf(conf_blf *blf)
 	log_info("blf file_name_prefix: %s", blf->file_name_prefix);
 	log_info("blf file_count:       %d", blf->file_count);
 	log_info("blf file_size:        %d", blf->file_size);
+	log_info("blf write_threads:    %u", blf->write_threads);
+	log_info("blf queue_limit:      %u", blf->queue_limit);
 }
 
 #if defined(SUPP_RULE_ENGINE)
@@ -1368,6 +1386,8 @@ print_conf(conf *nanomq_conf)
 		    nanomq_conf->tls.verify_peer ? "true" : "false");
 		log_info("tls fail_if_no_peer_cert: %s",
 		    nanomq_conf->tls.set_fail ? "true" : "false");
+		log_info("tls ktls:                 %s",
+		    nanomq_conf->tls.ktls ? "true" : "false");
 	}
 	log_info("daemon:                   %s",
 	    nanomq_conf->daemon ? "true" : "false");
@@ -4245,6 +4265,14 @@ conf_auth_http_parse(conf_auth_http *auth_http, const char *path)
 		                line, sz, "auth.http.pool_size")) != NULL) {
 			auth_http->pool_size = (size_t) atol(value);
 			free(value);
+		} else if ((value = get_conf_value(
+		                line, sz, "auth.http.cache_ttl")) != NULL) {
+			get_time(value, &auth_http->cache_ttl);
+			free(value);
+		} else if ((value = get_conf_value(
+		                line, sz, "auth.http.cache_size")) != NULL) {
+			auth_http->cache_size = (size_t) atol(value);
+			free(value);
 		}
 
 		free(line);
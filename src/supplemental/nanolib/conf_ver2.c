@@ -482,6 +482,7 @@ conf_tls_parse_ver2(conf *config, cJSON *jso)
 			hocon_read_bool(tls, verify_peer, jso_tls);
 			hocon_read_bool_base(
 			    tls, set_fail, "fail_if_no_peer_cert", jso_tls);
+			hocon_read_bool(tls, ktls, jso_tls);
 		}
 	}
 
@@ -498,6 +499,7 @@ conf_tls_parse_ver2(conf *config, cJSON *jso)
 			hocon_read_bool(node, verify_peer, node_item);
 			hocon_read_bool_base(
 			    node, set_fail, "fail_if_no_peer_cert", node_item);
+			hocon_read_bool(node, ktls, node_item);
 			cvector_push_back(config->tls_list.nodes, node);
 		} else {
 			nng_free(node, sizeof(node));
@@ -832,6 +834,12 @@ conf_auth_http_parse_ver2(conf *config, cJSON *jso)
 
 		hocon_read_num(auth_http, pool_size, jso);
 
+		char *cache_ttl =
+		    cJSON_GetStringValue(hocon_get_obj("cache_ttl", jso));
+		if (cache_ttl)
+			get_time(cache_ttl, &auth_http->cache_ttl);
+		hocon_read_num(auth_http, cache_size, jso);
+
 		conf_auth_http_req *auth_http_req = &(auth_http->auth_req);
 		cJSON *jso_auth_http_req = hocon_get_obj("auth_req", jso);
 		conf_auth_http_req_parse_ver2(
@@ -1528,6 +1536,9 @@ conf_parquet_parse_ver2(conf *config, cJSON *jso)
 		hocon_read_num(parquet, limit_frequency, jso_parquet);
 		hocon_read_num(parquet, file_count, jso_parquet);
 		hocon_read_size(parquet, file_size, jso_parquet);
+		hocon_read_num(parquet, row_group_size, jso_parquet);
+		hocon_read_num(parquet, write_threads, jso_parquet);
+		hocon_read_num(parquet, queue_limit, jso_parquet);
 		hocon_read_str(parquet, dir, jso_parquet);
 		hocon_read_str(parquet, file_name_prefix, jso_parquet);
 		update_parquet_vin(parquet);
@@ -1561,6 +1572,8 @@ conf_blf_parse_ver2(conf *config, cJSON *jso)
 		blf->enable   = true;
 		hocon_read_num(blf, file_count, jso_blf);
 		hocon_read_size(blf, file_size, jso_blf);
+		hocon_read_num(blf, write_threads, jso_blf);
+		hocon_read_num(blf, queue_limit, jso_blf);
 		hocon_read_str(blf, dir, jso_blf);
 		hocon_read_str(blf, file_name_prefix, jso_blf);
 		hocon_read_enum_base(
@@ -5,6 +5,7 @@
 #include <string.h>
 
 #include "nng/nng.h"
+#include "nng/supplemental/util/platform.h"
 
 #include "nuts.h"
 
@@ -373,8 +374,192 @@ dbtree_test(void)
 	puts("---------------TEST FINISHED----------------\n");
 }
 
+static bool
+ids_has(uint32_t *ids, uint32_t id)
+{
+	for (size_t i = 0; i < cvector_size(ids); i++) {
+		if (ids[i] == id) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void
+test_find_clients(void)
+{
+	dbtree   *t;
+	uint32_t *ids;
+
+	dbtree_create(&t);
+	dbtree_insert_client(t, "a/b/c", 1);
+	dbtree_insert_client(t, "a/+/c", 2);
+	dbtree_insert_client(t, "a/#", 3);
+	dbtree_insert_client(t, "#", 4);
+	dbtree_insert_client(t, "a/b/c", 5);
+	dbtree_insert_client(t, "a/b/c", 5);
+
+	ids = dbtree_find_clients(t, "a/b/c");
+	NUTS_TRUE(cvector_size(ids) == 5);
+	cvector_free(ids);
+
+	ids = dbtree_find_clients(t, "a");
+	NUTS_TRUE(cvector_size(ids) == 2);
+	NUTS_TRUE(ids_has(ids, 3) && ids_has(ids, 4));
+	cvector_free(ids);
+
+	ids = dbtree_find_clients(t, "x/y");
+	NUTS_TRUE(cvector_size(ids) == 1 && ids_has(ids, 4));
+	cvector_free(ids);
+
+	dbtree_delete_client(t, "a/b/c", 5);
+	dbtree_delete_client(t, "a/#", 3);
+	dbtree_delete_client(t, "a/#", 42);
+	dbtree_delete_client(t, "no/such/topic", 1);
+	ids = dbtree_find_clients(t, "a/b/c");
+	NUTS_TRUE(cvector_size(ids) == 3);
+	NUTS_TRUE(!ids_has(ids, 5) && !ids_has(ids, 3));
+	cvector_free(ids);
+
+	dbtree_delete_client(t, "a/b/c", 1);
+	dbtree_delete_client(t, "a/+/c", 2);
+	dbtree_delete_client(t, "#", 4);
+	ids = dbtree_find_clients(t, "a/b/c");
+	NUTS_TRUE(cvector_size(ids) == 0);
+	cvector_free(ids);
+
+	dbtree_destory(t);
+}
+
+static void
+test_retain_keeps_node(void)
+{
+	dbtree   *t;
+	nng_msg  *msg;
+	nng_msg **r;
+
+	dbtree_create(&t);
+	NUTS_PASS(nng_msg_alloc(&msg, 0));
+	NUTS_TRUE(dbtree_insert_retain(t, "a/b", msg) == NULL);
+	// the last subscriber going away must not drop the retained msg
+	dbtree_insert_client(t, "a/b", 1);
+	dbtree_delete_client(t, "a/b", 1);
+	r = dbtree_find_retain(t, "a/b");
+	NUTS_TRUE(cvector_size(r) == 1 && r[0] == msg);
+	nng_msg_free(r[0]);
+	cvector_free(r);
+	NUTS_TRUE(dbtree_delete_retain(t, "a/b") == msg);
+	nng_msg_free(msg);
+	dbtree_destory(t);
+}
+
+#define BENCH_READERS 4
+#define BENCH_SUBS 100000
+
+typedef struct {
+	dbtree  *db;
+	bool     done;
+	nng_mtx *mtx;
+	uint64_t lookups;
+	bool     missed;
+} bench_state;
+
+static void
+bench_reader(void *arg)
+{
+	bench_state *st = arg;
+	uint64_t     n  = 0;
+	bool         missed = false;
+	char         topic[64];
+
+	for (;;) {
+		nng_mtx_lock(st->mtx);
+		bool done = st->done;
+		nng_mtx_unlock(st->mtx);
+		if (done) {
+			break;
+		}
+		for (int i = 0; i < 1000; i++) {
+			snprintf(topic, sizeof(topic), "bench/%d/7/%d",
+			    i % 100, i);
+			uint32_t *ids = dbtree_find_clients(st->db, topic);
+			// The stable subscription must never go missing
+			// while the writer churns around it.
+			if (!ids_has(ids, 1)) {
+				missed = true;
+			}
+			cvector_free(ids);
+			n++;
+		}
+	}
+	nng_mtx_lock(st->mtx);
+	st->lookups += n;
+	st->missed = st->missed || missed;
+	nng_mtx_unlock(st->mtx);
+}
+
+// Lookups per second while a writer subscribes and unsubscribes
+// BENCH_SUBS filters.
+static void
+test_concurrent_churn(void)
+{
+	bench_state st;
+	nng_thread *thrs[BENCH_READERS];
+	char        topic[64];
+	nng_time    start;
+	nng_duration elapsed;
+
+	memset(&st, 0, sizeof(st));
+	NUTS_PASS(nng_mtx_alloc(&st.mtx));
+	dbtree_create(&st.db);
+	dbtree_insert_client(st.db, "bench/#", 1);
+
+	start = nng_clock();
+	for (int i = 0; i < BENCH_READERS; i++) {
+		NUTS_PASS(nng_thread_create(&thrs[i], bench_reader, &st));
+	}
+	for (int i = 0; i < BENCH_SUBS; i++) {
+		snprintf(topic, sizeof(topic), "bench/%d/%s/%d", i % 100,
+		    i % 3 ? "+" : "7", i % 1000);
+		dbtree_insert_client(st.db, topic, 100 + i);
+	}
+	for (int i = 0; i < BENCH_SUBS; i++) {
+		snprintf(topic, sizeof(topic), "bench/%d/%s/%d", i % 100,
+		    i % 3 ? "+" : "7", i % 1000);
+		dbtree_delete_client(st.db, topic, 100 + i);
+	}
+	nng_mtx_lock(st.mtx);
+	st.done = true;
+	nng_mtx_unlock(st.mtx);
+	for (int i = 0; i < BENCH_READERS; i++) {
+		nng_thread_destroy(thrs[i]);
+	}
+	elapsed = (nng_duration) (nng_clock() - start);
+	if (elapsed == 0) {
+		elapsed = 1;
+	}
+
+	NUTS_TRUE(!st.missed);
+	NUTS_TRUE(st.lookups > 0);
+	NUTS_MSG("%d readers, %d subscriptions churned in %d ms: "
+	         "%llu lookups/sec",
+	    BENCH_READERS, BENCH_SUBS, elapsed,
+	    (unsigned long long) (st.lookups * 1000 / elapsed));
+	printf("dbtree churn: %llu lookups/sec over %d ms\n",
+	    (unsigned long long) (st.lookups * 1000 / elapsed), elapsed);
+
+	uint32_t *ids = dbtree_find_clients(st.db, "bench/1/7/1");
+	NUTS_TRUE(cvector_size(ids) == 1);
+	cvector_free(ids);
+	dbtree_destory(st.db);
+	nng_mtx_free(st.mtx);
+}
+
 TEST_LIST = {
    {"dbtree_test", dbtree_test},
+   {"dbtree find clients", test_find_clients},
+   {"dbtree retain keeps node", test_retain_keeps_node},
+   {"dbtree concurrent churn", test_concurrent_churn},
 
    {NULL, NULL} 
 };
\ No newline at end of file
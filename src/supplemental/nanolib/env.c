@@ -222,6 +222,7 @@ read_env_conf(conf *config)
 
 	set_bool_var(&config->tls.verify_peer, NANOMQ_TLS_VERIFY_PEER);
 	set_bool_var(&config->tls.set_fail, NANOMQ_TLS_FAIL_IF_NO_PEER_CERT);
+	set_bool_var(&config->tls.ktls, NANOMQ_TLS_KTLS);
 
 
 	// log env
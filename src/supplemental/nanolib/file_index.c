@@ -0,0 +1,345 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/nng_impl.h"
+#include "nng/supplemental/nanolib/file_index.h"
+
+typedef struct {
+	uint64_t start;
+	uint64_t end;
+	char    *name;
+} file_index_entry;
+
+struct file_index {
+	nni_rwlock        lock;
+	file_index_entry *entries; // sorted by start key
+	uint32_t          len;
+	uint32_t          cap;
+	uint32_t          overlaps; // neighbours whose ranges overlap
+};
+
+int
+file_index_parse(const char *name, uint64_t *start_key, uint64_t *end_key)
+{
+	const char *s;
+	char       *e;
+
+	// {dir}/{prefix}...-{start_key}~{end_key}.{ext}
+	if (name == NULL || (s = strrchr(name, '-')) == NULL) {
+		return (NNG_EINVAL);
+	}
+	s++;
+	if (*s < '0' || *s > '9') {
+		return (NNG_EINVAL);
+	}
+	*start_key = strtoull(s, &e, 10);
+	if (*e != '~') {
+		return (NNG_EINVAL);
+	}
+	s = e + 1;
+	if (*s < '0' || *s > '9') {
+		return (NNG_EINVAL);
+	}
+	*end_key = strtoull(s, &e, 10);
+	if (*e != '.') {
+		return (NNG_EINVAL);
+	}
+	return (0);
+}
+
+int
+file_index_alloc(file_index **idxp)
+{
+	file_index *idx;
+
+	if ((idx = NNI_ALLOC_STRUCT(idx)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	nni_rwlock_init(&idx->lock);
+	*idxp = idx;
+	return (0);
+}
+
+void
+file_index_free(file_index *idx)
+{
+	if (idx == NULL) {
+		return;
+	}
+	for (uint32_t i = 0; i < idx->len; i++) {
+		nni_strfree(idx->entries[i].name);
+	}
+	if (idx->entries != NULL) {
+		nni_free(idx->entries, idx->cap * sizeof(file_index_entry));
+	}
+	nni_rwlock_fini(&idx->lock);
+	NNI_FREE_STRUCT(idx);
+}
+
+// Whether entry i and the one after it overlap.
+static bool
+file_index_touch(file_index *idx, uint32_t i)
+{
+	return (i + 1 < idx->len &&
+	    idx->entries[i].end >= idx->entries[i + 1].start);
+}
+
+// First entry with a start key greater than key.
+static uint32_t
+file_index_upper(file_index *idx, uint64_t key)
+{
+	uint32_t lo = 0;
+	uint32_t hi = idx->len;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (idx->entries[mid].start <= key) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return (lo);
+}
+
+// First entry with an end key not less than key, only meaningful when
+// nothing overlaps, as end keys are then sorted too.
+static uint32_t
+file_index_lower_end(file_index *idx, uint64_t key)
+{
+	uint32_t lo = 0;
+	uint32_t hi = idx->len;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (idx->entries[mid].end < key) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return (lo);
+}
+
+// Position of name, or idx->len.  Names compare ignoring case, like the
+// file queues they index.  Called with the lock held.
+static uint32_t
+file_index_locate(file_index *idx, const char *name)
+{
+	uint64_t start, end;
+	uint32_t i = 0;
+
+	if (file_index_parse(name, &start, &end) == 0) {
+		// Scan back over the entries sharing the start key
+		for (i = file_index_upper(idx, start); i > 0; i--) {
+			if (idx->entries[i - 1].start != start) {
+				return (idx->len);
+			}
+			if (nni_strcasecmp(idx->entries[i - 1].name, name) == 0) {
+				return (i - 1);
+			}
+		}
+		return (idx->len);
+	}
+	for (i = 0; i < idx->len; i++) {
+		if (nni_strcasecmp(idx->entries[i].name, name) == 0) {
+			break;
+		}
+	}
+	return (i);
+}
+
+int
+file_index_add(file_index *idx, const char *name)
+{
+	file_index_entry e;
+	uint32_t         pos;
+
+	if (file_index_parse(name, &e.start, &e.end) != 0 || e.start > e.end) {
+		return (NNG_EINVAL);
+	}
+	if ((e.name = nni_strdup(name)) == NULL) {
+		return (NNG_ENOMEM);
+	}
+
+	nni_rwlock_wrlock(&idx->lock);
+	if (idx->len == idx->cap) {
+		file_index_entry *entries;
+		uint32_t          cap = idx->cap ? idx->cap * 2 : 16;
+
+		if ((entries = nni_alloc(cap * sizeof(*entries))) == NULL) {
+			nni_rwlock_unlock(&idx->lock);
+			nni_strfree(e.name);
+			return (NNG_ENOMEM);
+		}
+		if (idx->len > 0) {
+			memcpy(entries, idx->entries, idx->len * sizeof(*entries));
+			nni_free(idx->entries, idx->cap * sizeof(*entries));
+		}
+		idx->entries = entries;
+		idx->cap     = cap;
+	}
+
+	// Usually an append, keys only grow
+	pos = file_index_upper(idx, e.start);
+	if (pos > 0 && file_index_touch(idx, pos - 1)) {
+		idx->overlaps--;
+	}
+	memmove(&idx->entries[pos + 1], &idx->entries[pos],
+	    (idx->len - pos) * sizeof(e));
+	idx->entries[pos] = e;
+	idx->len++;
+	if (pos > 0 && file_index_touch(idx, pos - 1)) {
+		idx->overlaps++;
+	}
+	if (file_index_touch(idx, pos)) {
+		idx->overlaps++;
+	}
+	nni_rwlock_unlock(&idx->lock);
+
+	return (0);
+}
+
+int
+file_index_remove(file_index *idx, const char *name)
+{
+	uint32_t pos;
+	char    *n;
+
+	nni_rwlock_wrlock(&idx->lock);
+	if ((pos = file_index_locate(idx, name)) == idx->len) {
+		nni_rwlock_unlock(&idx->lock);
+		return (NNG_ENOENT);
+	}
+	if (pos > 0 && file_index_touch(idx, pos - 1)) {
+		idx->overlaps--;
+	}
+	if (file_index_touch(idx, pos)) {
+		idx->overlaps--;
+	}
+	n = idx->entries[pos].name;
+	memmove(&idx->entries[pos], &idx->entries[pos + 1],
+	    (idx->len - pos - 1) * sizeof(file_index_entry));
+	idx->len--;
+	if (pos > 0 && file_index_touch(idx, pos - 1)) {
+		idx->overlaps++;
+	}
+	nni_rwlock_unlock(&idx->lock);
+
+	nni_strfree(n);
+	return (0);
+}
+
+bool
+file_index_has(file_index *idx, const char *name)
+{
+	bool found;
+
+	if (name == NULL) {
+		return (false);
+	}
+	nni_rwlock_rdlock(&idx->lock);
+	found = file_index_locate(idx, name) != idx->len;
+	nni_rwlock_unlock(&idx->lock);
+	return (found);
+}
+
+char *
+file_index_get(file_index *idx, const char *name)
+{
+	char    *found = NULL;
+	uint32_t pos;
+
+	if (name == NULL) {
+		return (NULL);
+	}
+	nni_rwlock_rdlock(&idx->lock);
+	if ((pos = file_index_locate(idx, name)) != idx->len) {
+		found = nni_strdup(idx->entries[pos].name);
+	}
+	nni_rwlock_unlock(&idx->lock);
+	return (found);
+}
+
+uint32_t
+file_index_size(file_index *idx)
+{
+	uint32_t len;
+
+	nni_rwlock_rdlock(&idx->lock);
+	len = idx->len;
+	nni_rwlock_unlock(&idx->lock);
+	return (len);
+}
+
+char *
+file_index_find(file_index *idx, uint64_t key)
+{
+	char    *name = NULL;
+	uint32_t i;
+
+	nni_rwlock_rdlock(&idx->lock);
+	if (idx->overlaps == 0) {
+		i = file_index_upper(idx, key);
+		if (i > 0 && idx->entries[i - 1].end >= key) {
+			name = nni_strdup(idx->entries[i - 1].name);
+		}
+	} else {
+		for (i = 0; i < idx->len; i++) {
+			if (idx->entries[i].start <= key &&
+			    idx->entries[i].end >= key) {
+				name = nni_strdup(idx->entries[i].name);
+				break;
+			}
+		}
+	}
+	nni_rwlock_unlock(&idx->lock);
+	return (name);
+}
+
+char **
+file_index_find_span(
+    file_index *idx, uint64_t start_key, uint64_t end_key, uint32_t *size)
+{
+	char   **names = NULL;
+	uint32_t first, last, n = 0;
+
+	*size = 0;
+	if (start_key > end_key) {
+		return (NULL);
+	}
+
+	nni_rwlock_rdlock(&idx->lock);
+	last = file_index_upper(idx, end_key);
+	first = idx->overlaps == 0 ? file_index_lower_end(idx, start_key) : 0;
+	if (first < last &&
+	    (names = nni_alloc((last - first) * sizeof(char *))) != NULL) {
+		for (uint32_t i = first; i < last; i++) {
+			if (idx->entries[i].end < start_key) {
+				continue;
+			}
+			if ((names[n] = nni_strdup(idx->entries[i].name)) ==
+			    NULL) {
+				break;
+			}
+			n++;
+		}
+		if (n == 0) {
+			nni_free(names, (last - first) * sizeof(char *));
+			names = NULL;
+		}
+	}
+	nni_rwlock_unlock(&idx->lock);
+
+	*size = n;
+	return (names);
+}
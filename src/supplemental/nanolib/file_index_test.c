@@ -0,0 +1,145 @@
+#include <inttypes.h>
+
+#include "nng/supplemental/nanolib/file_index.h"
+#include "nuts.h"
+
+static void
+add_file(file_index *idx, uint64_t start, uint64_t end)
+{
+	char name[128];
+
+	snprintf(name, sizeof(name),
+	    "/tmp/nanomq_topic_0123-%" PRIu64 "~%" PRIu64 ".parquet", start,
+	    end);
+	NUTS_PASS(file_index_add(idx, name));
+}
+
+static void
+free_names(char **names, uint32_t size)
+{
+	for (uint32_t i = 0; i < size; i++) {
+		nng_strfree(names[i]);
+	}
+	nng_free(names, sizeof(char *) * size);
+}
+
+void
+test_file_index_parse(void)
+{
+	uint64_t s, e;
+
+	NUTS_PASS(file_index_parse("/a/b_c_d-10~20.parquet", &s, &e));
+	NUTS_TRUE(s == 10 && e == 20);
+	NUTS_PASS(file_index_parse("dir/p-18446744073709551615~0.blf", &s, &e));
+	NUTS_TRUE(s == UINT64_MAX && e == 0);
+	NUTS_FAIL(file_index_parse("/a/b-10.parquet", &s, &e), NNG_EINVAL);
+	NUTS_FAIL(file_index_parse("/a/b-x~1.parquet", &s, &e), NNG_EINVAL);
+	NUTS_FAIL(file_index_parse("/a/b", &s, &e), NNG_EINVAL);
+}
+
+void
+test_file_index_find(void)
+{
+	file_index *idx;
+	char       *name;
+	char      **names;
+	uint32_t    size;
+
+	NUTS_PASS(file_index_alloc(&idx));
+	NUTS_FAIL(file_index_add(idx, "/tmp/a.parquet"), NNG_EINVAL);
+	NUTS_NULL(file_index_find(idx, 1));
+
+	// added out of order, like a directory listing at startup
+	add_file(idx, 20, 29);
+	add_file(idx, 0, 9);
+	add_file(idx, 10, 19);
+	NUTS_TRUE(file_index_size(idx) == 3);
+
+	NUTS_NULL(file_index_find(idx, 30));
+	NUTS_TRUE((name = file_index_find(idx, 15)) != NULL);
+	NUTS_MATCH(name, "/tmp/nanomq_topic_0123-10~19.parquet");
+	nng_strfree(name);
+
+	names = file_index_find_span(idx, 5, 20, &size);
+	NUTS_TRUE(size == 3);
+	NUTS_MATCH(names[0], "/tmp/nanomq_topic_0123-0~9.parquet");
+	NUTS_MATCH(names[2], "/tmp/nanomq_topic_0123-20~29.parquet");
+	free_names(names, size);
+	NUTS_NULL(file_index_find_span(idx, 30, 40, &size));
+	NUTS_TRUE(size == 0);
+	NUTS_NULL(file_index_find_span(idx, 20, 10, &size));
+
+	NUTS_TRUE(file_index_has(idx, "/tmp/nanomq_topic_0123-0~9.parquet"));
+	NUTS_TRUE(file_index_has(idx, "/TMP/NanoMQ_topic_0123-0~9.PARQUET"));
+	NUTS_NULL(file_index_get(idx, "/tmp/nanomq_topic_0123-0~8.parquet"));
+	NUTS_TRUE((name = file_index_get(
+	               idx, "/tmp/NANOMQ_topic_0123-0~9.parquet")) != NULL);
+	NUTS_MATCH(name, "/tmp/nanomq_topic_0123-0~9.parquet");
+	nng_strfree(name);
+	NUTS_PASS(file_index_remove(idx, "/tmp/nanomq_topic_0123-0~9.parquet"));
+	NUTS_TRUE(!file_index_has(idx, "/tmp/nanomq_topic_0123-0~9.parquet"));
+	NUTS_FAIL(file_index_remove(idx, "/tmp/nanomq_topic_0123-0~9.parquet"),
+	    NNG_ENOENT);
+	NUTS_NULL(file_index_find(idx, 5));
+
+	// an overlapping range, lookups fall back to a scan
+	add_file(idx, 5, 25);
+	names = file_index_find_span(idx, 0, 12, &size);
+	NUTS_TRUE(size == 2);
+	NUTS_MATCH(names[0], "/tmp/nanomq_topic_0123-5~25.parquet");
+	free_names(names, size);
+	NUTS_TRUE((name = file_index_find(idx, 22)) != NULL);
+	NUTS_MATCH(name, "/tmp/nanomq_topic_0123-5~25.parquet");
+	nng_strfree(name);
+	NUTS_PASS(file_index_remove(idx, "/tmp/nanomq_topic_0123-5~25.parquet"));
+	names = file_index_find_span(idx, 0, 12, &size);
+	NUTS_TRUE(size == 1);
+	free_names(names, size);
+
+	file_index_free(idx);
+}
+
+#define FILE_INDEX_BENCH_FILES 10000
+#define FILE_INDEX_BENCH_LOOKUPS 100000
+
+void
+test_file_index_bench(void)
+{
+	file_index *idx;
+	char       *name;
+	nng_time    t0, t1;
+
+	NUTS_PASS(file_index_alloc(&idx));
+	for (uint64_t i = 0; i < FILE_INDEX_BENCH_FILES; i++) {
+		add_file(idx, i * 100, i * 100 + 99);
+	}
+
+	t0 = nng_clock();
+	for (int i = 0; i < FILE_INDEX_BENCH_LOOKUPS; i++) {
+		uint64_t key = nng_random() % (FILE_INDEX_BENCH_FILES * 100);
+		name         = file_index_find(idx, key);
+		NUTS_TRUE(name != NULL);
+		nng_strfree(name);
+	}
+	t1 = nng_clock();
+	printf("file index %d lookups over %d files: %dms\n",
+	    FILE_INDEX_BENCH_LOOKUPS, FILE_INDEX_BENCH_FILES, (int) (t1 - t0));
+
+	// retention drops the oldest files
+	for (uint64_t i = 0; i < FILE_INDEX_BENCH_FILES; i++) {
+		char n[128];
+		snprintf(n, sizeof(n),
+		    "/tmp/nanomq_topic_0123-%" PRIu64 "~%" PRIu64 ".parquet",
+		    i * 100, i * 100 + 99);
+		NUTS_PASS(file_index_remove(idx, n));
+	}
+	NUTS_TRUE(file_index_size(idx) == 0);
+	file_index_free(idx);
+}
+
+NUTS_TESTS = {
+	{ "file index parse", test_file_index_parse },
+	{ "file index find", test_file_index_find },
+	{ "file index bench", test_file_index_bench },
+	{ NULL, NULL },
+};
@@ -24,9 +24,20 @@ static int log_facility = LOG_USER;
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <errno.h>
+#include <sys/uio.h>
 #define nano_localtime(t, pTm) localtime_r(t, pTm)
 #endif
 
+// Longest record in asynchronous mode, longer ones are truncated.
+#ifndef LOG_RECORD_MAX
+#define LOG_RECORD_MAX 1024
+#endif
+
+#define LOG_ASYNC_RECORDS 1024 // default ring size
+#define LOG_ASYNC_BATCH 64     // records per write
+#define LOG_ASYNC_IDLE 100     // ms the writer sleeps when idle
+#define LOG_ASYNC_CHECK 1000   // ms between checks of the log file
+
 
 typedef struct {
 	log_func  fn;
@@ -34,6 +45,8 @@ typedef struct {
 	uint8_t   level;
 	nng_mtx * mtx;
 	conf_log *config;
+	uint64_t  written; // async: size of the log file, as far as we know
+	nni_time  checked; // async: when the log file was last looked at
 } log_callback;
 
 static struct {
@@ -443,6 +456,453 @@ log_add_console(int level, void *mtx)
 	log_add_callback(stdout_callback, stdout, level, mtx, NULL);
 }
 
+// Asynchronous mode.  The ring is a bounded multi-producer queue of
+// fixed size slots: a producer claims a position with a compare and swap
+// on head, fills in the slot, and publishes it by setting its sequence
+// to position + 1.  The writer thread consumes slots in order, and hands
+// them back by setting the sequence to position + ring size.  A producer
+// that finds the slot at head not yet handed back drops its record.
+typedef struct {
+	nni_atomic_u64 seq;
+	log_callback  *cb;
+	size_t         len;
+	char           data[LOG_RECORD_MAX];
+} log_slot;
+
+static struct {
+	nni_atomic_bool on;
+	nni_atomic_bool idle; // writer is (about to be) waiting on cv
+	nni_atomic_int  busy; // producers between log_async_enter and exit
+	nni_atomic_u64  head;
+	nni_atomic_u64  dropped;
+	uint64_t        tail;     // writer only
+	uint64_t        reported; // writer only
+	log_slot       *slots;
+	size_t          size;
+	nni_thr         thr;
+	nni_mtx         mtx;
+	nni_cv          cv;
+	bool            stop;
+	bool            running;
+} LA;
+
+static nni_mtx log_async_lk = NNI_MTX_INITIALIZER;
+
+static NNI_THREAD_LOCAL char log_tls_buf[LOG_RECORD_MAX];
+static NNI_THREAD_LOCAL int  log_tls_tid;
+
+static int
+log_tid(void)
+{
+	if (log_tls_tid == 0) {
+#if (NNG_PLATFORM_WINDOWS || NNG_PLATFORM_DARWIN)
+		log_tls_tid = nni_plat_getpid();
+#else
+		log_tls_tid = (int) syscall(__NR_gettid);
+#endif
+	}
+	return (log_tls_tid);
+}
+
+static bool
+log_async_sink(log_callback *cb)
+{
+	return (cb->fn == file_callback || cb->fn == stdout_callback);
+}
+
+// Formats a record the way the synchronous callbacks do, newline included.
+static size_t
+log_async_format(char *buf, size_t sz, log_callback *cb, log_event *ev)
+{
+	char tbuf[64];
+	int  n;
+	int  m;
+
+	tbuf[strftime(tbuf, sizeof(tbuf), "%Y-%m-%d %H:%M:%S", &ev->time)] =
+	    '\0';
+	if (cb->fn == file_callback) {
+		n = snprintf(buf, sz, "%s [%i] %-5s %s:%d: ", tbuf, log_tid(),
+		    level_strings[ev->level], ev->file, ev->line);
+	} else {
+#ifdef LOG_USE_COLOR
+		n = snprintf(buf, sz,
+		    "%s [%i] %s%-5s\x1b[0m \x1b[0m%s:%d \x1b[0m %s: ", tbuf,
+		    log_tid(), level_colors[ev->level],
+		    level_strings[ev->level], ev->file, ev->line, ev->func);
+#else
+		n = snprintf(buf, sz, "%s [%i] %-5s %s:%d %s: ", tbuf,
+		    log_tid(), level_strings[ev->level], ev->file, ev->line,
+		    ev->func);
+#endif
+	}
+	if (n < 0) {
+		n = 0;
+	} else if ((size_t) n > sz - 2) {
+		n = (int) sz - 2;
+	}
+	m = vsnprintf(buf + n, sz - n, ev->fmt, ev->ap);
+	if (m > 0) {
+		n += m;
+	}
+	if ((size_t) n > sz - 2) {
+		n = (int) sz - 2;
+	}
+	buf[n++] = '\n';
+	return ((size_t) n);
+}
+
+// A producer holds busy while it may claim a slot, so that once
+// log_async_stop has turned the ring off and seen busy drop to zero,
+// head no longer moves and every claimed slot has been published.
+static bool
+log_async_enter(void)
+{
+	nni_atomic_inc(&LA.busy);
+	if (!nni_atomic_get_bool(&LA.on)) {
+		nni_atomic_dec(&LA.busy);
+		return (false);
+	}
+	return (true);
+}
+
+static void
+log_async_exit(void)
+{
+	nni_atomic_dec(&LA.busy);
+}
+
+static void
+log_async_push(log_callback *cb, log_event *ev)
+{
+	char     *buf = log_tls_buf;
+	size_t    len = log_async_format(buf, LOG_RECORD_MAX, cb, ev);
+	log_slot *slot;
+	uint64_t  pos;
+	uint64_t  seq;
+
+	for (;;) {
+		pos  = nni_atomic_get64(&LA.head);
+		slot = &LA.slots[pos & (LA.size - 1)];
+		seq  = nni_atomic_get64(&slot->seq);
+		if (seq == pos) {
+			if (nni_atomic_cas64(&LA.head, pos, pos + 1)) {
+				break;
+			}
+		} else if (seq < pos) {
+			// Still holds a record from the previous lap.
+			nni_atomic_inc64(&LA.dropped);
+			return;
+		}
+		// Otherwise another producer beat us to it, try again.
+	}
+	slot->cb  = cb;
+	slot->len = len;
+	memcpy(slot->data, buf, len);
+	nni_atomic_set64(&slot->seq, pos + 1);
+
+	if (nni_atomic_get_bool(&LA.idle)) {
+		nni_mtx_lock(&LA.mtx);
+		nni_cv_wake(&LA.cv);
+		nni_mtx_unlock(&LA.mtx);
+	}
+}
+
+static FILE *
+log_async_file(log_callback *cb)
+{
+	conf_log *config = cb->config;
+	size_t    sz     = 0;
+
+	if (config->fp == NULL) {
+#ifndef NNG_PLATFORM_WINDOWS
+		if (nng_access(config->dir, W_OK) < 0) {
+			return (NULL);
+		}
+#endif
+		if ((config->fp = fopen(config->abs_path, "a")) == NULL) {
+			return (NULL);
+		}
+		(void) nni_plat_file_size(config->abs_path, &sz);
+		cb->written = sz;
+		cb->checked = nni_clock();
+	}
+	return (config->fp);
+}
+
+// Looks at the log file now and then, and when it should have grown past
+// the rotation size, instead of once for every record.
+static void
+log_async_rotate(log_callback *cb, bool force)
+{
+	conf_log *config = cb->config;
+	nni_time  now    = nni_clock();
+	size_t    sz     = 0;
+
+	if (!force && (cb->written < config->rotation_sz) &&
+	    (now - cb->checked < LOG_ASYNC_CHECK)) {
+		return;
+	}
+	file_rotation(config->fp, config);
+	if (nni_plat_file_size(config->abs_path, &sz) == 0) {
+		cb->written = sz;
+	}
+	cb->checked = now;
+}
+
+static void
+log_async_write(log_callback *cb, nni_iov *iov, int niov)
+{
+	FILE  *fp;
+	size_t len = 0;
+
+	if (cb->mtx != NULL) {
+		nng_mtx_lock(cb->mtx);
+	}
+	fp = cb->fn == file_callback ? log_async_file(cb) : cb->udata;
+	if (fp == NULL) {
+		goto done;
+	}
+#ifndef NNG_PLATFORM_WINDOWS
+	struct iovec vec[LOG_ASYNC_BATCH];
+	int          fd = fileno(fp);
+	int          i  = 0;
+	ssize_t      n;
+
+	for (int j = 0; j < niov; j++) {
+		vec[j].iov_base = iov[j].iov_buf;
+		vec[j].iov_len  = iov[j].iov_len;
+		len += iov[j].iov_len;
+	}
+	while (i < niov) {
+		if ((n = writev(fd, vec + i, niov - i)) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		while ((i < niov) && ((size_t) n >= vec[i].iov_len)) {
+			n -= vec[i].iov_len;
+			i++;
+		}
+		if (i < niov) {
+			vec[i].iov_base = (char *) vec[i].iov_base + n;
+			vec[i].iov_len -= n;
+		}
+	}
+#else
+	for (int j = 0; j < niov; j++) {
+		fwrite(iov[j].iov_buf, 1, iov[j].iov_len, fp);
+		len += iov[j].iov_len;
+	}
+	fflush(fp);
+#endif
+	if (cb->fn == file_callback) {
+		cb->written += len;
+		log_async_rotate(cb, false);
+	}
+done:
+	if (cb->mtx != NULL) {
+		nng_mtx_unlock(cb->mtx);
+	}
+}
+
+// Writes out every record that is ready, in batches of records going to
+// the same sink, and returns how many there were.
+static size_t
+log_async_drain(void)
+{
+	nni_iov       iov[LOG_ASYNC_BATCH];
+	log_callback *cb    = NULL;
+	int           niov  = 0;
+	size_t        total = 0;
+	uint64_t      pos   = LA.tail;
+	log_slot     *slot;
+
+	for (;;) {
+		slot = &LA.slots[pos & (LA.size - 1)];
+		if ((nni_atomic_get64(&slot->seq) != pos + 1) ||
+		    ((niov > 0) &&
+		        ((slot->cb != cb) || (niov == LOG_ASYNC_BATCH)))) {
+			if (niov == 0) {
+				break;
+			}
+			log_async_write(cb, iov, niov);
+			for (; LA.tail < pos; LA.tail++) {
+				nni_atomic_set64(
+				    &LA.slots[LA.tail & (LA.size - 1)].seq,
+				    LA.tail + LA.size);
+			}
+			total += niov;
+			niov = 0;
+			continue;
+		}
+		cb                 = slot->cb;
+		iov[niov].iov_buf  = slot->data;
+		iov[niov].iov_len  = slot->len;
+		niov++;
+		pos++;
+	}
+	return (total);
+}
+
+static void
+log_async_report(void)
+{
+	uint64_t dropped = nni_atomic_get64(&LA.dropped);
+	char     buf[128];
+	nni_iov  iov;
+
+	if (dropped == LA.reported) {
+		return;
+	}
+	iov.iov_buf = buf;
+	iov.iov_len = (size_t) snprintf(buf, sizeof(buf),
+	    "log ring full, %llu records dropped\n",
+	    (unsigned long long) (dropped - LA.reported));
+	LA.reported = dropped;
+	for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
+		if (log_async_sink(&L.callbacks[i])) {
+			log_async_write(&L.callbacks[i], &iov, 1);
+		}
+	}
+}
+
+static void
+log_async_thr(void *arg)
+{
+	NNI_ARG_UNUSED(arg);
+
+	nni_thr_set_name(NULL, "nng:log");
+	for (;;) {
+		if (log_async_drain() > 0) {
+			log_async_report();
+			continue;
+		}
+		log_async_report();
+		nni_mtx_lock(&LA.mtx);
+		if (LA.stop) {
+			nni_mtx_unlock(&LA.mtx);
+			break;
+		}
+		nni_atomic_set_bool(&LA.idle, true);
+		// A record published before we set idle is seen here, one
+		// published after that will wake us.
+		if (nni_atomic_get64(
+		        &LA.slots[LA.tail & (LA.size - 1)].seq) != LA.tail + 1) {
+			(void) nni_cv_until(
+			    &LA.cv, nni_clock() + LOG_ASYNC_IDLE);
+		}
+		nni_atomic_set_bool(&LA.idle, false);
+		nni_mtx_unlock(&LA.mtx);
+
+		// Notice a log file that was removed even if we are idle.
+		for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
+			log_callback *cb = &L.callbacks[i];
+			if ((cb->fn == file_callback) &&
+			    (cb->config->fp != NULL)) {
+				if (cb->mtx != NULL) {
+					nng_mtx_lock(cb->mtx);
+				}
+				log_async_rotate(cb, false);
+				if (cb->mtx != NULL) {
+					nng_mtx_unlock(cb->mtx);
+				}
+			}
+		}
+	}
+}
+
+int
+log_async_start(size_t records)
+{
+	size_t size = 1;
+	int    rv;
+
+	if ((rv = nni_init()) != 0) {
+		return (rv);
+	}
+	if (records == 0) {
+		records = LOG_ASYNC_RECORDS;
+	}
+	while (size < records) {
+		size <<= 1;
+	}
+
+	nni_mtx_lock(&log_async_lk);
+	if (LA.running) {
+		nni_mtx_unlock(&log_async_lk);
+		return (NNG_EBUSY);
+	}
+	// The ring outlives log_async_stop, as threads that were logging
+	// at the time may still be filling in slots.
+	if (LA.slots != NULL && LA.size != size) {
+		if (LA.tail != nni_atomic_get64(&LA.head)) {
+			nni_mtx_unlock(&log_async_lk);
+			return (NNG_EBUSY);
+		}
+		nni_free(LA.slots, sizeof(log_slot) * LA.size);
+		LA.slots = NULL;
+	}
+	if (LA.slots == NULL) {
+		if ((LA.slots = nni_zalloc(sizeof(log_slot) * size)) == NULL) {
+			nni_mtx_unlock(&log_async_lk);
+			return (NNG_ENOMEM);
+		}
+		LA.size = size;
+		LA.tail = 0;
+		nni_atomic_init64(&LA.head);
+		for (size_t i = 0; i < size; i++) {
+			nni_atomic_init64(&LA.slots[i].seq);
+			nni_atomic_set64(&LA.slots[i].seq, i);
+		}
+		nni_mtx_init(&LA.mtx);
+		nni_cv_init(&LA.cv, &LA.mtx);
+	}
+	LA.stop = false;
+	if ((rv = nni_thr_init(&LA.thr, log_async_thr, NULL)) != 0) {
+		nni_mtx_unlock(&log_async_lk);
+		return (rv);
+	}
+	LA.running = true;
+	nni_atomic_set_bool(&LA.on, true);
+	nni_thr_run(&LA.thr);
+	nni_mtx_unlock(&log_async_lk);
+	return (0);
+}
+
+void
+log_async_stop(void)
+{
+	nni_mtx_lock(&log_async_lk);
+	if (!LA.running) {
+		nni_mtx_unlock(&log_async_lk);
+		return;
+	}
+	nni_atomic_set_bool(&LA.on, false);
+	// Threads that saw the ring on may still be claiming or filling
+	// in slots; wait for head to settle before telling the writer.
+	while (nni_atomic_get(&LA.busy) != 0) {
+		nni_msleep(1);
+	}
+	nni_mtx_lock(&LA.mtx);
+	LA.stop = true;
+	nni_cv_wake(&LA.cv);
+	nni_mtx_unlock(&LA.mtx);
+	nni_thr_fini(&LA.thr);
+	// The writer drains before it exits, but anything it did not get
+	// to is ours now.
+	(void) log_async_drain();
+	log_async_report();
+	LA.running = false;
+	nni_mtx_unlock(&log_async_lk);
+}
+
+uint64_t
+log_async_dropped(void)
+{
+	return (nni_atomic_get64(&LA.dropped));
+}
+
 static void
 init_event(log_event *ev, void *udata, conf_log *config)
 {
@@ -471,7 +931,10 @@ log_log(int level, const char *file, int line, const char *func,
 		if (level <= cb->level) {
 			init_event(&ev, cb->udata, cb->config);
 			va_start(ev.ap, fmt);
-			if (cb->mtx == NULL) {
+			if (log_async_sink(cb) && log_async_enter()) {
+				log_async_push(cb, &ev);
+				log_async_exit();
+			} else if (cb->mtx == NULL) {
 				cb->fn(&ev);
 			} else {
 				nng_mtx_lock(cb->mtx);
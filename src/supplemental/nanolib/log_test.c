@@ -0,0 +1,136 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include "core/nng_impl.h"
+#include "nng/supplemental/nanolib/log.h"
+
+#include <nuts.h>
+
+#define LOG_THREADS 16
+#define LOG_RECORDS 5000 // per thread
+
+static void
+log_bench_thr(void *arg)
+{
+	NNI_ARG_UNUSED(arg);
+	for (int i = 0; i < LOG_RECORDS; i++) {
+		log_log(NNG_LOG_INFO, __FILE__, __LINE__, __func__,
+		    "record %d of %d, some payload to make it look real", i,
+		    LOG_RECORDS);
+	}
+}
+
+// log_bench logs from LOG_THREADS threads at once, and returns the
+// number of records that reached the file per second.  The clock keeps
+// running until the async writer has been stopped, so both modes are
+// timed up to the point where their records are on disk, and records
+// the async ring dropped are not counted.
+static double
+log_bench(bool async)
+{
+	nni_thr  thrs[LOG_THREADS];
+	nni_time start;
+	nni_time end;
+	uint64_t dropped = log_async_dropped();
+
+	for (int i = 0; i < LOG_THREADS; i++) {
+		NUTS_PASS(nni_thr_init(&thrs[i], log_bench_thr, NULL));
+	}
+	start = nni_clock();
+	if (async) {
+		NUTS_PASS(log_async_start(8192));
+		NUTS_FAIL(log_async_start(0), NNG_EBUSY);
+	}
+	for (int i = 0; i < LOG_THREADS; i++) {
+		nni_thr_run(&thrs[i]);
+	}
+	for (int i = 0; i < LOG_THREADS; i++) {
+		nni_thr_fini(&thrs[i]);
+	}
+	if (async) {
+		log_async_stop();
+	}
+	end     = nni_clock();
+	dropped = log_async_dropped() - dropped;
+	return ((LOG_THREADS * LOG_RECORDS - dropped) * 1000.0 /
+	    (end > start ? end - start : 1));
+}
+
+static size_t
+log_count(const char *path)
+{
+	char  *data;
+	size_t len;
+	size_t n = 0;
+
+	NUTS_PASS(nni_plat_file_get(path, (void **) &data, &len));
+	for (size_t i = 0; i + 7 < len; i++) {
+		if (memcmp(data + i, "record ", 7) == 0) {
+			n++;
+		}
+	}
+	nni_free(data, len);
+	return (n);
+}
+
+static void
+test_log_async(void)
+{
+	conf_log config;
+	nng_mtx *mtx;
+	char    *tmp;
+	double   sync_rate;
+	double   async_rate;
+	uint64_t dropped;
+
+	NUTS_PASS(nni_init());
+	NUTS_ASSERT((tmp = nni_plat_temp_dir()) != NULL);
+	memset(&config, 0, sizeof(config));
+	config.type           = LOG_TO_FILE;
+	config.level          = NNG_LOG_INFO;
+	config.dir            = tmp;
+	config.file           = "nng_log_test.log";
+	config.rotation_sz    = (uint64_t) 1 << 40;
+	config.rotation_count = 1;
+	NUTS_ASSERT(
+	    (config.abs_path = nni_plat_join_dir(tmp, config.file)) != NULL);
+	(void) nni_plat_file_delete(config.abs_path);
+
+	NUTS_PASS(nng_mtx_alloc(&mtx));
+	log_clear_callback();
+	NUTS_TRUE(log_add_fp(NULL, NNG_LOG_INFO, mtx, &config) == 0);
+
+	sync_rate = log_bench(false);
+	NUTS_TRUE(log_count(config.abs_path) == LOG_THREADS * LOG_RECORDS);
+
+	async_rate = log_bench(true);
+	dropped    = log_async_dropped();
+
+	// Everything that was not reported dropped made it to the file.
+	NUTS_TRUE(log_count(config.abs_path) + dropped ==
+	    2 * LOG_THREADS * LOG_RECORDS);
+	printf("%d threads: %.0f sync, %.0f async records written/s, %llu "
+	       "dropped\n",
+	    LOG_THREADS, sync_rate, async_rate, (unsigned long long) dropped);
+
+	log_clear_callback();
+	if (config.fp != NULL) {
+		fclose(config.fp);
+	}
+	(void) nni_plat_file_delete(config.abs_path);
+	nni_strfree(config.abs_path);
+	nni_strfree(tmp);
+	nng_mtx_free(mtx);
+	nng_fini();
+}
+
+NUTS_TESTS = {
+	{ "log async", test_log_async },
+	{ NULL, NULL },
+};
@@ -21,23 +21,38 @@
 #define ROUND_ROBIN
 // #define RANDOM
 
+// Retired vectors and nodes are freed in batches of this size, once no
+// reader can still be looking at them.
+#ifndef DBTREE_RETIRE_BATCH
+#define DBTREE_RETIRE_BATCH 256
+#endif
+
 static size_t acnt;
 
 typedef struct dbtree_node dbtree_node;
 
+// Lookups do not take any lock.  The child and clients vectors of a node
+// are never changed in place once published: writers, serialized by
+// wlock, build a modified copy, publish it with an atomic store and retire
+// the old one.  Retired vectors, and nodes unlinked from the tree, are
+// only freed after a grace period, i.e. once every lookup that started
+// before they were unlinked has finished.  Wildcard children ("#" and "+")
+// sit in front of the literal children, which are sorted by topic.
 struct dbtree_node {
-	char    *topic;
-	int      plus;
-	int      well;
-	nng_msg *retain;
-	cvector(uint32_t) clients;
-	cvector(dbtree_node *) child;
-	nni_rwlock rwlock;
+	char          *topic;
+	nng_msg       *retain;
+	nni_atomic_ptr clients; // cvector(uint32_t)
+	nni_atomic_ptr child;   // cvector(dbtree_node *)
 };
 
 struct dbtree {
-	dbtree_node *root;
-	nni_rwlock   rwlock;
+	dbtree_node   *root;
+	nni_mtx        wlock;  // serializes writers
+	nni_rwlock     rwlock; // protects retained messages
+	nni_atomic_int phase;
+	nni_atomic_int readers[2];
+	cvector(void *) retired_vecs;
+	cvector(dbtree_node *) retired_nodes;
 };
 
 /**
@@ -180,6 +195,339 @@ topic_queue_free(char **topic_queue)
 	}
 }
 
+/**
+ * @brief is_well - Determine if the current topic is "#"
+ * @param topic_data - topic in one level
+ * @return true, if curr topic is "#"
+ */
+static bool
+is_well(char *topic_data)
+{
+	if (topic_data == NULL) {
+		return false;
+	}
+	return !strcmp(topic_data, "#");
+}
+
+/**
+ * @brief is_plus - Determine if the current topic is "+"
+ * @param topic_data - topic in one level
+ * @return true, if curr topic is "+"
+ */
+static bool
+is_plus(char *topic_data)
+{
+	if (topic_data == NULL) {
+		return false;
+	}
+	return !strcmp(topic_data, "+");
+}
+
+static inline dbtree_node **
+node_child(dbtree_node *node)
+{
+	return (nni_atomic_get_ptr(&node->child));
+}
+
+static inline uint32_t *
+node_clients(dbtree_node *node)
+{
+	return (nni_atomic_get_ptr(&node->clients));
+}
+
+// cvector_size() evaluates its argument twice, so the vectors must be
+// loaded once before being handed to it; a second load can observe a
+// different, or NULL, vector.
+static inline bool
+node_has_child(dbtree_node *node)
+{
+	dbtree_node **child = node_child(node);
+	return (!cvector_empty(child));
+}
+
+static inline bool
+node_has_clients(dbtree_node *node)
+{
+	uint32_t *clients = node_clients(node);
+	return (!cvector_empty(clients));
+}
+
+/**
+ * @brief db_read_enter - Start a lookup. Nothing retired after this
+ * returns is freed before the matching db_read_leave.
+ * @param db - dbtree
+ * @return phase to pass to db_read_leave
+ */
+static int
+db_read_enter(dbtree *db)
+{
+	int phase;
+
+	for (;;) {
+		phase = nni_atomic_get(&db->phase);
+		nni_atomic_inc(&db->readers[phase]);
+		// If a writer flipped the phase meanwhile it may not wait
+		// for us, so register again in the new phase.
+		if (nni_atomic_get(&db->phase) == phase) {
+			return phase;
+		}
+		nni_atomic_dec(&db->readers[phase]);
+	}
+}
+
+static void
+db_read_leave(dbtree *db, int phase)
+{
+	nni_atomic_dec(&db->readers[phase]);
+}
+
+/**
+ * @brief db_synchronize - Wait until all lookups that started before the
+ * call have finished. Called with wlock held.
+ * @param db - dbtree
+ * @return void
+ */
+static void
+db_synchronize(dbtree *db)
+{
+	int phase = nni_atomic_get(&db->phase);
+
+	nni_atomic_set(&db->phase, phase ^ 1);
+	for (int spin = 0; nni_atomic_get(&db->readers[phase]) != 0; spin++) {
+		if (spin > 1000) {
+			nni_msleep(1);
+		}
+	}
+}
+
+/**
+ * @brief dbtree_node_free - Free a node memory
+ * @param node - dbtree_node *
+ * @return void
+ */
+static void
+dbtree_node_free(dbtree_node *node)
+{
+	if (node) {
+		if (node->topic) {
+			log_debug("Delete node: [%s]", node->topic);
+			free(node->topic);
+			node->topic = NULL;
+		}
+		dbtree_node **child   = node_child(node);
+		uint32_t     *clients = node_clients(node);
+		cvector_free(child);
+		cvector_free(clients);
+		free(node);
+		node = NULL;
+	}
+}
+
+/**
+ * @brief db_reclaim - Free everything retired so far, after a grace period.
+ * @param db - dbtree
+ * @return void
+ */
+static void
+db_reclaim(dbtree *db)
+{
+	if (cvector_empty(db->retired_vecs) &&
+	    cvector_empty(db->retired_nodes)) {
+		return;
+	}
+	db_synchronize(db);
+	for (size_t i = 0; i < cvector_size(db->retired_vecs); i++) {
+		cvector_free(db->retired_vecs[i]);
+	}
+	for (size_t i = 0; i < cvector_size(db->retired_nodes); i++) {
+		dbtree_node_free(db->retired_nodes[i]);
+	}
+	cvector_set_size(db->retired_vecs, 0);
+	cvector_set_size(db->retired_nodes, 0);
+}
+
+static void
+db_retire_check(dbtree *db)
+{
+	if (cvector_size(db->retired_vecs) + cvector_size(db->retired_nodes) >=
+	    DBTREE_RETIRE_BATCH) {
+		db_reclaim(db);
+	}
+}
+
+static void
+db_retire_vec(dbtree *db, void *vec)
+{
+	if (vec != NULL) {
+		cvector_push_back(db->retired_vecs, vec);
+		db_retire_check(db);
+	}
+}
+
+static void
+db_retire_node(dbtree *db, dbtree_node *node)
+{
+	cvector_push_back(db->retired_nodes, node);
+	db_retire_check(db);
+}
+
+/**
+ * @brief vec_insert - Copy of a cvector with e inserted at index i.
+ * @param vec - original vector, left untouched
+ * @param esz - element size
+ * @param i - index
+ * @param e - pointer to the element
+ * @return new vector
+ */
+static void *
+vec_insert(void *vec, size_t esz, size_t i, const void *e)
+{
+	size_t   n = cvector_size(vec);
+	size_t  *p = malloc(sizeof(size_t) * 2 + (n + 1) * esz);
+	uint8_t *v;
+
+	assert(p);
+	p[0] = n + 1; // size
+	p[1] = n + 1; // capacity
+	v    = (uint8_t *) &p[2];
+	if (i > 0) {
+		memcpy(v, vec, i * esz);
+	}
+	memcpy(v + i * esz, e, esz);
+	if (n > i) {
+		memcpy(v + (i + 1) * esz, (uint8_t *) vec + i * esz,
+		    (n - i) * esz);
+	}
+	return (v);
+}
+
+/**
+ * @brief vec_erase - Copy of a cvector without the element at index i.
+ * @param vec - original vector, left untouched
+ * @param esz - element size
+ * @param i - index
+ * @return new vector, NULL if it would be empty
+ */
+static void *
+vec_erase(void *vec, size_t esz, size_t i)
+{
+	size_t   n = cvector_size(vec);
+	size_t  *p;
+	uint8_t *v;
+
+	if (n <= 1) {
+		return (NULL);
+	}
+	p = malloc(sizeof(size_t) * 2 + (n - 1) * esz);
+	assert(p);
+	p[0] = n - 1;
+	p[1] = n - 1;
+	v    = (uint8_t *) &p[2];
+	if (i > 0) {
+		memcpy(v, vec, i * esz);
+	}
+	if (n > i + 1) {
+		memcpy(v + i * esz, (uint8_t *) vec + (i + 1) * esz,
+		    (n - i - 1) * esz);
+	}
+	return (v);
+}
+
+static void
+child_insert(dbtree *db, dbtree_node *node, size_t i, dbtree_node *new_node)
+{
+	dbtree_node **old = node_child(node);
+	nni_atomic_set_ptr(
+	    &node->child, vec_insert(old, sizeof(dbtree_node *), i, &new_node));
+	db_retire_vec(db, old);
+}
+
+static void
+child_erase(dbtree *db, dbtree_node *node, size_t i)
+{
+	dbtree_node **old = node_child(node);
+	nni_atomic_set_ptr(
+	    &node->child, vec_erase(old, sizeof(dbtree_node *), i));
+	db_retire_vec(db, old);
+}
+
+/**
+ * @brief skip_wildcard - To get left boundry of binary search
+ * @param child - child vector of a node
+ * @param well - returns the "#" child or NULL
+ * @param plus - returns the "+" child or NULL
+ * @return l - left boundry
+ */
+static int
+skip_wildcard(dbtree_node **child, dbtree_node **well, dbtree_node **plus)
+{
+	int l = 0;
+
+	*well = NULL;
+	*plus = NULL;
+	while ((size_t) l < cvector_size(child) && l < 2) {
+		if (is_well(child[l]->topic)) {
+			*well = child[l];
+		} else if (is_plus(child[l]->topic)) {
+			*plus = child[l];
+		} else {
+			break;
+		}
+		l++;
+	}
+
+	return l;
+}
+
+/**
+ * @brief find_literal - binary search a literal topic in a child vector.
+ * @param child - child vector of a node
+ * @param l - left boundry, as from skip_wildcard
+ * @param topic - topic in one level
+ * @param index - found index, or index to insert at
+ * @return dbtree_node we find or NULL
+ */
+static dbtree_node *
+find_literal(dbtree_node **child, int l, char *topic, size_t *index)
+{
+	if ((size_t) l >= cvector_size(child)) {
+		*index = cvector_size(child);
+		return NULL;
+	}
+	if (true == binary_search((void **) child, l, index, topic, node_cmp)) {
+		return child[*index];
+	}
+	return NULL;
+}
+
+/**
+ * @brief find_next - check if this topic is exist in this level.
+ * @param child - child vector of a node
+ * @param topic - topic in one level, may be a wildcard
+ * @param index - index of the child, or index to insert it at
+ * @return dbtree_node we find or NULL
+ */
+static dbtree_node *
+find_next(dbtree_node **child, char *topic, size_t *index)
+{
+	dbtree_node *well, *plus;
+	int          l = skip_wildcard(child, &well, &plus);
+
+	if (is_well(topic) || is_plus(topic)) {
+		// new wildcard children go in front
+		*index = 0;
+		for (int i = 0; i < l; i++) {
+			if (strcmp(child[i]->topic, topic) == 0) {
+				*index = i;
+				return child[i];
+			}
+		}
+		return NULL;
+	}
+
+	return find_literal(child, l, topic, index);
+}
+
 void ***
 dbtree_get_tree(dbtree *db, void *(*cb)(uint32_t pipe_id))
 {
@@ -187,7 +535,7 @@ dbtree_get_tree(dbtree *db, void *(*cb)(uint32_t pipe_id))
 		return NULL;
 	}
 
-	nni_rwlock_wrlock(&(db->rwlock));
+	nni_mtx_lock(&db->wlock);
 
 	dbtree_node *  node    = db->root;
 	dbtree_node ** nodes   = NULL;
@@ -198,13 +546,14 @@ dbtree_get_tree(dbtree *db, void *(*cb)(uint32_t pipe_id))
 	while (!cvector_empty(nodes)) {
 		dbtree_info **ret_line_ping = NULL;
 		for (size_t i = 0; i < cvector_size(nodes); i++) {
-			dbtree_info *vn = nni_zalloc(sizeof(dbtree_info));
-			vn->clients     = NULL;
+			dbtree_info  *vn      = nni_zalloc(sizeof(dbtree_info));
+			dbtree_node **child   = node_child(nodes[i]);
+			uint32_t     *clients = node_clients(nodes[i]);
+			vn->clients           = NULL;
 			if (cb) {
-				for (size_t j = 0;
-				     j < cvector_size(nodes[i]->clients);
+				for (size_t j = 0; j < cvector_size(clients);
 				     j++) {
-					void *val = cb(nodes[i]->clients[j]);
+					void *val = cb(clients[j]);
 					if (val) {
 						cvector_push_back(
 						    vn->clients, val);
@@ -215,10 +564,9 @@ dbtree_get_tree(dbtree *db, void *(*cb)(uint32_t pipe_id))
 			cvector_push_back(ret_line_ping, vn);
 
 			vn->topic   = nni_strdup(nodes[i]->topic);
-			vn->cld_cnt = cvector_size(nodes[i]->child);
+			vn->cld_cnt = cvector_size(child);
 			for (size_t j = 0; j < (size_t) vn->cld_cnt; j++) {
-				cvector_push_back(
-				    nodes_t, (nodes[i]->child)[j]);
+				cvector_push_back(nodes_t, child[j]);
 			}
 		}
 		cvector_push_back(ret, ret_line_ping);
@@ -227,13 +575,14 @@ dbtree_get_tree(dbtree *db, void *(*cb)(uint32_t pipe_id))
 
 		dbtree_info **ret_line_pang = NULL;
 		for (size_t i = 0; i < cvector_size(nodes_t); i++) {
-			dbtree_info *vn = nni_zalloc(sizeof(dbtree_info));
-			vn->clients     = NULL;
+			dbtree_info  *vn      = nni_zalloc(sizeof(dbtree_info));
+			dbtree_node **child   = node_child(nodes_t[i]);
+			uint32_t     *clients = node_clients(nodes_t[i]);
+			vn->clients           = NULL;
 			if (cb) {
-				for (size_t j = 0;
-				     j < cvector_size(nodes_t[i]->clients);
+				for (size_t j = 0; j < cvector_size(clients);
 				     j++) {
-					void *val = cb(nodes_t[i]->clients[j]);
+					void *val = cb(clients[j]);
 					if (val) {
 						cvector_push_back(
 						    vn->clients, val);
@@ -244,17 +593,16 @@ dbtree_get_tree(dbtree *db, void *(*cb)(uint32_t pipe_id))
 			cvector_push_back(ret_line_pang, vn);
 
 			vn->topic   = nni_strdup(nodes_t[i]->topic);
-			vn->cld_cnt = cvector_size(nodes_t[i]->child);
+			vn->cld_cnt = cvector_size(child);
 			for (size_t j = 0; j < (size_t) vn->cld_cnt; j++) {
-				cvector_push_back(
-				    nodes, (nodes_t[i]->child)[j]);
+				cvector_push_back(nodes, child[j]);
 			}
 		}
 		cvector_push_back(ret, ret_line_pang);
 		cvector_free(nodes_t);
 		nodes_t = NULL;
 	}
-	nni_rwlock_unlock(&(db->rwlock));
+	nni_mtx_unlock(&db->wlock);
 	return (void ***) ret;
 }
 
@@ -278,7 +626,7 @@ dbtree_print(dbtree *db)
 		return;
 	}
 
-	nni_rwlock_wrlock(&(db->rwlock));
+	nni_mtx_lock(&db->wlock);
 
 	dbtree_node *node = db->root;
 	dbtree_node **nodes = NULL;
@@ -289,12 +637,11 @@ dbtree_print(dbtree *db)
 	log_debug("___________PRINT_DB_TREE__________");
 	while (!cvector_empty(nodes)) {
 		for (size_t i = 0; i < cvector_size(nodes); i++) {
+			dbtree_node **child = node_child(nodes[i]);
 			log_debug(node_fmt, nodes[i]->topic);
 
-			for (size_t j = 0; j < cvector_size(nodes[i]->child);
-			     j++) {
-				cvector_push_back(
-				    nodes_t, (nodes[i]->child)[j]);
+			for (size_t j = 0; j < cvector_size(child); j++) {
+				cvector_push_back(nodes_t, child[j]);
 			}
 		}
 		log_debug("\n");
@@ -302,72 +649,22 @@ dbtree_print(dbtree *db)
 		nodes = NULL;
 
 		for (size_t i = 0; i < cvector_size(nodes_t); i++) {
+			dbtree_node **child = node_child(nodes_t[i]);
 			log_debug(node_fmt, nodes_t[i]->topic);
 
-			for (size_t j = 0; j < cvector_size(nodes_t[i]->child);
-			     j++) {
-				cvector_push_back(
-				    nodes, (nodes_t[i]->child)[j]);
+			for (size_t j = 0; j < cvector_size(child); j++) {
+				cvector_push_back(nodes, child[j]);
 			}
 		}
 		log_debug("\n");
 		cvector_free(nodes_t);
 		nodes_t = NULL;
 	}
-	nni_rwlock_unlock(&(db->rwlock));
+	nni_mtx_unlock(&db->wlock);
 	log_debug("___________PRINT_DB_TREE__________");
 }
 #endif
 
-/**
- * @brief skip_wildcard - To get left boundry of binary search
- * @param node - dbtree_node
- * @return l - left boundry
- */
-static int
-skip_wildcard(dbtree_node *node)
-{
-	int l = 0;
-	if (node->plus != -1) {
-		l++;
-	}
-	if (node->well != -1) {
-		l++;
-	}
-
-	return l;
-}
-
-/**
- * @brief find_next - check if this topic is exist in this level.
- * @param node - dbtree_node
- * @param equal - a return state value
- * @param topic_queue - topic queue
- * @param index - search index will be return
- * @return dbtree_node we find or original node
- */
-// TODO topic or topic queue
-// TODO return NULL if no find ?
-static dbtree_node *
-find_next(dbtree_node *node, bool *equal, char **topic_queue, size_t *index)
-{
-	if (node == NULL || node->child == NULL) {
-		return NULL;
-	}
-
-	cvector(dbtree_node *) t = node->child;
-
-	int l = skip_wildcard(node);
-
-	if (true ==
-	    binary_search((void **) t, l, index, *topic_queue, node_cmp)) {
-		*equal = true;
-		return t[*index];
-	}
-
-	return node;
-}
-
 /**
  * @brief dbtree_node_new - create a node
  * @param topic - topic
@@ -384,34 +681,27 @@ dbtree_node_new(char *topic)
 	node->topic = nni_strdup(topic);
 	log_debug("New node: [%s]", node->topic);
 
-	node->retain  = NULL;
-	node->child   = NULL;
-	node->clients = NULL;
-	node->well    = -1;
-	node->plus    = -1;
+	node->retain = NULL;
+	nni_atomic_set_ptr(&node->child, NULL);
+	nni_atomic_set_ptr(&node->clients, NULL);
 
-	nni_rwlock_init(&node->rwlock);
 	return node;
 }
 
 /**
- * @brief dbtree_node_free - Free a node memory
+ * @brief dbtree_node_free_all - Free a node and everything below it
  * @param node - dbtree_node *
  * @return void
  */
 static void
-dbtree_node_free(dbtree_node *node)
+dbtree_node_free_all(dbtree_node *node)
 {
-	if (node) {
-		if (node->topic) {
-			log_debug("Delete node: [%s]", node->topic);
-			free(node->topic);
-			node->topic = NULL;
-		}
-		nni_rwlock_fini(&node->rwlock);
-		free(node);
-		node = NULL;
+	dbtree_node **child = node_child(node);
+
+	for (size_t i = 0; i < cvector_size(child); i++) {
+		dbtree_node_free_all(child[i]);
 	}
+	dbtree_node_free(node);
 }
 
 /**
@@ -428,7 +718,11 @@ dbtree_create(dbtree **db)
 
 	dbtree_node *node = dbtree_node_new("\0");
 	(*db)->root       = node;
+	nni_mtx_init(&(*db)->wlock);
 	nni_rwlock_init(&(*db)->rwlock);
+	nni_atomic_init(&(*db)->phase);
+	nni_atomic_init(&(*db)->readers[0]);
+	nni_atomic_init(&(*db)->readers[1]);
 #ifdef RANDOM
 	srand(time(NULL));
 #endif
@@ -444,79 +738,51 @@ void
 dbtree_destory(dbtree *db)
 {
 	if (db) {
-		dbtree_node_free(db->root);
+		nni_mtx_lock(&db->wlock);
+		db_reclaim(db);
+		nni_mtx_unlock(&db->wlock);
+		cvector_free(db->retired_vecs);
+		cvector_free(db->retired_nodes);
+		dbtree_node_free_all(db->root);
+		nni_rwlock_fini(&db->rwlock);
+		nni_mtx_fini(&db->wlock);
 		free(db);
 		db = NULL;
 	}
-
-	// nni_rwlock_destroy(&(db->rwlock));
-	// nni_rwlock_destroy(&(db->rwlock_session));
 }
 
 /**
  * @brief insert_client_cb - insert a client on the right position
+ * @param db - dbtree
  * @param node - dbtree_node
  * @param pipe_id - pipe id
  * @return
  */
 static void *
-insert_client_cb(dbtree_node *node, void *pipe_id)
+insert_client_cb(dbtree *db, dbtree_node *node, void *pipe_id)
 {
-	nni_rwlock_wrlock(&(node->rwlock));
-	size_t index = 0;
+	uint32_t *clients = node_clients(node);
+	uint32_t  id      = *(uint32_t *) pipe_id;
+	size_t    index   = 0;
+
 	if (false ==
-	    binary_search_uint32(
-	        node->clients, 0, &index, *(uint32_t *) pipe_id, ids_cmp)) {
-		if (index == cvector_size(node->clients)) {
-			cvector_push_back(
-			    node->clients, *(uint32_t *) pipe_id);
-		} else {
-			cvector_insert(
-			    node->clients, index, *(uint32_t *) pipe_id);
-		}
+	    binary_search_uint32(clients, 0, &index, id, ids_cmp)) {
+		nni_atomic_set_ptr(&node->clients,
+		    vec_insert(clients, sizeof(uint32_t), index, &id));
+		db_retire_vec(db, clients);
 	}
-	nni_rwlock_unlock(&(node->rwlock));
 	return NULL;
 }
 
 /**
- * @brief is_plus - Determine if the current topic is "#"
- * @param topic_data - topic in one level
- * @return true, if curr topic is "#"
- */
-static bool
-is_well(char *topic_data)
-{
-	if (topic_data == NULL) {
-		return false;
-	}
-	return !strcmp(topic_data, "#");
-}
-
-/**
- * @brief is_plus - Determine if the current topic is "+"
- * @param topic_data - topic in one level
- * @return true, if curr topic is "+"
- */
-static bool
-is_plus(char *topic_data)
-{
-	// TODO
-	if (topic_data == NULL) {
-		return false;
-	}
-	return !strcmp(topic_data, "+");
-}
-
-/**
- * @brief dbtree_node_insert - insert node until topic_queue is NULL
+ * @brief dbtree_node_insert - find or insert nodes until topic_queue is NULL
+ * @param db - dbtree
  * @param node - dbtree_node
  * @param topic_queue - topic queue position
- * @param client - client info
- * @return void
+ * @return the node for the last level
  */
 static dbtree_node *
-dbtree_node_insert(dbtree_node *node, char **topic_queue)
+dbtree_node_insert(dbtree *db, dbtree_node *node, char **topic_queue)
 {
 	if (node == NULL || topic_queue == NULL) {
 		log_warn("node or topic_queue is NULL");
@@ -524,61 +790,14 @@ dbtree_node_insert(dbtree_node *node, char **topic_queue)
 	}
 
 	while (*topic_queue) {
-		dbtree_node *new_node = NULL;
-		if (is_well(*topic_queue)) {
-			if (node->well != -1) {
-				new_node = node->child[node->well];
-			} else {
-				if (node->plus == 0) {
-					node->plus = 1;
-				}
-
-				node->well = 0;
-				new_node   = dbtree_node_new(*topic_queue);
-				cvector_insert(node->child,
-				    (size_t) node->well, new_node);
-			}
-
-		} else if (is_plus(*topic_queue)) {
-			if (node->plus != -1) {
-				new_node = node->child[node->plus];
-			} else {
-				if (node->well == 0) {
-					node->well = 1;
-				}
-
-				node->plus = 0;
-				new_node   = dbtree_node_new(*topic_queue);
-				cvector_insert(node->child,
-				    (size_t) node->plus, new_node);
-			}
-		} else {
-			size_t l = skip_wildcard(node);
-			if (l == cvector_size(node->child)) {
-				new_node = dbtree_node_new(*topic_queue);
-				cvector_push_back(node->child, new_node);
-
-			} else {
-				size_t index = 0;
-				if (false ==
-				    binary_search((void **) node->child, l,
-				        &index, *topic_queue, node_cmp)) {
-					new_node =
-					    dbtree_node_new(*topic_queue);
-
-					//  TODO
-					if (index ==
-					    cvector_size(node->child)) {
-						cvector_push_back(
-						    node->child, new_node);
-					} else {
-						cvector_insert(node->child,
-						    index, new_node);
-					}
-				} else {
-					new_node = node->child[index];
-				}
-			}
+		size_t       index = 0;
+		dbtree_node *new_node =
+		    find_next(node_child(node), *topic_queue, &index);
+
+		if (new_node == NULL) {
+			// Fully built before it is published.
+			new_node = dbtree_node_new(*topic_queue);
+			child_insert(db, node, index, new_node);
 		}
 
 		topic_queue++;
@@ -600,7 +819,7 @@ dbtree_node_insert(dbtree_node *node, char **topic_queue)
  */
 static void *
 search_insert_node(dbtree *db, char *topic, void *args,
-    void *(*inserter)(dbtree_node *node, void *args))
+    void *(*inserter)(dbtree *db, dbtree_node *node, void *args))
 {
 	if (db == NULL || topic == NULL) {
 		log_warn("db or topic is NULL");
@@ -608,59 +827,13 @@ search_insert_node(dbtree *db, char *topic, void *args,
 	}
 
 	char **topic_queue = topic_parse(topic);
-	char **for_free    = topic_queue;
-
-	nni_rwlock_wrlock(&(db->rwlock));
-	dbtree_node *node = db->root;
-	// while dbtree is NULL, we will insert directly.
-
-	if (!(node->child && *node->child)) {
-		node = dbtree_node_insert(node, topic_queue);
-	} else {
 
-		while (*topic_queue && node->child && *node->child) {
-			dbtree_node *node_t = *node->child;
-			log_debug("topic is: %s, node->topic is: %s",
-			    *topic_queue, node_t->topic);
-			if (strcmp(node_t->topic, *topic_queue)) {
-				bool   equal = false;
-				size_t index = 0;
-
-				node_t = find_next(
-				    node, &equal, topic_queue, &index);
-				if (equal == false) {
-					/*
-					 ** If no node is matched with topic
-					 ** insert node until topic_queue
-					 ** is NULL
-					 */
-					log_debug("searching unequal");
-					node = dbtree_node_insert(
-					    node_t, topic_queue);
-					break;
-				}
-			}
+	nni_mtx_lock(&db->wlock);
+	dbtree_node *node = dbtree_node_insert(db, db->root, topic_queue);
+	void        *ret  = inserter(db, node, args);
+	nni_mtx_unlock(&db->wlock);
 
-			if (node_t->child && *node_t->child &&
-			    *(topic_queue + 1)) {
-				topic_queue++;
-				node = node_t;
-			} else if (*(topic_queue + 1) == NULL) {
-				log_debug("Search and insert client");
-				node = node_t;
-				break;
-			} else {
-				log_debug("Insert node and client");
-				node = dbtree_node_insert(
-				    node_t, topic_queue + 1);
-				break;
-			}
-		}
-	}
-
-	void *ret = inserter(node, args);
-	nni_rwlock_unlock(&(db->rwlock));
-	topic_queue_free(for_free);
+	topic_queue_free(topic_queue);
 	return ret;
 }
 
@@ -686,75 +859,70 @@ collect_clients(uint32_t **vec, dbtree_node **nodes, dbtree_node ***nodes_t,
 	// TODO insert sort for clients
 	while (!cvector_empty(nodes)) {
 		dbtree_node **node_t_ = cvector_end(nodes) - 1;
-		dbtree_node * node_t  = *node_t_;
+		dbtree_node  *node_t  = *node_t_;
+		dbtree_node **child;
+		dbtree_node  *well, *plus, *t;
+		uint32_t     *clients;
+		size_t        index = 0;
+		int           l;
+
 		cvector_pop_back(nodes);
 
-		if (node_t == NULL || node_t->child == NULL ||
-		    (*(node_t->child)) == NULL) {
+		if (node_t == NULL) {
+			continue;
+		}
+		child = node_child(node_t);
+		if (cvector_empty(child)) {
 			continue;
 		}
 
-		dbtree_node * t     = *node_t->child;
-		dbtree_node **child = node_t->child;
+		l = skip_wildcard(child, &well, &plus);
 
-		if (node_t->well != -1) {
-			if (!cvector_empty(child[node_t->well]->clients)) {
+		if (well != NULL) {
+			clients = node_clients(well);
+			if (!cvector_empty(clients)) {
 				log_debug("Find # tag");
-				cvector_push_back(
-				    vec, child[node_t->well]->clients);
+				cvector_push_back(vec, clients);
 			}
 		}
 
-		if (node_t->plus != -1) {
+		if (plus != NULL) {
 			if (*(topic_queue + 1) == NULL) {
 				log_debug("add + clients");
-				if (!cvector_empty(
-				        child[node_t->plus]->clients)) {
-					cvector_push_back(
-					    vec, child[node_t->plus]->clients);
+				clients = node_clients(plus);
+				if (!cvector_empty(clients)) {
+					cvector_push_back(vec, clients);
 				}
 
 			} else {
-				cvector_push_back(
-				    (*nodes_t), child[node_t->plus]);
-				log_debug("add node_t: %s",
-				    (*(cvector_end((*nodes_t)) - 1))->topic);
+				cvector_push_back((*nodes_t), plus);
+				log_debug("add node_t: %s", plus->topic);
 			}
 		}
 
-		bool equal = false;
-		if (strcmp(t->topic, *topic_queue)) {
-			size_t index = 0;
-			t = find_next(node_t, &equal, topic_queue, &index);
-		} else {
-			equal = true;
-		}
-
-		if (equal == true) {
+		if ((t = find_literal(child, l, *topic_queue, &index)) !=
+		    NULL) {
 			log_debug("Searching client: %s", t->topic);
 			if (*(topic_queue + 1) == NULL) {
-				if (!cvector_empty(t->clients)) {
-					log_debug(
-					    "Searching client: %s", t->topic);
-					cvector_push_back(vec, t->clients);
+				clients = node_clients(t);
+				if (!cvector_empty(clients)) {
+					cvector_push_back(vec, clients);
 				}
 
-				if (t->well != -1) {
-					t = t->child[t->well];
-					if (!cvector_empty(t->clients)) {
-						log_debug(
-						    "Searching client: %s",
-						    t->topic);
-						cvector_push_back(
-						    vec, t->clients);
+				// "a/#" also matches "a"
+				skip_wildcard(node_child(t), &well, &plus);
+				if (well != NULL) {
+					clients = node_clients(well);
+					if (!cvector_empty(clients)) {
+						log_debug("Searching client: %s",
+						    well->topic);
+						cvector_push_back(vec, clients);
 					}
 				}
 
 			} else {
-				log_debug("Searching client: %s", t->topic);
 				cvector_push_back((*nodes_t), t);
-				log_debug("add node_t: %s",
-				    (*(cvector_end((*nodes_t)) - 1))->topic);
+				log_debug("add node_t: %s", t->topic);
 			}
 		}
 	}
@@ -810,14 +978,14 @@ search_client(dbtree *db, char *topic)
 	char **   for_free    = topic_queue;
 	uint32_t *ret         = NULL;
 
-	nni_rwlock_rdlock(&(db->rwlock));
+	int phase = db_read_enter(db);
 
 	dbtree_node *node              = db->root;
 	cvector(uint32_t *) pipe_ids   = NULL;
 	cvector(dbtree_node *) nodes   = NULL;
 	cvector(dbtree_node *) nodes_t = NULL;
 
-	if (node->child && *node->child) {
+	if (node_has_child(node)) {
 		cvector_push_back(nodes, node);
 	}
 
@@ -835,7 +1003,7 @@ search_client(dbtree *db, char *topic)
 
 	ret = iterate_client(pipe_ids);
 
-	nni_rwlock_unlock(&(db->rwlock));
+	db_read_leave(db, phase);
 	topic_queue_free(for_free);
 	cvector_free(nodes);
 	cvector_free(nodes_t);
@@ -852,90 +1020,110 @@ dbtree_find_clients(dbtree *db, char *topic)
 
 /**
  * @brief delete_dbtree_client - delete dbtree client
+ * @param db - dbtree
  * @param node - dbtree_node
- * @param id - client id
  * @param pipe_id - pipe id
  * @return
  */
 static void *
-delete_dbtree_client(dbtree_node *node, uint32_t pipe_id)
+delete_dbtree_client(dbtree *db, dbtree_node *node, uint32_t pipe_id)
 {
-	size_t index = 0;
-	void * ctxt  = NULL;
+	uint32_t *clients = node_clients(node);
+	size_t    index   = 0;
+	void *    ctxt    = NULL;
 
-	nni_rwlock_wrlock(&(node->rwlock));
 	if (true ==
-	    binary_search_uint32(node->clients, 0, &index, pipe_id, ids_cmp)) {
-		cvector_erase(node->clients, (size_t) index);
-		print_client(node->clients);
-
-		if (cvector_empty(node->clients)) {
-			cvector_free(node->clients);
-			node->clients = NULL;
-		} else {
-			print_client(node->clients);
-		}
+	    binary_search_uint32(clients, 0, &index, pipe_id, ids_cmp)) {
+		nni_atomic_set_ptr(&node->clients,
+		    vec_erase(clients, sizeof(uint32_t), index));
+		db_retire_vec(db, clients);
+		print_client(node_clients(node));
 	} else {
 		log_debug("Not find pipe id: [%d]", pipe_id);
 		log_debug("node->topic: %s", node->topic);
-		for (size_t i = 0; i < cvector_size(node->clients); i++) {
-			log_debug(
-			    "node->clients[%ld]: [%ld]:", i, node->clients[i]);
+		for (size_t i = 0; i < cvector_size(clients); i++) {
+			log_debug("node->clients[%ld]: [%ld]:", i, clients[i]);
 		}
 	}
 
-	nni_rwlock_unlock(&(node->rwlock));
 	return ctxt;
 }
 
 /**
- * @brief delete_dbtree_node - delete dbtree node
- * @param dbtree - dbtree_node
+ * @brief delete_dbtree_node - unlink child index of node if it became
+ * useless
+ * @param db - dbtree
+ * @param node - dbtree_node
  * @param index - index
- * @return
+ * @return true if the child was removed
  */
-static int
-delete_dbtree_node(dbtree_node *node, size_t index)
+static bool
+delete_dbtree_node(dbtree *db, dbtree_node *node, size_t index)
 {
-	nni_rwlock_wrlock(&(node->rwlock));
-	dbtree_node *node_t = node->child[index];
-	// TODO plus && well
+	dbtree_node *node_t = node_child(node)[index];
 
-	if (cvector_empty(node_t->child) && cvector_empty(node_t->clients)) {
+	if (!node_has_child(node_t) && !node_has_clients(node_t) &&
+	    node_t->retain == NULL) {
 		log_debug("Delete node: [%s]", node_t->topic);
-		cvector_free(node_t->child);
-		cvector_free(node_t->clients);
-		cvector_erase(node->child, index);
-		dbtree_node_free(node_t);
-		node_t = NULL;
-		if (index == 0) {
-			if (node->plus >= 0) {
-				node->plus--;
-			}
+		child_erase(db, node, index);
+		db_retire_node(db, node_t);
+		return true;
+	}
 
-			if (node->well >= 0) {
-				node->well--;
-			}
-		}
+	return false;
+}
 
-		if (index == 1) {
-			if (node->plus == 1) {
-				node->plus = -1;
-			}
+/**
+ * @brief search_node_path - find the node of topic, recording the path
+ * @param db - dbtree
+ * @param topic_queue - topic queue
+ * @param node_buf - parents along the path
+ * @param vec - child index taken at each parent
+ * @return the node of topic, or NULL
+ */
+static dbtree_node *
+search_node_path(
+    dbtree *db, char **topic_queue, dbtree_node ***node_buf, size_t **vec)
+{
+	dbtree_node *node = db->root;
 
-			if (node->well == 1) {
-				node->well = -1;
-			}
+	while (*topic_queue) {
+		size_t       index = 0;
+		dbtree_node *node_t =
+		    find_next(node_child(node), *topic_queue, &index);
+		if (node_t == NULL) {
+			log_debug("searching unequal");
+			return NULL;
 		}
+		cvector_push_back((*node_buf), node);
+		cvector_push_back((*vec), index);
+		node = node_t;
+		topic_queue++;
 	}
 
-	if (cvector_empty(node->child)) {
-		cvector_free(node->child);
-		node->child = NULL;
-	}
+	return node;
+}
 
-	nni_rwlock_unlock(&(node->rwlock));
-	return 0;
+/**
+ * @brief delete_node_path - remove nodes along the path that became useless
+ * @param db - dbtree
+ * @param node_buf - parents along the path
+ * @param vec - child index taken at each parent
+ * @return void
+ */
+static void
+delete_node_path(dbtree *db, dbtree_node **node_buf, size_t *vec)
+{
+	while (!cvector_empty(node_buf) && !cvector_empty(vec)) {
+		dbtree_node *t = *(cvector_end(node_buf) - 1);
+		size_t       i = *(cvector_end(vec) - 1);
+		cvector_pop_back(node_buf);
+		cvector_pop_back(vec);
+
+		if (!delete_dbtree_node(db, t, i)) {
+			break;
+		}
+	}
 }
 
 void *
@@ -946,98 +1134,41 @@ dbtree_delete_client(dbtree *db, char *topic, uint32_t pipe_id)
 		return NULL;
 	}
 
-	nni_rwlock_wrlock(&(db->rwlock));
-
 	char **       topic_queue = topic_parse(topic);
-	char **       for_free    = topic_queue;
-	dbtree_node * node        = db->root;
 	dbtree_node **node_buf    = NULL;
-	int *         vec         = NULL;
-	size_t        index       = 0;
-
-	while (*topic_queue && node->child && *node->child) {
-		index               = 0;
-		dbtree_node *node_t = *node->child;
-		log_debug("topic is: %s, node->topic is: %s", *topic_queue,
-		    node_t->topic);
-		if (strcmp(node_t->topic, *topic_queue)) {
-			bool equal = false;
-			if (is_well(*topic_queue) && (node->well != -1)) {
-				index = node->well;
-				equal = true;
-			}
-
-			if (is_plus(*topic_queue) && (node->plus != -1)) {
-				index = node->plus;
-				equal = true;
-			}
-
-			node_t = node->child[index];
-
-			if (equal == false) {
-				// TODO node_t or node->child[index], to
-				// determine if node_t is needed
-				node_t = find_next(
-				    node, &equal, topic_queue, &index);
-				if (equal == false) {
-					log_debug("searching unequal");
-					goto mem_free;
-				}
-			}
-		}
-
-		if (node_t->child && *node_t->child && *(topic_queue + 1)) {
-			topic_queue++;
-			cvector_push_back(node_buf, node);
-			cvector_push_back(vec, index);
-			node = node_t;
-
-		} else if (*(topic_queue + 1) == NULL) {
-			log_debug("Search and delete client");
-			log_debug("node->topic: %s", node->topic);
-			break;
-		} else {
-			log_debug("No node and client need to be delete");
-			goto mem_free;
-		}
-	}
+	size_t *      vec         = NULL;
+	dbtree_node * node;
 
-	if (node->child) {
-		delete_dbtree_client(node->child[index], pipe_id);
-		delete_dbtree_node(node, index);
-	}
+	nni_mtx_lock(&db->wlock);
 
-	while (!cvector_empty(node_buf) && !cvector_empty(vec)) {
-		dbtree_node *t = *(cvector_end(node_buf) - 1);
-		int          i = *(cvector_end(vec) - 1);
-		cvector_pop_back(node_buf);
-		cvector_pop_back(vec);
-
-		delete_dbtree_node(t, i);
+	node = search_node_path(db, topic_queue, &node_buf, &vec);
+	if (node != NULL) {
+		log_debug("Search and delete client");
+		delete_dbtree_client(db, node, pipe_id);
+		delete_node_path(db, node_buf, vec);
 	}
 
-mem_free:
+	nni_mtx_unlock(&db->wlock);
 	cvector_free(node_buf);
-	topic_queue_free(for_free);
 	cvector_free(vec);
-	nni_rwlock_unlock(&(db->rwlock));
+	topic_queue_free(topic_queue);
 
 	return NULL;
 }
 
 static void *
-insert_dbtree_retain(dbtree_node *node, void *args)
+insert_dbtree_retain(dbtree *db, dbtree_node *node, void *args)
 {
 	nng_msg *retain = (nng_msg *) args;
-	void *             ret    = NULL;
-	nni_rwlock_wrlock(&(node->rwlock));
+	void *   ret    = NULL;
+
+	nni_rwlock_wrlock(&db->rwlock);
 	if (node->retain != NULL) {
 		ret = node->retain;
 	}
 
 	node->retain = retain;
-
-	nni_rwlock_unlock(&(node->rwlock));
+	nni_rwlock_unlock(&db->rwlock);
 
 	return ret;
 }
@@ -1056,15 +1187,14 @@ collect_retain_well(void **vec, dbtree_node *node)
 	cvector_push_back(nodes, node);
 	while (!cvector_empty(nodes)) {
 		for (size_t i = 0; i < cvector_size(nodes); i++) {
+			dbtree_node **child = node_child(nodes[i]);
 			if (nodes[i]->retain) {
 				nng_msg_clone(nodes[i]->retain);
 				cvector_push_back(vec, nodes[i]->retain);
 			}
 
-			for (size_t j = 0; j < cvector_size(nodes[i]->child);
-			     j++) {
-				cvector_push_back(
-				    nodes_t, (nodes[i]->child)[j]);
+			for (size_t j = 0; j < cvector_size(child); j++) {
+				cvector_push_back(nodes_t, child[j]);
 			}
 		}
 
@@ -1072,15 +1202,14 @@ collect_retain_well(void **vec, dbtree_node *node)
 		nodes = NULL;
 
 		for (size_t i = 0; i < cvector_size(nodes_t); i++) {
+			dbtree_node **child = node_child(nodes_t[i]);
 			if (nodes_t[i]->retain) {
 				nng_msg_clone(nodes_t[i]->retain);
 				cvector_push_back(vec, nodes_t[i]->retain);
 			}
 
-			for (size_t j = 0; j < cvector_size(nodes_t[i]->child);
-			     j++) {
-				cvector_push_back(
-				    nodes, (nodes_t[i]->child)[j]);
+			for (size_t j = 0; j < cvector_size(child); j++) {
+				cvector_push_back(nodes, child[j]);
 			}
 		}
 		cvector_free(nodes_t);
@@ -1106,15 +1235,16 @@ collect_retains(void **vec, dbtree_node **nodes,
 	while (!cvector_empty(nodes)) {
 		dbtree_node **node_t_ = cvector_end(nodes) - 1;
 		dbtree_node * node_t  = *node_t_;
+		dbtree_node **child;
 		cvector_pop_back(nodes);
 
-		if (node_t == NULL || node_t->child == NULL ||
-		    (*(node_t->child)) == NULL) {
+		if (node_t == NULL) {
+			continue;
+		}
+		child = node_child(node_t);
+		if (cvector_empty(child)) {
 			continue;
 		}
-
-		dbtree_node * t     = *node_t->child;
-		dbtree_node **child = node_t->child;
 
 		if (is_well(*topic_queue)) {
 			vec = (void **)collect_retain_well(vec, node_t);
@@ -1142,18 +1272,12 @@ collect_retains(void **vec, dbtree_node **nodes,
 			}
 
 		} else {
-			bool equal = false;
-
-			if (strcmp(t->topic, *topic_queue)) {
-				size_t index = 0;
-				t            = find_next(
-                                    node_t, &equal, topic_queue, &index);
-
-			} else {
-				equal = true;
-			}
+			dbtree_node *well, *plus, *t;
+			size_t       index = 0;
+			int          l     = skip_wildcard(child, &well, &plus);
 
-			if (equal == true) {
+			if ((t = find_literal(child, l, *topic_queue,
+			         &index)) != NULL) {
 				log_debug(
 				    "Searching client: %s", node_t->topic);
 				if (*(topic_queue + 1) == NULL) {
@@ -1169,9 +1293,6 @@ collect_retains(void **vec, dbtree_node **nodes,
 					log_debug(
 					    "Searching client: %s", t->topic);
 					cvector_push_back((*nodes_t), t);
-					log_debug("add node_t: %s",
-					    (*(cvector_end((*nodes_t)) - 1))
-					        ->topic);
 				}
 			}
 		}
@@ -1190,14 +1311,17 @@ dbtree_find_retain(dbtree *db, char *topic)
 	}
 	char **topic_queue = topic_parse(topic);
 	char **for_free    = topic_queue;
-	nni_rwlock_rdlock(&(db->rwlock));
+	// The read section keeps the nodes alive, the lock keeps the
+	// retained messages from being freed under us.
+	int phase = db_read_enter(db);
+	nni_rwlock_rdlock(&db->rwlock);
 
 	dbtree_node *node              = db->root;
 	cvector(nng_msg *) rets        = NULL;
 	cvector(dbtree_node *) nodes   = NULL;
 	cvector(dbtree_node *) nodes_t = NULL;
 
-	if (node->child && *node->child) {
+	if (node_has_child(node)) {
 		cvector_push_back(nodes, node);
 	}
 
@@ -1212,7 +1336,8 @@ dbtree_find_retain(dbtree *db, char *topic)
 		topic_queue++;
 	}
 
-	nni_rwlock_unlock(&(db->rwlock));
+	nni_rwlock_unlock(&db->rwlock);
+	db_read_leave(db, phase);
 
 	topic_queue_free(for_free);
 	cvector_free(nodes);
@@ -1221,22 +1346,6 @@ dbtree_find_retain(dbtree *db, char *topic)
 	return rets;
 }
 
-static void *
-delete_dbtree_retain(dbtree_node *node)
-{
-	if (node == NULL) {
-		log_debug("node is NULL");
-		return NULL;
-	}
-	void *retain = NULL;
-	if (node) {
-		retain       = node->retain;
-		node->retain = NULL;
-	}
-
-	return retain;
-}
-
 nng_msg *
 dbtree_delete_retain(dbtree *db, char *topic)
 {
@@ -1244,74 +1353,30 @@ dbtree_delete_retain(dbtree *db, char *topic)
 		log_debug("db or topic is NULL");
 		return NULL;
 	}
-	nni_rwlock_wrlock(&(db->rwlock));
 
 	char **       topic_queue = topic_parse(topic);
-	char **       for_free    = topic_queue;
-	dbtree_node * node        = db->root;
 	dbtree_node **node_buf    = NULL;
-	int *         vec         = NULL;
-	void *        ret         = NULL;
-	size_t        index       = 0;
-
-	while (*topic_queue && node->child && *node->child) {
-		index               = 0;
-		dbtree_node *node_t = *node->child;
-		log_debug("topic is: %s, node->topic is: %s", *topic_queue,
-		    node_t->topic);
-		if (strcmp(node_t->topic, *topic_queue)) {
-			bool equal = false;
-
-			// TODO node_t or node->child[index], to determine if
-			// node_t is needed
-			node_t = find_next(node, &equal, topic_queue, &index);
-			if (equal == false) {
-				log_debug("searching unequal");
-				goto mem_free;
-			}
-		}
-
-		if (node_t->child && *node_t->child && *(topic_queue + 1)) {
-			topic_queue++;
-			cvector_push_back(node_buf, node);
-			cvector_push_back(vec, index);
-			node = node_t;
+	size_t *      vec         = NULL;
+	dbtree_node * node;
+	void *        ret = NULL;
 
-		} else if (*(topic_queue + 1) == NULL) {
-			log_debug("Search and delete retain");
-			log_debug("node->topic: %s", node->topic);
-			break;
-		} else {
-			log_debug("No node and client need to be delete");
-			goto mem_free;
-		}
-	}
+	nni_mtx_lock(&db->wlock);
 
-	if (node->child) {
-		ret = delete_dbtree_retain(node->child[index]);
-		// print_client(node->child[index]->clients);
-		delete_dbtree_node(node, index);
-		// print_client(node->child[index]->clients);
-	}
-
-	// dbtree_print(dbtree);
-
-	while (!cvector_empty(node_buf) && !cvector_empty(vec)) {
-		dbtree_node *t = *(cvector_end(node_buf) - 1);
-		int          i = *(cvector_end(vec) - 1);
-		cvector_pop_back(node_buf);
-		cvector_pop_back(vec);
-
-		delete_dbtree_node(t, i);
-		// dbtree_print(dbtree);
+	node = search_node_path(db, topic_queue, &node_buf, &vec);
+	if (node != NULL) {
+		log_debug("Search and delete retain");
+		nni_rwlock_wrlock(&db->rwlock);
+		ret          = node->retain;
+		node->retain = NULL;
+		nni_rwlock_unlock(&db->rwlock);
+		delete_node_path(db, node_buf, vec);
 	}
 
-mem_free:
+	nni_mtx_unlock(&db->wlock);
 	cvector_free(node_buf);
-	topic_queue_free(for_free);
 	cvector_free(vec);
-	nni_rwlock_unlock(&(db->rwlock));
-	
+	topic_queue_free(topic_queue);
+
 	return ret;
 }
 
@@ -1361,26 +1426,27 @@ dbtree_find_shared_clients(dbtree *db, char *topic)
 	cvector(uint32_t *) ids        = NULL;
 	cvector(dbtree_node *) nodes_p = NULL;
 	cvector(dbtree_node *) nodes_q = NULL;
-	bool   equal                   = false;
-	char * t                       = "$share";
-	size_t index;
+	dbtree_node *well, *plus;
+	size_t       index;
 
-	nni_rwlock_rdlock(&(db->rwlock));
-	dbtree_node *node = db->root;
+	int          phase = db_read_enter(db);
+	dbtree_node *node  = db->root;
 	if (node == NULL) {
-		nni_rwlock_unlock(&(db->rwlock));
+		db_read_leave(db, phase);
 		return NULL;
 	}
 
 	// Get shared node
-	dbtree_node *shared = find_next(node, &equal, &t, &index);
+	dbtree_node **child  = node_child(node);
+	int           l      = skip_wildcard(child, &well, &plus);
+	dbtree_node  *shared = find_literal(child, l, "$share", &index);
 
-	if (equal == false || shared == NULL || shared->child == NULL) {
-		nni_rwlock_unlock(&(db->rwlock));
+	if (shared == NULL || !node_has_child(shared)) {
+		db_read_leave(db, phase);
 		return NULL;
 	}
 
-	dbtree_node **nlist = shared->child;
+	dbtree_node **nlist = node_child(shared);
 
 	char **topic_queue = topic_parse(topic);
 	char **for_free    = topic_queue;
@@ -1388,7 +1454,7 @@ dbtree_find_shared_clients(dbtree *db, char *topic)
 	// Push all shared child.
 	for (size_t i = 0; i < cvector_size(nlist); i++) {
 		dbtree_node *node = nlist[i];
-		if (node->child && *node->child) {
+		if (node_has_child(node)) {
 			cvector_push_back(nodes_p, node);
 		}
 	}
@@ -1406,7 +1472,7 @@ dbtree_find_shared_clients(dbtree *db, char *topic)
 	}
 
 	uint32_t *ret = iterate_shared_client(ids);
-	nni_rwlock_unlock(&(db->rwlock));
+	db_read_leave(db, phase);
 	topic_queue_free(for_free);
 	cvector_free(nodes_p);
 	cvector_free(nodes_q);
@@ -1,20 +1,27 @@
 #include <arrow/io/file.h>
+#include <parquet/page_index.h>
+#include <parquet/statistics.h>
 #include <parquet/stream_reader.h>
 #include <parquet/stream_writer.h>
 
+#include "nng/supplemental/nanolib/file_index.h"
 #include "nng/supplemental/nanolib/log.h"
 #include "nng/supplemental/nanolib/md5.h"
 #include "nng/supplemental/nanolib/parquet.h"
 #include "nng/supplemental/nanolib/queue.h"
+#include <algorithm>
 #include <assert.h>
 #include <atomic>
+#include <deque>
 #include <dirent.h>
 #include <fstream>
 #include <inttypes.h>
 #include <iostream>
 #include <string>
+#include <stdarg.h>
 #include <sys/stat.h>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 using parquet::ConvertedType;
@@ -37,13 +44,12 @@ atomic_bool is_available = false;
 	while (!is_available) \
 		nng_msleep(10);
 
-#define UINT64_MAX_DIGITS 20
-
-CircularQueue        parquet_queue;
 CircularQueue        parquet_file_queue;
 pthread_mutex_t      parquet_queue_mutex     = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t       parquet_queue_not_empty = PTHREAD_COND_INITIALIZER;
 static conf_parquet *g_conf                  = NULL;
+// Key ranges of the files in parquet_file_queue, for lookups
+static file_index *parquet_file_index = NULL;
 
 static bool
 directory_exists(const std::string &directory_path)
@@ -61,25 +67,37 @@ create_directory(const std::string &directory_path)
 	return (status == 0);
 }
 
+// Format a file name into a buffer of the size it needs, freed with free().
 static char *
-get_file_name(conf_parquet *conf, uint64_t key_start, uint64_t key_end)
+file_name_printf(const char *fmt, ...)
 {
-	char *file_name = NULL;
-	char *dir       = conf->dir;
-	char *prefix    = conf->file_name_prefix;
-
-	file_name = (char *) malloc(strlen(prefix) + strlen(dir) +
-	    UINT64_MAX_DIGITS + UINT64_MAX_DIGITS + 16);
-	if (file_name == NULL) {
+	va_list ap;
+	char   *file_name;
+	int     len;
+
+	va_start(ap, fmt);
+	len = vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+	if (len < 0 || (file_name = (char *) malloc(len + 1)) == NULL) {
 		log_error("Failed to allocate memory for file name.");
 		return NULL;
 	}
-
-	sprintf(file_name, "%s/%s-%" PRIu64 "~%" PRIu64 ".parquet", dir,
-	    prefix, key_start, key_end);
+	va_start(ap, fmt);
+	vsnprintf(file_name, len + 1, fmt, ap);
+	va_end(ap);
 	return file_name;
 }
 
+static char *
+get_file_name(conf_parquet *conf, uint64_t key_start, uint64_t key_end)
+{
+	// Writers of different topics may start at the same key
+	static atomic<uint32_t> seq(0);
+	return file_name_printf("%s/%s-%" PRIu64 "~%" PRIu64 ".%u.parquet",
+	    conf->dir, conf->file_name_prefix, key_start, key_end,
+	    (unsigned) seq++);
+}
+
 string
 gen_random(const int len)
 {
@@ -98,27 +116,28 @@ gen_random(const int len)
 static char *
 get_random_file_name(char *prefix, uint64_t key_start, uint64_t key_end)
 {
-	char *file_name = NULL;
-	char  dir[]     = "/tmp";
-
-	file_name = (char *) malloc(strlen(prefix) + strlen(dir) +
-	    UINT64_MAX_DIGITS + UINT64_MAX_DIGITS + 16);
-	if (file_name == NULL) {
-		log_error("Failed to allocate memory for file name.");
-		return NULL;
-	}
-
-	sprintf(file_name, "%s/%s-%" PRIu64 "~%" PRIu64 ".parquet", dir,
-	    prefix, key_start, key_end);
+	char *file_name = file_name_printf(
+	    "/tmp/%s-%" PRIu64 "~%" PRIu64 ".parquet", prefix, key_start,
+	    key_end);
 	log_error("file_name: %s", file_name);
 	return file_name;
 }
 
+static void
+parquet_file_enqueue(char *filename)
+{
+	ENQUEUE(parquet_file_queue, filename);
+	if (file_index_add(parquet_file_index, filename) != 0) {
+		log_warn("No key range in file name %s", filename);
+	}
+}
+
 static int
 remove_old_file(void)
 {
 	int   ret      = 0;
 	char *filename = (char *) DEQUEUE(parquet_file_queue);
+	file_index_remove(parquet_file_index, filename);
 	if (remove(filename) == 0) {
 		log_debug("File '%s' removed successfully.\n", filename);
 	} else {
@@ -180,11 +199,14 @@ parquet_object_alloc(uint64_t *keys, uint8_t **darray, uint32_t *dsize,
 	elem->ranges->range  = NULL;
 	elem->ranges->start  = 0;
 	elem->ranges->size   = 0;
+	elem->topic          = NULL;
 	return elem;
 }
 
-void
-parquet_object_free(parquet_object *elem)
+// Hand the ranges written so far back through the aio, finished with rv,
+// and free elem.
+static void
+parquet_object_finish(parquet_object *elem, int rv)
 {
 	if (elem) {
 		FREE_IF_NOT_NULL(elem->keys, elem->size);
@@ -195,34 +217,56 @@ parquet_object_free(parquet_object *elem)
 		*szp          = elem->size;
 		nng_aio_set_msg(elem->aio, (nng_msg *) szp);
 		log_debug("finish write aio");
-		DO_IT_IF_NOT_NULL(nng_aio_finish_sync, elem->aio, 0);
+		DO_IT_IF_NOT_NULL(nng_aio_finish_sync, elem->aio, rv);
 		FREE_IF_NOT_NULL(elem->darray, elem->size);
 		for (int i = 0; i < elem->ranges->size; i++) {
 			parquet_file_range_free(elem->ranges->range[i]);
 		}
 		free(elem->ranges->range);
 		delete elem->ranges;
+		nng_strfree(elem->topic);
 		delete elem;
 	}
 }
 
-int
-parquet_write_batch_async(parquet_object *elem)
+void
+parquet_object_free(parquet_object *elem)
 {
-	if (g_conf == NULL || g_conf->enable == false) {
-		log_error("Parquet is not ready or not launch!");
-		return -1;
-	}
-	elem->type = WRITE_TO_NORMAL;
+	parquet_object_finish(elem, 0);
+}
+
+struct parquet_topic_queue;
+static parquet_topic_queue *parquet_topic_get(const char *topic);
+static size_t parquet_topic_len(parquet_topic_queue *q);
+static void   parquet_topic_push(parquet_topic_queue *q, parquet_object *elem);
+
+// Queue elem behind the other objects of its topic.  If the topic already
+// has queue_limit objects waiting, elem is finished right away with
+// NNG_EAGAIN instead, so that a slow disk pushes back on the producer
+// rather than growing the queue without bound.
+static int
+parquet_enqueue(parquet_object *elem)
+{
+	const char *topic = elem->topic != NULL ? elem->topic : "";
+
 	log_debug("WAIT_FOR_AVAILABLE");
 	WAIT_FOR_AVAILABLE
 	log_debug("WAIT_FOR parquet_queue_mutex");
 	pthread_mutex_lock(&parquet_queue_mutex);
-	if (IS_EMPTY(parquet_queue)) {
-		pthread_cond_broadcast(&parquet_queue_not_empty);
-		log_debug("broadcast signal!");
+	parquet_topic_queue *q = parquet_topic_get(topic);
+	if (q == NULL) {
+		pthread_mutex_unlock(&parquet_queue_mutex);
+		parquet_object_finish(elem, NNG_ENOMEM);
+		return -1;
+	}
+	if (g_conf->queue_limit != 0 &&
+	    parquet_topic_len(q) >= g_conf->queue_limit) {
+		pthread_mutex_unlock(&parquet_queue_mutex);
+		log_warn("parquet queue of topic '%s' is full", topic);
+		parquet_object_finish(elem, NNG_EAGAIN);
+		return -1;
 	}
-	ENQUEUE(parquet_queue, elem);
+	parquet_topic_push(q, elem);
 	log_debug("enqueue element.");
 
 	pthread_mutex_unlock(&parquet_queue_mutex);
@@ -230,6 +274,17 @@ parquet_write_batch_async(parquet_object *elem)
 	return 0;
 }
 
+int
+parquet_write_batch_async(parquet_object *elem)
+{
+	if (g_conf == NULL || g_conf->enable == false) {
+		log_error("Parquet is not ready or not launch!");
+		return -1;
+	}
+	elem->type = WRITE_TO_NORMAL;
+	return parquet_enqueue(elem);
+}
+
 int
 parquet_write_batch_tmp_async(parquet_object *elem)
 {
@@ -238,19 +293,7 @@ parquet_write_batch_tmp_async(parquet_object *elem)
 		return -1;
 	}
 	elem->type = WRITE_TO_TEMP;
-	log_debug("WAIT_FOR_AVAILABLE");
-	WAIT_FOR_AVAILABLE
-	log_debug("WAIT_FOR parquet_queue_mutex");
-	pthread_mutex_lock(&parquet_queue_mutex);
-	if (IS_EMPTY(parquet_queue)) {
-		pthread_cond_broadcast(&parquet_queue_not_empty);
-	}
-	ENQUEUE(parquet_queue, elem);
-	log_debug("enqueue element.");
-
-	pthread_mutex_unlock(&parquet_queue_mutex);
-
-	return 0;
+	return parquet_enqueue(elem);
 }
 
 shared_ptr<parquet::FileEncryptionProperties>
@@ -274,18 +317,6 @@ parquet_set_encryption(conf_parquet *conf)
 	return encryption_configurations;
 }
 
-static int
-compute_new_index(parquet_object *obj, uint32_t index, uint32_t file_size)
-{
-	uint64_t size = 0;
-	uint32_t new_index;
-	for (new_index = index; size < file_size && new_index < obj->size - 1;
-	     new_index++) {
-		size += obj->dsize[new_index];
-	}
-	return new_index;
-}
-
 void
 update_parquet_file_ranges(
     conf_parquet *conf, parquet_object *elem, parquet_file_range *range)
@@ -306,346 +337,567 @@ update_parquet_file_ranges(
 	}
 }
 
-int
-parquet_write_tmp(
-    conf_parquet *conf, shared_ptr<GroupNode> schema, parquet_object *elem)
-{
-	uint32_t old_index = 0;
-	uint32_t new_index = 0;
-again:
-
-	new_index = compute_new_index(elem, old_index, conf->file_size);
-	uint64_t key_start = elem->keys[old_index];
-	uint64_t key_end   = elem->keys[new_index];
-
-	string prefix = gen_random(6);
-	prefix        = "nanomq" + prefix;
-	char *filename =
-	    get_random_file_name(prefix.data(), key_start, key_end);
-	if (filename == NULL) {
-		log_error("Failed to get file name");
-		parquet_object_free(elem);
-		return -1;
+// Default number of rows per row group when conf->row_group_size is 0.
+#define PARQUET_ROW_GROUP_SIZE 65536
+
+// Output stream that feeds everything written to the file into an MD5
+// context, so the digest is ready when the file is closed instead of
+// reading the whole file back.
+class md5_output_stream : public arrow::io::OutputStream {
+    public:
+	explicit md5_output_stream(shared_ptr<arrow::io::FileOutputStream> file)
+	    : file_(std::move(file))
+	{
+		MD5Init(&ctx_);
 	}
 
+	static arrow::Result<shared_ptr<md5_output_stream>>
+	Open(const char *filename)
 	{
-		parquet_file_range *range =
-		    parquet_file_range_alloc(old_index, new_index, filename);
-		update_parquet_file_ranges(conf, elem, range);
+		shared_ptr<arrow::io::FileOutputStream> file;
+		ARROW_ASSIGN_OR_RAISE(
+		    file, arrow::io::FileOutputStream::Open(filename));
+		return make_shared<md5_output_stream>(file);
+	}
 
-		// Create a ParquetFileWriter instance
-		parquet::WriterProperties::Builder builder;
-
-		builder.created_by("NanoMQ")
-		    ->version(parquet::ParquetVersion::PARQUET_2_6)
-		    ->data_page_version(parquet::ParquetDataPageVersion::V2)
-		    ->compression(static_cast<arrow::Compression::type>(
-		        conf->comp_type));
-
-		if (conf->encryption.enable) {
-			shared_ptr<parquet::FileEncryptionProperties>
-			    encryption_configurations;
-			encryption_configurations =
-			    parquet_set_encryption(conf);
-			builder.encryption(encryption_configurations);
-		}
+	arrow::Status
+	Close() override
+	{
+		return file_->Close();
+	}
 
-		shared_ptr<parquet::WriterProperties> props = builder.build();
-		using FileClass = arrow::io::FileOutputStream;
-		shared_ptr<FileClass> out_file;
-		PARQUET_ASSIGN_OR_THROW(out_file, FileClass::Open(filename));
-		std::shared_ptr<parquet::ParquetFileWriter> file_writer =
-		    parquet::ParquetFileWriter::Open(out_file, schema, props);
-
-		// Append a RowGroup with a specific number of rows.
-		parquet::RowGroupWriter *rg_writer =
-		    file_writer->AppendRowGroup();
-
-		// Write the Int64 column
-		parquet::Int64Writer *int64_writer =
-		    static_cast<parquet::Int64Writer *>(
-		        rg_writer->NextColumn());
-		for (uint32_t i = old_index; i <= new_index; i++) {
-			int64_t value            = elem->keys[i];
-			int16_t definition_level = 1;
-			int64_writer->WriteBatch(
-			    1, &definition_level, nullptr, &value);
+	bool
+	closed() const override
+	{
+		return file_->closed();
+	}
+
+	arrow::Result<int64_t>
+	Tell() const override
+	{
+		return file_->Tell();
+	}
+
+	arrow::Status
+	Flush() override
+	{
+		return file_->Flush();
+	}
+
+	using arrow::io::OutputStream::Write;
+	arrow::Status
+	Write(const void *data, int64_t nbytes) override
+	{
+		unsigned char *p    = (unsigned char *) data;
+		int64_t        left = nbytes;
+		while (left > 0) {
+			unsigned int n = left > UINT32_MAX ? UINT32_MAX : left;
+			MD5Update(&ctx_, p, n);
+			p += n;
+			left -= n;
 		}
+		return file_->Write(data, nbytes);
+	}
 
-		// Write the ByteArray column. Make every alternate values NULL
-		parquet::ByteArrayWriter *ba_writer =
-		    static_cast<parquet::ByteArrayWriter *>(
-		        rg_writer->NextColumn());
-		for (uint32_t i = old_index; i <= new_index; i++) {
-			parquet::ByteArray value;
-			int16_t            definition_level = 1;
-			value.ptr                           = elem->darray[i];
-			value.len                           = elem->dsize[i];
-			ba_writer->WriteBatch(
-			    1, &definition_level, nullptr, &value);
+	// md5_str must hold MD5_STR_LEN + 1 bytes.
+	void
+	digest(char *md5_str)
+	{
+		unsigned char md5_value[MD5_SIZE];
+		MD5Final(&ctx_, md5_value);
+		for (int i = 0; i < MD5_SIZE; i++) {
+			snprintf(md5_str + i * 2, 2 + 1, "%02x", md5_value[i]);
 		}
+	}
 
-		old_index = new_index;
+    private:
+	shared_ptr<arrow::io::FileOutputStream> file_;
+	MD5_CTX                                 ctx_;
+};
 
-		FREE_IF_NOT_NULL(filename, strlen(filename));
+static shared_ptr<parquet::WriterProperties>
+parquet_writer_properties(conf_parquet *conf)
+{
+	parquet::WriterProperties::Builder builder;
 
-		if (new_index != elem->size - 1)
-			goto again;
+	builder.created_by("NanoMQ")
+	    ->version(parquet::ParquetVersion::PARQUET_2_6)
+	    ->data_page_version(parquet::ParquetDataPageVersion::V2)
+	    ->enable_write_page_index()
+	    ->compression(
+	        static_cast<arrow::Compression::type>(conf->comp_type));
+
+	if (conf->encryption.enable) {
+		shared_ptr<parquet::FileEncryptionProperties>
+		    encryption_configurations;
+		encryption_configurations = parquet_set_encryption(conf);
+		builder.encryption(encryption_configurations);
 	}
 
-	parquet_object_free(elem);
-	return 0;
+	return builder.build();
 }
-char *
-compute_and_rename_file_withMD5(char *filename, conf_parquet *conf, char *topic)
+
+static uint32_t
+parquet_row_group_size(conf_parquet *conf)
 {
-	char md5_buffer[MD5_LEN + 1];
-	log_debug("compute md5");
-	int ret = ComputeFileMD5(filename, md5_buffer);
-	if (ret != 0) {
-		log_error("Failed to calculate md5sum");
-		ret = remove(filename);
-		if (ret != 0) {
-			log_error("Failed to remove file %s errno: %d",
-			    filename, errno);
-		}
+	return conf->row_group_size != 0 ? conf->row_group_size
+	                                 : PARQUET_ROW_GROUP_SIZE;
+}
 
-		free(filename);
-		return NULL;
-	}
+// Scratch space reused between column batches.
+struct parquet_column_buffer {
+	vector<int16_t>            def_levels;
+	vector<parquet::ByteArray> values;
+};
 
-	char *md5_file_name = (char *) malloc(
-	    strlen(filename) + strlen("_") + strlen(topic) + strlen("_") + strlen(md5_buffer) + 2);
-	if (md5_file_name == NULL) {
-		log_error("Failed to allocate memory for file name.");
-		ret = remove(filename);
-		if (ret != 0) {
-			log_error("Failed to remove file %s errno: %d",
-			    filename, errno);
-		}
+// Write rows [start, end) of elem to both columns of a buffered row group
+// with one WriteBatch call per column.
+static void
+parquet_write_columns(parquet::RowGroupWriter *rg, parquet_object *elem,
+    uint32_t start, uint32_t end, parquet_column_buffer *buf)
+{
+	uint32_t n = end - start;
 
-		free(filename);
-		return NULL;
+	buf->def_levels.assign(n, 1);
+	buf->values.resize(n);
+	for (uint32_t i = 0; i < n; i++) {
+		buf->values[i].ptr = elem->darray[start + i];
+		buf->values[i].len = elem->dsize[start + i];
 	}
 
-	strncpy(md5_file_name, filename,
-	    strlen(conf->dir) + strlen(conf->file_name_prefix) + 1);
-	md5_file_name[strlen(conf->dir) + strlen(conf->file_name_prefix) + 1] =
-	    '\0';
-
-	strcat(md5_file_name, "_");
-	strcat(md5_file_name, topic);
-	strcat(md5_file_name, "_");
-	strcat(md5_file_name, md5_buffer);
-	strcat(md5_file_name,
-	    filename + strlen(conf->dir) + strlen(conf->file_name_prefix) + 1);
-	log_info("trying to rename... %s to %s", filename, md5_file_name);
-	ret = rename(filename, md5_file_name);
-	if (ret != 0) {
-		log_error("Failed to rename file %s to %s errno: %d", filename,
-		    md5_file_name, errno);
-		ret = remove(filename);
-		if (ret != 0) {
-			log_error("Failed to remove file %s errno: %d",
-			    filename, errno);
-		}
+	parquet::Int64Writer *int64_writer =
+	    static_cast<parquet::Int64Writer *>(rg->column(0));
+	int64_writer->WriteBatch(n, buf->def_levels.data(), nullptr,
+	    reinterpret_cast<const int64_t *>(elem->keys + start));
 
-		free(filename);
-		free(md5_file_name);
-		return NULL;
-	}
+	parquet::ByteArrayWriter *ba_writer =
+	    static_cast<parquet::ByteArrayWriter *>(rg->column(1));
+	ba_writer->WriteBatch(
+	    n, buf->def_levels.data(), nullptr, buf->values.data());
+}
 
-	free(filename);
-	return md5_file_name;
+// Number of rows from start on that go into a file that already holds
+// used bytes, at least one.
+static uint32_t
+parquet_rows_fit(
+    parquet_object *elem, uint32_t start, uint64_t used, uint64_t file_size)
+{
+	uint32_t end = start;
+
+	do {
+		used += elem->dsize[end++];
+	} while (used < file_size && end < elem->size);
+
+	return end - start;
 }
 
 int
-parquet_write(
+parquet_write_tmp(
     conf_parquet *conf, shared_ptr<GroupNode> schema, parquet_object *elem)
 {
-	uint32_t old_index      = 0;
-	uint32_t new_index      = 0;
-	char    *last_file_name = NULL;
-again:
-
-	if (last_file_name != NULL) {
-		char *md5_file_name =
-		    compute_and_rename_file_withMD5(last_file_name, conf, elem->topic);
-		if (md5_file_name == nullptr) {
-			log_error("Failed to rename file with md5");
+	parquet_column_buffer buf;
+	uint32_t              rg_size = parquet_row_group_size(conf);
+	uint32_t              start   = 0;
+
+	while (start < elem->size) {
+		uint32_t n   = parquet_rows_fit(elem, start, 0, conf->file_size);
+		uint32_t end = start + n;
+
+		string prefix = gen_random(6);
+		prefix        = "nanomq" + prefix;
+		char *filename = get_random_file_name(
+		    prefix.data(), elem->keys[start], elem->keys[end - 1]);
+		if (filename == NULL) {
+			log_error("Failed to get file name");
 			parquet_object_free(elem);
 			return -1;
 		}
 
-		char md5_buffer[MD5_LEN + 1];
-		log_debug("compute md5 after rename");
-		int ret = ComputeFileMD5(md5_file_name, md5_buffer);
-		if (ret != 0) {
-			log_error("Failed to calculate md5sum");
+		try {
+			using FileClass = arrow::io::FileOutputStream;
+			shared_ptr<FileClass> out_file;
+			PARQUET_ASSIGN_OR_THROW(
+			    out_file, FileClass::Open(filename));
+			std::shared_ptr<parquet::ParquetFileWriter>
+			    file_writer = parquet::ParquetFileWriter::Open(
+			        out_file, schema, parquet_writer_properties(conf));
+
+			for (uint32_t i = start; i < end; i += rg_size) {
+				parquet::RowGroupWriter *rg =
+				    file_writer->AppendBufferedRowGroup();
+				parquet_write_columns(rg, elem, i,
+				    end - i > rg_size ? i + rg_size : end, &buf);
+				rg->Close();
+			}
+			file_writer->Close();
+			PARQUET_THROW_NOT_OK(out_file->Close());
+		} catch (const std::exception &e) {
+			log_error("Failed to write %s: %s", filename, e.what());
+			FREE_IF_NOT_NULL(filename, strlen(filename));
+			parquet_object_free(elem);
+			return -1;
 		}
-		log_debug("wait for parquet_queue_mutex");
-		pthread_mutex_lock(&parquet_queue_mutex);
-		ENQUEUE(parquet_file_queue, md5_file_name);
 
-		if (QUEUE_SIZE(parquet_file_queue) > conf->file_count) {
-			remove_old_file();
-		}
+		parquet_file_range *range =
+		    parquet_file_range_alloc(start, end - 1, filename);
+		update_parquet_file_ranges(conf, elem, range);
+		FREE_IF_NOT_NULL(filename, strlen(filename));
 
-		pthread_mutex_unlock(&parquet_queue_mutex);
-		last_file_name = NULL;
-	}
-	log_debug("parquet_write");
-	new_index = compute_new_index(elem, old_index, conf->file_size);
-	uint64_t key_start = elem->keys[old_index];
-	uint64_t key_end   = elem->keys[new_index];
-	char    *filename  = get_file_name(conf, key_start, key_end);
-	if (filename == NULL) {
-		parquet_object_free(elem);
+		start = end;
+	}
+
+	parquet_object_free(elem);
+	return 0;
+}
+
+// Rows of one parquet_object that went into the open file.
+struct parquet_pending {
+	parquet_object *elem;
+	uint32_t        start_idx;
+	uint32_t        end_idx;
+};
+
+// The file being written.  It stays open across parquet_objects until it
+// reaches file_size or the queue of its topic runs dry, so a
+// flush costs one file and one footer rather than one per object, and
+// row groups fill up to row_group_size rows.
+struct parquet_batch_writer {
+	conf_parquet                          *conf = NULL;
+	shared_ptr<GroupNode>                  schema;
+	shared_ptr<md5_output_stream>          out;
+	shared_ptr<parquet::ParquetFileWriter> writer;
+	parquet::RowGroupWriter               *rg        = NULL;
+	uint32_t                               rg_rows   = 0;
+	char                                  *filename  = NULL;
+	string                                 topic;
+	uint64_t                               key_start = 0;
+	uint64_t                               key_end   = 0;
+	uint64_t                               bytes     = 0; // payload bytes
+	vector<parquet_pending>                pending;
+	parquet_column_buffer                  buf;
+};
+
+// {dir}/{prefix}_{topic}_{md5}-{start_key}~{end_key}.parquet
+static char *
+get_md5_file_name(conf_parquet *conf, const char *topic, const char *md5,
+    uint64_t key_start, uint64_t key_end)
+{
+	return file_name_printf("%s/%s_%s_%s-%" PRIu64 "~%" PRIu64 ".parquet",
+	    conf->dir, conf->file_name_prefix, topic, md5, key_start, key_end);
+}
+
+static void
+parquet_batch_reset(parquet_batch_writer *w)
+{
+	w->writer.reset();
+	w->out.reset();
+	w->rg      = NULL;
+	w->rg_rows = 0;
+	w->bytes   = 0;
+	w->topic.clear();
+	FREE_IF_NOT_NULL(w->filename, strlen(w->filename));
+	w->filename = NULL;
+}
+
+// Give up on the open file, the objects that had rows in it are finished
+// without ranges for them.
+static void
+parquet_batch_abort(parquet_batch_writer *w)
+{
+	try {
+		w->writer.reset();
+	} catch (...) {
+	}
+	if (w->out != nullptr && !w->out->closed()) {
+		(void) w->out->Close();
+	}
+	if (w->filename != NULL && remove(w->filename) != 0) {
+		log_error("Failed to remove file %s errno: %d", w->filename,
+		    errno);
+	}
+	for (auto &p : w->pending) {
+		parquet_object_free(p.elem);
+	}
+	w->pending.clear();
+	parquet_batch_reset(w);
+}
+
+static int
+parquet_batch_open(parquet_batch_writer *w, parquet_object *elem, uint32_t start)
+{
+	w->key_start = elem->keys[start];
+	w->topic     = elem->topic != NULL ? elem->topic : "";
+	// No "_" in the name until it is complete, see parquet_file_queue_init
+	w->filename = get_file_name(w->conf, w->key_start, w->key_start);
+	if (w->filename == NULL) {
 		log_error("Failed to get file name");
 		return -1;
 	}
 
-	{
-		parquet_file_range *range =
-		    parquet_file_range_alloc(old_index, new_index, filename);
-		update_parquet_file_ranges(conf, elem, range);
+	try {
+		PARQUET_ASSIGN_OR_THROW(
+		    w->out, md5_output_stream::Open(w->filename));
+		w->writer = parquet::ParquetFileWriter::Open(
+		    w->out, w->schema, parquet_writer_properties(w->conf));
+	} catch (const std::exception &e) {
+		log_error("Failed to open %s: %s", w->filename, e.what());
+		parquet_batch_abort(w);
+		return -1;
+	}
 
-		// Create a ParquetFileWriter instance
-		parquet::WriterProperties::Builder builder;
-		log_debug("init builder");
-		builder.created_by("NanoMQ")
-		    ->version(parquet::ParquetVersion::PARQUET_2_6)
-		    ->data_page_version(parquet::ParquetDataPageVersion::V2)
-		    ->compression(static_cast<arrow::Compression::type>(
-		        conf->comp_type));
-		log_debug("check encry");
-		if (conf->encryption.enable) {
-			shared_ptr<parquet::FileEncryptionProperties>
-			    encryption_configurations;
-			encryption_configurations =
-			    parquet_set_encryption(conf);
-			builder.encryption(encryption_configurations);
-		}
+	return 0;
+}
 
-		shared_ptr<parquet::WriterProperties> props = builder.build();
-		using FileClass = arrow::io::FileOutputStream;
-		shared_ptr<FileClass> out_file;
-		PARQUET_ASSIGN_OR_THROW(out_file, FileClass::Open(filename));
-		std::shared_ptr<parquet::ParquetFileWriter> file_writer =
-		    parquet::ParquetFileWriter::Open(out_file, schema, props);
-
-		// Append a RowGroup with a specific number of rows.
-		parquet::RowGroupWriter *rg_writer =
-		    file_writer->AppendRowGroup();
-
-		// Write the Int64 column
-		log_debug("start doing int64 write");
-		parquet::Int64Writer *int64_writer =
-		    static_cast<parquet::Int64Writer *>(
-		        rg_writer->NextColumn());
-		for (uint32_t i = old_index; i <= new_index; i++) {
-			int64_t value            = elem->keys[i];
-			int16_t definition_level = 1;
-			int64_writer->WriteBatch(
-			    1, &definition_level, nullptr, &value);
-		}
-		log_debug("stop doing int64 write");
-
-		// Write the ByteArray column. Make every alternate values NULL
-		parquet::ByteArrayWriter *ba_writer =
-		    static_cast<parquet::ByteArrayWriter *>(
-		        rg_writer->NextColumn());
-		for (uint32_t i = old_index; i <= new_index; i++) {
-			parquet::ByteArray value;
-			int16_t            definition_level = 1;
-			value.ptr                           = elem->darray[i];
-			value.len                           = elem->dsize[i];
-			ba_writer->WriteBatch(
-			    1, &definition_level, nullptr, &value);
+// Finish the open file: write the footer, name it after its MD5 and key
+// range, publish it and finish the objects whose last rows it holds.
+static int
+parquet_batch_close(parquet_batch_writer *w)
+{
+	char  md5_buffer[MD5_LEN + 1];
+	char *md5_file_name;
+
+	if (w->writer == nullptr) {
+		return 0;
+	}
+
+	try {
+		w->writer->Close();
+		PARQUET_THROW_NOT_OK(w->out->Close());
+	} catch (const std::exception &e) {
+		log_error("Failed to close %s: %s", w->filename, e.what());
+		parquet_batch_abort(w);
+		return -1;
+	}
+
+	w->out->digest(md5_buffer);
+	md5_file_name = get_md5_file_name(
+	    w->conf, w->topic.c_str(), md5_buffer, w->key_start, w->key_end);
+	if (md5_file_name == NULL) {
+		parquet_batch_abort(w);
+		return -1;
+	}
+	log_info("trying to rename... %s to %s", w->filename, md5_file_name);
+	if (rename(w->filename, md5_file_name) != 0) {
+		log_error("Failed to rename file %s to %s errno: %d",
+		    w->filename, md5_file_name, errno);
+		free(md5_file_name);
+		parquet_batch_abort(w);
+		return -1;
+	}
+
+	// Publish the file before finishing the objects, so that their
+	// owners can look up what was just written.
+	for (auto &p : w->pending) {
+		parquet_file_range *range = parquet_file_range_alloc(
+		    p.start_idx, p.end_idx, md5_file_name);
+		update_parquet_file_ranges(w->conf, p.elem, range);
+	}
+
+	log_debug("wait for parquet_queue_mutex");
+	pthread_mutex_lock(&parquet_queue_mutex);
+	parquet_file_enqueue(md5_file_name);
+	if (QUEUE_SIZE(parquet_file_queue) > w->conf->file_count) {
+		remove_old_file();
+	}
+	pthread_mutex_unlock(&parquet_queue_mutex);
+
+	for (auto &p : w->pending) {
+		if (p.end_idx == p.elem->size - 1) {
+			parquet_object_free(p.elem);
 		}
-		log_debug("stop doing ByteArray write");
+	}
+	w->pending.clear();
 
-		old_index = new_index;
+	parquet_batch_reset(w);
+	log_info("flush finished!");
+	return 0;
+}
 
-		last_file_name = filename;
+int
+parquet_write(parquet_batch_writer *w, parquet_object *elem)
+{
+	uint32_t    rg_size = parquet_row_group_size(w->conf);
+	uint32_t    size    = elem->size;
+	uint32_t    start   = 0;
+	const char *topic   = elem->topic != NULL ? elem->topic : "";
 
-		if (new_index != elem->size - 1)
-			goto again;
+	if (size == 0) {
+		parquet_object_free(elem);
+		return 0;
+	}
+	if (w->writer != nullptr && w->topic != topic) {
+		parquet_batch_close(w);
 	}
-	if (last_file_name != NULL) {
-		char *md5_file_name =
-		    compute_and_rename_file_withMD5(last_file_name, conf, elem->topic);
-		if (md5_file_name == nullptr) {
+
+	// elem may be finished by a close once its last rows are written
+	while (start < size) {
+		if (w->writer == nullptr &&
+		    parquet_batch_open(w, elem, start) != 0) {
 			parquet_object_free(elem);
-			log_error("fail to get md5 from parquet file");
 			return -1;
 		}
 
-		char md5_buffer[MD5_LEN + 1];
-		log_debug("compute md5 after rename");
-		int ret = ComputeFileMD5(md5_file_name, md5_buffer);
-		if (ret != 0) {
-			log_error("Failed to calculate md5sum");
+		uint32_t end = start +
+		    parquet_rows_fit(elem, start, w->bytes, w->conf->file_size);
+		w->pending.push_back({ elem, start, end - 1 });
+
+		try {
+			for (uint32_t i = start; i < end;) {
+				if (w->rg == NULL) {
+					w->rg = w->writer->AppendBufferedRowGroup();
+					w->rg_rows = 0;
+				}
+				uint32_t n = end - i;
+				if (n > rg_size - w->rg_rows) {
+					n = rg_size - w->rg_rows;
+				}
+				parquet_write_columns(w->rg, elem, i, i + n, &w->buf);
+				w->rg_rows += n;
+				i += n;
+				if (w->rg_rows == rg_size) {
+					w->rg->Close();
+					w->rg = NULL;
+				}
+			}
+		} catch (const std::exception &e) {
+			log_error("Failed to write %s: %s", w->filename, e.what());
+			// elem is in pending and is finished with the rest
+			parquet_batch_abort(w);
+			return -1;
 		}
-		log_debug("wait for parquet_queue_mutex");
-		pthread_mutex_lock(&parquet_queue_mutex);
-		ENQUEUE(parquet_file_queue, md5_file_name);
 
-		if (QUEUE_SIZE(parquet_file_queue) > conf->file_count) {
-			remove_old_file();
+		for (uint32_t i = start; i < end; i++) {
+			w->bytes += elem->dsize[i];
 		}
+		w->key_end = elem->keys[end - 1];
+		start      = end;
 
-		pthread_mutex_unlock(&parquet_queue_mutex);
-		last_file_name = NULL;
+		if (w->bytes >= (uint64_t) w->conf->file_size &&
+		    parquet_batch_close(w) != 0) {
+			// the abort finished elem along with the others
+			return -1;
+		}
 	}
 
-	log_info("flush finished!");
-	parquet_object_free(elem);
 	return 0;
 }
 
+// Objects of one topic waiting to be written, and the file they go to.
+// A topic is handed to one writer thread at a time, from the moment it
+// gets an object until its file is published, which keeps the files of a
+// topic in order while different topics are written in parallel.
+struct parquet_topic_queue {
+	deque<parquet_object *> objs;
+	bool                    busy = false; // on parquet_ready or taken
+	parquet_batch_writer    writer;
+};
+
+// Objects a thread writes for a topic before letting the next topic in.
+#define PARQUET_TOPIC_BATCH 8
+
+// All guarded by parquet_queue_mutex.
+static unordered_map<string, parquet_topic_queue *> parquet_topics;
+static deque<parquet_topic_queue *>                 parquet_ready;
+
+static parquet_topic_queue *
+parquet_topic_get(const char *topic)
+{
+	auto it = parquet_topics.find(topic);
+	if (it != parquet_topics.end()) {
+		return it->second;
+	}
+	parquet_topic_queue *q = new (std::nothrow) parquet_topic_queue;
+	if (q == NULL) {
+		log_error("Failed to allocate queue of topic %s", topic);
+		return NULL;
+	}
+	q->writer.conf   = g_conf;
+	q->writer.schema = setup_schema();
+	parquet_topics.emplace(topic, q);
+	return q;
+}
+
+static size_t
+parquet_topic_len(parquet_topic_queue *q)
+{
+	return q->objs.size();
+}
+
+static void
+parquet_topic_schedule(parquet_topic_queue *q)
+{
+	q->busy = true;
+	parquet_ready.push_back(q);
+	pthread_cond_signal(&parquet_queue_not_empty);
+}
+
+static void
+parquet_topic_push(parquet_topic_queue *q, parquet_object *elem)
+{
+	q->objs.push_back(elem);
+	if (!q->busy) {
+		parquet_topic_schedule(q);
+	}
+}
+
 void *
 parquet_write_loop_v2(void *config)
 {
 	if (config == NULL) {
 		log_error("parquet conf is NULL");
+		return NULL;
 	}
 
 	conf_parquet *conf = (conf_parquet *) config;
-	if (!directory_exists(conf->dir)) {
-		if (!create_directory(conf->dir)) {
-			log_error("Failed to create directory %s", conf->dir);
-			return NULL;
-		}
-	}
-
-	shared_ptr<GroupNode> schema = setup_schema();
 
 	while (true) {
-		// wait for mqtt messages to send method request
+		// wait for a topic with something to write
 		pthread_mutex_lock(&parquet_queue_mutex);
-
-		while (IS_EMPTY(parquet_queue)) {
+		while (parquet_ready.empty()) {
 			pthread_cond_wait(
 			    &parquet_queue_not_empty, &parquet_queue_mutex);
 		}
+		parquet_topic_queue *q = parquet_ready.front();
+		parquet_ready.pop_front();
+
+		for (int n = 0; n < PARQUET_TOPIC_BATCH && !q->objs.empty();
+		     n++) {
+			log_debug("fetch element from parquet queue");
+			parquet_object *ele = q->objs.front();
+			q->objs.pop_front();
+			pthread_mutex_unlock(&parquet_queue_mutex);
+
+			switch (ele->type) {
+			case WRITE_TO_NORMAL:
+				parquet_write(&q->writer, ele);
+				break;
+			case WRITE_TO_TEMP:
+				parquet_write_tmp(conf, q->writer.schema, ele);
+				break;
+			default:
+				break;
+			}
+			pthread_mutex_lock(&parquet_queue_mutex);
+		}
 
-		log_debug("fetch element from parquet queue");
-		parquet_object *ele =
-		    (parquet_object *) DEQUEUE(parquet_queue);
-
+		if (!q->objs.empty()) {
+			// Keep the file open and give other topics a turn.
+			parquet_topic_schedule(q);
+			pthread_mutex_unlock(&parquet_queue_mutex);
+			continue;
+		}
 		pthread_mutex_unlock(&parquet_queue_mutex);
 
-		switch (ele->type) {
-		case WRITE_TO_NORMAL:
-			parquet_write(conf, schema, ele);
-			break;
-		case WRITE_TO_TEMP:
-			parquet_write_tmp(conf, schema, ele);
-			break;
-		default:
-			break;
+		// Nothing else is queued for the topic, publish what we have.
+		parquet_batch_close(&q->writer);
+
+		pthread_mutex_lock(&parquet_queue_mutex);
+		if (q->objs.empty()) {
+			q->busy = false;
+		} else {
+			parquet_topic_schedule(q);
 		}
+		pthread_mutex_unlock(&parquet_queue_mutex);
 	}
 	return NULL;
 }
@@ -696,7 +948,7 @@ parquet_file_queue_init(conf_parquet *conf)
 						return;
 					}
 				}
-				ENQUEUE(parquet_file_queue, file_path);
+				parquet_file_enqueue(file_path);
 			}
 		}
 		int load_num =
@@ -718,45 +970,33 @@ parquet_write_launcher(conf_parquet *conf)
 	// Using a global variable g_conf temporarily, because it is
 	// inconvenient to access conf in exchange.
 	g_conf = conf;
-	INIT_QUEUE(parquet_queue);
+	if (!directory_exists(conf->dir) && !create_directory(conf->dir)) {
+		log_error("Failed to create directory %s", conf->dir);
+		return -1;
+	}
+	if (file_index_alloc(&parquet_file_index) != 0) {
+		log_error("Failed to allocate parquet file index.");
+		return -1;
+	}
 	parquet_file_queue_init(conf);
 	is_available = true;
-	pthread_t write_thread;
-	int result = 0;
-	result = pthread_create(&write_thread, NULL, parquet_write_loop_v2, conf);
-	if (result != 0) {
-		log_error("Failed to create parquet write thread.");
-		return -1;
+
+	int threads = conf->write_threads > 0 ? conf->write_threads : 1;
+	for (int i = 0; i < threads; i++) {
+		pthread_t write_thread;
+		if (pthread_create(&write_thread, NULL, parquet_write_loop_v2,
+		        conf) != 0) {
+			log_error("Failed to create parquet write thread.");
+			// the ones already running keep the queues moving
+			return i > 0 ? 0 : -1;
+		}
+		pthread_detach(write_thread);
 	}
+	log_info("started %d parquet write threads", threads);
 
 	return 0;
 }
 
-static void
-get_range(const char *name, uint64_t range[2])
-{
-	//{prefix}_{md5}-{start_key}~{end_key}.parquet
-	const char *start = strrchr(name, '-');
-	sscanf(start, "-%ld~%ld.parquet", &range[0], &range[1]);
-	return;
-}
-
-static bool
-compare_callback(void *name, uint64_t key)
-{
-	uint64_t range[2] = { 0 };
-	get_range((const char *) name, range);
-	return (key >= range[0] && key <= range[1]);
-}
-
-static bool
-compare_callback_span(void *name, uint64_t low, uint64_t high)
-{
-	uint64_t range[2] = { 0 };
-	get_range((const char *) name, range);
-	return !(low > range[1] || high < range[0]);
-}
-
 const char *
 parquet_find(uint64_t key)
 {
@@ -765,18 +1005,7 @@ parquet_find(uint64_t key)
 		return NULL;
 	}
 	WAIT_FOR_AVAILABLE
-	const char *value = NULL;
-	void       *elem  = NULL;
-	pthread_mutex_lock(&parquet_queue_mutex);
-	FOREACH_QUEUE(parquet_file_queue, elem)
-	{
-		if (elem && compare_callback(elem, key)) {
-			value = nng_strdup((char *) elem);
-			break;
-		}
-	}
-	pthread_mutex_unlock(&parquet_queue_mutex);
-	return value;
+	return file_index_find(parquet_file_index, key);
 }
 
 const char **
@@ -793,36 +1022,8 @@ parquet_find_span(uint64_t start_key, uint64_t end_key, uint32_t *size)
 	}
 
 	WAIT_FOR_AVAILABLE
-
-	uint64_t     low        = start_key;
-	uint64_t     high       = end_key;
-	uint32_t     local_size = 0;
-	const char  *value      = NULL;
-	const char **array      = NULL;
-	const char **ret        = NULL;
-	void        *elem       = NULL;
-
-	pthread_mutex_lock(&parquet_queue_mutex);
-	if (parquet_file_queue.size != 0) {
-		array = (const char **) nng_alloc(
-		    sizeof(char *) * parquet_file_queue.size);
-
-		ret = array;
-		FOREACH_QUEUE(parquet_file_queue, elem)
-		{
-			if (elem) {
-				if (compare_callback_span(elem, low, high)) {
-					++local_size;
-					value    = nng_strdup((char *) elem);
-					*array++ = value;
-				}
-			}
-		}
-	}
-
-	pthread_mutex_unlock(&parquet_queue_mutex);
-	(*size) = local_size;
-	return ret;
+	return (const char **) file_index_find_span(
+	    parquet_file_index, start_key, end_key, size);
 }
 
 void
@@ -851,316 +1052,285 @@ parquet_read_set_property(
 	return;
 }
 
-static uint8_t *
-parquet_read(conf_parquet *conf, char *filename, uint64_t key, uint32_t *len)
-{
-	conf                                 = g_conf;
-	std::string               path_int64 = "key";
-	std::string               path_str   = "data";
-	parquet::ReaderProperties reader_properties =
-	    parquet::default_reader_properties();
+// Keys are stored as INT64 with the UINT_64 converted type, so statistics
+// and page index bounds are compared as unsigned.
 
-	parquet_read_set_property(reader_properties, conf);
-
-	// Create a ParquetReader instance
-	std::string exception_msg = "";
-	try {
-		std::unique_ptr<parquet::ParquetFileReader> parquet_reader =
-		    parquet::ParquetFileReader::OpenFile(
-		        filename, false, reader_properties);
-
-		// Get the File MetaData
-		std::shared_ptr<parquet::FileMetaData> file_metadata =
-		    parquet_reader->metadata();
-
-		int num_row_groups =
-		    file_metadata
-		        ->num_row_groups(); // Get the number of RowGroups
-		int num_columns =
-		    file_metadata->num_columns(); // Get the number of Columns
-		assert(num_columns == 2);
-
-		for (int r = 0; r < num_row_groups; ++r) {
-
-			std::shared_ptr<parquet::RowGroupReader>
-			    row_group_reader = parquet_reader->RowGroup(
-			        r); // Get the RowGroup Reader
-			int64_t values_read = 0;
-			int64_t rows_read   = 0;
-			int16_t definition_level;
-			int16_t repetition_level;
-			std::shared_ptr<parquet::ColumnReader> column_reader;
-
-			// Get the Column Reader for the Int64 column
-			column_reader = row_group_reader->Column(0);
-			parquet::Int64Reader *int64_reader =
-			    static_cast<parquet::Int64Reader *>(
-			        column_reader.get());
-
-			int i = 0;
-			while (int64_reader->HasNext()) {
-				int64_t value;
-				rows_read = int64_reader->ReadBatch(1,
-				    &definition_level, &repetition_level,
-				    &value, &values_read);
-				if (1 == rows_read && 1 == values_read) {
-					if (((uint64_t) value) == key)
-						break;
-				}
-				i++;
-			}
+// Whether row group r can hold keys in [low, high] according to the
+// column chunk statistics in the footer.
+static bool
+parquet_rg_may_hold(
+    parquet::FileMetaData *md, int r, uint64_t low, uint64_t high)
+{
+	auto chunk = md->RowGroup(r)->ColumnChunk(0);
+	if (!chunk->is_stats_set()) {
+		return true;
+	}
+	auto stats =
+	    dynamic_pointer_cast<parquet::Int64Statistics>(chunk->statistics());
+	if (stats == nullptr || !stats->HasMinMax()) {
+		return true;
+	}
+	return !((uint64_t) stats->max() < low ||
+	    (uint64_t) stats->min() > high);
+}
 
-			// Get the Column Reader for the ByteArray column
-			column_reader = row_group_reader->Column(1);
-			parquet::ByteArrayReader *ba_reader =
-			    static_cast<parquet::ByteArrayReader *>(
-			        column_reader.get());
+// Narrow the rows of row group r that can hold keys in [low, high] down to
+// the pages that can, if the file has a page index.  Otherwise [lo, hi)
+// is the whole row group.
+static void
+parquet_key_rows(shared_ptr<parquet::PageIndexReader> &pindex, int r,
+    int64_t num_rows, uint64_t low, uint64_t high, int64_t *lo, int64_t *hi)
+{
+	*lo = 0;
+	*hi = num_rows;
+	if (pindex == nullptr) {
+		return;
+	}
+	auto rg_index = pindex->RowGroup(r);
+	if (rg_index == nullptr) {
+		return;
+	}
+	auto cindex = dynamic_pointer_cast<parquet::Int64ColumnIndex>(
+	    rg_index->GetColumnIndex(0));
+	auto oindex = rg_index->GetOffsetIndex(0);
+	if (cindex == nullptr || oindex == nullptr) {
+		return;
+	}
 
-			if (ba_reader->HasNext()) {
-				ba_reader->Skip(i);
-			}
+	const auto &pages = oindex->page_locations();
+	const auto &mins  = cindex->min_values();
+	const auto &maxs  = cindex->max_values();
+	// Keys are never null, so there is a min and max for every page.
+	if (mins.size() != pages.size() || maxs.size() != pages.size()) {
+		return;
+	}
 
-			if (ba_reader->HasNext()) {
-				parquet::ByteArray value;
-				rows_read =
-				    ba_reader->ReadBatch(1, &definition_level,
-				        nullptr, &value, &values_read);
-				if (1 == rows_read && 1 == values_read) {
-					uint8_t *ret = (uint8_t *) malloc(
-					    value.len * sizeof(uint8_t));
-					memcpy(ret, value.ptr, value.len);
-					*len = value.len;
-					return ret;
-				}
-			}
+	size_t first = pages.size();
+	size_t last  = 0;
+	for (size_t p = 0; p < pages.size(); p++) {
+		if ((uint64_t) maxs[p] < low || (uint64_t) mins[p] > high) {
+			continue;
 		}
-
-	} catch (const std::exception &e) {
-		exception_msg = e.what();
-		log_error("exception_msg=[%s]", exception_msg.c_str());
+		if (first == pages.size()) {
+			first = p;
+		}
+		last = p;
 	}
-
-	return NULL;
+	if (first == pages.size()) {
+		*hi = 0;
+		return;
+	}
+	*lo = pages[first].first_row_index;
+	*hi = last + 1 < pages.size() ? pages[last + 1].first_row_index
+	                              : num_rows;
 }
 
-static vector<int>
-get_keys_indexes(
-    parquet::Int64Reader *int64_reader, const vector<uint64_t> &keys)
+// Read rows [lo, hi) of the key column in batches.
+static vector<uint64_t>
+parquet_read_keys(parquet::RowGroupReader *rg, int64_t lo, int64_t hi)
 {
-	vector<int> index_vector;
-	int64_t     values_read = 0;
-	int64_t     rows_read   = 0;
-	int16_t     definition_level;
-	int16_t     repetition_level;
-
-	int  index     = 0;
-	for (const auto &key : keys) {
-		bool found = false;
-		while (int64_reader->HasNext()) {
-			int64_t value;
-			rows_read =
-			    int64_reader->ReadBatch(1, &definition_level,
-			        &repetition_level, &value, &values_read);
-			if (1 == rows_read && 1 == values_read) {
-				if (((uint64_t) value) == key) {
-					index_vector.push_back(index++);
-					found = true;
-					break;
-				}
-			}
-			index++;
-		}
-		if (!found) {
-			index_vector.push_back(-1);
+	vector<uint64_t> keys(hi - lo);
+	vector<int16_t>  def_levels(hi - lo);
+	int64_t          n = 0;
+
+	auto column_reader = rg->Column(0);
+	auto int64_reader =
+	    static_cast<parquet::Int64Reader *>(column_reader.get());
+
+	int64_reader->Skip(lo);
+	while (n < hi - lo && int64_reader->HasNext()) {
+		int64_t values_read = 0;
+		int64_t rows_read   = int64_reader->ReadBatch(hi - lo - n,
+		      def_levels.data() + n, nullptr,
+		      reinterpret_cast<int64_t *>(keys.data()) + n, &values_read);
+		if (rows_read == 0 || values_read != rows_read) {
+			break;
 		}
+		n += rows_read;
 	}
+	keys.resize(n);
 
-	return index_vector;
+	return keys;
 }
 
-static vector<int>
-get_keys_indexes_fuzing(
-    parquet::Int64Reader *int64_reader, uint64_t start_key, uint64_t end_key)
+static parquet_data_packet *
+parquet_data_packet_alloc(const parquet::ByteArray &value)
 {
-	vector<int> index_vector;
-	int64_t     values_read = 0;
-	int64_t     rows_read   = 0;
-	int16_t     definition_level;
-	int16_t     repetition_level;
-
-	int  index = 0;
-	bool found = false;
-
-	while (int64_reader->HasNext()) {
-		int64_t value;
-		rows_read = int64_reader->ReadBatch(1, &definition_level,
-		    &repetition_level, &value, &values_read);
-		if (1 == rows_read && 1 == values_read) {
-			if (((uint64_t) value) >= start_key) {
-				index_vector.push_back(index++);
-				found = true;
-				break;
-			}
-			index++;
-		}
+	parquet_data_packet *pack =
+	    (parquet_data_packet *) malloc(sizeof(parquet_data_packet));
+	if (pack == NULL) {
+		log_error("Memory allocation failed for parquet_data_packet");
+		return NULL;
 	}
-	if (!found) {
-		index_vector.push_back(-1);
-		index_vector.push_back(-1);
-	} else {
-		found = false;
-		while (int64_reader->HasNext()) {
-			int64_t value;
-			rows_read =
-			    int64_reader->ReadBatch(1, &definition_level,
-			        &repetition_level, &value, &values_read);
-			if (1 == rows_read && 1 == values_read) {
-				if (((uint64_t) value) > end_key) {
-					index_vector.push_back(index - 1);
-					found = true;
-					break;
-				} else if (((uint64_t) value) == end_key) {
-					index_vector.push_back(index);
-					found = true;
-					break;
-				}
-				index++;
-			}
-		}
+	pack->data = (uint8_t *) malloc(value.len * sizeof(uint8_t));
+	if (pack->data == NULL && value.len != 0) {
+		log_error("Memory allocation failed for parquet_data_packet");
+		free(pack);
+		return NULL;
+	}
+	memcpy(pack->data, value.ptr, value.len);
+	pack->size = value.len;
+	return pack;
+}
 
-		if (!found) {
-			index_vector.push_back(index - 1);
+// Fetch the data of the given rows, in ascending order, into out at the
+// paired slots.  Only the rows asked for are read, the rest is skipped.
+static void
+parquet_read_rows(parquet::RowGroupReader *rg,
+    const vector<pair<int64_t, uint32_t>> &rows,
+    vector<parquet_data_packet *>         &out)
+{
+	int64_t cur = 0;
+
+	auto column_reader = rg->Column(1);
+	auto ba_reader =
+	    static_cast<parquet::ByteArrayReader *>(column_reader.get());
+
+	for (const auto &row : rows) {
+		parquet::ByteArray value;
+		int16_t            definition_level;
+		int64_t            values_read = 0;
+
+		if (row.first > cur) {
+			ba_reader->Skip(row.first - cur);
 		}
+		if (!ba_reader->HasNext()) {
+			break;
+		}
+		if (ba_reader->ReadBatch(1, &definition_level, nullptr, &value,
+		        &values_read) == 1 &&
+		    values_read == 1) {
+			out[row.second] = parquet_data_packet_alloc(value);
+		}
+		cur = row.first + 1;
 	}
-
-	return index_vector;
 }
 
-static vector<parquet_data_packet *>
-parquet_read(conf_parquet *conf, char *filename, vector<uint64_t> keys)
+static unique_ptr<parquet::ParquetFileReader>
+parquet_open(conf_parquet *conf, const char *filename)
 {
-	conf = g_conf;
-	vector<parquet_data_packet *> ret_vec;
-	std::string                   path_int64 = "key";
-	std::string                   path_str   = "data";
-	parquet::ReaderProperties     reader_properties =
+	parquet::ReaderProperties reader_properties =
 	    parquet::default_reader_properties();
 
 	parquet_read_set_property(reader_properties, conf);
-	vector<int> index_vector(keys.size());
+	return parquet::ParquetFileReader::OpenFile(
+	    filename, false, reader_properties);
+}
 
-	// Create a ParquetReader instance
-	std::string exception_msg = "";
-	try {
-		std::unique_ptr<parquet::ParquetFileReader> parquet_reader =
-		    parquet::ParquetFileReader::OpenFile(
-		        filename, false, reader_properties);
+// Look up keys, sorted by key and paired with their slot in out, in one
+// pass over the file.  Row groups and pages whose key range holds none of
+// the keys are never read.
+static void
+parquet_read(conf_parquet *conf, const char *filename,
+    const vector<pair<uint64_t, uint32_t>> &keys,
+    vector<parquet_data_packet *>          &out)
+{
+	conf = g_conf;
 
-		// Get the File MetaData
-		std::shared_ptr<parquet::FileMetaData> file_metadata =
+	try {
+		unique_ptr<parquet::ParquetFileReader> parquet_reader =
+		    parquet_open(conf, filename);
+		shared_ptr<parquet::FileMetaData> file_metadata =
 		    parquet_reader->metadata();
-
-		int num_row_groups =
-		    file_metadata
-		        ->num_row_groups(); // Get the number of RowGroups
-		int num_columns =
-		    file_metadata->num_columns(); // Get the number of Columns
-		assert(num_columns == 2);
-
-		for (int r = 0; r < num_row_groups; ++r) {
-
-			std::shared_ptr<parquet::RowGroupReader>
-			    row_group_reader = parquet_reader->RowGroup(
-			        r); // Get the RowGroup Reader
-			int64_t values_read = 0;
-			int64_t rows_read   = 0;
-			int16_t definition_level;
-			std::shared_ptr<parquet::ColumnReader> column_reader;
-
-			column_reader = row_group_reader->Column(0);
-			parquet::Int64Reader *int64_reader =
-			    static_cast<parquet::Int64Reader *>(
-			        column_reader.get());
-
-			index_vector = get_keys_indexes(int64_reader, keys);
-			// Get the Column Reader for the ByteArray column
-			column_reader = row_group_reader->Column(1);
-			parquet::ByteArrayReader *ba_reader =
-			    static_cast<parquet::ByteArrayReader *>(
-			        column_reader.get());
-
-			for (const auto &index : index_vector) {
-				if (-1 == index) {
-					ret_vec.push_back(NULL);
-					continue;
+		shared_ptr<parquet::PageIndexReader> pindex =
+		    parquet_reader->GetPageIndexReader();
+		assert(file_metadata->num_columns() == 2);
+
+		auto by_key = [](const pair<uint64_t, uint32_t> &k,
+		                  uint64_t v) { return k.first < v; };
+		for (int r = 0; r < file_metadata->num_row_groups(); ++r) {
+			int64_t num_rows =
+			    file_metadata->RowGroup(r)->num_rows();
+			int64_t lo, hi;
+
+			// Keys this row group can hold, bounded by statistics
+			auto kb = keys.begin();
+			auto ke = keys.end();
+			auto chunk = file_metadata->RowGroup(r)->ColumnChunk(0);
+			auto stats = chunk->is_stats_set()
+			    ? dynamic_pointer_cast<parquet::Int64Statistics>(
+			          chunk->statistics())
+			    : nullptr;
+			if (stats != nullptr && stats->HasMinMax()) {
+				kb = lower_bound(keys.begin(), keys.end(),
+				    (uint64_t) stats->min(), by_key);
+				ke = lower_bound(kb, keys.end(),
+				    (uint64_t) stats->max() + 1, by_key);
+				if ((uint64_t) stats->max() == UINT64_MAX) {
+					ke = keys.end();
 				}
+			}
+			// Skip the ones found in an earlier row group
+			while (kb != ke && out[kb->second] != NULL) {
+				kb++;
+			}
+			if (kb == ke) {
+				continue;
+			}
 
-				if (ba_reader->HasNext()) {
-					ba_reader->Skip(index - 1);
-				}
+			parquet_key_rows(pindex, r, num_rows, kb->first,
+			    (ke - 1)->first, &lo, &hi);
+			if (lo >= hi) {
+				continue;
+			}
 
-				if (ba_reader->HasNext()) {
-					parquet::ByteArray value;
-					rows_read = ba_reader->ReadBatch(1,
-					    &definition_level, nullptr, &value,
-					    &values_read);
-					if (1 == rows_read &&
-					    1 == values_read) {
-						parquet_data_packet *pack =
-						    (parquet_data_packet *)
-						        malloc(sizeof(
-						            parquet_data_packet));
-						pack->data =
-						    (uint8_t *) malloc(
-						        value.len *
-						        sizeof(uint8_t));
-						memcpy(pack->data, value.ptr,
-						    value.len);
-						pack->size = value.len;
-						ret_vec.push_back(pack);
-					}
+			shared_ptr<parquet::RowGroupReader> row_group_reader =
+			    parquet_reader->RowGroup(r);
+			vector<uint64_t> values =
+			    parquet_read_keys(row_group_reader.get(), lo, hi);
+			bool sorted = is_sorted(values.begin(), values.end());
+
+			vector<pair<int64_t, uint32_t>> rows;
+			for (auto k = kb; k != ke; k++) {
+				if (out[k->second] != NULL) {
+					continue;
 				}
+				auto it = sorted
+				    ? lower_bound(
+				          values.begin(), values.end(), k->first)
+				    : find(values.begin(), values.end(), k->first);
+				if (it == values.end() || *it != k->first) {
+					continue;
+				}
+				rows.push_back(
+				    { lo + (it - values.begin()), k->second });
+			}
+			if (rows.empty()) {
+				continue;
 			}
+			sort(rows.begin(), rows.end());
+			parquet_read_rows(row_group_reader.get(), rows, out);
 		}
-
 	} catch (const std::exception &e) {
-		exception_msg = e.what();
-		log_error("exception_msg=[%s]", exception_msg.c_str());
+		log_error("exception_msg=[%s]", e.what());
 	}
-
-	return ret_vec;
 }
 
-vector<parquet_data_packet *>
-parquet_find_data_packet(
-    conf_parquet *conf, char *filename, vector<uint64_t> keys)
+// Copy of the queued file name matching filename, ignoring case, to be
+// freed with nng_strfree.  Names without a key range are not indexed and
+// are looked up in the queue.
+static char *
+parquet_find_file(const char *filename)
 {
-	vector<parquet_data_packet *> ret_vec;
-	if (g_conf == NULL || g_conf->enable == false) {
-		log_error("Parquet is not ready or not launch!");
-		return ret_vec;
+	uint64_t start, end;
+	void    *elem = NULL;
+	char    *name = NULL;
+
+	if (file_index_parse(filename, &start, &end) == 0) {
+		return file_index_get(parquet_file_index, filename);
 	}
-	WAIT_FOR_AVAILABLE
-	void *elem = NULL;
 	pthread_mutex_lock(&parquet_queue_mutex);
 	FOREACH_QUEUE(parquet_file_queue, elem)
 	{
 		if (elem && nng_strcasecmp((char *) elem, filename) == 0) {
+			name = nng_strdup((char *) elem);
 			goto find;
 		}
 	}
 
 find:
 	pthread_mutex_unlock(&parquet_queue_mutex);
-
-	if (elem) {
-		ret_vec = parquet_read(conf, (char *) elem, keys);
-	} else {
-
-		ret_vec.resize(keys.size(), nullptr);
-		log_debug("Not find file %s in file queue", (char *) elem);
-	}
-	return ret_vec;
+	return name;
 }
 
 parquet_data_packet *
@@ -1171,34 +1341,18 @@ parquet_find_data_packet(conf_parquet *conf, char *filename, uint64_t key)
 		return NULL;
 	}
 	WAIT_FOR_AVAILABLE
-	void *elem = NULL;
-	pthread_mutex_lock(&parquet_queue_mutex);
-	FOREACH_QUEUE(parquet_file_queue, elem)
-	{
-		if (elem && nng_strcasecmp((char *) elem, filename) == 0) {
-			goto find;
-		}
-	}
-
-find:
-	pthread_mutex_unlock(&parquet_queue_mutex);
+	char *elem = parquet_find_file(filename);
 
 	if (elem) {
-		uint32_t size = 0;
-		uint8_t *data = parquet_read(conf, (char *) elem, key, &size);
-		if (size) {
-			parquet_data_packet *pack =
-			    (parquet_data_packet *) malloc(
-			        sizeof(parquet_data_packet));
-			pack->data = data;
-			pack->size = size;
-			return pack;
-		} else {
-			log_debug(
-			    "No key %ld in file: %s", key, (char *) elem);
+		vector<parquet_data_packet *> out(1, nullptr);
+		parquet_read(conf, elem, { { key, 0 } }, out);
+		if (out[0] == NULL) {
+			log_debug("No key %ld in file: %s", key, elem);
 		}
+		nng_strfree(elem);
+		return out[0];
 	}
-	log_debug("Not find file %s in file queue", (char *) elem);
+	log_debug("Not find file %s in file queue", filename);
 	return NULL;
 }
 
@@ -1206,34 +1360,44 @@ parquet_data_packet **
 parquet_find_data_packets(
     conf_parquet *conf, char **filenames, uint64_t *keys, uint32_t len)
 {
-	unordered_map<char *, vector<uint64_t>> file_name_map;
-	vector<parquet_data_packet *>           ret_vec;
-	parquet_data_packet                   **packets = NULL;
-	// Get the file map
+	unordered_map<string, vector<pair<uint64_t, uint32_t>>> file_name_map;
+	vector<parquet_data_packet *> out(len, nullptr);
+	parquet_data_packet         **packets = NULL;
+	bool                          found   = false;
+
+	if (g_conf == NULL || g_conf->enable == false) {
+		log_error("Parquet is not ready or not launch!");
+		return NULL;
+	}
+	WAIT_FOR_AVAILABLE
+
+	// Group the keys by file, remembering where each one goes
 	for (uint32_t i = 0; i < len; i++) {
-		vector<uint64_t> key_vec;
-		if (auto s = file_name_map.find(filenames[i]);
-		    s != file_name_map.end()) {
-			s->second.push_back(keys[i]);
-		} else {
-			key_vec.push_back(keys[i]);
-			file_name_map.insert(pair(filenames[i], key_vec));
+		if (filenames[i] != NULL) {
+			file_name_map[filenames[i]].push_back({ keys[i], i });
 		}
 	}
 
-	// Traverse the map and get the vector of parquet_data_packet
-	for (const auto &entry : file_name_map) {
-		char		        *filename = entry.first;
-		const std::vector<uint64_t> &sizes    = entry.second;
-
-		auto tmp = parquet_find_data_packet(conf, filename, sizes);
-		ret_vec.insert(ret_vec.end(), tmp.begin(), tmp.end());
+	// One sorted, merged pass per file
+	for (auto &entry : file_name_map) {
+		char *filename = parquet_find_file(entry.first.c_str());
+		if (filename == NULL) {
+			log_debug("Not find file %s in file queue",
+			    entry.first.c_str());
+			continue;
+		}
+		sort(entry.second.begin(), entry.second.end());
+		parquet_read(conf, filename, entry.second, out);
+		nng_strfree(filename);
 	}
 
-	if (!ret_vec.empty()) {
+	for (auto p : out) {
+		found = found || p != NULL;
+	}
+	if (found) {
 		packets = (parquet_data_packet **) malloc(
 		    sizeof(parquet_data_packet *) * len);
-		copy(ret_vec.begin(), ret_vec.end(), packets);
+		copy(out.begin(), out.end(), packets);
 	}
 
 	return packets;
@@ -1244,109 +1408,87 @@ parquet_read_span(conf_parquet *conf, const char *filename, uint64_t keys[2])
 {
 	conf = g_conf;
 	vector<parquet_data_packet *> ret_vec;
-	std::string                   path_int64 = "key";
-	std::string                   path_str   = "data";
-	parquet::ReaderProperties     reader_properties =
-	    parquet::default_reader_properties();
 
-	parquet_read_set_property(reader_properties, conf);
-	vector<int> index_vector(2);
-
-	// Create a ParquetReader instance
-	std::string exception_msg = "";
 	try {
-		std::unique_ptr<parquet::ParquetFileReader> parquet_reader =
-		    parquet::ParquetFileReader::OpenFile(
-		        filename, false, reader_properties);
-
-		// Get the File MetaData
-		std::shared_ptr<parquet::FileMetaData> file_metadata =
+		unique_ptr<parquet::ParquetFileReader> parquet_reader =
+		    parquet_open(conf, filename);
+		shared_ptr<parquet::FileMetaData> file_metadata =
 		    parquet_reader->metadata();
-
-		int num_row_groups =
-		    file_metadata
-		        ->num_row_groups(); // Get the number of RowGroups
-		int num_columns =
-		    file_metadata->num_columns(); // Get the number of Columns
-		assert(num_row_groups == 1);
-		assert(num_columns == 2);
-
-		for (int r = 0; r < num_row_groups; ++r) {
-
-			std::shared_ptr<parquet::RowGroupReader>
-			    row_group_reader = parquet_reader->RowGroup(
-			        r); // Get the RowGroup Reader
-			int64_t values_read = 0;
-			int64_t rows_read   = 0;
-			std::shared_ptr<parquet::ColumnReader> column_reader;
-
-			column_reader = row_group_reader->Column(0);
-			parquet::Int64Reader *int64_reader =
-			    static_cast<parquet::Int64Reader *>(
-			        column_reader.get());
-
-			index_vector = get_keys_indexes_fuzing(
-			    int64_reader, keys[0], keys[1]);
-			if (-1 == index_vector[0] || -1 == index_vector[1]) {
-				ret_vec.push_back(NULL);
-				return ret_vec;
+		shared_ptr<parquet::PageIndexReader> pindex =
+		    parquet_reader->GetPageIndexReader();
+		assert(file_metadata->num_columns() == 2);
+
+		for (int r = 0; r < file_metadata->num_row_groups(); ++r) {
+			int64_t num_rows =
+			    file_metadata->RowGroup(r)->num_rows();
+			int64_t lo, hi;
+
+			if (!parquet_rg_may_hold(
+			        file_metadata.get(), r, keys[0], keys[1])) {
+				continue;
 			}
-			// Get the Column Reader for the ByteArray column
-			column_reader = row_group_reader->Column(1);
-			auto ba_reader =
-			    dynamic_pointer_cast<parquet::ByteArrayReader>(
-			        column_reader);
-
-			if (ba_reader->HasNext()) {
-				ba_reader->Skip(index_vector[0] - 1);
+			parquet_key_rows(
+			    pindex, r, num_rows, keys[0], keys[1], &lo, &hi);
+			if (lo >= hi) {
+				continue;
 			}
 
-			if (ba_reader->HasNext()) {
-				int64_t batch_size =
-				    index_vector[1] - index_vector[0] + 1;
-				std::vector<parquet::ByteArray> values(
-				    batch_size);
-				std::vector<int16_t> definition_levels(batch_size); // Use a vector for definition levels
-				parquet::ByteArray value;
-				rows_read = ba_reader->ReadBatch(batch_size,
-				    definition_levels.data(), nullptr, values.data(),
-				    &values_read);
-				if (batch_size == rows_read &&
-				    batch_size == values_read) {
-					for (int64_t b = 0; b < batch_size;
-					     b++) {
-						parquet_data_packet *pack =
-						    (parquet_data_packet *)
-						        malloc(sizeof(
-						            parquet_data_packet));
-						if (!pack) {
-							log_error("Memory allocation failed for parquet_data_packet");
-							for (auto p : ret_vec) {
-								free(p->data);
-								free(p);
-							}
-							return vector<parquet_data_packet *>();
+			shared_ptr<parquet::RowGroupReader> row_group_reader =
+			    parquet_reader->RowGroup(r);
+			vector<uint64_t> values =
+			    parquet_read_keys(row_group_reader.get(), lo, hi);
+
+			// Keys are written in ascending order
+			auto first = lower_bound(
+			    values.begin(), values.end(), keys[0]);
+			auto last = upper_bound(first, values.end(), keys[1]);
+			if (first == last) {
+				continue;
+			}
+
+			auto column_reader = row_group_reader->Column(1);
+			auto ba_reader = static_cast<parquet::ByteArrayReader *>(
+			    column_reader.get());
+			int64_t batch_size = last - first;
+			std::vector<parquet::ByteArray> values_data(batch_size);
+			std::vector<int16_t> definition_levels(batch_size);
+			int64_t              n = 0;
+
+			ba_reader->Skip(lo + (first - values.begin()));
+			while (n < batch_size && ba_reader->HasNext()) {
+				int64_t values_read = 0;
+				int64_t rows_read =
+				    ba_reader->ReadBatch(batch_size - n,
+				        definition_levels.data(), nullptr,
+				        values_data.data(), &values_read);
+				if (rows_read == 0) {
+					break;
+				}
+				for (int64_t b = 0; b < values_read; b++) {
+					parquet_data_packet *pack =
+					    parquet_data_packet_alloc(
+					        values_data[b]);
+					if (!pack) {
+						for (auto p : ret_vec) {
+							free(p->data);
+							free(p);
 						}
-						pack->data =
-						    (uint8_t *) malloc(
-						        values[b].len *
-						        sizeof(uint8_t));
-						memcpy(pack->data,
-						    values[b].ptr,
-						    values[b].len);
-						pack->size = values[b].len;
-						ret_vec.push_back(pack);
+						return vector<
+						    parquet_data_packet *>();
 					}
+					ret_vec.push_back(pack);
 				}
+				n += rows_read;
 			}
-
 		}
 
 	} catch (const std::exception &e) {
-		exception_msg = e.what();
-		log_error("exception_msg=[%s]", exception_msg.c_str());
+		log_error("exception_msg=[%s]", e.what());
 	}
 
+	if (ret_vec.empty()) {
+		ret_vec.push_back(NULL);
+	}
 	return ret_vec;
 }
 
@@ -1360,7 +1502,7 @@ get_key(const char *filename, key_type type)
 {
 	uint64_t range[2] = { 0 };
 	uint64_t res      = 0;
-	get_range(filename, range);
+	file_index_parse(filename, &range[0], &range[1]);
 	switch (type) {
 	case START_KEY:
 		res = range[0];
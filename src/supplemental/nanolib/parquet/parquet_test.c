@@ -0,0 +1,382 @@
+//
+// Copyright 2024 NanoMQ Team, Inc. <jaylin@emqx.io>
+//
+// This software is supplied under the terms of the MIT License, a
+// copy of which should be located in the distribution where this
+// file was obtained (LICENSE.txt).  A copy of the license may also be
+// found online at https://opensource.org/licenses/MIT.
+//
+
+#include <ctype.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "nng/supplemental/nanolib/md5.h"
+#include "nng/supplemental/nanolib/parquet.h"
+#include "nuts.h"
+
+#define MAX_RANGES 64
+
+// What the writer handed back through the aio.
+typedef struct {
+	nng_aio *aio;
+	nng_mtx *mtx;
+	nng_cv  *cv;
+	bool     done;
+	int      rv;
+	int      nranges;
+	char    *files[MAX_RANGES];
+	uint32_t start[MAX_RANGES];
+	uint32_t end[MAX_RANGES];
+	char    *payload; // row data, owned by the caller of the write
+} write_result;
+
+static conf_parquet pconf;
+static char         dir[] = "/tmp/nng_parquet_XXXXXX";
+
+static void
+test_conf_init(uint32_t row_group_size, int32_t file_size)
+{
+	NUTS_TRUE(mkdtemp(dir) != NULL);
+	memset(&pconf, 0, sizeof(pconf));
+	pconf.enable           = true;
+	pconf.dir              = dir;
+	pconf.file_name_prefix = "test";
+	pconf.file_count       = MAX_RANGES;
+	pconf.file_size        = file_size;
+	pconf.row_group_size   = row_group_size;
+	pconf.write_threads    = 1;
+	pconf.comp_type        = UNCOMPRESSED;
+	NUTS_PASS(parquet_write_launcher(&pconf));
+}
+
+static void
+test_conf_fini(void)
+{
+	DIR           *d;
+	struct dirent *ent;
+	char           path[512];
+
+	NUTS_TRUE((d = opendir(dir)) != NULL);
+	while ((ent = readdir(d)) != NULL) {
+		if (ent->d_name[0] == '.') {
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+		NUTS_PASS(unlink(path));
+	}
+	closedir(d);
+	NUTS_PASS(rmdir(dir));
+}
+
+static void
+write_cb(void *arg)
+{
+	write_result        *wr     = arg;
+	parquet_file_ranges *ranges = nng_aio_get_output(wr->aio, 1);
+	uint32_t            *szp    = (uint32_t *) nng_aio_get_msg(wr->aio);
+
+	// The ranges are freed once we return, keep what we need.
+	nng_mtx_lock(wr->mtx);
+	wr->rv = nng_aio_result(wr->aio);
+	for (int n = 0; ranges != NULL && n < ranges->size; n++) {
+		parquet_file_range *r =
+		    ranges->range[(ranges->start + n) % ranges->size];
+		if (wr->nranges < MAX_RANGES) {
+			wr->files[wr->nranges] = nng_strdup(r->filename);
+			wr->start[wr->nranges] = r->start_idx;
+			wr->end[wr->nranges]   = r->end_idx;
+			wr->nranges++;
+		}
+	}
+	free(szp);
+	nng_aio_set_msg(wr->aio, NULL);
+	wr->done = true;
+	nng_cv_wake(wr->cv);
+	nng_mtx_unlock(wr->mtx);
+}
+
+// Write n rows with keys first, first + step, ... and "value-<key>" as
+// data, and wait for the files holding them to be published.
+static void
+write_rows(write_result *wr, uint64_t first, uint64_t step, uint32_t n,
+    const char *topic)
+{
+	uint64_t       *keys;
+	uint8_t       **darray;
+	uint32_t       *dsize;
+	char           *p;
+	parquet_object *obj;
+
+	memset(wr, 0, sizeof(*wr));
+	NUTS_PASS(nng_mtx_alloc(&wr->mtx));
+	NUTS_PASS(nng_cv_alloc(&wr->cv, wr->mtx));
+	NUTS_PASS(nng_aio_alloc(&wr->aio, write_cb, wr));
+
+	NUTS_TRUE((keys = nng_alloc(n * sizeof(uint64_t))) != NULL);
+	NUTS_TRUE((darray = nng_alloc(n * sizeof(uint8_t *))) != NULL);
+	NUTS_TRUE((dsize = nng_alloc(n * sizeof(uint32_t))) != NULL);
+	NUTS_TRUE((wr->payload = malloc((size_t) n * 32)) != NULL);
+	p = wr->payload;
+	for (uint32_t i = 0; i < n; i++) {
+		keys[i]   = first + i * step;
+		darray[i] = (uint8_t *) p;
+		dsize[i]  = (uint32_t) sprintf(p, "value-%" PRIu64, keys[i]);
+		p += 32;
+	}
+
+	obj        = parquet_object_alloc(keys, darray, dsize, n, wr->aio, NULL);
+	obj->topic = topic != NULL ? nng_strdup(topic) : NULL;
+	nng_aio_begin(wr->aio);
+	NUTS_PASS(parquet_write_batch_async(obj));
+
+	nng_mtx_lock(wr->mtx);
+	while (!wr->done) {
+		nng_cv_wait(wr->cv);
+	}
+	nng_mtx_unlock(wr->mtx);
+	NUTS_PASS(wr->rv);
+}
+
+static void
+write_result_fini(write_result *wr)
+{
+	for (int i = 0; i < wr->nranges; i++) {
+		nng_strfree(wr->files[i]);
+	}
+	free(wr->payload);
+	nng_aio_free(wr->aio);
+	nng_cv_free(wr->cv);
+	nng_mtx_free(wr->mtx);
+}
+
+static void
+check_packet(parquet_data_packet *pack, uint64_t key)
+{
+	char want[32];
+
+	snprintf(want, sizeof(want), "value-%" PRIu64, key);
+	NUTS_TRUE(pack != NULL);
+	if (pack == NULL) {
+		return;
+	}
+	NUTS_TRUE(pack->size == strlen(want));
+	NUTS_TRUE(memcmp(pack->data, want, pack->size) == 0);
+	free(pack->data);
+	free(pack);
+}
+
+void
+test_parquet_round_trip(void)
+{
+	write_result          wr;
+	parquet_data_packet  *pack;
+	parquet_data_packet **packs;
+	const char           *name;
+	char                 *upper;
+	char                 *files[4];
+	uint64_t              keys[4] = { 999, 3, 500, 5000 };
+	uint32_t              size;
+
+	// Ten row groups in one file
+	test_conf_init(100, 1 << 24);
+	write_rows(&wr, 0, 1, 1000, NULL);
+
+	NUTS_TRUE(wr.nranges == 1);
+	NUTS_TRUE(wr.start[0] == 0);
+	NUTS_TRUE(wr.end[0] == 999);
+	NUTS_TRUE(strstr(wr.files[0], "-0~999.parquet") != NULL);
+
+	NUTS_TRUE((name = parquet_find(500)) != NULL);
+	NUTS_MATCH(name, wr.files[0]);
+	nng_strfree((char *) name);
+	NUTS_NULL(parquet_find(1000));
+
+	pack = parquet_find_data_packet(&pconf, wr.files[0], 0);
+	check_packet(pack, 0);
+	pack = parquet_find_data_packet(&pconf, wr.files[0], 999);
+	check_packet(pack, 999);
+	NUTS_NULL(parquet_find_data_packet(&pconf, wr.files[0], 1000));
+
+	// File names match ignoring case
+	NUTS_TRUE((upper = nng_strdup(wr.files[0])) != NULL);
+	for (char *c = upper; *c != '\0'; c++) {
+		*c = (char) toupper((unsigned char) *c);
+	}
+	check_packet(parquet_find_data_packet(&pconf, upper, 42), 42);
+	nng_strfree(upper);
+
+	// Results line up with the keys asked for, whatever their order.
+	for (int i = 0; i < 4; i++) {
+		files[i] = wr.files[0];
+	}
+	packs = parquet_find_data_packets(&pconf, files, keys, 4);
+	NUTS_TRUE(packs != NULL);
+	for (int i = 0; i < 3; i++) {
+		check_packet(packs[i], keys[i]);
+	}
+	NUTS_NULL(packs[3]);
+	free(packs);
+
+	// A span across row groups comes back in key order.
+	packs = parquet_find_data_span_packets(&pconf, 95, 204, &size, "");
+	NUTS_TRUE(packs != NULL);
+	NUTS_TRUE(size == 110);
+	for (uint32_t i = 0; i < size; i++) {
+		check_packet(packs[i], 95 + i);
+	}
+	free(packs);
+
+	write_result_fini(&wr);
+	test_conf_fini();
+}
+
+// The MD5 in each file name is computed while writing, it has to match
+// the file on disk.
+void
+test_parquet_md5(void)
+{
+	write_result wr;
+	char         md5[MD5_STR_LEN + 1];
+	uint32_t     next = 0;
+
+	// Small files, so the rows are spread over several of them
+	test_conf_init(100, 4000);
+	write_rows(&wr, 0, 1, 2000, NULL);
+
+	NUTS_TRUE(wr.nranges > 1);
+	for (int i = 0; i < wr.nranges; i++) {
+		const char *sum = strrchr(wr.files[i], '_');
+		char        suffix[64];
+
+		NUTS_TRUE(wr.start[i] == next);
+		NUTS_TRUE(wr.end[i] >= wr.start[i]);
+		next = wr.end[i] + 1;
+
+		NUTS_PASS(ComputeFileMD5(wr.files[i], md5));
+		NUTS_TRUE(sum != NULL);
+		NUTS_TRUE(strncmp(sum + 1, md5, MD5_STR_LEN) == 0);
+		snprintf(suffix, sizeof(suffix), "-%u~%u.parquet", wr.start[i],
+		    wr.end[i]);
+		NUTS_MATCH(sum + 1 + MD5_STR_LEN, suffix);
+	}
+	NUTS_TRUE(next == 2000);
+
+	write_result_fini(&wr);
+	test_conf_fini();
+}
+
+// Enough rows for two row groups of several pages each (Arrow cuts a page
+// every 20000 rows by default), so lookups go through the page index.
+// Keys are even, so there are gaps to miss.
+void
+test_parquet_page_index(void)
+{
+	write_result          wr;
+	parquet_data_packet **packs;
+	char                 *files[9];
+	uint32_t              size;
+	// Page and row group edges, and keys that are not there
+	uint64_t keys[9] = { 131072, 0, 39998, 40000, 199998, 131070, 40001,
+		200000, 79999 };
+
+	test_conf_init(0, 1 << 30);
+	write_rows(&wr, 0, 2, 100000, NULL);
+	NUTS_TRUE(wr.nranges == 1);
+
+	for (int i = 0; i < 9; i++) {
+		files[i] = wr.files[0];
+	}
+	packs = parquet_find_data_packets(&pconf, files, keys, 9);
+	NUTS_TRUE(packs != NULL);
+	for (int i = 0; i < 9; i++) {
+		if (keys[i] % 2 == 0 && keys[i] < 200000) {
+			check_packet(packs[i], keys[i]);
+		} else {
+			NUTS_NULL(packs[i]);
+		}
+	}
+	free(packs);
+
+	for (uint64_t k = 0; k < 200000; k += 19998) {
+		check_packet(parquet_find_data_packet(&pconf, wr.files[0], k), k);
+	}
+	NUTS_NULL(parquet_find_data_packet(&pconf, wr.files[0], 131071));
+
+	// Across the row group edge
+	packs =
+	    parquet_find_data_span_packets(&pconf, 131000, 131201, &size, "");
+	NUTS_TRUE(packs != NULL);
+	NUTS_TRUE(size == 101);
+	for (uint32_t i = 0; i < size; i++) {
+		check_packet(packs[i], 131000 + 2 * i);
+	}
+	free(packs);
+
+	write_result_fini(&wr);
+	test_conf_fini();
+}
+
+// Topics get their own files, even over the same keys.
+void
+test_parquet_topics(void)
+{
+	write_result          one, two;
+	parquet_data_packet **packs;
+	uint32_t              size;
+
+	test_conf_init(0, 1 << 24);
+	write_rows(&one, 0, 1, 100, "topicone");
+	write_rows(&two, 0, 1, 100, "topictwo");
+
+	NUTS_TRUE(one.nranges == 1);
+	NUTS_TRUE(two.nranges == 1);
+	NUTS_TRUE(strstr(one.files[0], "_topicone_") != NULL);
+	NUTS_TRUE(strstr(two.files[0], "_topictwo_") != NULL);
+	check_packet(parquet_find_data_packet(&pconf, two.files[0], 7), 7);
+
+	packs = parquet_find_data_span_packets(&pconf, 0, 99, &size, "topicone");
+	NUTS_TRUE(packs != NULL);
+	NUTS_TRUE(size == 100);
+	for (uint32_t i = 0; i < size; i++) {
+		check_packet(packs[i], i);
+	}
+	free(packs);
+
+	write_result_fini(&one);
+	write_result_fini(&two);
+	test_conf_fini();
+}
+
+// Twenty digit keys make the longest names.
+void
+test_parquet_long_names(void)
+{
+	write_result wr;
+	uint64_t     first = UINT64_MAX - 99;
+
+	test_conf_init(0, 1 << 24);
+	write_rows(&wr, first, 1, 100, "topicone");
+
+	NUTS_TRUE(wr.nranges == 1);
+	NUTS_TRUE(strstr(wr.files[0], "-18446744073709551516~"
+	                              "18446744073709551615.parquet") != NULL);
+	check_packet(parquet_find_data_packet(&pconf, wr.files[0], first), first);
+	check_packet(
+	    parquet_find_data_packet(&pconf, wr.files[0], UINT64_MAX), UINT64_MAX);
+
+	write_result_fini(&wr);
+	test_conf_fini();
+}
+
+NUTS_TESTS = {
+	{ "parquet round trip", test_parquet_round_trip },
+	{ "parquet md5", test_parquet_md5 },
+	{ "parquet page index", test_parquet_page_index },
+	{ "parquet topics", test_parquet_topics },
+	{ "parquet long names", test_parquet_long_names },
+	{ NULL, NULL },
+};
@@ -10,6 +10,101 @@
 #include "nng/supplemental/nanolib/ringbuffer.h"
 #include "core/nng_impl.h"
 
+/* Physical slot of the n-th message counted from head */
+static inline unsigned int ringBuffer_slot(ringBuffer_t *rb, unsigned int n)
+{
+	return (unsigned int)(((uint64_t)rb->head + n) % rb->cap);
+}
+
+static inline void ringBuffer_index_add(ringBuffer_t *rb, uint64_t key, unsigned int slot)
+{
+	if (rb->keyIndex == NULL) {
+		return;
+	}
+	if (nni_id_get(rb->keyIndex, key) != NULL) {
+		/* Keep the oldest one, the index can not answer for this key any more */
+		rb->keyIndexExact = 0;
+		return;
+	}
+	if (nni_id_set(rb->keyIndex, key, (void *)((uintptr_t)slot + 1)) != 0) {
+		rb->keyIndexExact = 0;
+	}
+}
+
+static inline void ringBuffer_index_del(ringBuffer_t *rb, uint64_t key, unsigned int slot)
+{
+	if (rb->keyIndex == NULL) {
+		return;
+	}
+	if (nni_id_get(rb->keyIndex, key) == (void *)((uintptr_t)slot + 1)) {
+		nni_id_remove(rb->keyIndex, key);
+	}
+}
+
+static inline void ringBuffer_index_reset(ringBuffer_t *rb)
+{
+	if (rb->keyIndex != NULL) {
+		nni_id_map_fini(rb->keyIndex);
+		nni_id_map_init(rb->keyIndex, 0, 0, false);
+	}
+	rb->keyIndexExact = 1;
+	rb->keysSorted = 1;
+}
+
+/*
+ * Only valid when keys are sorted. Returns the logical position of the
+ * first message whose key is >= key (or > key if upper), size if none.
+ */
+static unsigned int ringBuffer_bound(ringBuffer_t *rb, uint64_t key, int upper)
+{
+	unsigned int low = 0;
+	unsigned int high = rb->size;
+	unsigned int mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		uint64_t k = rb->msgs[ringBuffer_slot(rb, mid)].key;
+		if (k < key || (upper && k == key)) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+
+	return low;
+}
+
+/* Logical position of the oldest message with key, or -1 */
+static int64_t ringBuffer_find_key(ringBuffer_t *rb, uint64_t key)
+{
+	unsigned int pos;
+
+	if (rb->keyIndex != NULL && rb->keyIndexExact) {
+		void *val = nni_id_get(rb->keyIndex, key);
+		if (val == NULL) {
+			return -1;
+		}
+		pos = (unsigned int)((uintptr_t)val - 1);
+		return (int64_t)(((uint64_t)pos + rb->cap - rb->head) % rb->cap);
+	}
+
+	if (rb->keysSorted) {
+		pos = ringBuffer_bound(rb, key, 0);
+		if (pos < rb->size && rb->msgs[ringBuffer_slot(rb, pos)].key == key) {
+			return pos;
+		}
+		return -1;
+	}
+
+	for (pos = 0; pos < rb->size; pos++) {
+		if (rb->msgs[ringBuffer_slot(rb, pos)].key == key) {
+			return pos;
+		}
+	}
+
+	return -1;
+}
+
 static inline int ringBuffer_get_msgs(ringBuffer_t *rb, unsigned int *count, nng_msg ***list)
 {
 	unsigned int i = 0;
@@ -27,22 +122,16 @@ static inline int ringBuffer_get_msgs(ringBuffer_t *rb, unsigned int *count, nng
 		return -1;
 	}
 
-	for (i = rb->head; i < rb->size; i++) {
-		i = i % rb->cap;
+	for (j = 0; j < *count; j++) {
+		i = ringBuffer_slot(rb, j);
 		nng_msg *msg = rb->msgs[i].data;
 		nng_msg_set_proto_data(msg, NULL, (void *)(uintptr_t)rb->msgs[i].key);
 
 		newList[j] = msg;
-
-		j++;
-		if (j == *count) {
-			*list = newList;
-			return 0;
-		}
 	}
 
-	nng_free(newList, sizeof(*newList));
-	return -1;
+	*list = newList;
+	return 0;
 }
 
 static inline void ringBuffer_clean_msgs(ringBuffer_t *rb, int needFree)
@@ -72,6 +161,7 @@ static inline void ringBuffer_clean_msgs(ringBuffer_t *rb, int needFree)
 	rb->head = 0;
 	rb->tail = 0;
 	rb->size = 0;
+	ringBuffer_index_reset(rb);
 
 	return;
 }
@@ -81,7 +171,7 @@ int ringBuffer_get_and_clean_msgs(ringBuffer_t *rb,
 {
 	int ret;
 
-	if (rb == NULL || list == NULL || count == NULL) {
+	if (rb == NULL || list == NULL || count == NULL || rb->spmc != NULL) {
 		return -1;
 	}
 	if (rb->size == 0) {
@@ -101,10 +191,158 @@ int ringBuffer_get_and_clean_msgs(ringBuffer_t *rb,
 	return 0;
 }
 
-int ringBuffer_init(ringBuffer_t **rb,
-					unsigned int cap,
-					enum fullOption fullOp,
-					unsigned long long expiredAt)
+/*
+ * Single producer, multiple consumer mode. Positions are 64 bit sequence
+ * numbers that never wrap, the slot of seq is seq % cap. The producer
+ * alone moves tail, consumers (and the producer when dropping) take
+ * messages by moving head with a compare and swap, which hands over the
+ * ring's reference exactly once. Every slot carries the sequence it
+ * holds, so readers can tell when the producer has lapped them.
+ *
+ * Readers only look at slots while registered in a phase. Messages that
+ * leave the ring are retired instead of freed, and only freed once every
+ * reader that might have seen them has left, so a reader can always take
+ * its own reference on what it found.
+ */
+#define RB_CACHELINE 64
+/* Slot sequence while the producer rewrites it */
+#define RB_SEQ_BUSY UINT64_MAX
+
+typedef struct {
+	nni_atomic_u64 seq;
+	nni_atomic_u64 key;
+	nni_atomic_ptr data;
+} ringBufferSlot_t;
+
+/* Keeps the producer's and the consumers' counters on separate lines */
+typedef union {
+	nni_atomic_u64 v;
+	char           pad[RB_CACHELINE];
+} ringBufferCounter_t;
+
+struct ringBufferSpmc_s {
+	ringBufferCounter_t tail;
+	ringBufferCounter_t head;
+	nni_atomic_int      phase;
+	nni_atomic_int      readers[2];
+	char                pad[RB_CACHELINE];
+	nni_atomic_bool     sorted;
+	uint64_t            lastKey; /* producer only */
+	nng_mtx            *retire_lock;
+	cvector(nng_msg *)  retired[2];
+	ringBufferSlot_t   *slots;
+};
+
+static ringBufferSpmc_t *ringBuffer_spmc_alloc(unsigned int cap)
+{
+	ringBufferSpmc_t *s;
+
+	if ((s = nni_zalloc(sizeof(*s))) == NULL) {
+		return NULL;
+	}
+	if ((s->slots = nni_zalloc(sizeof(ringBufferSlot_t) * cap)) == NULL) {
+		nni_free(s, sizeof(*s));
+		return NULL;
+	}
+	if (nng_mtx_alloc(&s->retire_lock) != 0) {
+		nni_free(s->slots, sizeof(ringBufferSlot_t) * cap);
+		nni_free(s, sizeof(*s));
+		return NULL;
+	}
+	for (unsigned int i = 0; i < cap; i++) {
+		nni_atomic_init64(&s->slots[i].seq);
+		nni_atomic_set64(&s->slots[i].seq, RB_SEQ_BUSY);
+		nni_atomic_init64(&s->slots[i].key);
+	}
+	nni_atomic_init64(&s->tail.v);
+	nni_atomic_init64(&s->head.v);
+	nni_atomic_init(&s->phase);
+	nni_atomic_init(&s->readers[0]);
+	nni_atomic_init(&s->readers[1]);
+	nni_atomic_init_bool(&s->sorted);
+	nni_atomic_set_bool(&s->sorted, true);
+
+	return s;
+}
+
+static void ringBuffer_spmc_free(ringBufferSpmc_t *s, unsigned int cap)
+{
+	uint64_t head = nni_atomic_get64(&s->head.v);
+	uint64_t tail = nni_atomic_get64(&s->tail.v);
+
+	for (uint64_t seq = head; seq < tail; seq++) {
+		nng_msg_free(nni_atomic_get_ptr(&s->slots[seq % cap].data));
+	}
+	for (int i = 0; i < 2; i++) {
+		for (size_t j = 0; j < cvector_size(s->retired[i]); j++) {
+			nng_msg_free(s->retired[i][j]);
+		}
+		cvector_free(s->retired[i]);
+	}
+	nng_mtx_free(s->retire_lock);
+	nni_free(s->slots, sizeof(ringBufferSlot_t) * cap);
+	nni_free(s, sizeof(*s));
+}
+
+static int ringBuffer_spmc_read_enter(ringBufferSpmc_t *s)
+{
+	int phase;
+
+	for (;;) {
+		phase = nni_atomic_get(&s->phase);
+		nni_atomic_inc(&s->readers[phase]);
+		/* Retirements may not wait for us if the phase just flipped */
+		if (nni_atomic_get(&s->phase) == phase) {
+			return phase;
+		}
+		nni_atomic_dec(&s->readers[phase]);
+	}
+}
+
+static void ringBuffer_spmc_read_leave(ringBufferSpmc_t *s, int phase)
+{
+	nni_atomic_dec(&s->readers[phase]);
+}
+
+/*
+ * Frees what was retired during the previous phase once no reader of
+ * that phase is left, then starts a new one. Called with retire_lock.
+ */
+static void ringBuffer_spmc_reclaim(ringBufferSpmc_t *s)
+{
+	int phase = nni_atomic_get(&s->phase);
+	int old = phase ^ 1;
+
+	if (nni_atomic_get(&s->readers[old]) != 0) {
+		return;
+	}
+	for (size_t i = 0; i < cvector_size(s->retired[old]); i++) {
+		nng_msg_free(s->retired[old][i]);
+	}
+	cvector_set_size(s->retired[old], 0);
+	nni_atomic_set(&s->phase, old);
+}
+
+/* Reads the slot of seq, false if it holds something else by now */
+static inline bool ringBuffer_spmc_read(ringBufferSpmc_t *s, unsigned int cap,
+										uint64_t seq, uint64_t *key, nng_msg **data)
+{
+	ringBufferSlot_t *slot = &s->slots[seq % cap];
+
+	if (nni_atomic_get64(&slot->seq) != seq) {
+		return false;
+	}
+	*key = nni_atomic_get64(&slot->key);
+	*data = nni_atomic_get_ptr(&slot->data);
+
+	return nni_atomic_get64(&slot->seq) == seq;
+}
+
+static int ringBuffer_alloc(ringBuffer_t **rb,
+							unsigned int cap,
+							enum fullOption fullOp,
+							unsigned long long expiredAt,
+							int spmc)
 {
 	ringBuffer_t *newRB;
 
@@ -124,11 +362,22 @@ int ringBuffer_init(ringBuffer_t **rb,
 		return -1;
 	}
 
-	newRB->msgs = (ringBufferMsg_t *)nng_alloc(sizeof(ringBufferMsg_t) * cap);
-	if (newRB->msgs == NULL) {
-		log_error("New ringbuffer messages alloc failed\n");
-		nng_free(newRB, sizeof(*newRB));
-		return -1;
+	newRB->msgs = NULL;
+	newRB->spmc = NULL;
+	if (spmc) {
+		newRB->spmc = ringBuffer_spmc_alloc(cap);
+		if (newRB->spmc == NULL) {
+			log_error("New ringbuffer slots alloc failed\n");
+			nng_free(newRB, sizeof(*newRB));
+			return -1;
+		}
+	} else {
+		newRB->msgs = (ringBufferMsg_t *)nng_alloc(sizeof(ringBufferMsg_t) * cap);
+		if (newRB->msgs == NULL) {
+			log_error("New ringbuffer messages alloc failed\n");
+			nng_free(newRB, sizeof(*newRB));
+			return -1;
+		}
 	}
 
 	newRB->head = 0;
@@ -140,6 +389,11 @@ int ringBuffer_init(ringBuffer_t **rb,
 	newRB->fullOp = fullOp;
 	newRB->files = NULL;
 
+	newRB->topic = NULL;
+	newRB->keyIndex = NULL;
+	newRB->keyIndexExact = 1;
+	newRB->keysSorted = 1;
+
 	newRB->enqinRuleList[0] = NULL;
 	newRB->enqoutRuleList[0] = NULL;
 	newRB->deqinRuleList[0] = NULL;
@@ -157,6 +411,31 @@ int ringBuffer_init(ringBuffer_t **rb,
 	return 0;
 }
 
+int ringBuffer_init(ringBuffer_t **rb,
+					unsigned int cap,
+					enum fullOption fullOp,
+					unsigned long long expiredAt)
+{
+	return ringBuffer_alloc(rb, cap, fullOp, expiredAt, 0);
+}
+
+int ringBuffer_init_spmc(ringBuffer_t **rb,
+						 unsigned int cap,
+						 enum fullOption fullOp,
+						 unsigned long long expiredAt)
+{
+	if (cap == 0) {
+		log_error("Want to init a ring buffer with no capacity\n");
+		return -1;
+	}
+	if (fullOp != RB_FULL_NONE && fullOp != RB_FULL_DROP) {
+		log_error("fullOp is not supported by spmc ring buffer: %d\n", fullOp);
+		return -1;
+	}
+
+	return ringBuffer_alloc(rb, cap, fullOp, expiredAt, 1);
+}
+
 static inline int ringBufferRule_check(ringBuffer_t *rb,
 									   ringBufferRule_t **list,
 									   unsigned int len,
@@ -212,6 +491,32 @@ static inline int ringBuffer_rule_check(ringBuffer_t *rb, void *data, int flag)
 	return 0;
 }
 
+#if defined(SUPP_PARQUET) || defined(SUPP_BLF)
+/*
+ * The writer failed or its queue was full, drop the clones handed to it.
+ */
+static void ringbuffer_file_msgs_free(nng_aio *aio)
+{
+	nng_msg **smsgs = (nng_msg **)nng_aio_get_prov_data(aio);
+	uint32_t *szp = (uint32_t *)nng_aio_get_msg(aio);
+
+	if (szp == NULL) {
+		return;
+	}
+	for (uint32_t i = 0; i < *szp && smsgs != NULL; i++) {
+		if (smsgs[i] != NULL) {
+			nng_msg_free(smsgs[i]);
+		}
+	}
+	if (smsgs != NULL) {
+		nng_free(smsgs, sizeof(nng_msg *) * *szp);
+	}
+	free(szp);
+	nng_aio_set_msg(aio, NULL);
+	nng_aio_set_prov_data(aio, NULL);
+}
+#endif
+
 #ifdef SUPP_PARQUET
 void ringbuffer_parquet_cb(void *arg)
 {
@@ -221,7 +526,8 @@ void ringbuffer_parquet_cb(void *arg)
 		return;
 	}
 	if (nng_aio_result(file->aio) != 0) {
-		log_error("parquet write file failed\n");
+		log_error("parquet write file failed: %d\n", nng_aio_result(file->aio));
+		ringbuffer_file_msgs_free(file->aio);
 		return;
 	}
 
@@ -350,6 +656,10 @@ static parquet_object *init_parquet_object(ringBuffer_t *rb, ringBufferFile_t *f
 		nng_free(dsize, sizeof(uint32_t) * rb->size);
 		return NULL;
 	}
+	/* Without a topic everything goes to one stream of files */
+	if (rb->topic != NULL) {
+		newObj->topic = nng_strdup(rb->topic);
+	}
 
 	return newObj;
 }
@@ -629,7 +939,8 @@ void ringbuffer_blf_cb(void *arg)
 		return;
 	}
 	if (nng_aio_result(file->aio) != 0) {
-		log_error("blf write file failed\n");
+		log_error("blf write file failed: %d\n", nng_aio_result(file->aio));
+		ringbuffer_file_msgs_free(file->aio);
 		return;
 	}
 
@@ -761,6 +1072,9 @@ static blf_object *init_blf_object(ringBuffer_t *rb, ringBufferFile_t *file)
 		nng_free(dsize, sizeof(uint32_t) * rb->size);
 		return NULL;
 	}
+	if (rb->topic != NULL) {
+		newObj->topic = nng_strdup(rb->topic);
+	}
 
 	return newObj;
 }
@@ -896,18 +1210,259 @@ put_msgs_to_aio(ringBuffer_t *rb, nng_aio *aio)
 	return 0;
 }
 
+/* Producer only: take every msg in [head, tail) out of the ring */
+static int ringBuffer_spmc_drop(ringBuffer_t *rb, uint64_t head, uint64_t tail)
+{
+	ringBufferSpmc_t *s = rb->spmc;
+	int phase;
+
+	if (!nni_atomic_cas64(&s->head.v, head, tail)) {
+		return -1;
+	}
+
+	nng_mtx_lock(s->retire_lock);
+	phase = nni_atomic_get(&s->phase);
+	for (uint64_t seq = head; seq < tail; seq++) {
+		cvector_push_back(s->retired[phase],
+			(nng_msg *)nni_atomic_get_ptr(&s->slots[seq % rb->cap].data));
+	}
+	ringBuffer_spmc_reclaim(s);
+	nng_mtx_unlock(s->retire_lock);
+
+	return 0;
+}
+
+static int ringBuffer_spmc_enqueue(ringBuffer_t *rb, uint64_t key, void *data)
+{
+	ringBufferSpmc_t *s = rb->spmc;
+	ringBufferSlot_t *slot;
+	uint64_t head;
+	uint64_t tail;
+
+	if (ringBuffer_rule_check(rb, data, ENQUEUE_IN_HOOK) != 0) {
+		return -1;
+	}
+
+	tail = nni_atomic_get64(&s->tail.v);
+	head = nni_atomic_get64(&s->head.v);
+	while (tail - head >= rb->cap) {
+		if (rb->fullOp != RB_FULL_DROP) {
+			log_error("Ring buffer is full enqueue failed!!!\n");
+			return -1;
+		}
+		if (ringBuffer_spmc_drop(rb, head, tail) == 0) {
+			head = tail;
+			break;
+		}
+		/* consumers took some, look again */
+		head = nni_atomic_get64(&s->head.v);
+	}
+
+	if (head == tail) {
+		nni_atomic_set_bool(&s->sorted, true);
+	} else if (key < s->lastKey) {
+		nni_atomic_set_bool(&s->sorted, false);
+	}
+	s->lastKey = key;
+
+	slot = &s->slots[tail % rb->cap];
+	nni_atomic_set64(&slot->seq, RB_SEQ_BUSY);
+	nni_atomic_set64(&slot->key, key);
+	nni_atomic_set_ptr(&slot->data, data);
+	nni_atomic_set64(&slot->seq, tail);
+	nni_atomic_set64(&s->tail.v, tail + 1);
+
+	(void)ringBuffer_rule_check(rb, data, ENQUEUE_OUT_HOOK);
+
+	return 0;
+}
+
+static int ringBuffer_spmc_dequeue(ringBuffer_t *rb, void **data)
+{
+	ringBufferSpmc_t *s = rb->spmc;
+	nng_msg *msg;
+	uint64_t head;
+	uint64_t key;
+
+	if (ringBuffer_rule_check(rb, NULL, DEQUEUE_IN_HOOK) != 0) {
+		return -1;
+	}
+
+	for (;;) {
+		head = nni_atomic_get64(&s->head.v);
+		if (head == nni_atomic_get64(&s->tail.v)) {
+			log_error("Ring buffer is NULL dequeue failed\n");
+			return -1;
+		}
+		if (ringBuffer_spmc_read(s, rb->cap, head, &key, &msg) &&
+			nni_atomic_cas64(&s->head.v, head, head + 1)) {
+			break;
+		}
+	}
+
+	/*
+	 * Readers may still be cloning the ring's reference, so hand out a
+	 * new one and retire ours.
+	 */
+	nng_msg_clone(msg);
+	nng_mtx_lock(s->retire_lock);
+	cvector_push_back(s->retired[nni_atomic_get(&s->phase)], msg);
+	ringBuffer_spmc_reclaim(s);
+	nng_mtx_unlock(s->retire_lock);
+
+	*data = msg;
+	(void)ringBuffer_rule_check(rb, msg, DEQUEUE_OUT_HOOK);
+
+	return 0;
+}
+
+/*
+ * First seq in [lo, hi) whose key is >= key (or > key if upper). Slots
+ * the producer has lapped were dropped, so they count as older.
+ */
+static uint64_t ringBuffer_spmc_bound(ringBuffer_t *rb, uint64_t lo, uint64_t hi,
+									  uint64_t key, int upper)
+{
+	uint64_t mid;
+	uint64_t k;
+	nng_msg *msg;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (!ringBuffer_spmc_read(rb->spmc, rb->cap, mid, &k, &msg) ||
+			k < key || (upper && k == key)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+static int ringBuffer_spmc_snapshot(ringBuffer_t *rb,
+									uint64_t start,
+									uint64_t end,
+									uint32_t *count,
+									nng_msg ***list)
+{
+	ringBufferSpmc_t *s = rb->spmc;
+	nng_msg **newList;
+	nng_msg *msg;
+	uint64_t first;
+	uint64_t last;
+	uint64_t key;
+	uint32_t n = 0;
+	int phase;
+
+	phase = ringBuffer_spmc_read_enter(s);
+	first = nni_atomic_get64(&s->head.v);
+	last = nni_atomic_get64(&s->tail.v);
+	if (nni_atomic_get_bool(&s->sorted)) {
+		first = ringBuffer_spmc_bound(rb, first, last, start, 0);
+		last = ringBuffer_spmc_bound(rb, first, last, end, 1);
+	}
+	if (first >= last) {
+		ringBuffer_spmc_read_leave(s, phase);
+		return -1;
+	}
+
+	newList = nng_alloc((last - first) * sizeof(nng_msg *));
+	if (newList == NULL) {
+		ringBuffer_spmc_read_leave(s, phase);
+		return -1;
+	}
+	for (uint64_t seq = first; seq < last; seq++) {
+		if (!ringBuffer_spmc_read(s, rb->cap, seq, &key, &msg) ||
+			key < start || key > end) {
+			continue;
+		}
+		/* Retired msgs are not freed before we leave */
+		nng_msg_clone(msg);
+		newList[n++] = msg;
+	}
+	ringBuffer_spmc_read_leave(s, phase);
+
+	if (n == 0) {
+		nng_free(newList, (last - first) * sizeof(nng_msg *));
+		return -1;
+	}
+
+	*count = n;
+	*list = newList;
+	return 0;
+}
+
 int ringBuffer_set_fullOp(ringBuffer_t *rb, enum fullOption fullOp)
 {
 	if (rb == NULL || fullOp >= RB_FULL_MAX) {
 		log_error("ringbuffer is NULL or fullOp is not valid: %d\n", fullOp);
 		return -1;
 	}
+	if (rb->spmc != NULL && fullOp != RB_FULL_NONE && fullOp != RB_FULL_DROP) {
+		log_error("fullOp is not supported by spmc ring buffer: %d\n", fullOp);
+		return -1;
+	}
 
 	rb->fullOp = fullOp;
 
 	return 0;
 }
 
+int ringBuffer_set_key_index(ringBuffer_t *rb, int enable)
+{
+	unsigned int i = 0;
+
+	if (rb == NULL || rb->spmc != NULL) {
+		log_error("ringbuffer is NULL or spmc\n");
+		return -1;
+	}
+
+	nng_mtx_lock(rb->ring_lock);
+	if (enable && rb->keyIndex == NULL) {
+		rb->keyIndex = nng_alloc(sizeof(nni_id_map));
+		if (rb->keyIndex == NULL) {
+			nng_mtx_unlock(rb->ring_lock);
+			log_error("alloc key index failed! no memory!\n");
+			return -1;
+		}
+		nni_id_map_init(rb->keyIndex, 0, 0, false);
+		rb->keyIndexExact = 1;
+		for (i = 0; i < rb->size; i++) {
+			unsigned int slot = ringBuffer_slot(rb, i);
+			ringBuffer_index_add(rb, rb->msgs[slot].key, slot);
+		}
+	} else if (!enable && rb->keyIndex != NULL) {
+		nni_id_map_fini(rb->keyIndex);
+		nng_free(rb->keyIndex, sizeof(nni_id_map));
+		rb->keyIndex = NULL;
+	}
+	nng_mtx_unlock(rb->ring_lock);
+
+	return 0;
+}
+
+int ringBuffer_set_topic(ringBuffer_t *rb, const char *topic)
+{
+	char *t = NULL;
+
+	if (rb == NULL) {
+		log_error("ringbuffer is NULL\n");
+		return -1;
+	}
+	if (topic != NULL && (t = nng_strdup(topic)) == NULL) {
+		log_error("alloc topic failed! no memory!\n");
+		return -1;
+	}
+
+	nng_mtx_lock(rb->ring_lock);
+	nng_strfree(rb->topic);
+	rb->topic = t;
+	nng_mtx_unlock(rb->ring_lock);
+
+	return 0;
+}
+
 int ringBuffer_enqueue(ringBuffer_t *rb,
 					   uint64_t key,
 					   void *data,
@@ -916,6 +1471,10 @@ int ringBuffer_enqueue(ringBuffer_t *rb,
 {
 	int ret;
 
+	if (rb->spmc != NULL) {
+		return ringBuffer_spmc_enqueue(rb, key, data);
+	}
+
 	nng_mtx_lock(rb->ring_lock);
 	ret = ringBuffer_rule_check(rb, data, ENQUEUE_IN_HOOK);
 	if (ret != 0) {
@@ -951,6 +1510,12 @@ int ringBuffer_enqueue(ringBuffer_t *rb,
 		}
 	}
 
+	if (rb->size > 0 &&
+		key < rb->msgs[ringBuffer_slot(rb, rb->size - 1)].key) {
+		rb->keysSorted = 0;
+	}
+	ringBuffer_index_add(rb, key, rb->tail);
+
 	ringBufferMsg_t *msg = &rb->msgs[rb->tail];
 
 	msg->key = key;
@@ -969,6 +1534,10 @@ int ringBuffer_enqueue(ringBuffer_t *rb,
 int ringBuffer_dequeue(ringBuffer_t *rb, void **data)
 {
 	int ret;
+
+	if (rb->spmc != NULL) {
+		return ringBuffer_spmc_dequeue(rb, data);
+	}
 	nng_mtx_lock(rb->ring_lock);
 	ret = ringBuffer_rule_check(rb, NULL, DEQUEUE_IN_HOOK);
 	if (ret != 0) {
@@ -983,8 +1552,13 @@ int ringBuffer_dequeue(ringBuffer_t *rb, void **data)
 	}
 
 	*data = rb->msgs[rb->head].data;
+	ringBuffer_index_del(rb, rb->msgs[rb->head].key, rb->head);
 	rb->head = (rb->head + 1) % rb->cap;
 	rb->size = rb->size - 1;
+	if (rb->size == 0) {
+		/* Every indexed key has been removed along the way */
+		ringBuffer_index_reset(rb);
+	}
 
 	(void)ringBuffer_rule_check(rb, *data, DEQUEUE_OUT_HOOK);
 
@@ -1020,6 +1594,10 @@ int ringBuffer_release(ringBuffer_t *rb)
 	}
 
 	nng_mtx_lock(rb->ring_lock);
+	if (rb->spmc != NULL) {
+		ringBuffer_spmc_free(rb->spmc, rb->cap);
+		rb->spmc = NULL;
+	}
 	if (rb->msgs != NULL) {
 		if (rb->size != 0) {
 			i = rb->head;
@@ -1045,6 +1623,12 @@ int ringBuffer_release(ringBuffer_t *rb)
 		cvector_free(rb->files);
 	}
 
+	if (rb->keyIndex != NULL) {
+		nni_id_map_fini(rb->keyIndex);
+		nng_free(rb->keyIndex, sizeof(nni_id_map));
+	}
+	nng_strfree(rb->topic);
+
 	ringBufferRuleList_release(rb->enqinRuleList, rb->enqinRuleListLen);
 	ringBufferRuleList_release(rb->deqinRuleList, rb->deqinRuleListLen);
 	ringBufferRuleList_release(rb->enqoutRuleList, rb->enqoutRuleListLen);
@@ -1130,28 +1714,27 @@ int ringBuffer_add_rule(ringBuffer_t *rb,
 
 int ringBuffer_search_msg_by_key(ringBuffer_t *rb, uint64_t key, nng_msg **msg)
 {
-	unsigned int i = 0;
+	int64_t pos;
 
-	if (rb == NULL || msg == NULL) {
+	if (rb == NULL || msg == NULL || rb->spmc != NULL) {
 		return -1;
 	}
 
 	nng_mtx_lock(rb->ring_lock);
-	for (i = rb->head; i < rb->size; i++) {
-		i = i % rb->cap;
-		if (rb->msgs[i].key == key) {
-			*msg = rb->msgs[i].data;
-			nng_mtx_unlock(rb->ring_lock);
-			return 0;
-		}
+	pos = ringBuffer_find_key(rb, key);
+	if (pos < 0) {
+		nng_mtx_unlock(rb->ring_lock);
+		return -1;
 	}
 
+	*msg = rb->msgs[ringBuffer_slot(rb, (unsigned int)pos)].data;
 	nng_mtx_unlock(rb->ring_lock);
-	return -1;
+	return 0;
 }
 
 /*
- * binary search, only for ringbuffer head is 0
+ * Messages with start <= key <= end, oldest first. Binary search over
+ * the ring when keys are monotonic, otherwise a scan.
  */
 int ringBuffer_search_msgs_fuzz(ringBuffer_t *rb,
 								uint64_t start,
@@ -1159,85 +1742,66 @@ int ringBuffer_search_msgs_fuzz(ringBuffer_t *rb,
 								uint32_t *count,
 								nng_msg ***list)
 {
-	uint32_t low = 0;
-	uint32_t high = 0;
-	uint32_t mid = 0;
-	uint32_t start_index = 0;
-	uint32_t end_index = 0;
+	unsigned int first = 0;
+	unsigned int last = 0;
+	unsigned int pos = 0;
+	uint32_t n = 0;
 
-	nng_mtx_lock(rb->ring_lock);
-	if (rb == NULL || rb->size == 0 || count == NULL || list == NULL) {
-		nng_mtx_unlock(rb->ring_lock);
+	if (rb == NULL || count == NULL || list == NULL) {
 		log_error("ringbuffer is NULL or count is NULL or list is NULL\n");
 		return -1;
 	}
-
-	if (start > end ||
-		start > rb->msgs[rb->head + rb->size - 1].key ||
-		end < rb->msgs[rb->head].key) {
-		nng_mtx_unlock(rb->ring_lock);
+	if (rb->spmc != NULL) {
+		log_error("use ringBuffer_snapshot_msgs on spmc ring buffer\n");
 		return -1;
 	}
 
-	if (rb->head != 0) {
-		log_error("Ringbuffer head is not 0, can not use binary search\n");
+	nng_mtx_lock(rb->ring_lock);
+	if (rb->size == 0 || start > end) {
 		nng_mtx_unlock(rb->ring_lock);
 		return -1;
 	}
 
-	low	= rb->head;
-	high = rb->head + rb->size - 1;
-	while (low < high) {
-		mid = (low + high) / 2;
-		if (rb->msgs[mid].key < start) {
-			low = mid + 1;
-		} else {
-			high = mid;
-		}
-	}
-
-	if (rb->msgs[high].key >= start) {
-		start_index = high;
+	if (rb->keysSorted) {
+		first = ringBuffer_bound(rb, start, 0);
+		last = ringBuffer_bound(rb, end, 1);
+		n = last > first ? last - first : 0;
 	} else {
-		nng_mtx_unlock(rb->ring_lock);
-		return -1;
-	}
-
-	low	= rb->head;
-	high = rb->head + rb->size - 1;
-	while (low < high) {
-		mid = (low + high + 1) / 2;
-		if (rb->msgs[mid].key <= end) {
-			low = mid;
-		} else {
-			high = mid - 1;
+		first = 0;
+		last = rb->size;
+		for (pos = first; pos < last; pos++) {
+			uint64_t key = rb->msgs[ringBuffer_slot(rb, pos)].key;
+			if (key >= start && key <= end) {
+				n++;
+			}
 		}
 	}
 
-	if (rb->msgs[low].key > end) {
+	if (n == 0) {
 		nng_mtx_unlock(rb->ring_lock);
 		return -1;
-	} else {
-		end_index = low;
 	}
 
-	*count = end_index - start_index + 1;
-	nng_msg **newList = nng_alloc((*count) * sizeof(nng_msg *));
+	nng_msg **newList = nng_alloc(n * sizeof(nng_msg *));
 	if (newList == NULL) {
 		nng_mtx_unlock(rb->ring_lock);
 		return -1;
 	}
 
-	for (uint32_t i = start_index; i <= end_index; i++) {
-		nng_msg *msg = rb->msgs[i].data;
-		if (msg == NULL) {
-			nng_free(newList, sizeof(*newList));
+	*count = 0;
+	for (pos = first; pos < last; pos++) {
+		ringBufferMsg_t *rmsg = &rb->msgs[ringBuffer_slot(rb, pos)];
+		if (rmsg->key < start || rmsg->key > end) {
+			continue;
+		}
+		if (rmsg->data == NULL) {
+			nng_free(newList, n * sizeof(nng_msg *));
 			nng_mtx_unlock(rb->ring_lock);
 			log_error("msg is NULL and some error occured\n");
 			return -1;
 		}
-		nng_msg_set_proto_data(msg, NULL, (void *)(uintptr_t)rb->msgs[i].key);
-		newList[i - start_index] = msg;
+		nng_msg_set_proto_data(rmsg->data, NULL, (void *)(uintptr_t)rmsg->key);
+		newList[(*count)++] = rmsg->data;
 	}
 
 	*list = newList;
@@ -1245,12 +1809,17 @@ int ringBuffer_search_msgs_fuzz(ringBuffer_t *rb,
 	return 0;
 }
 
+/*
+ * count messages starting from the oldest one with key, wrapping around
+ * to the head if there are not that many after it.
+ */
 int ringBuffer_search_msgs_by_key(ringBuffer_t *rb, uint64_t key, uint32_t count, nng_msg ***list)
 {
 	unsigned int i = 0;
 	unsigned int j = 0;
+	int64_t pos;
 
-	if (rb == NULL || count <= 0 || list == NULL) {
+	if (rb == NULL || count <= 0 || list == NULL || rb->spmc != NULL) {
 		return -1;
 	}
 
@@ -1260,31 +1829,92 @@ int ringBuffer_search_msgs_by_key(ringBuffer_t *rb, uint64_t key, uint32_t count
 		return -1;
 	}
 
+	pos = ringBuffer_find_key(rb, key);
+	if (pos < 0) {
+		nng_mtx_unlock(rb->ring_lock);
+		return -1;
+	}
+
 	nng_msg **newList = nng_alloc(count * sizeof(nng_msg *));
 	if (newList == NULL) {
 		nng_mtx_unlock(rb->ring_lock);
 		return -1;
 	}
 
-	for (i = rb->head; i < rb->size; i++) {
-		i = i % rb->cap;
-		if (rb->msgs[i].key == key) {
-			for (j = 0; j < count; j++) {
-				nng_msg *msg = rb->msgs[i].data;
+	for (j = 0; j < count; j++) {
+		i = ringBuffer_slot(rb, (unsigned int)((pos + j) % rb->size));
+		nng_msg *msg = rb->msgs[i].data;
+
+		nng_msg_set_proto_data(msg, NULL, (void *)(uintptr_t)rb->msgs[i].key);
+
+		newList[j] = msg;
+	}
+
+	*list = newList;
+	nng_mtx_unlock(rb->ring_lock);
+	return 0;
+}
+
+int ringBuffer_snapshot_msgs(ringBuffer_t *rb,
+							 uint64_t start,
+							 uint64_t end,
+							 uint32_t *count,
+							 nng_msg ***list)
+{
+	unsigned int first = 0;
+	unsigned int last = 0;
+	unsigned int pos = 0;
+	uint32_t n = 0;
+
+	if (rb == NULL || count == NULL || list == NULL || start > end) {
+		log_error("ringbuffer is NULL or count is NULL or list is NULL\n");
+		return -1;
+	}
+
+	if (rb->spmc != NULL) {
+		return ringBuffer_spmc_snapshot(rb, start, end, count, list);
+	}
 
-				nng_msg_set_proto_data(msg, NULL, (void *)(uintptr_t)rb->msgs[i].key);
+	nng_mtx_lock(rb->ring_lock);
+	if (rb->size == 0) {
+		nng_mtx_unlock(rb->ring_lock);
+		return -1;
+	}
 
-				newList[j] = msg;
+	if (rb->keysSorted) {
+		first = ringBuffer_bound(rb, start, 0);
+		last = ringBuffer_bound(rb, end, 1);
+	} else {
+		first = 0;
+		last = rb->size;
+	}
+	if (first >= last) {
+		nng_mtx_unlock(rb->ring_lock);
+		return -1;
+	}
 
-				i = (i + 1) % rb->cap;
-			}
-			*list = newList;
-			nng_mtx_unlock(rb->ring_lock);
-			return 0;
-		}
+	nng_msg **newList = nng_alloc((last - first) * sizeof(nng_msg *));
+	if (newList == NULL) {
+		nng_mtx_unlock(rb->ring_lock);
+		return -1;
 	}
 
+	for (pos = first; pos < last; pos++) {
+		ringBufferMsg_t *rmsg = &rb->msgs[ringBuffer_slot(rb, pos)];
+		if (rmsg->key < start || rmsg->key > end || rmsg->data == NULL) {
+			continue;
+		}
+		nng_msg_clone(rmsg->data);
+		newList[n++] = rmsg->data;
+	}
 	nng_mtx_unlock(rb->ring_lock);
-	nng_free(newList, sizeof(*newList));
-	return -1;
+
+	if (n == 0) {
+		nng_free(newList, (last - first) * sizeof(nng_msg *));
+		return -1;
+	}
+
+	*count = n;
+	*list = newList;
+	return 0;
 }
@@ -1,6 +1,7 @@
 #include "nng/supplemental/nanolib/ringbuffer.h"
 #include "nng/mqtt/mqtt_client.h"
 #include <nuts.h>
+#include <stdlib.h>
 
 #define UNUSED(x) ((void) x)
 
@@ -530,6 +531,334 @@ void test_ringBuffer_get_and_clean_up()
 
 }
 
+void test_ringBuffer_search_wrapped()
+{
+	ringBuffer_t *rb = NULL;
+	nng_msg *tmp = NULL;
+	nng_msg *msgs[10];
+	nng_msg **msgList = NULL;
+	uint32_t count = 0;
+	void *data;
+
+	NUTS_TRUE(ringBuffer_init(&rb, 10, RB_FULL_NONE, -1) == 0);
+	NUTS_TRUE(ringBuffer_set_key_index(rb, 1) == 0);
+	/* keys 0..9, then move head to 6 and wrap keys 10..15 over 0..5 */
+	for (int i = 0; i < 10; i++) {
+		msgs[i] = alloc_pub_msg("topic1");
+		NUTS_TRUE(ringBuffer_enqueue(rb, i, msgs[i], -1, NULL) == 0);
+	}
+	for (int i = 0; i < 6; i++) {
+		NUTS_TRUE(ringBuffer_dequeue(rb, &data) == 0);
+		NUTS_TRUE(data == msgs[i]);
+		nng_msg_free(data);
+		msgs[i] = alloc_pub_msg("topic1");
+		NUTS_TRUE(ringBuffer_enqueue(rb, 10 + i, msgs[i], -1, NULL) == 0);
+	}
+	NUTS_TRUE(rb->head == 6);
+
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 3, &tmp) == -1);
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 7, &tmp) == 0);
+	NUTS_TRUE(tmp == msgs[7]);
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 12, &tmp) == 0);
+	NUTS_TRUE(tmp == msgs[2]);
+
+	NUTS_TRUE(ringBuffer_search_msgs_by_key(rb, 8, 4, &msgList) == 0);
+	NUTS_TRUE(msgList[0] == msgs[8]);
+	NUTS_TRUE(msgList[3] == msgs[1]);
+	nng_free(msgList, sizeof(nng_msg *) * 4);
+
+	/* the range spans the end of the array */
+	NUTS_TRUE(ringBuffer_search_msgs_fuzz(rb, 7, 11, &count, &msgList) == 0);
+	NUTS_TRUE(count == 5);
+	NUTS_TRUE(msgList[0] == msgs[7]);
+	NUTS_TRUE(msgList[4] == msgs[1]);
+	nng_free(msgList, sizeof(nng_msg *) * count);
+	NUTS_TRUE(ringBuffer_search_msgs_fuzz(rb, 0, 5, &count, &msgList) == -1);
+	NUTS_TRUE(ringBuffer_search_msgs_fuzz(rb, 16, 100, &count, &msgList) == -1);
+
+	/* a duplicate key, the oldest one still wins */
+	NUTS_TRUE(ringBuffer_dequeue(rb, &data) == 0);
+	NUTS_TRUE(data == msgs[6]);
+	nng_msg_free(data);
+	msgs[6] = alloc_pub_msg("topic1");
+	NUTS_TRUE(ringBuffer_enqueue(rb, 8, msgs[6], -1, NULL) == 0);
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 8, &tmp) == 0);
+	NUTS_TRUE(tmp == msgs[8]);
+	NUTS_TRUE(ringBuffer_search_msgs_fuzz(rb, 8, 8, &count, &msgList) == 0);
+	NUTS_TRUE(count == 2);
+	nng_free(msgList, sizeof(nng_msg *) * count);
+
+	NUTS_TRUE(ringBuffer_release(rb) == 0);
+}
+
+/*
+ * The benches take seconds, so they only run when NNG_TEST_RINGBUFFER_BENCH
+ * is set in the environment.
+ */
+static int rb_bench_enabled(const char *name)
+{
+	if (getenv("NNG_TEST_RINGBUFFER_BENCH") == NULL) {
+		printf("%s skipped, set NNG_TEST_RINGBUFFER_BENCH to run it\n",
+		    name);
+		return 0;
+	}
+	return 1;
+}
+
+#define RB_BENCH_SIZE (1024 * 1024)
+#define RB_BENCH_WRAP (RB_BENCH_SIZE / 3)
+#define RB_BENCH_LOOKUPS 200000
+
+void test_ringBuffer_search_bench()
+{
+	ringBuffer_t *rb = NULL;
+	nng_msg *msg = alloc_pub_msg("topic1");
+	nng_msg *tmp = NULL;
+	nng_msg **msgList = NULL;
+	uint32_t count = 0;
+	uint64_t first = RB_BENCH_WRAP;
+	uint64_t last = RB_BENCH_SIZE + RB_BENCH_WRAP - 1;
+	void *data;
+	nng_time t0, t1;
+	int misses = 0;
+
+	if (!rb_bench_enabled("ringbuffer search bench")) {
+		nng_msg_free(msg);
+		return;
+	}
+	/* Every entry shares one msg, we drain the buffer before release */
+	NUTS_TRUE(ringBuffer_init(&rb, RB_BENCH_SIZE, RB_FULL_NONE, -1) == 0);
+	NUTS_TRUE(ringBuffer_set_key_index(rb, 1) == 0);
+	for (uint64_t i = 0; i < RB_BENCH_SIZE; i++) {
+		NUTS_TRUE(ringBuffer_enqueue(rb, i, msg, -1, NULL) == 0);
+	}
+	for (uint64_t i = RB_BENCH_SIZE; i <= last; i++) {
+		NUTS_TRUE(ringBuffer_dequeue(rb, &data) == 0);
+		NUTS_TRUE(ringBuffer_enqueue(rb, i, msg, -1, NULL) == 0);
+	}
+	NUTS_TRUE(rb->head == RB_BENCH_WRAP);
+
+	t0 = nng_clock();
+	for (int i = 0; i < RB_BENCH_LOOKUPS; i++) {
+		uint64_t key = first + nng_random() % RB_BENCH_SIZE;
+		if (ringBuffer_search_msg_by_key(rb, key, &tmp) != 0) {
+			misses++;
+		}
+	}
+	t1 = nng_clock();
+	NUTS_TRUE(misses == 0);
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, first - 1, &tmp) == -1);
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, last + 1, &tmp) == -1);
+	printf("ringbuffer %d exact lookups at %d entries: %dms\n",
+	    RB_BENCH_LOOKUPS, RB_BENCH_SIZE, (int) (t1 - t0));
+
+	t0 = nng_clock();
+	for (int i = 0; i < RB_BENCH_LOOKUPS; i++) {
+		uint64_t start = first + nng_random() % (RB_BENCH_SIZE - 16);
+		if (ringBuffer_search_msgs_fuzz(
+		        rb, start, start + 15, &count, &msgList) != 0) {
+			misses++;
+			continue;
+		}
+		if (count != 16) {
+			misses++;
+		}
+		nng_free(msgList, sizeof(nng_msg *) * count);
+	}
+	t1 = nng_clock();
+	NUTS_TRUE(misses == 0);
+	printf("ringbuffer %d range lookups at %d entries: %dms\n",
+	    RB_BENCH_LOOKUPS, RB_BENCH_SIZE, (int) (t1 - t0));
+
+	/* A range across the wrap point */
+	NUTS_TRUE(ringBuffer_search_msgs_fuzz(rb, RB_BENCH_SIZE - 10,
+	              RB_BENCH_SIZE + 9, &count, &msgList) == 0);
+	NUTS_TRUE(count == 20);
+	nng_free(msgList, sizeof(nng_msg *) * count);
+
+	while (ringBuffer_dequeue(rb, &data) == 0) {
+		;
+	}
+	NUTS_TRUE(ringBuffer_release(rb) == 0);
+	nng_msg_free(msg);
+}
+
+void test_ringBuffer_spmc()
+{
+	ringBuffer_t *rb = NULL;
+	nng_msg *msgs[5];
+	nng_msg *tmp = NULL;
+	nng_msg **msgList = NULL;
+	uint32_t count = 0;
+	void *data;
+
+	NUTS_TRUE(ringBuffer_init_spmc(&rb, 4, RB_FULL_FILE, -1) == -1);
+	NUTS_TRUE(ringBuffer_init_spmc(&rb, 4, RB_FULL_DROP, -1) == 0);
+	NUTS_TRUE(ringBuffer_set_key_index(rb, 1) == -1);
+	NUTS_TRUE(ringBuffer_set_fullOp(rb, RB_FULL_RETURN) == -1);
+
+	for (int i = 0; i < 4; i++) {
+		msgs[i] = alloc_pub_msg("topic1");
+		NUTS_TRUE(ringBuffer_enqueue(rb, i, msgs[i], -1, NULL) == 0);
+	}
+	NUTS_TRUE(ringBuffer_search_msg_by_key(rb, 1, &tmp) == -1);
+
+	/* snapshots hold their own references */
+	NUTS_TRUE(ringBuffer_snapshot_msgs(rb, 1, 2, &count, &msgList) == 0);
+	NUTS_TRUE(count == 2);
+	NUTS_TRUE(msgList[0] == msgs[1]);
+	NUTS_TRUE(msgList[1] == msgs[2]);
+
+	/* full, everything is dropped */
+	msgs[4] = alloc_pub_msg("topic1");
+	NUTS_TRUE(ringBuffer_enqueue(rb, 4, msgs[4], -1, NULL) == 0);
+	NUTS_TRUE(nng_msg_len(msgList[1]) == nng_msg_len(msgs[4]));
+	for (uint32_t i = 0; i < count; i++) {
+		nng_msg_free(msgList[i]);
+	}
+	nng_free(msgList, sizeof(nng_msg *) * count);
+
+	NUTS_TRUE(ringBuffer_snapshot_msgs(rb, 0, 3, &count, &msgList) == -1);
+	NUTS_TRUE(ringBuffer_snapshot_msgs(rb, 0, 10, &count, &msgList) == 0);
+	NUTS_TRUE(count == 1);
+	NUTS_TRUE(msgList[0] == msgs[4]);
+	nng_msg_free(msgList[0]);
+	nng_free(msgList, sizeof(nng_msg *) * count);
+
+	NUTS_TRUE(ringBuffer_dequeue(rb, &data) == 0);
+	NUTS_TRUE(data == msgs[4]);
+	nng_msg_free(data);
+	NUTS_TRUE(ringBuffer_dequeue(rb, &data) == -1);
+
+	/* out of order keys fall back to a scan */
+	for (int i = 0; i < 3; i++) {
+		msgs[i] = alloc_pub_msg("topic1");
+		NUTS_TRUE(ringBuffer_enqueue(rb, 10 - i, msgs[i], -1, NULL) == 0);
+	}
+	NUTS_TRUE(ringBuffer_snapshot_msgs(rb, 8, 9, &count, &msgList) == 0);
+	NUTS_TRUE(count == 2);
+	NUTS_TRUE(msgList[0] == msgs[1]);
+	NUTS_TRUE(msgList[1] == msgs[2]);
+	for (uint32_t i = 0; i < count; i++) {
+		nng_msg_free(msgList[i]);
+	}
+	nng_free(msgList, sizeof(nng_msg *) * count);
+	NUTS_TRUE(ringBuffer_release(rb) == 0);
+
+	NUTS_TRUE(ringBuffer_init_spmc(&rb, 2, RB_FULL_NONE, -1) == 0);
+	for (int i = 0; i < 3; i++) {
+		msgs[i] = alloc_pub_msg("topic1");
+	}
+	NUTS_TRUE(ringBuffer_enqueue(rb, 0, msgs[0], -1, NULL) == 0);
+	NUTS_TRUE(ringBuffer_enqueue(rb, 1, msgs[1], -1, NULL) == 0);
+	NUTS_TRUE(ringBuffer_enqueue(rb, 2, msgs[2], -1, NULL) == -1);
+	nng_msg_free(msgs[2]);
+	NUTS_TRUE(ringBuffer_release(rb) == 0);
+}
+
+#define RB_SPMC_CAP 4096
+#define RB_SPMC_MSGS 200000
+#define RB_SPMC_RANGE 32
+
+typedef struct {
+	ringBuffer_t *rb;
+	volatile uint64_t produced;
+	volatile int stop;
+	uint64_t snapshots[8];
+} spmc_bench_t;
+
+typedef struct {
+	spmc_bench_t *b;
+	int id;
+} spmc_reader_t;
+
+static void spmc_bench_reader(void *arg)
+{
+	spmc_reader_t *r = arg;
+	spmc_bench_t *b = r->b;
+	nng_msg **msgList = NULL;
+	uint32_t count = 0;
+
+	while (!b->stop) {
+		uint64_t start = b->produced;
+		start = start > RB_SPMC_RANGE ? start - RB_SPMC_RANGE : 0;
+		start -= nng_random() % (RB_SPMC_CAP / 2);
+		if (ringBuffer_snapshot_msgs(b->rb, start, start + RB_SPMC_RANGE,
+		                             &count, &msgList) == 0) {
+			for (uint32_t i = 0; i < count; i++) {
+				nng_msg_free(msgList[i]);
+			}
+			nng_free(msgList, sizeof(nng_msg *) * count);
+		}
+		b->snapshots[r->id]++;
+	}
+}
+
+static void spmc_bench_run(int spmc, int nreaders)
+{
+	spmc_bench_t b;
+	spmc_reader_t readers[8];
+	nng_thread *thr[8];
+	uint64_t snapshots = 0;
+	uint64_t n;
+	nng_time t0, t1;
+	int rv = 0;
+
+	memset(&b, 0, sizeof(b));
+	if (spmc) {
+		NUTS_TRUE(ringBuffer_init_spmc(&b.rb, RB_SPMC_CAP, RB_FULL_DROP, -1) == 0);
+	} else {
+		NUTS_TRUE(ringBuffer_init(&b.rb, RB_SPMC_CAP, RB_FULL_DROP, -1) == 0);
+	}
+	for (int i = 0; i < nreaders; i++) {
+		readers[i].b = &b;
+		readers[i].id = i;
+		NUTS_PASS(nng_thread_create(&thr[i], spmc_bench_reader, &readers[i]));
+	}
+
+	t0 = nng_clock();
+	for (n = 0; n < RB_SPMC_MSGS; n++) {
+		nng_msg *msg;
+		if ((rv = nng_msg_alloc(&msg, 0)) != 0) {
+			break;
+		}
+		if (ringBuffer_enqueue(b.rb, n, msg, -1, NULL) != 0) {
+			nng_msg_free(msg);
+			rv = NNG_EINTERNAL;
+			break;
+		}
+		b.produced = n;
+	}
+	t1 = nng_clock();
+	b.stop = 1;
+	for (int i = 0; i < nreaders; i++) {
+		nng_thread_destroy(thr[i]);
+		snapshots += b.snapshots[i];
+	}
+	NUTS_PASS(rv);
+	if (t1 == t0) {
+		t1 = t0 + 1;
+	}
+
+	printf("ringbuffer %s, %d readers: %d enqueues/s, %d snapshots/s\n",
+	    spmc ? "spmc" : "mutex", nreaders,
+	    (int) (RB_SPMC_MSGS * 1000 / (t1 - t0)),
+	    (int) (snapshots * 1000 / (t1 - t0)));
+
+	NUTS_TRUE(ringBuffer_release(b.rb) == 0);
+}
+
+void test_ringBuffer_spmc_bench()
+{
+	if (!rb_bench_enabled("ringbuffer spmc bench")) {
+		return;
+	}
+	for (int n = 1; n <= 8; n *= 2) {
+		spmc_bench_run(0, n);
+		spmc_bench_run(1, n);
+	}
+}
+
 NUTS_TESTS = {
 	{ "Ring buffer init test", test_ringBuffer_init },
 	{ "Ring buffer release test", test_ringBuffer_release },
@@ -540,5 +869,9 @@ NUTS_TESTS = {
 	{ "Ring buffer search msgs by key", test_ringBuffer_search_msgs_by_key },
 	{ "Ring buffer search msgs fuzz", test_ringBuffer_search_msgs_fuzz },
 	{ "Ring buffer get and clean up test", test_ringBuffer_get_and_clean_up},
+	{ "Ring buffer search wrapped", test_ringBuffer_search_wrapped },
+	{ "Ring buffer search bench", test_ringBuffer_search_bench },
+	{ "Ring buffer spmc", test_ringBuffer_spmc },
+	{ "Ring buffer spmc bench", test_ringBuffer_spmc_bench },
 	{ NULL, NULL },
 };
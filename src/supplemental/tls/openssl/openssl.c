@@ -17,6 +17,12 @@
 #include <openssl/err.h>
 #include <openssl/crypto.h>
 #include <openssl/x509v3.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_MAJOR >= 3
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
 
 // Follow the suggestion from Sliepen. https://stackoverflow.com/questions/69079419/how-i-can-read-more-than-16384-bytes-using-openssl-tls
 #define OPEN_BUF_SZ 16000
@@ -96,6 +102,44 @@ print_hex(char *str, const uint8_t *data, size_t len)
 #include "nng/supplemental/tls/tls.h"
 #include <nng/supplemental/tls/engine.h>
 
+#ifdef NNG_HAVE_KTLS
+#include <ctype.h>
+#include <errno.h>
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <openssl/hmac.h>
+#include <sys/socket.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+// open_rec_count counts the records that pass through one of our BIOs.
+// The kernel has to be told the sequence number of the next record, and
+// OpenSSL keeps those to itself, so we work them out from the stream.
+typedef struct {
+	uint8_t  hdr[5];
+	size_t   hdr_len;
+	size_t   body; // left of the current record
+	uint64_t count; // complete records
+} open_rec_count;
+
+typedef struct {
+	bool           on;
+	bool           ulp; // TCP_ULP is set on the socket
+	open_rec_count tx;
+	open_rec_count rx;
+	uint64_t       tx_base; // count at which sequence numbers start
+	uint64_t       rx_base;
+	unsigned char  secret[2][EVP_MAX_MD_SIZE]; // TLS 1.3 client, server
+	size_t         secret_len;
+} open_ktls;
+#endif
+
 struct nng_tls_engine_conn {
 	void    *tls; // parent conn
 	SSL     *ssl;
@@ -109,19 +153,110 @@ struct nng_tls_engine_conn {
 	int      wntcpsz;
 	int      running;
 	int      ok;
+#ifdef NNG_HAVE_KTLS
+	open_ktls ktls;
+#endif
 };
 
+// open_ticket_key protects session tickets.  OpenSSL uses one key for
+// the life of the context, so when rotation is wanted we supply our own:
+// the current key, and the one before it, which can still decrypt the
+// tickets it issued until they expire.
+typedef struct {
+	unsigned char name[16];
+	unsigned char aes[32];
+	unsigned char hmac[32];
+	nni_time      retire; // when it stops issuing tickets, 0 if unused
+} open_ticket_key;
+
 struct nng_tls_engine_config {
-	SSL_CTX     *ctx;
-	nng_tls_mode mode;
-	char        *pass;
-	char        *server_name;
-	int          auth_mode;
-	nni_list     psks;
+	SSL_CTX        *ctx;
+	nng_tls_mode    mode;
+	char           *pass;
+	char           *server_name;
+	int             auth_mode;
+	nni_list        psks;
+	nni_mtx         ticket_lk;
+	open_ticket_key ticket_keys[2]; // current and previous
+	nng_duration    ticket_life;
+	nng_duration    ticket_rotate;
+	bool            ktls;
 };
 
 static int open_conn_handshake(nng_tls_engine_conn *ec);
 
+#ifdef NNG_HAVE_KTLS
+static void open_ktls_ready(nng_tls_engine_conn *ec);
+
+static void
+open_rec_feed(open_rec_count *rc, const uint8_t *buf, size_t len)
+{
+	while (len > 0) {
+		if (rc->body > 0) {
+			size_t n = rc->body < len ? rc->body : len;
+			rc->body -= n;
+			buf += n;
+			len -= n;
+			if (rc->body == 0) {
+				rc->count++;
+			}
+			continue;
+		}
+		rc->hdr[rc->hdr_len++] = *buf++;
+		len--;
+		if (rc->hdr_len == sizeof(rc->hdr)) {
+			rc->hdr_len = 0;
+			rc->body    = ((size_t) rc->hdr[3] << 8) | rc->hdr[4];
+			if (rc->body == 0) {
+				rc->count++;
+			}
+		}
+	}
+}
+
+// open_rec_pending returns how many records are completed by data that
+// has not been counted yet, as if it followed what has been.
+static uint64_t
+open_rec_pending(const open_rec_count *rc, BIO *bio)
+{
+	open_rec_count copy = *rc;
+	char          *data;
+	long           len;
+
+	if ((len = BIO_get_mem_data(bio, &data)) <= 0) {
+		return (0);
+	}
+	open_rec_feed(&copy, (const uint8_t *) data, (size_t) len);
+	return (copy.count - rc->count);
+}
+#endif
+
+// open_bio_read takes the records OpenSSL produced, and open_bio_write
+// gives it those we received.  All data goes through these two.
+static int
+open_bio_read(nng_tls_engine_conn *ec, char *buf, int len)
+{
+	int rv = BIO_read(ec->wbio, buf, len);
+#ifdef NNG_HAVE_KTLS
+	if (ec->ktls.on && (rv > 0)) {
+		open_rec_feed(&ec->ktls.tx, (const uint8_t *) buf, rv);
+	}
+#endif
+	return (rv);
+}
+
+static int
+open_bio_write(nng_tls_engine_conn *ec, const char *buf, int len)
+{
+	int rv = BIO_write(ec->rbio, buf, len);
+#ifdef NNG_HAVE_KTLS
+	if (ec->ktls.on && (rv > 0)) {
+		open_rec_feed(&ec->ktls.rx, (const uint8_t *) buf, rv);
+	}
+#endif
+	return (rv);
+}
+
 /************************* SSL Connection ***********************/
 
 static void
@@ -129,6 +264,9 @@ open_conn_fini(nng_tls_engine_conn *ec)
 {
 	trace("start");
 	SSL_free(ec->ssl);
+#ifdef NNG_HAVE_KTLS
+	OPENSSL_cleanse(ec->ktls.secret, sizeof(ec->ktls.secret));
+#endif
 	trace("end");
 }
 
@@ -221,11 +359,57 @@ open_conn_init(nng_tls_engine_conn *ec, void *tls, nng_tls_engine_config *cfg)
 	if (cfg->server_name != NULL) {
 		SSL_set_tlsext_host_name(ec->ssl, cfg->server_name);
 	}
+#ifdef NNG_HAVE_KTLS
+	// The key log callback finds us through this.
+	ec->ktls.on = cfg->ktls;
+	SSL_set_app_data(ec->ssl, ec);
+#endif
 	trace("end");
 
 	return (0);
 }
 
+static void *
+open_conn_session_get(nng_tls_engine_conn *ec)
+{
+	SSL_SESSION *sess;
+	SSL_SESSION *dup = NULL;
+
+	// With TLS 1.3 the session is only resumable once a ticket has
+	// arrived, which happens after the handshake.  We keep a copy, as
+	// freeing an SSL that was not shut down cleanly marks its session
+	// as not resumable.
+	if ((sess = SSL_get1_session(ec->ssl)) == NULL) {
+		return (NULL);
+	}
+	if (SSL_SESSION_is_resumable(sess)) {
+		dup = SSL_SESSION_dup(sess);
+	}
+	SSL_SESSION_free(sess);
+	return (dup);
+}
+
+static int
+open_conn_session_set(nng_tls_engine_conn *ec, void *sess)
+{
+	if (SSL_set_session(ec->ssl, sess) != 1) {
+		return (NNG_ECRYPTO);
+	}
+	return (0);
+}
+
+static void
+open_conn_session_free(void *sess)
+{
+	SSL_SESSION_free(sess);
+}
+
+static bool
+open_conn_resumed(nng_tls_engine_conn *ec)
+{
+	return (SSL_session_reused(ec->ssl) == 1);
+}
+
 static void
 open_conn_close(nng_tls_engine_conn *ec)
 {
@@ -253,7 +437,7 @@ open_conn_handshake(nng_tls_engine_conn *ec)
 	if (rv == SSL_ERROR_WANT_READ || rv == SSL_ERROR_WANT_WRITE) {
 		int ensz, sz;
 		while ((ensz = open_net_read(ec->tls, ec->wbuf, OPEN_BUF_SZ)) > 0) {
-			sz = BIO_write(ec->rbio, ec->wbuf, ensz);
+			sz = open_bio_write(ec, ec->wbuf, ensz);
 			log_debug("NNG-TLS-CONN-HANDSHAKE" "BIO write sz%d/%d", sz, ensz);
 			if (sz < 0) {
 				log_debug("NNG-TLS-CONN-HANDSHAKE"
@@ -271,7 +455,7 @@ open_conn_handshake(nng_tls_engine_conn *ec)
 			}
 		}
 
-		while ((ensz = BIO_read(ec->wbio, ec->rbuf, OPEN_BUF_SZ)) > 0) {
+		while ((ensz = open_bio_read(ec, ec->rbuf, OPEN_BUF_SZ)) > 0) {
 			log_debug("NNG-TLS-CONN-HANDSHAKE" "BIO read rv%d", ensz);
 			if (ensz < 0) {
 				if (!BIO_should_retry(ec->wbio)) {
@@ -299,6 +483,9 @@ finished:
 		log_warn("NNG-TLS-CONN-HANDSHAKE"
 				"openssl do handshake successfully");
 		ec->ok = 1;
+#ifdef NNG_HAVE_KTLS
+		open_ktls_ready(ec);
+#endif
 		return 0;
 	}
 	return NNG_ECRYPTO;
@@ -320,7 +507,7 @@ open_conn_recv(nng_tls_engine_conn *ec, uint8_t *buf, size_t *szp)
 		return (NNG_ECLOSED);
 
 	int written = 0;
-	while ((ensz = BIO_write(ec->rbio, ec->wbuf + written, rv - written)) > 0) {
+	while ((ensz = open_bio_write(ec, ec->wbuf + written, rv - written)) > 0) {
 		written += ensz;
 		if (written == rv)
 			break;
@@ -421,7 +608,7 @@ open_conn_send(nng_tls_engine_conn *ec, const uint8_t *buf, size_t *szp)
 		// We would better to read all bufs first then send.
 		int ensz;
 		int read2buf = 0;
-		while ((ensz = BIO_read(ec->wbio, ec->rbuf + read2buf, OPEN_BUF_SZ)) > 0) {
+		while ((ensz = open_bio_read(ec, ec->rbuf + read2buf, OPEN_BUF_SZ)) > 0) {
 			log_debug("NNG-TLS-CONN-SEND" "BIO read ensz%d", ensz);
 			read2buf += ensz;
 			if (read2buf > 2 * OPEN_BUF_SZ) {
@@ -487,6 +674,364 @@ open_conn_verified(nng_tls_engine_conn *ec)
 	return (X509_V_OK == rv);
 }
 
+#ifdef NNG_HAVE_KTLS
+
+/************************* Kernel TLS ***********************/
+
+// The kernel only does AES-GCM here, which covers what nearly every
+// peer negotiates.  Keys are derived from the secrets of the handshake,
+// as OpenSSL can only hand them to the kernel itself through socket BIOs,
+// and we use memory BIOs.
+
+// open_ktls_ready notes where the sequence numbers of the application
+// records start, once the handshake is done.  In TLS 1.2 the Finished
+// message was record zero, in TLS 1.3 the application keys start afresh,
+// but a server has already used them for the session tickets it wrote.
+// Records still sitting in the BIOs have been counted, but have not been
+// sent, or given to OpenSSL.
+static void
+open_ktls_ready(nng_tls_engine_conn *ec)
+{
+	open_ktls *k = &ec->ktls;
+	uint64_t   tx;
+	uint64_t   rx;
+
+	if (!k->on) {
+		return;
+	}
+	tx = k->tx.count + open_rec_pending(&k->tx, ec->wbio);
+	rx = k->rx.count - open_rec_pending(&(open_rec_count) { 0 }, ec->rbio);
+	if (SSL_version(ec->ssl) != TLS1_3_VERSION) {
+		k->tx_base = tx - 1;
+		k->rx_base = rx - 1;
+	} else {
+		k->tx_base = SSL_is_server(ec->ssl) ? k->tx.count : tx;
+		k->rx_base = rx;
+	}
+}
+
+static int
+open_ktls_hex(unsigned char *out, size_t max, const char *hex, size_t *lenp)
+{
+	size_t len = 0;
+
+	while (isxdigit((unsigned char) hex[0]) &&
+	    isxdigit((unsigned char) hex[1])) {
+		unsigned int v;
+		if ((len == max) || (sscanf(hex, "%2x", &v) != 1)) {
+			return (NNG_EINVAL);
+		}
+		out[len++] = (unsigned char) v;
+		hex += 2;
+	}
+	*lenp = len;
+	return (0);
+}
+
+// open_ktls_keylog collects the TLS 1.3 application traffic secrets,
+// which OpenSSL only gives out through its key log.
+static void
+open_ktls_keylog(const SSL *ssl, const char *line)
+{
+	nng_tls_engine_conn *ec = SSL_get_app_data(ssl);
+	open_ktls           *k;
+	const char          *p;
+	int                  idx;
+	size_t               len;
+
+	if ((ec == NULL) || (!ec->ktls.on)) {
+		return;
+	}
+	k = &ec->ktls;
+	if (strncmp(line, "CLIENT_TRAFFIC_SECRET_0 ", 24) == 0) {
+		idx = 0;
+	} else if (strncmp(line, "SERVER_TRAFFIC_SECRET_0 ", 24) == 0) {
+		idx = 1;
+	} else {
+		return;
+	}
+	// Skip the client random.
+	if ((p = strchr(line + 24, ' ')) == NULL) {
+		return;
+	}
+	if (open_ktls_hex(k->secret[idx], sizeof(k->secret[idx]), p + 1,
+	        &len) == 0) {
+		k->secret_len = len;
+	}
+}
+
+// open_ktls_expand is HKDF-Expand-Label from RFC 8446.  The output is
+// never longer than the hash, so one block will do.
+static int
+open_ktls_expand(const EVP_MD *md, const unsigned char *secret, size_t slen,
+    const char *label, unsigned char *out, size_t len)
+{
+	unsigned char info[64];
+	unsigned char t[EVP_MAX_MD_SIZE];
+	unsigned int  tlen;
+	size_t        llen = strlen(label);
+	size_t        n    = 0;
+
+	info[n++] = (unsigned char) (len >> 8);
+	info[n++] = (unsigned char) len;
+	info[n++] = (unsigned char) (6 + llen);
+	memcpy(info + n, "tls13 ", 6);
+	n += 6;
+	memcpy(info + n, label, llen);
+	n += llen;
+	info[n++] = 0; // no context
+	info[n++] = 1; // first block
+
+	if ((HMAC(md, secret, (int) slen, info, n, t, &tlen) == NULL) ||
+	    (tlen < len)) {
+		return (NNG_ECRYPTO);
+	}
+	memcpy(out, t, len);
+	OPENSSL_cleanse(t, sizeof(t));
+	return (0);
+}
+
+// open_ktls_prf is the TLS 1.2 PRF from RFC 5246.
+static int
+open_ktls_prf(const EVP_MD *md, const unsigned char *secret, size_t slen,
+    const unsigned char *seed, size_t seedlen, unsigned char *out,
+    size_t len)
+{
+	unsigned char a[EVP_MAX_MD_SIZE];
+	unsigned char buf[EVP_MAX_MD_SIZE + 128];
+	unsigned char t[EVP_MAX_MD_SIZE];
+	unsigned int  alen;
+	unsigned int  tlen;
+	int           rv = 0;
+
+	NNI_ASSERT(seedlen <= 128);
+	if (HMAC(md, secret, (int) slen, seed, seedlen, a, &alen) == NULL) {
+		return (NNG_ECRYPTO);
+	}
+	while (len > 0) {
+		size_t n;
+		memcpy(buf, a, alen);
+		memcpy(buf + alen, seed, seedlen);
+		if ((HMAC(md, secret, (int) slen, buf, alen + seedlen, t,
+		         &tlen) == NULL) ||
+		    (HMAC(md, secret, (int) slen, a, alen, buf, &alen) ==
+		        NULL)) {
+			rv = NNG_ECRYPTO;
+			break;
+		}
+		memcpy(a, buf, alen);
+		n = len < tlen ? len : tlen;
+		memcpy(out, t, n);
+		out += n;
+		len -= n;
+	}
+	OPENSSL_cleanse(a, sizeof(a));
+	OPENSSL_cleanse(buf, sizeof(buf));
+	OPENSSL_cleanse(t, sizeof(t));
+	return (rv);
+}
+
+// open_ktls_keys derives the key and the 12 byte IV for one direction.
+static int
+open_ktls_keys(nng_tls_engine_conn *ec, bool tx, unsigned char *key,
+    size_t klen, unsigned char *iv)
+{
+	open_ktls        *k      = &ec->ktls;
+	const SSL_CIPHER *cipher = SSL_get_current_cipher(ec->ssl);
+	const EVP_MD     *md     = SSL_CIPHER_get_handshake_digest(cipher);
+	bool              client = (tx != (SSL_is_server(ec->ssl) == 1));
+	unsigned char     master[SSL_MAX_MASTER_KEY_LENGTH];
+	unsigned char     seed[13 + 2 * SSL3_RANDOM_SIZE];
+	unsigned char     block[2 * 32 + 2 * 4];
+	size_t            mlen;
+	int               rv;
+
+	if (md == NULL) {
+		return (NNG_ENOTSUP);
+	}
+	if (SSL_version(ec->ssl) == TLS1_3_VERSION) {
+		const unsigned char *secret = k->secret[client ? 0 : 1];
+		if (k->secret_len == 0) {
+			return (NNG_ENOTSUP);
+		}
+		if (((rv = open_ktls_expand(md, secret, k->secret_len, "key",
+		          key, klen)) != 0) ||
+		    ((rv = open_ktls_expand(
+		          md, secret, k->secret_len, "iv", iv, 12)) != 0)) {
+			return (rv);
+		}
+		return (0);
+	}
+
+	// TLS 1.2: the key block is client key, server key, client IV and
+	// server IV, where the IV is the implicit part only.
+	mlen = SSL_SESSION_get_master_key(
+	    SSL_get_session(ec->ssl), master, sizeof(master));
+	memcpy(seed, "key expansion", 13);
+	SSL_get_server_random(ec->ssl, seed + 13, SSL3_RANDOM_SIZE);
+	SSL_get_client_random(
+	    ec->ssl, seed + 13 + SSL3_RANDOM_SIZE, SSL3_RANDOM_SIZE);
+	rv = open_ktls_prf(md, master, mlen, seed, sizeof(seed), block,
+	    2 * klen + 2 * 4);
+	if (rv == 0) {
+		memcpy(key, block + (client ? 0 : klen), klen);
+		memcpy(iv, block + 2 * klen + (client ? 0 : 4), 4);
+		// The explicit part is sent with each record, and only has
+		// to be unique, so we use the sequence number.
+		memset(iv + 4, 0, 8);
+	}
+	OPENSSL_cleanse(master, sizeof(master));
+	OPENSSL_cleanse(block, sizeof(block));
+	return (rv);
+}
+
+static int
+open_ktls_install(nng_tls_engine_conn *ec, int fd, bool tx)
+{
+	open_ktls    *k = &ec->ktls;
+	bool          tls13;
+	uint16_t      version;
+	uint64_t      seq;
+	unsigned char rec_seq[8];
+	unsigned char key[32];
+	unsigned char iv[12];
+	size_t        klen;
+	socklen_t     sz;
+	int           rv;
+	union {
+		struct tls12_crypto_info_aes_gcm_128 gcm128;
+		struct tls12_crypto_info_aes_gcm_256 gcm256;
+	} ci;
+
+	switch (SSL_version(ec->ssl)) {
+	case TLS1_2_VERSION:
+		tls13 = false;
+		break;
+	case TLS1_3_VERSION:
+		tls13 = true;
+		break;
+	default:
+		return (NNG_ENOTSUP);
+	}
+	switch (SSL_CIPHER_get_cipher_nid(SSL_get_current_cipher(ec->ssl))) {
+	case NID_aes_128_gcm:
+		klen = TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+		break;
+	case NID_aes_256_gcm:
+		klen = TLS_CIPHER_AES_GCM_256_KEY_SIZE;
+		break;
+	default:
+		return (NNG_ENOTSUP);
+	}
+	if ((rv = open_ktls_keys(ec, tx, key, klen, iv)) != 0) {
+		return (rv);
+	}
+
+	seq = tx ? k->tx.count - k->tx_base : k->rx.count - k->rx_base;
+	for (int i = 7; i >= 0; i--) {
+		rec_seq[i] = (unsigned char) seq;
+		seq >>= 8;
+	}
+	if (!tls13) {
+		memcpy(iv + 4, rec_seq, 8);
+	}
+
+	// The layouts only differ in the size of the key.
+	version = tls13 ? TLS_1_3_VERSION : TLS_1_2_VERSION;
+	memset(&ci, 0, sizeof(ci));
+	if (klen == TLS_CIPHER_AES_GCM_128_KEY_SIZE) {
+		ci.gcm128.info.version     = version;
+		ci.gcm128.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+		memcpy(ci.gcm128.key, key, klen);
+		memcpy(ci.gcm128.salt, iv, 4);
+		memcpy(ci.gcm128.iv, iv + 4, 8);
+		memcpy(ci.gcm128.rec_seq, rec_seq, 8);
+		sz = sizeof(ci.gcm128);
+	} else {
+		ci.gcm256.info.version     = version;
+		ci.gcm256.info.cipher_type = TLS_CIPHER_AES_GCM_256;
+		memcpy(ci.gcm256.key, key, klen);
+		memcpy(ci.gcm256.salt, iv, 4);
+		memcpy(ci.gcm256.iv, iv + 4, 8);
+		memcpy(ci.gcm256.rec_seq, rec_seq, 8);
+		sz = sizeof(ci.gcm256);
+	}
+	OPENSSL_cleanse(key, sizeof(key));
+	OPENSSL_cleanse(iv, sizeof(iv));
+
+	rv = 0;
+	if ((!k->ulp) &&
+	    (setsockopt(fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)) {
+		// Most likely the tls module is not loaded.
+		log_info("NNG-TLS-KTLS" "kernel TLS unavailable: %d", errno);
+		rv = NNG_ENOTSUP;
+	} else {
+		k->ulp = true;
+		if (setsockopt(fd, SOL_TLS, tx ? TLS_TX : TLS_RX, &ci, sz) !=
+		    0) {
+			log_info("NNG-TLS-KTLS" "kernel TLS %s refused: %d",
+			    tx ? "TX" : "RX", errno);
+			rv = NNG_ENOTSUP;
+		}
+	}
+	OPENSSL_cleanse(&ci, sizeof(ci));
+	return (rv);
+}
+
+static int
+open_conn_ktls_tx(nng_tls_engine_conn *ec, int fd)
+{
+	int n;
+	int rv;
+
+	if (ec->wnext != NULL) {
+		return (NNG_EAGAIN);
+	}
+	if (BIO_ctrl_pending(ec->wbio) > 0) {
+		// Records OpenSSL wrote, but nobody sent yet, such as the
+		// last of the handshake or session tickets.
+		if ((n = open_bio_read(ec, ec->rbuf, OPEN_BUF_SZ)) <= 0) {
+			return (NNG_ECRYPTO);
+		}
+		if ((rv = open_net_write(ec->tls, ec->rbuf, n)) < 0) {
+			if ((rv != 0 - SSL_ERROR_WANT_READ) &&
+			    (rv != 0 - SSL_ERROR_WANT_WRITE)) {
+				return (NNG_ECLOSED);
+			}
+			rv = 0;
+		}
+		if (rv < n) {
+			// Sent with the next write, as for open_conn_send.
+			ec->wnext = nng_alloc(n - rv);
+			memcpy(ec->wnext, ec->rbuf + rv, n - rv);
+			ec->wnsz    = n - rv;
+			ec->wntcpsz = 0;
+		}
+		return (NNG_EAGAIN);
+	}
+	return (open_ktls_install(ec, fd, true));
+}
+
+static int
+open_conn_ktls_rx(nng_tls_engine_conn *ec, int fd)
+{
+	open_rec_count *rc = &ec->ktls.rx;
+
+	// The kernel hands anything other than application data back to
+	// us as an error, and TLS 1.3 servers send tickets at any time.
+	if ((SSL_version(ec->ssl) == TLS1_3_VERSION) &&
+	    (!SSL_is_server(ec->ssl))) {
+		return (NNG_ENOTSUP);
+	}
+	if ((BIO_ctrl_pending(ec->rbio) > 0) || SSL_has_pending(ec->ssl) ||
+	    (rc->hdr_len != 0) || (rc->body != 0)) {
+		return (NNG_EAGAIN);
+	}
+	return (open_ktls_install(ec, fd, false));
+}
+
+#endif // NNG_HAVE_KTLS
+
 /************************* SSL Configuration ***********************/
 
 static void
@@ -500,6 +1045,8 @@ open_config_fini(nng_tls_engine_config *cfg)
 	if (cfg->pass != NULL) {
 		nng_strfree(cfg->pass);
 	}
+	OPENSSL_cleanse(cfg->ticket_keys, sizeof(cfg->ticket_keys));
+	nni_mtx_fini(&cfg->ticket_lk);
 	trace("end");
 }
 
@@ -512,6 +1059,7 @@ open_config_init(nng_tls_engine_config *cfg, enum nng_tls_mode mode)
 	trace("start");
 
 	cfg->mode = mode;
+	nni_mtx_init(&cfg->ticket_lk);
 	// TODO NNI_LIST_INIT(&cfg->psks, psk, node);
 	if (mode == NNG_TLS_MODE_SERVER) {
 		method    = SSLv23_server_method();
@@ -531,6 +1079,7 @@ open_config_init(nng_tls_engine_config *cfg, enum nng_tls_mode mode)
 	// Set max/min version TODO
 
 	SSL_CTX_set_verify(cfg->ctx, auth_mode, NULL);
+	SSL_CTX_set_app_data(cfg->ctx, cfg);
 	//SSL_CTX_set_mode(cfg->ctx, SSL_MODE_AUTO_RETRY);
 	//SSL_CTX_set_options(cfg->ctx, SSL_OP_ALL|SSL_OP_NO_SSLv2|SSL_OP_NO_SSLv3);
 
@@ -768,6 +1317,177 @@ open_config_version(nng_tls_engine_config *cfg, nng_tls_version min_ver,
 	return (0);
 }
 
+static int
+open_ticket_key_new(open_ticket_key *key, nni_time now, nng_duration rotate)
+{
+	if ((RAND_bytes(key->name, sizeof(key->name)) != 1) ||
+	    (RAND_bytes(key->aes, sizeof(key->aes)) != 1) ||
+	    (RAND_bytes(key->hmac, sizeof(key->hmac)) != 1)) {
+		return (NNG_ECRYPTO);
+	}
+	key->retire = now + rotate;
+	return (0);
+}
+
+// open_ticket_key_cb picks the key for a ticket we issue (enc is 1) or
+// receive.  It returns 1 to go ahead, 2 if the ticket is good but was
+// made with the previous key so that a new one should be issued, 0 for
+// a ticket we cannot decrypt (so full handshake), and -1 on error.
+#if OPENSSL_VERSION_MAJOR >= 3
+static int
+open_ticket_key_cb(SSL *ssl, unsigned char *name, unsigned char *iv,
+    EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc)
+#else
+static int
+open_ticket_key_cb(SSL *ssl, unsigned char *name, unsigned char *iv,
+    EVP_CIPHER_CTX *cctx, HMAC_CTX *hctx, int enc)
+#endif
+{
+	nng_tls_engine_config *cfg;
+	open_ticket_key       *keys;
+	open_ticket_key        key;
+	nni_time               now = nni_clock();
+	int                    rv  = 1;
+
+	cfg  = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+	keys = cfg->ticket_keys;
+
+	nni_mtx_lock(&cfg->ticket_lk);
+	if (enc) {
+		if (now >= keys[0].retire) {
+			keys[1] = keys[0];
+			if (open_ticket_key_new(
+			        &keys[0], now, cfg->ticket_rotate) != 0) {
+				nni_mtx_unlock(&cfg->ticket_lk);
+				return (-1);
+			}
+		}
+		key = keys[0];
+	} else if ((keys[0].retire != 0) &&
+	    (memcmp(name, keys[0].name, sizeof(key.name)) == 0)) {
+		key = keys[0];
+	} else if ((keys[1].retire != 0) &&
+	    (memcmp(name, keys[1].name, sizeof(key.name)) == 0) &&
+	    (now < keys[1].retire + cfg->ticket_life)) {
+		key = keys[1];
+		rv  = 2;
+	} else {
+		rv = 0;
+	}
+	nni_mtx_unlock(&cfg->ticket_lk);
+	if (rv == 0) {
+		return (0);
+	}
+
+	if (enc) {
+		memcpy(name, key.name, sizeof(key.name));
+		if ((RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) !=
+		        1) ||
+		    (EVP_EncryptInit_ex(
+		         cctx, EVP_aes_256_cbc(), NULL, key.aes, iv) != 1)) {
+			rv = -1;
+		}
+	} else if (EVP_DecryptInit_ex(
+	               cctx, EVP_aes_256_cbc(), NULL, key.aes, iv) != 1) {
+		rv = -1;
+	}
+	if (rv > 0) {
+#if OPENSSL_VERSION_MAJOR >= 3
+		OSSL_PARAM params[3];
+
+		params[0] = OSSL_PARAM_construct_octet_string(
+		    OSSL_MAC_PARAM_KEY, key.hmac, sizeof(key.hmac));
+		params[1] = OSSL_PARAM_construct_utf8_string(
+		    OSSL_MAC_PARAM_DIGEST, "sha256", 0);
+		params[2] = OSSL_PARAM_construct_end();
+		if (EVP_MAC_CTX_set_params(hctx, params) != 1) {
+			rv = -1;
+		}
+#else
+		if (HMAC_Init_ex(hctx, key.hmac, sizeof(key.hmac),
+		        EVP_sha256(), NULL) != 1) {
+			rv = -1;
+		}
+#endif
+	}
+	OPENSSL_cleanse(&key, sizeof(key));
+	return (rv);
+}
+
+static long
+open_duration_secs(nng_duration d)
+{
+	return ((long) ((d + 999) / 1000));
+}
+
+static int
+open_config_session_cache(
+    nng_tls_engine_config *cfg, size_t size, nng_duration lifetime)
+{
+	if (cfg->mode != NNG_TLS_MODE_SERVER) {
+		return (NNG_ENOTSUP);
+	}
+	if (size == 0) {
+		SSL_CTX_set_session_cache_mode(cfg->ctx, SSL_SESS_CACHE_OFF);
+		return (0);
+	}
+	SSL_CTX_set_session_cache_mode(cfg->ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_sess_set_cache_size(cfg->ctx, (long) size);
+	// Resumption is refused when verifying peers without this.
+	SSL_CTX_set_session_id_context(
+	    cfg->ctx, (const unsigned char *) "nng", 3);
+	// OpenSSL has one lifetime for sessions, cached or in tickets.
+	if (lifetime > 0) {
+		SSL_CTX_set_timeout(cfg->ctx, open_duration_secs(lifetime));
+	}
+	return (0);
+}
+
+static int
+open_config_session_tickets(
+    nng_tls_engine_config *cfg, nng_duration lifetime, nng_duration rotate)
+{
+	if (cfg->mode != NNG_TLS_MODE_SERVER) {
+		return (NNG_ENOTSUP);
+	}
+	if (lifetime == 0) {
+		SSL_CTX_set_options(cfg->ctx, SSL_OP_NO_TICKET);
+		return (0);
+	}
+	SSL_CTX_clear_options(cfg->ctx, SSL_OP_NO_TICKET);
+	SSL_CTX_set_session_id_context(
+	    cfg->ctx, (const unsigned char *) "nng", 3);
+	if (lifetime > 0) {
+		SSL_CTX_set_timeout(cfg->ctx, open_duration_secs(lifetime));
+	}
+
+	nni_mtx_lock(&cfg->ticket_lk);
+	cfg->ticket_life   = SSL_CTX_get_timeout(cfg->ctx) * 1000;
+	cfg->ticket_rotate = rotate;
+	memset(cfg->ticket_keys, 0, sizeof(cfg->ticket_keys));
+	nni_mtx_unlock(&cfg->ticket_lk);
+
+	// Without rotation OpenSSL's own key is fine.
+#if OPENSSL_VERSION_MAJOR >= 3
+	SSL_CTX_set_tlsext_ticket_key_evp_cb(
+	    cfg->ctx, rotate > 0 ? open_ticket_key_cb : NULL);
+#else
+	SSL_CTX_set_tlsext_ticket_key_cb(
+	    cfg->ctx, rotate > 0 ? open_ticket_key_cb : NULL);
+#endif
+	return (0);
+}
+
+#ifdef NNG_HAVE_KTLS
+static int
+open_config_ktls(nng_tls_engine_config *cfg, bool on)
+{
+	cfg->ktls = on;
+	SSL_CTX_set_keylog_callback(cfg->ctx, on ? open_ktls_keylog : NULL);
+	return (0);
+}
+#endif
+
 static nng_tls_engine_config_ops open_config_ops = {
 	.init     = open_config_init,
 	.fini     = open_config_fini,
@@ -778,6 +1498,12 @@ static nng_tls_engine_config_ops open_config_ops = {
 	.server   = open_config_server,
 	.psk      = open_config_psk,
 	.version  = open_config_version,
+
+	.session_cache   = open_config_session_cache,
+	.session_tickets = open_config_session_tickets,
+#ifdef NNG_HAVE_KTLS
+	.ktls = open_config_ktls,
+#endif
 };
 
 static nng_tls_engine_conn_ops open_conn_ops = {
@@ -789,6 +1515,15 @@ static nng_tls_engine_conn_ops open_conn_ops = {
 	.send      = open_conn_send,
 	.handshake = open_conn_handshake,
 	.verified  = open_conn_verified,
+
+	.session_get  = open_conn_session_get,
+	.session_set  = open_conn_session_set,
+	.session_free = open_conn_session_free,
+	.resumed      = open_conn_resumed,
+#ifdef NNG_HAVE_KTLS
+	.ktls_tx = open_conn_ktls_tx,
+	.ktls_rx = open_conn_ktls_rx,
+#endif
 };
 
 static nng_tls_engine open_engine = {
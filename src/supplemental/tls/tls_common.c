@@ -28,10 +28,30 @@
 // NNG_TLS_MAX_RECV_SIZE limits the amount of data we will receive in a single
 // operation.  As we have to buffer data, this drives the size of our
 // intermediary buffer.  The 16K is aligned to the maximum TLS record size.
-#ifndef NNG_TLX_MAX_RECV_SIZE
+#ifndef NNG_TLS_MAX_RECV_SIZE
 #define NNG_TLS_MAX_RECV_SIZE 16384
 #endif
 
+// NNG_TLS_BUF_POOL is the number of idle buffers of each size kept in the
+// shared pool.  Connections only hold their send and receive buffers while
+// data is in flight, so this bounds the memory parked for the next burst.
+#ifndef NNG_TLS_BUF_POOL
+#define NNG_TLS_BUF_POOL 256
+#endif
+
+// TLS_RECV_PEEK is the size of the receive buffer built into each
+// connection.  An idle connection waits for its peer with a read of this
+// size, which is that of a TLS record header, and only borrows a full
+// buffer once data is arriving.
+#define TLS_RECV_PEEK 5
+
+// TLS_RECV_GRACE is how long, in milliseconds, a connection keeps its
+// receive buffer while waiting for the peer, before handing it back and
+// going back to peeking.  A busy connection thus reads each message in
+// one go without going to the pool, and only one that has gone quiet
+// pays for the extra read when it wakes up.
+#define TLS_RECV_GRACE 200
+
 // This file contains common code for TLS, and is only compiled if we
 // have TLS configured in the system.  In particular, this provides the
 // parts of TLS support that are invariant relative to different TLS
@@ -47,11 +67,23 @@ struct nng_tls_config {
 	nni_mtx                   lock;
 	int                       ref;
 	bool                      busy;
+	bool                      ktls;
 	size_t                    size;
 
 	// ... engine config data follows
 };
 
+// tls_session holds the session a dialer offers on its next connection.
+// It is shared by the dialer and the connections it made, which refresh
+// it when their handshake completes, and again when they are closed, as
+// TLS 1.3 servers only send their tickets after the handshake.
+typedef struct {
+	nni_mtx               lock;
+	int                   ref;
+	const nng_tls_engine *engine;
+	void                 *session; // engine session, or NULL
+} tls_session;
+
 typedef struct {
 	nng_stream              stream;
 	nng_tls_engine_conn_ops ops;
@@ -68,15 +100,23 @@ typedef struct {
 	nng_stream *            tcp;      // lower level stream
 	nni_aio                 tcp_send; // lower level send pending
 	nni_aio                 tcp_recv; // lower level recv pending
-	uint8_t *               tcp_send_buf;
-	uint8_t *               tcp_recv_buf;
+	uint8_t *               tcp_send_buf; // borrowed, NULL when idle
+	uint8_t *               tcp_recv_buf; // borrowed, NULL when idle
+	uint8_t                 tcp_recv_peek[TLS_RECV_PEEK];
 	size_t                  tcp_recv_len;
 	size_t                  tcp_recv_off;
 	bool                    tcp_recv_pend;
+	bool                    tcp_recv_more; // last read filled the buffer
 	bool                    tcp_send_active;
 	size_t                  tcp_send_len;
 	size_t                  tcp_send_head;
 	size_t                  tcp_send_tail;
+	tls_session *           sess; // dialer's session, if reusing
+	int                     ktls_fd;
+	bool                    ktls_tx_try; // offload still possible
+	bool                    ktls_rx_try;
+	bool                    ktls_tx; // kernel protects the records
+	bool                    ktls_rx;
 	nni_reap_node           reap;
 
 	// ... engine connection data follows
@@ -87,12 +127,215 @@ static void tls_tcp_recv_cb(void *arg);
 static void tls_do_send(tls_conn *);
 static void tls_do_recv(tls_conn *);
 static void tls_tcp_send_start(tls_conn *);
+static void tls_tcp_recv_start(tls_conn *);
 static void tls_free(void *);
 static void tls_reap(void *);
 static int  tls_alloc(tls_conn **, nng_tls_config *, nng_aio *);
 static int  tls_start(tls_conn *, nng_stream *);
 static void tls_tcp_error(tls_conn *, int);
 
+// Send and receive buffers are borrowed from a pool shared by all
+// connections, with a free list per power of two size class, rather than
+// being owned by each connection for its whole life.  Sizes outside of
+// the classes go straight to the allocator.  The free lists are split
+// into shards, one per CPU up to TLS_BUF_SHARDS, each with its own lock.
+// A thread sticks to one shard and only looks at the others when its own
+// comes up empty, so threads serving different connections do not all
+// meet on one lock.
+#define TLS_BUF_SHIFT 12  // smallest class is 4 KiB
+#define TLS_BUF_CLASSES 5 // 4 KiB .. 64 KiB
+#define TLS_BUF_SHARDS 16
+
+typedef struct tls_buf tls_buf;
+struct tls_buf {
+	tls_buf *tb_next;
+};
+
+typedef struct {
+	nni_mtx  lk;
+	tls_buf *list[TLS_BUF_CLASSES];
+	unsigned nfree[TLS_BUF_CLASSES];
+} tls_buf_shard;
+
+static tls_buf_shard  tls_buf_shards[TLS_BUF_SHARDS];
+static int            tls_buf_nshards;
+static unsigned       tls_buf_cap; // idle buffers per shard and class
+static nni_atomic_int tls_buf_assign;
+
+static NNI_THREAD_LOCAL int tls_buf_self; // shard index + 1, 0 if none
+
+static nni_stat_item tls_st_root;
+static nni_stat_item tls_st_buf_pooled;
+static nni_stat_item tls_st_buf_alloc;
+static nni_stat_item tls_st_buf_held;
+static nni_stat_item tls_st_buf_idle;
+
+static int
+tls_buf_class(size_t sz, size_t *csp)
+{
+	size_t cs = (size_t) 1 << TLS_BUF_SHIFT;
+
+	for (int c = 0; c < TLS_BUF_CLASSES; c++, cs <<= 1) {
+		if (sz <= cs) {
+			*csp = cs;
+			return (c);
+		}
+	}
+	*csp = sz;
+	return (-1);
+}
+
+static int
+tls_buf_shard_index(void)
+{
+	if (tls_buf_self == 0) {
+		// Two threads may end up on the same shard, which is fine.
+		nni_atomic_inc(&tls_buf_assign);
+		tls_buf_self = 1 + nni_atomic_get(&tls_buf_assign);
+	}
+	return ((tls_buf_self - 1) % tls_buf_nshards);
+}
+
+static void *
+tls_buf_get(size_t sz)
+{
+	tls_buf *tb = NULL;
+	size_t   cs;
+	int      c;
+
+	if ((c = tls_buf_class(sz, &cs)) >= 0) {
+		int self = tls_buf_shard_index();
+		for (int i = 0; (i < tls_buf_nshards) && (tb == NULL); i++) {
+			tls_buf_shard *sh =
+			    &tls_buf_shards[(self + i) % tls_buf_nshards];
+			nni_mtx_lock(&sh->lk);
+			if ((tb = sh->list[c]) != NULL) {
+				sh->list[c] = tb->tb_next;
+				sh->nfree[c]--;
+			}
+			nni_mtx_unlock(&sh->lk);
+		}
+	}
+	if (tb != NULL) {
+		nni_stat_inc(&tls_st_buf_pooled, 1);
+		nni_stat_dec(&tls_st_buf_idle, 1);
+	} else if ((tb = nni_alloc(cs)) != NULL) {
+		nni_stat_inc(&tls_st_buf_alloc, 1);
+	} else {
+		return (NULL);
+	}
+	nni_stat_inc(&tls_st_buf_held, 1);
+	return (tb);
+}
+
+static void
+tls_buf_put(void *buf, size_t sz)
+{
+	tls_buf *tb = buf;
+	size_t   cs;
+	int      c;
+
+	nni_stat_dec(&tls_st_buf_held, 1);
+	if ((c = tls_buf_class(sz, &cs)) >= 0) {
+		tls_buf_shard *sh = &tls_buf_shards[tls_buf_shard_index()];
+		nni_mtx_lock(&sh->lk);
+		if (sh->nfree[c] < tls_buf_cap) {
+			tb->tb_next = sh->list[c];
+			sh->list[c] = tb;
+			sh->nfree[c]++;
+			tb = NULL;
+		}
+		nni_mtx_unlock(&sh->lk);
+	}
+	if (tb != NULL) {
+		nni_free(tb, cs);
+	} else {
+		nni_stat_inc(&tls_st_buf_idle, 1);
+	}
+}
+
+static void
+tls_buf_sys_init(void)
+{
+	tls_buf_nshards = nni_plat_ncpu();
+	if (tls_buf_nshards > TLS_BUF_SHARDS) {
+		tls_buf_nshards = TLS_BUF_SHARDS;
+	} else if (tls_buf_nshards < 1) {
+		tls_buf_nshards = 1;
+	}
+	tls_buf_cap = NNG_TLS_BUF_POOL / tls_buf_nshards;
+	if (tls_buf_cap < 1) {
+		tls_buf_cap = 1;
+	}
+	for (int i = 0; i < tls_buf_nshards; i++) {
+		nni_mtx_init(&tls_buf_shards[i].lk);
+	}
+	nni_atomic_init(&tls_buf_assign);
+
+#ifdef NNG_ENABLE_STATS
+	static const nni_stat_info root_info = {
+		.si_name = "tls",
+		.si_desc = "tls record buffers",
+		.si_type = NNG_STAT_SCOPE,
+	};
+	static const nni_stat_info pooled_info = {
+		.si_name   = "buf_pooled",
+		.si_desc   = "buffers reused from the pool",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_atomic = true,
+	};
+	static const nni_stat_info alloc_info = {
+		.si_name   = "buf_alloc",
+		.si_desc   = "buffers allocated from the system",
+		.si_type   = NNG_STAT_COUNTER,
+		.si_atomic = true,
+	};
+	static const nni_stat_info held_info = {
+		.si_name   = "buf_held",
+		.si_desc   = "buffers held by connections",
+		.si_type   = NNG_STAT_LEVEL,
+		.si_atomic = true,
+	};
+	static const nni_stat_info idle_info = {
+		.si_name   = "buf_idle",
+		.si_desc   = "buffers idle in the pool",
+		.si_type   = NNG_STAT_LEVEL,
+		.si_atomic = true,
+	};
+
+	nni_stat_init(&tls_st_root, &root_info);
+	nni_stat_init(&tls_st_buf_pooled, &pooled_info);
+	nni_stat_init(&tls_st_buf_alloc, &alloc_info);
+	nni_stat_init(&tls_st_buf_held, &held_info);
+	nni_stat_init(&tls_st_buf_idle, &idle_info);
+	nni_stat_add(&tls_st_root, &tls_st_buf_pooled);
+	nni_stat_add(&tls_st_root, &tls_st_buf_alloc);
+	nni_stat_add(&tls_st_root, &tls_st_buf_held);
+	nni_stat_add(&tls_st_root, &tls_st_buf_idle);
+	nni_stat_register(&tls_st_root);
+#endif
+}
+
+static void
+tls_buf_sys_fini(void)
+{
+#ifdef NNG_ENABLE_STATS
+	nni_stat_unregister(&tls_st_root);
+#endif
+	for (int i = 0; i < tls_buf_nshards; i++) {
+		tls_buf_shard *sh = &tls_buf_shards[i];
+		for (int c = 0; c < TLS_BUF_CLASSES; c++) {
+			tls_buf *tb;
+			while ((tb = sh->list[c]) != NULL) {
+				sh->list[c] = tb->tb_next;
+				nni_free(tb, (size_t) 1 << (TLS_BUF_SHIFT + c));
+			}
+			sh->nfree[c] = 0;
+		}
+		nni_mtx_fini(&sh->lk);
+	}
+}
+
 static nni_reap_list tls_conn_reap_list = {
 	.rl_offset = offsetof(tls_conn, reap),
 	.rl_func   = tls_reap,
@@ -102,9 +345,53 @@ typedef struct {
 	nng_stream_dialer  ops;
 	nng_stream_dialer *d; // underlying TCP dialer
 	nng_tls_config *   cfg;
-	nni_mtx            lk; // protects the config
+	tls_session *      sess; // non-NULL if reusing sessions
+	nni_mtx            lk;   // protects the config
 } tls_dialer;
 
+static tls_session *
+tls_session_alloc(void)
+{
+	tls_session *sess;
+
+	if ((sess = NNI_ALLOC_STRUCT(sess)) != NULL) {
+		nni_mtx_init(&sess->lock);
+		sess->ref = 1;
+	}
+	return (sess);
+}
+
+static tls_session *
+tls_session_hold(tls_session *sess)
+{
+	if (sess != NULL) {
+		nni_mtx_lock(&sess->lock);
+		sess->ref++;
+		nni_mtx_unlock(&sess->lock);
+	}
+	return (sess);
+}
+
+static void
+tls_session_rele(tls_session *sess)
+{
+	int ref;
+
+	if (sess == NULL) {
+		return;
+	}
+	nni_mtx_lock(&sess->lock);
+	ref = --sess->ref;
+	nni_mtx_unlock(&sess->lock);
+	if (ref == 0) {
+		if (sess->session != NULL) {
+			sess->engine->conn_ops->session_free(sess->session);
+		}
+		nni_mtx_fini(&sess->lock);
+		NNI_FREE_STRUCT(sess);
+	}
+}
+
 static void
 tls_dialer_close(void *arg)
 {
@@ -119,6 +406,7 @@ tls_dialer_free(void *arg)
 	if ((d = arg) != NULL) {
 		nng_stream_dialer_free(d->d);
 		nng_tls_config_free(d->cfg);
+		tls_session_rele(d->sess);
 		nni_mtx_fini(&d->lk);
 		NNI_FREE_STRUCT(d);
 	}
@@ -180,6 +468,9 @@ tls_dialer_dial(void *arg, nng_aio *aio)
 		nni_aio_finish_error(aio, rv);
 		return;
 	}
+	nni_mtx_lock(&d->lk);
+	conn->sess = tls_session_hold(d->sess);
+	nni_mtx_unlock(&d->lk);
 
 	if ((rv = nni_aio_schedule(aio, tls_conn_cancel, conn)) != 0) {
 		nni_aio_finish_error(aio, rv);
@@ -308,6 +599,46 @@ tls_dialer_set_cert_key_file(
 	return (rv);
 }
 
+static int
+tls_dialer_set_session_reuse(
+    void *arg, const void *buf, size_t sz, nni_opt_type t)
+{
+	tls_dialer * d = arg;
+	tls_session *old;
+	bool         b;
+	int          rv;
+
+	if ((rv = nni_copyin_bool(&b, buf, sz, t)) != 0) {
+		return (rv);
+	}
+	nni_mtx_lock(&d->lk);
+	old = d->sess;
+	if (b && (old == NULL)) {
+		if ((d->sess = tls_session_alloc()) == NULL) {
+			rv = NNG_ENOMEM;
+		}
+	} else if (!b) {
+		d->sess = NULL;
+	}
+	nni_mtx_unlock(&d->lk);
+	if (!b) {
+		tls_session_rele(old);
+	}
+	return (rv);
+}
+
+static int
+tls_dialer_get_session_reuse(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	tls_dialer *d = arg;
+	bool        b;
+
+	nni_mtx_lock(&d->lk);
+	b = d->sess != NULL;
+	nni_mtx_unlock(&d->lk);
+	return (nni_copyout_bool(b, buf, szp, t));
+}
+
 static const nni_option tls_dialer_opts[] = {
 	{
 	    .o_name = NNG_OPT_TLS_CONFIG,
@@ -330,6 +661,11 @@ static const nni_option tls_dialer_opts[] = {
 	    .o_name = NNG_OPT_TLS_AUTH_MODE,
 	    .o_set  = tls_dialer_set_auth_mode,
 	},
+	{
+	    .o_name = NNG_OPT_TLS_SESSION_REUSE,
+	    .o_get  = tls_dialer_get_session_reuse,
+	    .o_set  = tls_dialer_set_session_reuse,
+	},
 	{
 	    .o_name = NULL,
 	},
@@ -732,12 +1068,55 @@ tls_recv(void *arg, nni_aio *aio)
 	nni_mtx_unlock(&conn->lock);
 }
 
+// tls_session_save refreshes the dialer's session from the connection.
+// Called with the connection lock held.
+static void
+tls_session_save(tls_conn *conn)
+{
+	tls_session *sess = conn->sess;
+	void *       session;
+	void *       old;
+
+	if ((sess == NULL) || (!conn->hs_done) ||
+	    (conn->ops.session_get == NULL) ||
+	    ((session = conn->ops.session_get((void *) (conn + 1))) == NULL)) {
+		return;
+	}
+	nni_mtx_lock(&sess->lock);
+	old           = sess->session;
+	sess->session = session;
+	sess->engine  = conn->engine;
+	nni_mtx_unlock(&sess->lock);
+	if (old != NULL) {
+		conn->ops.session_free(old);
+	}
+}
+
+// tls_session_offer offers the dialer's session, if it has one, to the
+// server on a new connection.  If that fails we just do a full handshake.
+static void
+tls_session_offer(tls_conn *conn)
+{
+	tls_session *sess = conn->sess;
+
+	if ((sess == NULL) || (conn->ops.session_set == NULL)) {
+		return;
+	}
+	nni_mtx_lock(&sess->lock);
+	if (sess->session != NULL) {
+		(void) conn->ops.session_set(
+		    (void *) (conn + 1), sess->session);
+	}
+	nni_mtx_unlock(&sess->lock);
+}
+
 static void
 tls_close(void *arg)
 {
 	tls_conn *conn = arg;
 
 	nni_mtx_lock(&conn->lock);
+	tls_session_save(conn);
 	conn->ops.close((void *) (conn + 1));
 	tls_tcp_error(conn, NNG_ECLOSED);
 	nni_mtx_unlock(&conn->lock);
@@ -756,6 +1135,33 @@ tls_get_verified(void *arg, void *buf, size_t *szp, nni_type t)
 	return (nni_copyout_bool(v, buf, szp, t));
 }
 
+static int
+tls_get_session_resumed(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	tls_conn *conn = arg;
+	bool      v;
+
+	if (conn->ops.resumed == NULL) {
+		return (NNG_ENOTSUP);
+	}
+	nni_mtx_lock(&conn->lock);
+	v = conn->hs_done && conn->ops.resumed((void *) (conn + 1));
+	nni_mtx_unlock(&conn->lock);
+	return (nni_copyout_bool(v, buf, szp, t));
+}
+
+static int
+tls_get_ktls(void *arg, void *buf, size_t *szp, nni_type t)
+{
+	tls_conn *conn = arg;
+	bool      v;
+
+	nni_mtx_lock(&conn->lock);
+	v = conn->ktls_tx || conn->ktls_rx;
+	nni_mtx_unlock(&conn->lock);
+	return (nni_copyout_bool(v, buf, szp, t));
+}
+
 static int
 tls_get_peer_cn(void *arg, void *buf, size_t *szp, nni_type t)
 {
@@ -801,6 +1207,14 @@ static const nni_option tls_options[] = {
 	    .o_name = NNG_OPT_TLS_PEER_ALT_NAMES,
 	    .o_get  = tls_get_peer_alt_names,
 	},
+	{
+	    .o_name = NNG_OPT_TLS_SESSION_RESUMED,
+	    .o_get  = tls_get_session_resumed,
+	},
+	{
+	    .o_name = NNG_OPT_TLS_KTLS,
+	    .o_get  = tls_get_ktls,
+	},
 	{
 	    .o_name = NULL,
 	},
@@ -852,13 +1266,6 @@ tls_alloc(tls_conn **conn_p, nng_tls_config *cfg, nng_aio *user_aio)
 	if ((conn = nni_zalloc(size)) == NULL) {
 		return (NNG_ENOMEM);
 	}
-	if (((conn->tcp_send_buf = nni_alloc(NNG_TLS_MAX_SEND_SIZE)) ==
-	        NULL) ||
-	    ((conn->tcp_recv_buf = nni_alloc(NNG_TLS_MAX_RECV_SIZE)) ==
-	        NULL)) {
-		tls_free(conn);
-		return (NNG_ENOMEM);
-	}
 	conn->size     = size;
 	conn->ops      = *eng->conn_ops;
 	conn->engine   = eng;
@@ -900,6 +1307,7 @@ tls_reap(void *arg)
 	nni_aio_stop(&conn->tcp_send);
 	nni_aio_stop(&conn->tcp_recv);
 
+	tls_session_save(conn);
 	conn->ops.fini((void *) (conn + 1));
 	nni_aio_fini(&conn->conn_aio);
 	nni_aio_fini(&conn->tcp_send);
@@ -908,11 +1316,12 @@ tls_reap(void *arg)
 	if (conn->cfg != NULL) {
 		nng_tls_config_free(conn->cfg); // this drops our hold on it
 	}
+	tls_session_rele(conn->sess);
 	if (conn->tcp_send_buf != NULL) {
-		nni_free(conn->tcp_send_buf, NNG_TLS_MAX_SEND_SIZE);
+		tls_buf_put(conn->tcp_send_buf, NNG_TLS_MAX_SEND_SIZE);
 	}
 	if (conn->tcp_recv_buf != NULL) {
-		nni_free(conn->tcp_recv_buf, NNG_TLS_MAX_RECV_SIZE);
+		tls_buf_put(conn->tcp_recv_buf, NNG_TLS_MAX_RECV_SIZE);
 	}
 	nni_mtx_fini(&conn->lock);
 	NNI_FREE_STRUCT(conn);
@@ -929,12 +1338,63 @@ tls_free(void *arg)
 static int
 tls_start(tls_conn *conn, nng_stream *tcp)
 {
-	int rv;
+	int    rv;
+	int    fd;
+	size_t sz = sizeof(fd);
 
 	conn->tcp = tcp;
 	rv        = conn->ops.init(
             (void *) (conn + 1), conn, (void *) (conn->cfg + 1));
-	return (rv);
+	if (rv != 0) {
+		return (rv);
+	}
+	tls_session_offer(conn);
+
+	// Kernel TLS needs the socket itself, so only plain TCP will do.
+	// The configuration is busy by now, so no need to lock it.
+	if (conn->cfg->ktls && (conn->ops.ktls_tx != NULL) &&
+	    (nni_stream_get(tcp, NNI_OPT_TCP_FD, &fd, &sz, NNI_TYPE_INT32) ==
+	        0)) {
+		conn->ktls_fd     = fd;
+		conn->ktls_tx_try = true;
+		conn->ktls_rx_try = (conn->ops.ktls_rx != NULL);
+	}
+	return (0);
+}
+
+// tls_ktls_start tries to hand each direction to the kernel, once the
+// handshake is done and nothing for that direction is held by us.  If the
+// engine is not ready yet we try again later, and any other failure just
+// leaves the engine doing the work.
+static void
+tls_ktls_start(tls_conn *conn)
+{
+	int rv;
+
+	if ((!conn->hs_done) || conn->closed) {
+		return;
+	}
+	if (conn->ktls_tx_try && (!conn->tcp_send_active) &&
+	    (conn->tcp_send_len == 0)) {
+		rv = conn->ops.ktls_tx((void *) (conn + 1), conn->ktls_fd);
+		if (rv == 0) {
+			conn->ktls_tx = true;
+		}
+		conn->ktls_tx_try = (rv == NNG_EAGAIN);
+	}
+	if (conn->ktls_rx_try && (!conn->tcp_recv_pend) &&
+	    (conn->tcp_recv_len == 0)) {
+		rv = conn->ops.ktls_rx((void *) (conn + 1), conn->ktls_fd);
+		if (rv == 0) {
+			conn->ktls_rx = true;
+			if (conn->tcp_recv_buf != NULL) {
+				tls_buf_put(
+				    conn->tcp_recv_buf, NNG_TLS_MAX_RECV_SIZE);
+				conn->tcp_recv_buf = NULL;
+			}
+		}
+		conn->ktls_rx_try = (rv == NNG_EAGAIN);
+	}
 }
 
 static void
@@ -966,6 +1426,7 @@ tls_do_handshake(tls_conn *conn)
 	}
 	if (rv == 0) {
 		conn->hs_done = true;
+		tls_session_save(conn);
 		return (true);
 	}
 	tls_tcp_error(conn, rv);
@@ -1000,10 +1461,26 @@ tls_do_recv(tls_conn *conn)
 			continue;
 		}
 
+		tls_ktls_start(conn);
+		if (conn->ktls_rx) {
+			// The kernel decrypts, so read straight into the
+			// caller's buffers.  Completed in tls_tcp_recv_cb.
+			if (!conn->tcp_recv_pend) {
+				conn->tcp_recv_pend = true;
+				nni_aio_set_timeout(
+				    &conn->tcp_recv, NNG_DURATION_INFINITE);
+				nni_aio_set_iov(&conn->tcp_recv, nio, iov);
+				nng_stream_recv(conn->tcp, &conn->tcp_recv);
+			}
+			return;
+		}
+
 		rv = conn->ops.recv((void *) (conn + 1), buf, &len);
 		if (rv == NNG_EAGAIN) {
 			// Nothing more we can do, the engine doesn't
-			// have anything else for us (yet).
+			// have anything else for us (yet).  Make sure we
+			// are reading, see nng_tls_engine_recv.
+			tls_tcp_recv_start(conn);
 			return;
 		}
 
@@ -1050,6 +1527,24 @@ tls_do_send(tls_conn *conn)
 			continue;
 		}
 
+		tls_ktls_start(conn);
+		if (conn->ktls_tx) {
+			// The kernel encrypts, so send straight from the
+			// caller's buffers.  Completed in tls_tcp_send_cb.
+			if (!conn->tcp_send_active) {
+				conn->tcp_send_active = true;
+				nni_aio_set_iov(&conn->tcp_send, nio, iov);
+				nng_stream_send(conn->tcp, &conn->tcp_send);
+			}
+			return;
+		}
+		if (conn->ktls_tx_try && conn->hs_done &&
+		    (conn->tcp_send_active || (conn->tcp_send_len != 0))) {
+			// Let the engine's data drain first, so that we
+			// can hand over to the kernel when it has.
+			return;
+		}
+
 		// Ask the engine to send.
 		rv = conn->ops.send((void *) (conn + 1), buf, &len);
 		if (rv == NNG_EAGAIN) {
@@ -1085,10 +1580,27 @@ tls_tcp_send_cb(void *arg)
 	}
 
 	count = nni_aio_count(aio);
+	if (conn->ktls_tx) {
+		nni_aio *user;
+		if ((user = nni_list_first(&conn->send_queue)) != NULL) {
+			nni_aio_list_remove(user);
+			nni_aio_finish(user, 0, count);
+		}
+		tls_do_send(conn);
+		nni_mtx_unlock(&conn->lock);
+		return;
+	}
 	NNI_ASSERT(count <= conn->tcp_send_len);
 	conn->tcp_send_len -= count;
 	conn->tcp_send_tail += count;
 	conn->tcp_send_tail %= NNG_TLS_MAX_SEND_SIZE;
+	if (conn->tcp_send_len == 0) {
+		// All sent, nothing to hold on to.
+		tls_buf_put(conn->tcp_send_buf, NNG_TLS_MAX_SEND_SIZE);
+		conn->tcp_send_buf  = NULL;
+		conn->tcp_send_head = 0;
+		conn->tcp_send_tail = 0;
+	}
 	tls_tcp_send_start(conn);
 
 	if (tls_do_handshake(conn)) {
@@ -1109,15 +1621,40 @@ tls_tcp_recv_cb(void *arg)
 	nni_mtx_lock(&conn->lock);
 
 	conn->tcp_recv_pend = false;
-	if ((rv = nni_aio_result(aio)) != 0) {
+	if (((rv = nni_aio_result(aio)) == NNG_ETIMEDOUT) &&
+	    (nni_aio_count(aio) == 0) && (conn->tcp_recv_buf != NULL) &&
+	    (!conn->ktls_rx)) {
+		// Quiet for a while, give the buffer back and peek.
+		tls_buf_put(conn->tcp_recv_buf, NNG_TLS_MAX_RECV_SIZE);
+		conn->tcp_recv_buf  = NULL;
+		conn->tcp_recv_more = false;
+		tls_tcp_recv_start(conn);
+		nni_mtx_unlock(&conn->lock);
+		return;
+	}
+	if (rv != 0) {
 		tls_tcp_error(conn, rv);
 		nni_mtx_unlock(&conn->lock);
 		return;
 	}
 
+	if (conn->ktls_rx) {
+		nni_aio *user;
+		if ((user = nni_list_first(&conn->recv_queue)) != NULL) {
+			nni_aio_list_remove(user);
+			nni_aio_finish(user, 0, nni_aio_count(aio));
+		}
+		tls_do_recv(conn);
+		nni_mtx_unlock(&conn->lock);
+		return;
+	}
+
 	NNI_ASSERT(conn->tcp_recv_len == 0);
 	NNI_ASSERT(conn->tcp_recv_off == 0);
-	conn->tcp_recv_len = nni_aio_count(aio);
+	conn->tcp_recv_len  = nni_aio_count(aio);
+	conn->tcp_recv_more = conn->tcp_recv_len ==
+	    (conn->tcp_recv_buf != NULL ? NNG_TLS_MAX_RECV_SIZE
+	                                : TLS_RECV_PEEK);
 
 	if (tls_do_handshake(conn)) {
 		tls_do_recv(conn);
@@ -1141,8 +1678,27 @@ tls_tcp_recv_start(tls_conn *conn)
 		return;
 	}
 	conn->tcp_recv_off = 0;
-	iov.iov_len        = NNG_TLS_MAX_RECV_SIZE;
-	iov.iov_buf        = conn->tcp_recv_buf;
+
+	// Only borrow a buffer when the last read suggests that more data
+	// is waiting, otherwise just wait for the next record header.  If
+	// there is no buffer to be had we limp along on the small one.
+	// A buffer we already hold is kept for a grace period when the peer
+	// has nothing more for now; tls_tcp_recv_cb returns it if that
+	// expires.
+	if ((conn->tcp_recv_buf == NULL) && conn->tcp_recv_more) {
+		conn->tcp_recv_buf = tls_buf_get(NNG_TLS_MAX_RECV_SIZE);
+	}
+	if (conn->tcp_recv_buf != NULL) {
+		iov.iov_len = NNG_TLS_MAX_RECV_SIZE;
+		iov.iov_buf = conn->tcp_recv_buf;
+		nni_aio_set_timeout(&conn->tcp_recv,
+		    conn->tcp_recv_more ? NNG_DURATION_INFINITE
+		                        : TLS_RECV_GRACE);
+	} else {
+		iov.iov_len = TLS_RECV_PEEK;
+		iov.iov_buf = conn->tcp_recv_peek;
+		nni_aio_set_timeout(&conn->tcp_recv, NNG_DURATION_INFINITE);
+	}
 
 	conn->tcp_recv_pend = true;
 	nng_aio_set_iov(&conn->tcp_recv, 1, &iov);
@@ -1211,11 +1767,21 @@ nng_tls_engine_send(void *arg, const uint8_t *buf, size_t *szp)
 	if (conn->closed) {
 		return (NNG_ECLOSED);
 	}
+	if (conn->ktls_tx) {
+		// The kernel owns the records now.
+		return (NNG_ESTATE);
+	}
 
 	if (len > space) {
 		len = space;
 	}
 
+	if ((conn->tcp_send_buf == NULL) &&
+	    ((conn->tcp_send_buf = tls_buf_get(NNG_TLS_MAX_SEND_SIZE)) ==
+	        NULL)) {
+		return (NNG_ENOMEM);
+	}
+
 	// We are committed at this point to sending out len bytes.
 	// Update this now, so that we can use len to update.
 	*szp = len;
@@ -1250,10 +1816,14 @@ nng_tls_engine_recv(void *arg, uint8_t *buf, size_t *szp)
 {
 	tls_conn *conn = arg;
 	size_t    len  = *szp;
+	uint8_t  *src;
 
 	if (conn->closed) {
 		return (NNG_ECLOSED);
 	}
+	if (conn->ktls_rx) {
+		return (NNG_ESTATE);
+	}
 	if (conn->tcp_recv_len == 0) {
 		tls_tcp_recv_start(conn);
 		return (NNG_EAGAIN);
@@ -1261,13 +1831,18 @@ nng_tls_engine_recv(void *arg, uint8_t *buf, size_t *szp)
 	if (len > conn->tcp_recv_len) {
 		len = conn->tcp_recv_len;
 	}
-	memcpy(buf, conn->tcp_recv_buf + conn->tcp_recv_off, len);
+	src = conn->tcp_recv_buf != NULL ? conn->tcp_recv_buf
+	                                 : conn->tcp_recv_peek;
+	memcpy(buf, src + conn->tcp_recv_off, len);
 	conn->tcp_recv_off += len;
 	conn->tcp_recv_len -= len;
 
 	// If we still have data left in the buffer, then the following
-	// call is a no-op.
-	tls_tcp_recv_start(conn);
+	// call is a no-op.  While the kernel may yet take over receiving,
+	// we leave that to tls_do_recv, so that it gets a chance first.
+	if (!(conn->ktls_rx_try && conn->hs_done)) {
+		tls_tcp_recv_start(conn);
+	}
 
 	*szp = len;
 	return (0);
@@ -1334,6 +1909,61 @@ nng_tls_config_version(
 	} else {
 		rv = cfg->ops.version((void *) (cfg + 1), min_ver, max_ver);
 	}
+
+	nni_mtx_unlock(&cfg->lock);
+	return (rv);
+}
+
+int
+nng_tls_config_session_cache(
+    nng_tls_config *cfg, size_t size, nng_duration lifetime)
+{
+	int rv;
+
+	nni_mtx_lock(&cfg->lock);
+	if (cfg->busy) {
+		rv = NNG_EBUSY;
+	} else if (cfg->ops.session_cache == NULL) {
+		rv = NNG_ENOTSUP;
+	} else {
+		rv = cfg->ops.session_cache((void *) (cfg + 1), size, lifetime);
+	}
+	nni_mtx_unlock(&cfg->lock);
+	return (rv);
+}
+
+int
+nng_tls_config_session_tickets(
+    nng_tls_config *cfg, nng_duration lifetime, nng_duration rotate)
+{
+	int rv;
+
+	nni_mtx_lock(&cfg->lock);
+	if (cfg->busy) {
+		rv = NNG_EBUSY;
+	} else if (cfg->ops.session_tickets == NULL) {
+		rv = NNG_ENOTSUP;
+	} else {
+		rv = cfg->ops.session_tickets(
+		    (void *) (cfg + 1), lifetime, rotate);
+	}
+	nni_mtx_unlock(&cfg->lock);
+	return (rv);
+}
+
+int
+nng_tls_config_ktls(nng_tls_config *cfg, bool on)
+{
+	int rv;
+
+	nni_mtx_lock(&cfg->lock);
+	if (cfg->busy) {
+		rv = NNG_EBUSY;
+	} else if (cfg->ops.ktls == NULL) {
+		rv = NNG_ENOTSUP;
+	} else if ((rv = cfg->ops.ktls((void *) (cfg + 1), on)) == 0) {
+		cfg->ktls = on;
+	}
 	nni_mtx_unlock(&cfg->lock);
 	return (rv);
 }
@@ -1550,6 +2180,7 @@ nni_tls_sys_init(void)
 	if (rv != 0) {
 		return (rv);
 	}
+	tls_buf_sys_init();
 	return (0);
 }
 
@@ -1557,6 +2188,8 @@ void
 nni_tls_sys_fini(void)
 {
 	NNG_TLS_ENGINE_FINI();
+	nni_reap_drain(); // connections still being reaped return buffers
+	tls_buf_sys_fini();
 }
 
 #else // NNG_SUPP_TLS
@@ -1685,6 +2318,34 @@ nng_tls_config_version(
 	return (NNG_ENOTSUP);
 }
 
+int
+nng_tls_config_session_cache(
+    nng_tls_config *cfg, size_t size, nng_duration lifetime)
+{
+	NNI_ARG_UNUSED(cfg);
+	NNI_ARG_UNUSED(size);
+	NNI_ARG_UNUSED(lifetime);
+	return (NNG_ENOTSUP);
+}
+
+int
+nng_tls_config_session_tickets(
+    nng_tls_config *cfg, nng_duration lifetime, nng_duration rotate)
+{
+	NNI_ARG_UNUSED(cfg);
+	NNI_ARG_UNUSED(lifetime);
+	NNI_ARG_UNUSED(rotate);
+	return (NNG_ENOTSUP);
+}
+
+int
+nng_tls_config_ktls(nng_tls_config *cfg, bool on)
+{
+	NNI_ARG_UNUSED(cfg);
+	NNI_ARG_UNUSED(on);
+	return (NNG_ENOTSUP);
+}
+
 int
 nni_tls_dialer_alloc(nng_stream_dialer **dp, const nng_url *url)
 {
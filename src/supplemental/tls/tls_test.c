@@ -9,6 +9,10 @@
 
 #include <nuts.h>
 
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
 void
 test_tls_config_version(void)
 {
@@ -472,6 +476,414 @@ test_tls_psk_config_busy(void)
 	nng_tls_config_free(c1);
 }
 
+static uint64_t
+tls_stat(const char *name)
+{
+	nng_stat *st;
+	nng_stat *item;
+	uint64_t  val = 0;
+
+	NUTS_PASS(nng_stats_get(&st));
+	if ((item = nng_stat_find(st, name)) != NULL) {
+		val = nng_stat_value(item);
+	}
+	nng_stats_free(st);
+	return (val);
+}
+
+// tls_rss returns the resident set size in bytes, or 0 if we don't know.
+static size_t
+tls_rss(void)
+{
+	size_t rss = 0;
+#ifdef __linux__
+	FILE         *f;
+	unsigned long size;
+	unsigned long res;
+
+	if ((f = fopen("/proc/self/statm", "r")) != NULL) {
+		if (fscanf(f, "%lu %lu", &size, &res) == 2) {
+			rss = (size_t) res * (size_t) sysconf(_SC_PAGESIZE);
+		}
+		fclose(f);
+	}
+#endif
+	return (rss);
+}
+
+// test_tls_idle_buffers opens a number of idle connections, each side
+// waiting to receive, and checks that none of them holds on to a record
+// buffer.  The count can be raised with NNG_TEST_TLS_CONNS (which will
+// likely need a higher file descriptor limit) to measure the memory
+// cost of a large number of idle devices.
+void
+test_tls_idle_buffers(void)
+{
+	nng_stream_listener *l;
+	nng_stream_dialer   *d;
+	nng_tls_config      *c1;
+	nng_tls_config      *c2;
+	nng_aio             *aio1;
+	nng_aio             *aio2;
+	nng_stream         **s;
+	nng_aio            **raio;
+	uint8_t             *rbuf;
+	nng_iov              iov;
+	char                 addr[32];
+	const char          *env;
+	static uint8_t       burst1[16384];
+	static uint8_t       burst2[16384];
+	int                  n = 64;
+	int                  port;
+	size_t               rss;
+	nng_time             expire;
+	uint64_t             held;
+	void                *t;
+
+	if ((env = getenv("NNG_TEST_TLS_CONNS")) != NULL) {
+		n = atoi(env);
+	}
+	NUTS_TRUE(n > 0);
+	for (size_t i = 0; i < sizeof(burst1); i++) {
+		burst1[i] = rand() & 0xff;
+	}
+	NUTS_ASSERT((s = calloc(2 * n, sizeof(*s))) != NULL);
+	NUTS_ASSERT((raio = calloc(2 * n, sizeof(*raio))) != NULL);
+	NUTS_ASSERT((rbuf = calloc(2 * n, 1)) != NULL);
+
+	NUTS_PASS(nng_aio_alloc(&aio1, NULL, NULL));
+	NUTS_PASS(nng_aio_alloc(&aio2, NULL, NULL));
+	nng_aio_set_timeout(aio1, 5000);
+	nng_aio_set_timeout(aio2, 5000);
+
+	NUTS_PASS(nng_stream_listener_alloc(&l, "tls+tcp://127.0.0.1:0"));
+	NUTS_PASS(nng_tls_config_alloc(&c1, NNG_TLS_MODE_SERVER));
+	NUTS_PASS(nng_tls_config_own_cert(
+	    c1, nuts_server_crt, nuts_server_key, NULL));
+	NUTS_PASS(nng_stream_listener_set_ptr(l, NNG_OPT_TLS_CONFIG, c1));
+	NUTS_PASS(nng_stream_listener_listen(l));
+	NUTS_PASS(
+	    nng_stream_listener_get_int(l, NNG_OPT_TCP_BOUND_PORT, &port));
+
+	snprintf(addr, sizeof(addr), "tls+tcp://127.0.0.1:%d", port);
+	NUTS_PASS(nng_stream_dialer_alloc(&d, addr));
+	NUTS_PASS(nng_tls_config_alloc(&c2, NNG_TLS_MODE_CLIENT));
+	NUTS_PASS(nng_tls_config_ca_chain(c2, nuts_server_crt, NULL));
+	NUTS_PASS(nng_tls_config_server_name(c2, "localhost"));
+	NUTS_PASS(nng_stream_dialer_set_ptr(d, NNG_OPT_TLS_CONFIG, c2));
+
+	rss = tls_rss();
+	for (int i = 0; i < n; i++) {
+		nng_stream_listener_accept(l, aio1);
+		nng_stream_dialer_dial(d, aio2);
+		nng_aio_wait(aio1);
+		nng_aio_wait(aio2);
+		NUTS_PASS(nng_aio_result(aio1));
+		NUTS_PASS(nng_aio_result(aio2));
+		s[2 * i]     = nng_aio_get_output(aio1, 0);
+		s[2 * i + 1] = nng_aio_get_output(aio2, 0);
+	}
+
+	// Each client sends a burst to its server first (clients speak
+	// first, like MQTT), which drives the handshakes and touches the
+	// buffers.  Then everybody waits for a byte.
+	for (int i = 0; i < n; i++) {
+		void *t2;
+
+		t = nuts_stream_send_start(
+		    s[2 * i + 1], burst1, sizeof(burst1));
+		t2 = nuts_stream_recv_start(s[2 * i], burst2, sizeof(burst2));
+		NUTS_PASS(nuts_stream_wait(t));
+		NUTS_PASS(nuts_stream_wait(t2));
+	}
+	NUTS_TRUE(memcmp(burst1, burst2, sizeof(burst1)) == 0);
+	for (int i = 0; i < 2 * n; i++) {
+		NUTS_PASS(nng_aio_alloc(&raio[i], NULL, NULL));
+		nng_aio_set_timeout(raio[i], 10000);
+		iov.iov_buf = &rbuf[i];
+		iov.iov_len = 1;
+		NUTS_PASS(nng_aio_set_iov(raio[i], 1, &iov));
+		nng_stream_recv(s[i], raio[i]);
+	}
+	NUTS_TRUE(tls_stat("buf_pooled") + tls_stat("buf_alloc") > 0);
+
+	// Once things settle, idle connections hold no buffers.
+	expire = nng_clock() + 5000;
+	while (((held = tls_stat("buf_held")) != 0) &&
+	    (nng_clock() < expire)) {
+		nng_msleep(20);
+	}
+	NUTS_TRUE(held == 0);
+	if ((rss != 0) && (tls_rss() > rss)) {
+		printf("%d idle connection pairs: %zu bytes RSS per pair\n",
+		    n, (tls_rss() - rss) / n);
+	}
+
+	// And they still work of course.
+	t = nuts_stream_send_start(s[1], "y", 1);
+	NUTS_PASS(nuts_stream_wait(t));
+	nng_aio_wait(raio[0]);
+	NUTS_PASS(nng_aio_result(raio[0]));
+	NUTS_TRUE(rbuf[0] == 'y');
+
+	for (int i = 0; i < 2 * n; i++) {
+		nng_stream_free(s[i]);
+		nng_aio_free(raio[i]);
+	}
+	nng_stream_dialer_free(d);
+	nng_stream_listener_free(l);
+	nng_tls_config_free(c1);
+	nng_tls_config_free(c2);
+	nng_aio_free(aio1);
+	nng_aio_free(aio2);
+	free(s);
+	free(raio);
+	free(rbuf);
+}
+
+// tls_handshakes connects and exchanges a byte each way n times, and
+// returns handshakes per second.  The client reads the server's reply so
+// that TLS 1.3 session tickets get processed before the close.
+static double
+tls_handshakes(nng_stream_listener *l, nng_stream_dialer *d, int n,
+    int *resumed)
+{
+	nng_aio    *aio1;
+	nng_aio    *aio2;
+	nng_stream *s1;
+	nng_stream *s2;
+	char        buf[5];
+	nng_time    start;
+	nng_time    end;
+	void       *t1;
+	void       *t2;
+	bool        b;
+	int         rv;
+
+	NUTS_PASS(nng_aio_alloc(&aio1, NULL, NULL));
+	NUTS_PASS(nng_aio_alloc(&aio2, NULL, NULL));
+	nng_aio_set_timeout(aio1, 5000);
+	nng_aio_set_timeout(aio2, 5000);
+	*resumed = 0;
+	start    = nng_clock();
+	for (int i = 0; i < n; i++) {
+		nng_stream_listener_accept(l, aio1);
+		nng_stream_dialer_dial(d, aio2);
+		nng_aio_wait(aio1);
+		nng_aio_wait(aio2);
+		NUTS_PASS(nng_aio_result(aio1));
+		NUTS_PASS(nng_aio_result(aio2));
+		s1 = nng_aio_get_output(aio1, 0);
+		s2 = nng_aio_get_output(aio2, 0);
+
+		t1 = nuts_stream_send_start(s2, "hello", 5);
+		t2 = nuts_stream_recv_start(s1, buf, 5);
+		NUTS_PASS(nuts_stream_wait(t1));
+		NUTS_PASS(nuts_stream_wait(t2));
+		t1 = nuts_stream_send_start(s1, "x", 1);
+		t2 = nuts_stream_recv_start(s2, buf, 1);
+		NUTS_PASS(nuts_stream_wait(t1));
+		NUTS_PASS(nuts_stream_wait(t2));
+
+		rv = nng_stream_get_bool(s2, NNG_OPT_TLS_SESSION_RESUMED, &b);
+		if (rv == NNG_ENOTSUP) {
+			*resumed = -1;
+		} else {
+			NUTS_PASS(rv);
+			if (b && (*resumed >= 0)) {
+				(*resumed)++;
+			}
+		}
+		nng_stream_free(s2);
+		nng_stream_free(s1);
+	}
+	end = nng_clock();
+	nng_aio_free(aio1);
+	nng_aio_free(aio2);
+	return (n * 1000.0 / (end > start ? end - start : 1));
+}
+
+static void
+test_tls_session_resumption(void)
+{
+	nng_stream_listener *l;
+	nng_stream_dialer   *d;
+	nng_tls_config      *c1;
+	nng_tls_config      *c2;
+	char                 addr[32];
+	const char          *env;
+	int                  n = 100;
+	int                  port;
+	int                  resumed;
+	int                  rv;
+	double               full;
+	double               fast;
+	bool                 b;
+
+	if ((env = getenv("NNG_TEST_TLS_HANDSHAKES")) != NULL) {
+		n = atoi(env);
+	}
+	NUTS_TRUE(n > 1);
+
+	NUTS_PASS(nng_tls_config_alloc(&c1, NNG_TLS_MODE_SERVER));
+	NUTS_PASS(nng_tls_config_own_cert(
+	    c1, nuts_server_crt, nuts_server_key, NULL));
+	if ((rv = nng_tls_config_session_cache(c1, 1024, 300000)) ==
+	    NNG_ENOTSUP) {
+		printf("session resumption not supported by %s\n",
+		    nng_tls_engine_name());
+		NUTS_FAIL(nng_tls_config_session_tickets(c1, 300000, 60000),
+		    NNG_ENOTSUP);
+		nng_tls_config_free(c1);
+		return;
+	}
+	NUTS_PASS(rv);
+	NUTS_PASS(nng_tls_config_session_tickets(c1, 300000, 60000));
+	NUTS_PASS(nng_stream_listener_alloc(&l, "tls+tcp://127.0.0.1:0"));
+	NUTS_PASS(nng_stream_listener_set_ptr(l, NNG_OPT_TLS_CONFIG, c1));
+	NUTS_PASS(nng_stream_listener_listen(l));
+	NUTS_PASS(
+	    nng_stream_listener_get_int(l, NNG_OPT_TCP_BOUND_PORT, &port));
+
+	snprintf(addr, sizeof(addr), "tls+tcp://127.0.0.1:%d", port);
+	NUTS_PASS(nng_stream_dialer_alloc(&d, addr));
+	NUTS_PASS(nng_tls_config_alloc(&c2, NNG_TLS_MODE_CLIENT));
+	NUTS_PASS(nng_tls_config_ca_chain(c2, nuts_server_crt, NULL));
+	NUTS_PASS(nng_tls_config_server_name(c2, "localhost"));
+	NUTS_PASS(nng_stream_dialer_set_ptr(d, NNG_OPT_TLS_CONFIG, c2));
+
+	// Session configuration is server side only.
+	NUTS_FAIL(nng_tls_config_session_cache(c2, 1024, 0), NNG_ENOTSUP);
+
+	NUTS_PASS(
+	    nng_stream_dialer_get_bool(d, NNG_OPT_TLS_SESSION_REUSE, &b));
+	NUTS_TRUE(b == false);
+	full = tls_handshakes(l, d, n, &resumed);
+	NUTS_TRUE(resumed <= 0);
+
+	NUTS_PASS(
+	    nng_stream_dialer_set_bool(d, NNG_OPT_TLS_SESSION_REUSE, true));
+	NUTS_PASS(
+	    nng_stream_dialer_get_bool(d, NNG_OPT_TLS_SESSION_REUSE, &b));
+	NUTS_TRUE(b);
+	fast = tls_handshakes(l, d, n, &resumed);
+	if (resumed >= 0) {
+		// The session is saved when a connection is reaped, which
+		// can race with the next dial, so allow for a few misses.
+		NUTS_TRUE(resumed >= n / 2);
+	}
+	printf("%d handshakes: %.0f/s full, %.0f/s resumed, %d resumed "
+	       "(%s)\n",
+	    n, full, fast, resumed, nng_tls_engine_name());
+	NUTS_FAIL(nng_tls_config_session_tickets(c1, 0, 0), NNG_EBUSY);
+
+	nng_stream_dialer_free(d);
+	nng_stream_listener_free(l);
+	nng_tls_config_free(c1);
+	nng_tls_config_free(c2);
+}
+
+static void
+test_tls_kernel_offload(void)
+{
+	nng_stream_listener *l;
+	nng_stream_dialer   *d;
+	nng_tls_config      *c1;
+	nng_tls_config      *c2;
+	nng_aio             *aio1;
+	nng_aio             *aio2;
+	nng_stream          *s1;
+	nng_stream          *s2;
+	char                 addr[32];
+	int                  port;
+	int                  rv;
+	bool                 b1;
+	bool                 b2;
+	void                *t1;
+	void                *t2;
+	size_t               size = 12000;
+	uint8_t             *buf1;
+	uint8_t             *buf2;
+
+	NUTS_PASS(nng_tls_config_alloc(&c1, NNG_TLS_MODE_SERVER));
+	NUTS_PASS(nng_tls_config_own_cert(
+	    c1, nuts_server_crt, nuts_server_key, NULL));
+	NUTS_PASS(nng_tls_config_alloc(&c2, NNG_TLS_MODE_CLIENT));
+	NUTS_PASS(nng_tls_config_ca_chain(c2, nuts_server_crt, NULL));
+	NUTS_PASS(nng_tls_config_server_name(c2, "localhost"));
+	if ((rv = nng_tls_config_ktls(c1, true)) == NNG_ENOTSUP) {
+		printf("kernel TLS not supported by %s\n",
+		    nng_tls_engine_name());
+		nng_tls_config_free(c1);
+		nng_tls_config_free(c2);
+		return;
+	}
+	NUTS_PASS(rv);
+	NUTS_PASS(nng_tls_config_ktls(c2, true));
+
+	NUTS_ASSERT((buf1 = nng_alloc(size)) != NULL);
+	NUTS_ASSERT((buf2 = nng_alloc(size)) != NULL);
+	for (size_t i = 0; i < size; i++) {
+		buf1[i] = rand() & 0xff;
+	}
+	NUTS_PASS(nng_aio_alloc(&aio1, NULL, NULL));
+	NUTS_PASS(nng_aio_alloc(&aio2, NULL, NULL));
+	nng_aio_set_timeout(aio1, 5000);
+	nng_aio_set_timeout(aio2, 5000);
+
+	NUTS_PASS(nng_stream_listener_alloc(&l, "tls+tcp://127.0.0.1:0"));
+	NUTS_PASS(nng_stream_listener_set_ptr(l, NNG_OPT_TLS_CONFIG, c1));
+	NUTS_PASS(nng_stream_listener_listen(l));
+	NUTS_PASS(
+	    nng_stream_listener_get_int(l, NNG_OPT_TCP_BOUND_PORT, &port));
+	snprintf(addr, sizeof(addr), "tls+tcp://127.0.0.1:%d", port);
+	NUTS_PASS(nng_stream_dialer_alloc(&d, addr));
+	NUTS_PASS(nng_stream_dialer_set_ptr(d, NNG_OPT_TLS_CONFIG, c2));
+
+	nng_stream_listener_accept(l, aio1);
+	nng_stream_dialer_dial(d, aio2);
+	nng_aio_wait(aio1);
+	nng_aio_wait(aio2);
+	NUTS_PASS(nng_aio_result(aio1));
+	NUTS_PASS(nng_aio_result(aio2));
+	s1 = nng_aio_get_output(aio1, 0);
+	s2 = nng_aio_get_output(aio2, 0);
+
+	// Whether or not the kernel takes over, the data must get through
+	// unharmed, in both directions, and across the switch.
+	for (int i = 0; i < 3; i++) {
+		memset(buf2, 0, size);
+		t1 = nuts_stream_send_start(s2, buf1, size);
+		t2 = nuts_stream_recv_start(s1, buf2, size);
+		NUTS_PASS(nuts_stream_wait(t1));
+		NUTS_PASS(nuts_stream_wait(t2));
+		NUTS_TRUE(memcmp(buf1, buf2, size) == 0);
+
+		memset(buf2, 0, size);
+		t1 = nuts_stream_send_start(s1, buf1, size);
+		t2 = nuts_stream_recv_start(s2, buf2, size);
+		NUTS_PASS(nuts_stream_wait(t1));
+		NUTS_PASS(nuts_stream_wait(t2));
+		NUTS_TRUE(memcmp(buf1, buf2, size) == 0);
+	}
+	NUTS_PASS(nng_stream_get_bool(s1, NNG_OPT_TLS_KTLS, &b1));
+	NUTS_PASS(nng_stream_get_bool(s2, NNG_OPT_TLS_KTLS, &b2));
+	printf("kernel TLS: server %s, client %s\n", b1 ? "yes" : "no",
+	    b2 ? "yes" : "no");
+	NUTS_FAIL(nng_tls_config_ktls(c1, false), NNG_EBUSY);
+
+	nng_stream_free(s1);
+	nng_stream_free(s2);
+	nng_stream_dialer_free(d);
+	nng_stream_listener_free(l);
+	nng_tls_config_free(c1);
+	nng_tls_config_free(c2);
+	nng_aio_free(aio1);
+	nng_aio_free(aio2);
+	nng_free(buf1, size);
+	nng_free(buf2, size);
+}
+
 TEST_LIST = {
 	{ "tls config version", test_tls_config_version },
 	{ "tls conn refused", test_tls_conn_refused },
@@ -482,5 +894,8 @@ TEST_LIST = {
 	{ "tls psk bad identity", test_tls_psk_bad_identity },
 	{ "tls psk key too big", test_tls_psk_key_too_big },
 	{ "tls psk key config busy", test_tls_psk_config_busy },
+	{ "tls idle buffers", test_tls_idle_buffers },
+	{ "tls session resumption", test_tls_session_resumption },
+	{ "tls kernel offload", test_tls_kernel_offload },
 	{ NULL, NULL },
 };
\ No newline at end of file
@@ -22,6 +22,21 @@
 
 #include "websocket.h"
 
+// Masking runs over every byte a client sends and a server receives, so
+// it uses whatever vector width the compiler was told it may.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WS_MASK_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define WS_MASK_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define WS_MASK_NEON
+#endif
+
 // This should be removed or handled differently in the future.
 typedef int (*nni_ws_listen_hook)(void *, nng_http_req *, nng_http_res *);
 
@@ -166,6 +181,7 @@ struct ws_frame {
 	size_t        asize; // allocated size
 	uint8_t      *adata;
 	uint8_t      *buf;
+	nni_msg      *msg; // whole message received in place, if not NULL
 	nng_aio      *aio;
 };
 
@@ -352,9 +368,62 @@ ws_frame_fini(ws_frame *frame)
 	if (frame->asize != 0) {
 		nni_free(frame->adata, frame->asize);
 	}
+	if (frame->msg != NULL) {
+		nni_msg_free(frame->msg);
+	}
 	NNI_FREE_STRUCT(frame);
 }
 
+void
+nni_ws_mask(uint8_t *buf, size_t len, const uint8_t *mask)
+{
+	uint8_t  rep[32];
+	uint64_t m64;
+	size_t   i = 0;
+
+	// Every step is a multiple of four bytes, so the mask repeated
+	// lines up for each of them, whatever the byte order.
+	for (size_t j = 0; j < sizeof(rep); j++) {
+		rep[j] = mask[j % 4];
+	}
+#ifdef WS_MASK_AVX2
+	if (len >= 32) {
+		__m256i m = _mm256_loadu_si256((const __m256i *) rep);
+		for (; i + 32 <= len; i += 32) {
+			__m256i *p = (__m256i *) (buf + i);
+			_mm256_storeu_si256(
+			    p, _mm256_xor_si256(_mm256_loadu_si256(p), m));
+		}
+	}
+#endif
+#if defined(WS_MASK_SSE2)
+	if (len - i >= 16) {
+		__m128i m = _mm_loadu_si128((const __m128i *) rep);
+		for (; i + 16 <= len; i += 16) {
+			__m128i *p = (__m128i *) (buf + i);
+			_mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), m));
+		}
+	}
+#elif defined(WS_MASK_NEON)
+	if (len - i >= 16) {
+		uint8x16_t m = vld1q_u8(rep);
+		for (; i + 16 <= len; i += 16) {
+			vst1q_u8(buf + i, veorq_u8(vld1q_u8(buf + i), m));
+		}
+	}
+#endif
+	memcpy(&m64, rep, sizeof(m64));
+	for (; i + 8 <= len; i += 8) {
+		uint64_t w;
+		memcpy(&w, buf + i, sizeof(w));
+		w ^= m64;
+		memcpy(buf + i, &w, sizeof(w));
+	}
+	for (; i < len; i++) {
+		buf[i] ^= mask[i % 4];
+	}
+}
+
 static void
 ws_mask_frame(ws_frame *frame)
 {
@@ -365,9 +434,7 @@ ws_mask_frame(ws_frame *frame)
 	}
 	r = nni_random();
 	NNI_PUT32(frame->mask, r);
-	for (size_t i = 0; i < frame->len; i++) {
-		frame->buf[i] ^= frame->mask[i % 4];
-	}
+	nni_ws_mask(frame->buf, frame->len, frame->mask);
 	memcpy(frame->head + frame->hlen, frame->mask, 4);
 	frame->hlen += 4;
 	frame->head[1] |= 0x80; // set masked bit
@@ -381,9 +448,7 @@ ws_unmask_frame(ws_frame *frame)
 	if (!frame->masked) {
 		return;
 	}
-	for (size_t i = 0; i < frame->len; i++) {
-		frame->buf[i] ^= frame->mask[i % 4];
-	}
+	nni_ws_mask(frame->buf, frame->len, frame->mask);
 	frame->hlen -= 4;
 	frame->head[1] &= 0x7f; // clear masked bit
 	frame->masked = false;
@@ -916,6 +981,20 @@ ws_read_finish_msg(nni_ws *ws)
 
 	nni_aio_list_remove(aio);
 
+	frame = nni_list_first(&ws->rxq);
+	if (frame->msg != NULL) {
+		// Whole message in one frame, received in place.
+		NNI_ASSERT(nni_list_next(&ws->rxq, frame) == NULL);
+		nni_list_remove(&ws->rxq, frame);
+		msg        = frame->msg;
+		frame->msg = NULL;
+		ws_frame_fini(frame);
+		nni_aio_set_msg(aio, msg);
+		nni_aio_bump_count(aio, nni_msg_len(msg));
+		nni_aio_finish(aio, 0, nni_msg_len(msg));
+		return;
+	}
+
 	if ((rv = nni_msg_alloc(&msg, len)) != 0) {
 		nni_aio_finish_error(aio, rv);
 		ws_close_error(ws, WS_CLOSE_INTERNAL);
@@ -1133,8 +1212,21 @@ ws_read_cb(void *arg)
 
 			nni_iov iov;
 
-			// Short frames can avoid an alloc
-			if (frame->len < 126) {
+			if ((!ws->isstream) && (!ws->inmsg) && frame->final &&
+			    ((frame->op == WS_BINARY) ||
+			        (frame->op == WS_TEXT))) {
+				// A message in a single frame can go
+				// straight into the message we deliver.
+				if (nni_msg_alloc(&frame->msg, frame->len) !=
+				    0) {
+					ws_close(ws, WS_CLOSE_INTERNAL);
+					nni_mtx_unlock(&ws->mtx);
+					return;
+				}
+				frame->asize = 0;
+				frame->buf   = nni_msg_body(frame->msg);
+			} else if (frame->len < 126) {
+				// Short frames can avoid an alloc
 				frame->buf   = frame->sdata;
 				frame->asize = 0;
 			} else {
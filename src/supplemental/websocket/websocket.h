@@ -34,4 +34,8 @@ typedef struct nni_ws_dialer   nni_ws_dialer;
 extern int nni_ws_listener_alloc(nng_stream_listener **, const nni_url *);
 extern int nni_ws_dialer_alloc(nng_stream_dialer **, const nni_url *);
 
+// nni_ws_mask applies (or removes) the 4-byte frame mask to len bytes of
+// payload, starting at the beginning of the payload.
+extern void nni_ws_mask(uint8_t *, size_t, const uint8_t *);
+
 #endif // NNG_SUPPLEMENTAL_WEBSOCKET_WEBSOCKET_H
@@ -14,6 +14,9 @@
 
 #include <nuts.h>
 
+#include "core/nng_impl.h"
+#include "supplemental/websocket/websocket.h"
+
 void
 test_websocket_wildcard(void)
 {
@@ -511,10 +514,136 @@ test_websocket_fragmentation(void)
 	nng_stream_listener_free(l);
 }
 
+void
+test_websocket_mask(void)
+{
+	uint8_t  mask[4] = { 0x12, 0x9a, 0xc3, 0x7f };
+	uint8_t *buf;
+	uint8_t *ref;
+	size_t   size = 1 << 20;
+	nng_time start;
+	nng_time end;
+	int      n = 200;
+
+	NUTS_TRUE((buf = nng_alloc(size + 8)) != NULL);
+	NUTS_TRUE((ref = nng_alloc(size + 8)) != NULL);
+
+	// Every alignment and every tail, against a plain byte loop.
+	for (size_t off = 0; off < 8; off++) {
+		for (size_t len = 0; len < 200; len++) {
+			for (size_t i = 0; i < len; i++) {
+				ref[i] = buf[off + i] = (uint8_t) (i * 7 + off);
+			}
+			nni_ws_mask(buf + off, len, mask);
+			for (size_t i = 0; i < len; i++) {
+				ref[i] ^= mask[i % 4];
+			}
+			if (memcmp(buf + off, ref, len) != 0) {
+				NUTS_TRUE(memcmp(buf + off, ref, len) == 0);
+				NUTS_MSG("offset %d length %d", (int) off,
+				    (int) len);
+			}
+		}
+	}
+
+	memset(buf, 0, size);
+	start = nng_clock();
+	for (int i = 0; i < n; i++) {
+		nni_ws_mask(buf + 1, size, mask);
+	}
+	end = nng_clock();
+	// An even number of passes leaves the buffer as it was.
+	for (size_t i = 0; i < size; i++) {
+		if (buf[i + 1] != 0) {
+			NUTS_TRUE(buf[i + 1] == 0);
+			break;
+		}
+	}
+	printf("mask: %.0f MB/s\n",
+	    n * 1000.0 / (end > start ? end - start : 1));
+
+	nng_free(buf, size + 8);
+	nng_free(ref, size + 8);
+}
+
+typedef struct bench_state {
+	nng_socket s;
+	int        count;
+	size_t     size;
+	int        err;
+} bench_state;
+
+static void
+bench_send(void *arg)
+{
+	bench_state *b = arg;
+	nng_msg     *m;
+
+	for (int i = 0; (i < b->count) && (b->err == 0); i++) {
+		if ((b->err = nng_msg_alloc(&m, b->size)) != 0) {
+			break;
+		}
+		memset(nng_msg_body(m), i, b->size);
+		if ((b->err = nng_sendmsg(b->s, m, 0)) != 0) {
+			nng_msg_free(m);
+		}
+	}
+}
+
+void
+test_websocket_msg_throughput(void)
+{
+	nng_socket  s1;
+	nng_socket  s2;
+	nng_thread *thr;
+	nng_msg    *m;
+	const char *addr;
+	bench_state b;
+	nng_time    start;
+	nng_time    end;
+
+	b.count = 500;
+	b.size  = 65536;
+	b.err   = 0;
+
+	NUTS_ADDR(addr, "ws");
+	NUTS_OPEN(s1);
+	NUTS_OPEN(s2);
+	NUTS_PASS(nng_socket_set_ms(s1, NNG_OPT_RECVTIMEO, 5000));
+	NUTS_PASS(nng_socket_set_ms(s2, NNG_OPT_SENDTIMEO, 5000));
+	NUTS_PASS(nng_listen(s1, addr, NULL, 0));
+	NUTS_PASS(nng_dial(s2, addr, NULL, 0));
+	b.s = s2;
+
+	start = nng_clock();
+	NUTS_PASS(nng_thread_create(&thr, bench_send, &b));
+	for (int i = 0; i < b.count; i++) {
+		uint8_t *body;
+		NUTS_PASS(nng_recvmsg(s1, &m, 0));
+		NUTS_TRUE(nng_msg_len(m) == b.size);
+		body = nng_msg_body(m);
+		NUTS_TRUE(body[0] == (uint8_t) i);
+		NUTS_TRUE(body[b.size - 1] == (uint8_t) i);
+		nng_msg_free(m);
+	}
+	end = nng_clock();
+	nng_thread_destroy(thr);
+	NUTS_PASS(b.err);
+
+	printf("%d x %d byte messages: %.0f MB/s\n", b.count, (int) b.size,
+	    (b.count * (double) b.size) / 1048576.0 * 1000.0 /
+	        (end > start ? end - start : 1));
+
+	NUTS_CLOSE(s1);
+	NUTS_CLOSE(s2);
+}
+
 NUTS_TESTS = {
 	{ "websocket stream wildcard", test_websocket_wildcard },
 	{ "websocket conn properties", test_websocket_conn_props },
 	{ "websocket fragmentation", test_websocket_fragmentation },
 	{ "websocket text mode", test_websocket_text_mode },
+	{ "websocket mask", test_websocket_mask },
+	{ "websocket message throughput", test_websocket_msg_throughput },
 	{ NULL, NULL },
 };
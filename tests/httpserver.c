@@ -996,6 +996,244 @@ TestMain("HTTP Server", {
 		});
 	});
 
+	Convey("File streaming works", {
+		char          urlstr[32];
+		char          fullurl[256];
+		nng_url *     url;
+		nng_url *     curl;
+		nng_http_req *req;
+		nng_http_res *res;
+		char *        tmpdir;
+		char *        big;
+		char *        small;
+		char *        bigdoc;
+		size_t        bigsz = 300 * 1024 + 17;
+		void *        data;
+		size_t        size;
+		const char *  ptr;
+		char          etag[64];
+
+		So((bigdoc = nng_alloc(bigsz)) != NULL);
+		for (size_t i = 0; i < bigsz; i++) {
+			bigdoc[i] = (char) ('a' + ((i * 7) % 26));
+		}
+		trantest_next_address(urlstr, "http://127.0.0.1:");
+		So(nng_url_parse(&url, urlstr) == 0);
+		So(nng_http_server_hold(&s, url) == 0);
+		So((tmpdir = nni_plat_temp_dir()) != NULL);
+		So((big = nni_file_join(tmpdir, "httpbig.bin")) != NULL);
+		So((small = nni_file_join(tmpdir, "httpsmall.txt")) != NULL);
+		So(nni_file_put(big, bigdoc, bigsz) == 0);
+		So(nni_file_put(small, doc2, strlen(doc2)) == 0);
+		snprintf(fullurl, sizeof(fullurl), "%s/big", urlstr);
+		So(nng_url_parse(&curl, fullurl) == 0);
+		So(nng_http_req_alloc(&req, curl) == 0);
+		So(nng_http_res_alloc(&res) == 0);
+
+		Reset({
+			nng_http_req_free(req);
+			nng_http_res_free(res);
+			nng_url_free(curl);
+			nng_http_server_release(s);
+			nni_file_delete(big);
+			nni_file_delete(small);
+			free(big);
+			free(small);
+			free(tmpdir);
+			nng_free(bigdoc, bigsz);
+			nng_url_free(url);
+		});
+
+		So(nng_http_handler_alloc_file(&h, "/big", big) == 0);
+		So(nng_http_server_add_handler(s, h) == 0);
+		So(nng_http_handler_alloc_file(&h, "/small", small) == 0);
+		So(nng_http_handler_set_file_cache(h, 4096) == 0);
+		So(nng_http_server_add_handler(s, h) == 0);
+		So(nng_http_server_start(s) == 0);
+
+		Convey("Large file is streamed whole", {
+			So(httpdo(curl, req, res, &data, &size) == 0);
+			So(nng_http_res_get_status(res) == NNG_HTTP_STATUS_OK);
+			So(size == bigsz);
+			So(memcmp(data, bigdoc, size) == 0);
+			ptr = nng_http_res_get_header(res, "Accept-Ranges");
+			So(ptr != NULL);
+			So(strcmp(ptr, "bytes") == 0);
+			nng_free(data, size);
+		});
+
+		Convey("Range requests work", {
+			So(nng_http_req_set_header(
+			       req, "Range", "bytes=70000-269999") == 0);
+			So(httpdo(curl, req, res, &data, &size) == 0);
+			So(nng_http_res_get_status(res) ==
+			    NNG_HTTP_STATUS_PARTIAL_CONTENT);
+			So(size == 200000);
+			So(memcmp(data, bigdoc + 70000, size) == 0);
+			ptr = nng_http_res_get_header(res, "Content-Range");
+			So(ptr != NULL);
+			So(strcmp(ptr, "bytes 70000-269999/307217") == 0);
+			nng_free(data, size);
+		});
+
+		Convey("Suffix ranges work", {
+			So(nng_http_req_set_header(req, "Range", "bytes=-10") ==
+			    0);
+			So(httpdo(curl, req, res, &data, &size) == 0);
+			So(nng_http_res_get_status(res) ==
+			    NNG_HTTP_STATUS_PARTIAL_CONTENT);
+			So(size == 10);
+			So(memcmp(data, bigdoc + bigsz - 10, size) == 0);
+			nng_free(data, size);
+		});
+
+		Convey("Unsatisfiable range gives 416", {
+			So(nng_http_req_set_header(
+			       req, "Range", "bytes=400000-") == 0);
+			So(httpdo(curl, req, res, &data, &size) == 0);
+			So(nng_http_res_get_status(res) ==
+			    NNG_HTTP_STATUS_RANGE_NOT_SATISFIABLE);
+			ptr = nng_http_res_get_header(res, "Content-Range");
+			So(ptr != NULL);
+			So(strcmp(ptr, "bytes */307217") == 0);
+			nng_free(data, size);
+		});
+
+		Convey("Matching ETag gives 304", {
+			So(httpdo(curl, req, res, &data, &size) == 0);
+			nng_free(data, size);
+			ptr = nng_http_res_get_header(res, "ETag");
+			So(ptr != NULL);
+			snprintf(etag, sizeof(etag), "%s", ptr);
+			nng_http_req_free(req);
+			nng_http_res_reset(res);
+			So(nng_http_req_alloc(&req, curl) == 0);
+			So(nng_http_req_set_header(
+			       req, "If-None-Match", etag) == 0);
+			So(httpdo(curl, req, res, &data, &size) == 0);
+			So(nng_http_res_get_status(res) ==
+			    NNG_HTTP_STATUS_NOT_MODIFIED);
+			So(size == 0);
+			So(nng_http_res_get_header(res, "Content-Length") ==
+			    NULL);
+		});
+
+		Convey("Cached file is refreshed when changed", {
+			uint16_t stat;
+			char *   ctype;
+
+			snprintf(fullurl, sizeof(fullurl), "%s/small", urlstr);
+			for (int i = 0; i < 2; i++) {
+				So(httpget(fullurl, &data, &size, &stat,
+				       &ctype) == 0);
+				So(stat == NNG_HTTP_STATUS_OK);
+				So(size == strlen(doc2));
+				So(memcmp(data, doc2, size) == 0);
+				nng_strfree(ctype);
+				nng_free(data, size);
+			}
+			So(nni_file_put(small, doc1, strlen(doc1)) == 0);
+			So(httpget(fullurl, &data, &size, &stat, &ctype) == 0);
+			So(stat == NNG_HTTP_STATUS_OK);
+			So(size == strlen(doc1));
+			So(memcmp(data, doc1, size) == 0);
+			nng_strfree(ctype);
+			nng_free(data, size);
+		});
+	});
+
+	Convey("Dispatch across many routes", {
+		char             urlstr[32];
+		char             path[64];
+		char             body[32];
+		nng_url *        url;
+		nng_http_client *cli;
+		nng_http_conn *  conn;
+		nng_aio *        aio;
+		nng_time         start;
+		nng_time         end;
+		int              nroutes = 500;
+		int              nreqs   = 2000;
+
+		trantest_next_address(urlstr, "http://127.0.0.1:");
+		So(nng_url_parse(&url, urlstr) == 0);
+		So(nng_http_server_hold(&s, url) == 0);
+		So(nng_aio_alloc(&aio, NULL, NULL) == 0);
+		So(nng_http_client_alloc(&cli, url) == 0);
+
+		Reset({
+			nng_http_client_free(cli);
+			nng_aio_free(aio);
+			nng_http_server_release(s);
+			nng_url_free(url);
+		});
+
+		for (int i = 0; i < nroutes; i++) {
+			snprintf(path, sizeof(path), "/api/v1/dev%d/status", i);
+			snprintf(body, sizeof(body), "dev%d", i);
+			So(nng_http_handler_alloc_static(&h, path, body,
+			       strlen(body), "text/plain") == 0);
+			So(nng_http_server_add_handler(s, h) == 0);
+		}
+		// A tree handler catches everything else under /api.
+		So(nng_http_handler_alloc_static(
+		       &h, "/api", "api", 3, "text/plain") == 0);
+		So(nng_http_handler_set_tree(h) == 0);
+		So(nng_http_server_add_handler(s, h) == 0);
+		So(nng_http_server_start(s) == 0);
+
+		nng_http_client_connect(cli, aio);
+		nng_aio_wait(aio);
+		So(nng_aio_result(aio) == 0);
+		conn = nng_aio_get_output(aio, 0);
+
+		start = nng_clock();
+		for (int i = 0; i < nreqs; i++) {
+			nng_http_req *req;
+			nng_http_res *res;
+			const char *  want;
+			char          data[32];
+			nng_iov       iov;
+			int           n = (i * 7919) % (nroutes + 1);
+
+			if (n == nroutes) {
+				snprintf(path, sizeof(path),
+				    "/api/v1/dev%d/other", i % nroutes);
+				want = "api";
+			} else {
+				snprintf(path, sizeof(path),
+				    "/api/v1/dev%d/status", n);
+				snprintf(body, sizeof(body), "dev%d", n);
+				want = body;
+			}
+			So(nng_http_req_alloc(&req, url) == 0);
+			So(nng_http_req_set_uri(req, path) == 0);
+			So(nng_http_res_alloc(&res) == 0);
+			nng_http_conn_write_req(conn, req, aio);
+			nng_aio_wait(aio);
+			So(nng_aio_result(aio) == 0);
+			nng_http_conn_read_res(conn, res, aio);
+			nng_aio_wait(aio);
+			So(nng_aio_result(aio) == 0);
+			So(nng_http_res_get_status(res) == NNG_HTTP_STATUS_OK);
+			So(atoi(nng_http_res_get_header(
+			       res, "Content-Length")) == (int) strlen(want));
+			iov.iov_buf = data;
+			iov.iov_len = strlen(want);
+			nng_aio_set_iov(aio, 1, &iov);
+			nng_http_conn_read_all(conn, aio);
+			nng_aio_wait(aio);
+			So(nng_aio_result(aio) == 0);
+			So(memcmp(data, want, strlen(want)) == 0);
+			nng_http_req_free(req);
+			nng_http_res_free(res);
+		}
+		end = nng_clock();
+		printf("%d requests across %d routes: %.0f req/s\n", nreqs,
+		    nroutes, nreqs * 1000.0 / (end > start ? end - start : 1));
+		nng_http_conn_close(conn);
+	});
+
 	Convey("Root tree handler works", {
 		char     urlstr[32];
 		nng_url *url;
@@ -19,6 +19,7 @@
 #include "stubs.h"
 
 static int nclients = 200;
+static int ntimers  = 100000;
 
 static char *addr = "inproc:///atscale";
 nng_socket   rep;
@@ -85,6 +86,50 @@ transact(nng_socket *clients, int num)
 	return (rv);
 }
 
+// timers starts ntimers sleeps at once.  Odd ones are long and get
+// canceled, even ones expire within about a quarter second, so both the
+// expiration and the cancellation paths see the whole population.
+int
+timers(int num)
+{
+	nng_aio **aios;
+	nng_time  start;
+	int       rv = 0;
+	int       i;
+
+	if ((aios = calloc(num, sizeof(nng_aio *))) == NULL) {
+		return (NNG_ENOMEM);
+	}
+	for (i = 0; i < num; i++) {
+		if ((rv = nng_aio_alloc(&aios[i], NULL, NULL)) != 0) {
+			goto out;
+		}
+	}
+	start = nng_clock();
+	for (i = 0; i < num; i++) {
+		nng_sleep_aio((i % 2) ? 60000 : 50 + (i % 200), aios[i]);
+	}
+	for (i = 1; i < num; i += 2) {
+		nng_aio_cancel(aios[i]);
+	}
+	for (i = 0; i < num; i++) {
+		nng_aio_wait(aios[i]);
+		if (nng_aio_result(aios[i]) != ((i % 2) ? NNG_ECANCELED : 0)) {
+			rv = NNG_EINTERNAL;
+		}
+	}
+	printf("%d timers in %d ms\n", num, (int) (nng_clock() - start));
+
+out:
+	for (i = 0; i < num; i++) {
+		if (aios[i] != NULL) {
+			nng_aio_free(aios[i]);
+		}
+	}
+	free(aios);
+	return (rv);
+}
+
 Main({
 	nng_socket *clients;
 	int *       results;
@@ -110,6 +155,9 @@ Main({
 				So(nng_close(clients[i]) == 0);
 			}
 		});
+
+		Convey("We can handle many many timers",
+		    { So(timers(ntimers) == 0); });
 	});
 
 	nng_close(rep);
@@ -1110,6 +1110,25 @@ encode_unsuback_msg(nng_msg *msg, nano_work *work)
 	return 0;
 }
 
+// Value of a socket statistic, or 0 if it is not there.
+static uint64_t
+trantest_sock_stat(nng_socket s, const char *name)
+{
+	nng_stat *stats;
+	nng_stat *st;
+	uint64_t  val = 0;
+
+	if (nng_stats_get(&stats) != 0) {
+		return (0);
+	}
+	if (((st = nng_stat_find_socket(stats, s)) != NULL) &&
+	    ((st = nng_stat_find(st, name)) != NULL)) {
+		val = nng_stat_value(st);
+	}
+	nng_stats_free(stats);
+	return (val);
+}
+
 void
 trantest_mqtt_broker_send_recv(trantest *tt)
 {
@@ -1194,6 +1213,29 @@ trantest_mqtt_broker_send_recv(trantest *tt)
 		//client recv pub msg.
 		trantest_mqtt_sub_recv(tt->reqsock);
 
+		// every publish is counted once each way.
+		for (int i = 0; i < 10; i++) {
+			trantest_mqtt_pub(tt->reqsock, false);
+			nng_msleep(20);
+			nng_ctx_recv(work->ctx, work->aio);
+			So((rmsg = nng_aio_get_msg(work->aio)) != NULL);
+			So(nng_msg_get_type(rmsg) == CMD_PUBLISH);
+			nng_aio_set_msg(work->aio, rmsg);
+			nng_aio_set_prov_data(work->aio, &pipe.id);
+			nng_ctx_send(work->ctx, work->aio);
+			trantest_mqtt_sub_recv(tt->reqsock);
+		}
+		nng_stat *stats;
+		if (nng_stats_get(&stats) == 0) {
+			nng_stats_free(stats);
+			So(trantest_sock_stat(tt->repsock, "mqtt_publish_in") ==
+			    11);
+			So(trantest_sock_stat(tt->repsock,
+			       "mqtt_publish_out") == 11);
+			So(trantest_sock_stat(tt->repsock, "mqtt_msg_drop") ==
+			    0);
+		}
+
 		// client send unsub msg and server recv unsub msg.
 		trantest_mqtt_unsub_send(tt->reqsock, client, true);
 		nng_msleep(20);